@@ -0,0 +1,105 @@
+/*
+ * BinarySerializerTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <sstream>
+
+#include <core/BinarySerializer.hpp>
+
+namespace rstudio {
+namespace core {
+namespace binary {
+
+context("Binary Serializer")
+{
+   test_that("Written values are read back")
+   {
+      std::ostringstream ostr;
+      writeValue(ostr, static_cast<boost::int32_t>(-7));
+      writeString(ostr, "hello");
+      std::vector<std::string> strings;
+      strings.push_back("a");
+      strings.push_back("");
+      writeStrings(ostr, strings);
+      writeVarint(ostr, 300);
+      writeValue(ostr, static_cast<boost::uint64_t>(1) << 40);
+
+      std::string data = ostr.str();
+      Reader reader(data.data(), data.data() + data.size());
+
+      boost::int32_t value;
+      std::string string;
+      std::vector<std::string> readStrings;
+      boost::uint32_t varint;
+      boost::uint64_t large;
+      expect_true(reader.read(&value));
+      expect_true(reader.read(&string));
+      expect_true(reader.read(&readStrings));
+      expect_true(reader.readVarint(&varint));
+      expect_true(reader.read(&large));
+
+      expect_true(value == -7);
+      expect_true(string == "hello");
+      expect_true(readStrings == strings);
+      expect_true(varint == 300);
+      expect_true(large == (static_cast<boost::uint64_t>(1) << 40));
+      expect_true(reader.atEnd());
+   }
+
+   test_that("Reads past the end fail and leave the reader failed")
+   {
+      std::ostringstream ostr;
+      writeString(ostr, "truncated");
+      std::string data = ostr.str();
+      data.resize(data.size() - 1);
+
+      Reader reader(data.data(), data.data() + data.size());
+      std::string string;
+      expect_false(reader.read(&string));
+      expect_true(reader.failed());
+
+      boost::uint8_t byte;
+      expect_false(reader.read(&byte));
+      expect_false(reader.atEnd());
+   }
+
+   test_that("Counts larger than the remaining data are rejected")
+   {
+      std::ostringstream ostr;
+      writeValue(ostr, static_cast<boost::uint32_t>(1000000));
+      writeString(ostr, "a");
+      std::string data = ostr.str();
+
+      Reader reader(data.data(), data.data() + data.size());
+      std::vector<std::string> strings;
+      expect_false(reader.read(&strings));
+      expect_true(strings.empty());
+   }
+
+   test_that("Values are read at known positions")
+   {
+      std::ostringstream ostr;
+      writeValue(ostr, static_cast<boost::uint32_t>(1));
+      writeValue(ostr, static_cast<boost::uint32_t>(2));
+      std::string data = ostr.str();
+
+      expect_true(valueAt<boost::uint32_t>(data.data() + 4) == 2);
+   }
+}
+
+} // namespace binary
+} // namespace core
+} // namespace rstudio
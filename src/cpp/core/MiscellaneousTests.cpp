@@ -249,6 +249,31 @@ context("LruCache")
 
       expect_true(cache.size() == 0);
    }
+
+   test_that("The least recently used entry can be removed")
+   {
+      LruCache<int, int> cache(100);
+      for (int i = 0; i < 10; ++i)
+      {
+         cache.insert(i, i);
+      }
+
+      int val;
+      expect_true(cache.get(0, &val));
+
+      int key;
+      expect_true(cache.removeOldest(&key));
+      expect_true(key == 1);
+      expect_false(cache.get(1, &val));
+      expect_true(cache.size() == 9);
+
+      for (int i = 0; i < 9; ++i)
+      {
+         expect_true(cache.removeOldest(&key));
+      }
+      expect_true(key == 0);
+      expect_false(cache.removeOldest(&key));
+   }
 }
 
 } // namespace unit_tests
@@ -14,6 +14,12 @@
  */
 
 #include <core/Thread.hpp>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <core/Macros.hpp>
 
 #include <core/system/System.hpp>
@@ -46,6 +52,103 @@ void safeLaunchThread(boost::function<void()> threadMain,
    }
 }
 
+ThreadPool::ThreadPool(std::size_t threadCount)
+   : stopped_(false)
+{
+   if (threadCount == 0)
+      threadCount = std::max(1u, boost::thread::hardware_concurrency());
+
+   for (std::size_t i = 0; i < threadCount; i++)
+   {
+      boost::shared_ptr<boost::thread> pThread(new boost::thread());
+      safeLaunchThread(boost::bind(&ThreadPool::run, this), pThread.get());
+      if (pThread->joinable())
+         threads_.push_back(pThread);
+   }
+}
+
+ThreadPool::~ThreadPool()
+{
+   try
+   {
+      stop();
+   }
+   catch(...)
+   {
+   }
+}
+
+void ThreadPool::enque(const boost::function<void()>& task)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopped_)
+         return;
+
+      tasks_.push_back(task);
+   }
+   END_LOCK_MUTEX
+
+   taskAvailable_.notify_one();
+}
+
+void ThreadPool::stop()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopped_)
+         return;
+
+      stopped_ = true;
+      tasks_.clear();
+   }
+   END_LOCK_MUTEX
+
+   taskAvailable_.notify_all();
+
+   BOOST_FOREACH(boost::shared_ptr<boost::thread> pThread, threads_)
+   {
+      try
+      {
+         pThread->join();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+void ThreadPool::run()
+{
+   while (true)
+   {
+      boost::function<void()> task;
+
+      try
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (!stopped_ && tasks_.empty())
+            taskAvailable_.wait(lock);
+
+         if (stopped_)
+            return;
+
+         task = tasks_.front();
+         tasks_.pop_front();
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                         ERROR_LOCATION));
+         return;
+      }
+
+      try
+      {
+         task();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
 } // namespace core
 } // namespace thread
 } // namespace rstudio
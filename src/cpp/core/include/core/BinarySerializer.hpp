@@ -0,0 +1,188 @@
+/*
+ * BinarySerializer.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_BINARY_SERIALIZER_HPP
+#define CORE_BINARY_SERIALIZER_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+
+// helpers for the binary formats of on disk caches. values are written in
+// native byte order (caches aren't shared between machines), strings as
+// their size (uint32) followed by their bytes
+
+namespace rstudio {
+namespace core {
+namespace binary {
+
+template <typename T>
+void writeValue(std::ostream& ostr, T value)
+{
+   ostr.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void writeString(std::ostream& ostr, const std::string& value)
+{
+   writeValue(ostr, static_cast<boost::uint32_t>(value.size()));
+   ostr.write(value.data(), value.size());
+}
+
+inline void writeStrings(std::ostream& ostr,
+                         const std::vector<std::string>& values)
+{
+   writeValue(ostr, static_cast<boost::uint32_t>(values.size()));
+   BOOST_FOREACH(const std::string& value, values)
+   {
+      writeString(ostr, value);
+   }
+}
+
+// variable length encoding of small values (7 bits per byte)
+inline void writeVarint(std::ostream& ostr, boost::uint32_t value)
+{
+   while (value >= 0x80)
+   {
+      ostr.put(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+   }
+   ostr.put(static_cast<char>(value));
+}
+
+// read a value at a known position in a buffer
+template <typename T>
+T valueAt(const char* pData)
+{
+   T value;
+   std::memcpy(&value, pData, sizeof(T));
+   return value;
+}
+
+// reads values from a (typically memory mapped) buffer. reads past the end
+// of the buffer fail, and leave the reader failed
+class Reader
+{
+public:
+   Reader(const char* begin, const char* end)
+      : pos_(begin), end_(end), failed_(false)
+   {
+   }
+
+   template <typename T>
+   bool read(T* pValue)
+   {
+      if (failed_ || end_ - pos_ < static_cast<std::ptrdiff_t>(sizeof(T)))
+         return fail();
+
+      std::memcpy(pValue, pos_, sizeof(T));
+      pos_ += sizeof(T);
+      return true;
+   }
+
+   bool read(std::string* pValue)
+   {
+      boost::uint32_t size;
+      if (!read(&size) || remaining() < size)
+         return fail();
+
+      pValue->assign(pos_, size);
+      pos_ += size;
+      return true;
+   }
+
+   bool read(std::vector<std::string>* pValues)
+   {
+      boost::uint32_t count;
+      if (!readCount(&count))
+         return false;
+
+      pValues->resize(count);
+      for (boost::uint32_t i = 0; i < count; i++)
+      {
+         if (!read(&(*pValues)[i]))
+            return false;
+      }
+      return true;
+   }
+
+   // read a count of elements which follow (guards against allocating for
+   // a corrupt count; every element takes at least four bytes)
+   bool readCount(boost::uint32_t* pCount)
+   {
+      if (!read(pCount) || remaining() / 4 < *pCount)
+         return fail();
+      return true;
+   }
+
+   bool readVarint(boost::uint32_t* pValue)
+   {
+      boost::uint32_t value = 0;
+      for (int shift = 0; shift < 35; shift += 7)
+      {
+         boost::uint8_t byte;
+         if (!read(&byte))
+            return false;
+
+         value |= static_cast<boost::uint32_t>(byte & 0x7F) << shift;
+         if ((byte & 0x80) == 0)
+         {
+            *pValue = value;
+            return true;
+         }
+      }
+      return fail();
+   }
+
+   bool skip(std::size_t size)
+   {
+      if (failed_ || remaining() < size)
+         return fail();
+
+      pos_ += size;
+      return true;
+   }
+
+   // mark the reader failed (e.g. on reading an invalid value)
+   bool fail()
+   {
+      failed_ = true;
+      return false;
+   }
+
+   const char* position() const { return pos_; }
+   bool failed() const { return failed_; }
+   bool atEnd() const { return !failed_ && pos_ == end_; }
+
+private:
+   std::size_t remaining() const
+   {
+      return static_cast<std::size_t>(end_ - pos_);
+   }
+
+   const char* pos_;
+   const char* end_;
+   bool failed_;
+};
+
+} // namespace binary
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_BINARY_SERIALIZER_HPP
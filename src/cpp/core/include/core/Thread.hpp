@@ -16,7 +16,9 @@
 #ifndef CORE_THREAD_HPP
 #define CORE_THREAD_HPP
 
+#include <deque>
 #include <queue>
+#include <vector>
 
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
@@ -301,6 +303,37 @@ private:
 
 void safeLaunchThread(boost::function<void()> threadMain,
                       boost::thread* pThread = NULL);
+
+// fixed-size pool of worker threads which execute queued tasks in the
+// order they were enqueued. tasks run off the main thread so they must
+// not call into R or touch any other main-thread-only state. passing 0
+// as the thread count sizes the pool to the available hardware threads
+class ThreadPool : boost::noncopyable
+{
+public:
+   explicit ThreadPool(std::size_t threadCount = 0);
+   virtual ~ThreadPool();
+
+   // COPYING: boost::noncopyable
+
+public:
+   void enque(const boost::function<void()>& task);
+
+   // stop accepting new work, discard pending tasks and wait for the
+   // tasks currently executing to complete
+   void stop();
+
+   std::size_t threadCount() const { return threads_.size(); }
+
+private:
+   void run();
+
+   boost::mutex mutex_;
+   boost::condition_variable taskAvailable_;
+   std::deque<boost::function<void()> > tasks_;
+   bool stopped_;
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+};
       
 } // namespace thread
 } // namespace core
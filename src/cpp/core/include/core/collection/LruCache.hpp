@@ -110,6 +110,46 @@ public:
       END_LOCK_MUTEX
    }
 
+   // remove the least recently used entry, returning its key (returns false
+   // if the cache is empty)
+   bool removeOldest(KeyType* pKey)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (!backNode_)
+            return false;
+
+         auto pNode = backNode_;
+         removeNode(pNode);
+         *pKey = pNode->key;
+         map_.erase(pNode->key);
+         return true;
+      }
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+   void clear()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         // break the links between nodes so that they are freed
+         for (typename CollectionType::iterator iter = map_.begin();
+              iter != map_.end();
+              ++iter)
+         {
+            iter->second->pLeft.reset();
+            iter->second->pRight.reset();
+         }
+
+         map_.clear();
+         frontNode_.reset();
+         backNode_.reset();
+      }
+      END_LOCK_MUTEX
+   }
+
    size_t size()
    {
       LOCK_MUTEX(mutex_)
@@ -0,0 +1,116 @@
+/*
+ * RPackageSymbolCache.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_PACKAGE_SYMBOL_CACHE_HPP
+#define CORE_R_UTIL_R_PACKAGE_SYMBOL_CACHE_HPP
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/r_util/RFunctionInformation.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+
+namespace r_util {
+
+// a package as installed in a particular library. the install time (that
+// of its DESCRIPTION) distinguishes re-installs of the same version
+struct InstalledPackage
+{
+   InstalledPackage() : installTime(0) {}
+
+   bool empty() const { return name.empty(); }
+
+   std::string name;
+   std::string version;
+   std::string libraryPath;
+   std::time_t installTime;
+};
+
+// find the first of the library paths in which a package is installed.
+// returns an empty package if it isn't installed in any of them
+Error findInstalledPackage(const std::string& name,
+                           const std::vector<FilePath>& libPaths,
+                           InstalledPackage* pPackage);
+
+enum PackageSymbolKind
+{
+   PackageSymbolsAttached  = 0,   // objects in the attached package
+   PackageSymbolsExports   = 1,   // objects exported by the namespace
+   PackageSymbolsNamespace = 2    // all objects in the namespace
+};
+
+// persistent cache of the symbols (and function information) published by
+// installed packages, for sharing between sessions. there is one file per
+// package, version and library; files are memory mapped (and the sections
+// within them decoded) only when a package is first looked up. entries are
+// replaced atomically, so several sessions can safely share a cache
+// directory. this class is not synchronized
+class PackageSymbolCache : boost::noncopyable
+{
+public:
+   explicit PackageSymbolCache(const FilePath& cacheDir);
+   ~PackageSymbolCache();
+
+   bool getSymbols(const InstalledPackage& package,
+                   PackageSymbolKind kind,
+                   std::vector<std::string>* pSymbols);
+
+   Error putSymbols(const InstalledPackage& package,
+                    PackageSymbolKind kind,
+                    const std::vector<std::string>& symbols);
+
+   bool getPackageInformation(const InstalledPackage& package,
+                              PackageInformation* pInfo);
+
+   Error putPackageInformation(const InstalledPackage& package,
+                               const PackageInformation& info);
+
+   // the file holding a package's entry
+   FilePath entryPath(const InstalledPackage& package) const;
+
+private:
+   class Entry;
+
+   boost::shared_ptr<Entry> entry(const InstalledPackage& package);
+
+   bool getSection(const InstalledPackage& package,
+                   boost::uint32_t section,
+                   const char** pBegin,
+                   const char** pEnd);
+
+   Error putSection(const InstalledPackage& package,
+                    boost::uint32_t section,
+                    const std::string& contents);
+
+   FilePath cacheDir_;
+   std::map<std::string, boost::shared_ptr<Entry> > entries_;
+};
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_R_UTIL_R_PACKAGE_SYMBOL_CACHE_HPP
@@ -193,8 +193,19 @@ public:
    //   - Must be UTF-8 encoded
    //   - Must use \n only for linebreaks
    //
+   // Indexes built off the main thread should pass false for
+   // shareInferredPackages, and call shareInferredPackages() once they
+   // have been handed back to it
    RSourceIndex(const std::string& context,
-                const std::string& code);
+                const std::string& code,
+                bool shareInferredPackages = true);
+
+   // Recreate an index from the items (and inferred packages) found by
+   // indexing unchanged code previously
+   RSourceIndex(const std::string& context,
+                const std::vector<RSourceItem>& items,
+                const std::vector<std::string>& inferredPackages,
+                bool shareInferredPackages = true);
 
    const std::string& context() const { return context_; }
 
@@ -291,7 +302,7 @@ public:
       return s_allInferredPkgNames_;
    }
 
-   const std::vector<std::string>& getInferredPackages()
+   const std::vector<std::string>& getInferredPackages() const
    {
       return inferredPkgNames_;
    }
@@ -313,22 +324,32 @@ public:
       return s_packageInformation_;
    }
    
+   // NOTE: lookups don't add entries for packages (or functions) without
+   // information, so they're safe to make from multiple (linting) threads
+   // while the database isn't being modified
    static const PackageInformation& getPackageInformation(const std::string& package)
    {
-      return s_packageInformation_[package];
+      PackageInformationDatabase::const_iterator it =
+            s_packageInformation_.find(package);
+      
+      return it != s_packageInformation_.end() ? it->second : s_noSuchPackage_;
    }
    
    static bool hasFunctionInformation(const std::string& func,
                                       const std::string& pkg)
    {
-      return s_packageInformation_[pkg].functionInfo.count(func);
+      return getPackageInformation(pkg).functionInfo.count(func);
    }
    
    static const FunctionInformation& getFunctionInformation(
          const std::string& func,
          const std::string& pkg)
    {
-      return s_packageInformation_[pkg].functionInfo[func];
+      const FunctionInformationMap& functionInfo =
+            getPackageInformation(pkg).functionInfo;
+      
+      FunctionInformationMap::const_iterator it = functionInfo.find(func);
+      return it != functionInfo.end() ? it->second : s_noSuchFunction_;
    }
    
    static const FunctionInformation& getFunctionInformationAnywhere(
@@ -341,12 +362,12 @@ public:
            ++it)
       {
          const std::string& pkg = *it;
-         if (s_packageInformation_.count(pkg))
-         {
-            const PackageInformation& pkgInfo = s_packageInformation_[pkg];
-            if (pkgInfo.functionInfo.count(func))
-               return const_cast<FunctionInformationMap&>(pkgInfo.functionInfo)[func];
-         }
+         const FunctionInformationMap& functionInfo =
+               getPackageInformation(pkg).functionInfo;
+         
+         FunctionInformationMap::const_iterator entry = functionInfo.find(func);
+         if (entry != functionInfo.end())
+            return entry->second;
       }
       
       *pLookupFailed = true;
@@ -370,7 +391,15 @@ public:
    void addInferredPackage(const std::string& packageName)
    {
       inferredPkgNames_.push_back(packageName);
-      s_allInferredPkgNames_.insert(packageName);
+      if (shareInferredPackages_)
+         s_allInferredPkgNames_.insert(packageName);
+   }
+   
+   void shareInferredPackages()
+   {
+      shareInferredPackages_ = true;
+      s_allInferredPkgNames_.insert(inferredPkgNames_.begin(),
+                                    inferredPkgNames_.end());
    }
    
    static void addGloballyInferredPackage(const std::string& pkgName)
@@ -425,6 +454,7 @@ private:
    // but we share that state in a static variable (so that we can
    // cache and share across all indexes)
    std::vector<std::string> inferredPkgNames_;
+   bool shareInferredPackages_;
    static std::set<std::string> s_importedPackages_;
    static ImportFromMap s_importFromDirectives_;
    static std::set<std::string> s_allInferredPkgNames_;
@@ -432,6 +462,7 @@ private:
    // NOTE: All source indexes share a set of completions
    static std::map<std::string, PackageInformation> s_packageInformation_;
    static FunctionInformation s_noSuchFunction_;
+   static PackageInformation s_noSuchPackage_;
    
 };
 
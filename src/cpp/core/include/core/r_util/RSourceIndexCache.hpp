@@ -0,0 +1,90 @@
+/*
+ * RSourceIndexCache.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+#define CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+
+#include <ctime>
+#include <map>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FileInfo.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace r_util {
+
+class RSourceIndex;
+
+// persistent cache of the items (and inferred packages) found by indexing
+// R source files, so that unchanged files needn't be tokenized again when a
+// project is re-opened. an entry is valid while its file's size and
+// modification time are unchanged or, failing that, while its contents
+// still hash the same (e.g. after a checkout which touched the file).
+// lookups are safe from multiple threads; updates are not
+class RSourceIndexCache
+{
+public:
+   struct Entry
+   {
+      Entry() : size(0), lastWriteTime(0), contentHash(0) {}
+
+      uintmax_t size;
+      std::time_t lastWriteTime;
+      boost::uint32_t contentHash;
+      boost::shared_ptr<RSourceIndex> pIndex;
+   };
+
+   // the hash of the (decoded) code of a source file
+   static boost::uint32_t contentHash(const std::string& code);
+
+   // read a cache file. a missing, corrupt or out of date file reads as an
+   // empty cache
+   Error read(const FilePath& cacheFile);
+
+   Error write(const FilePath& cacheFile) const;
+
+   // the entry for a file, if it is unchanged since it was cached
+   const Entry* find(const FileInfo& fileInfo) const;
+
+   // the entry for a file, if its code hashes the same as when it was cached
+   const Entry* find(const FileInfo& fileInfo, boost::uint32_t contentHash) const;
+
+   void insert(const FileInfo& fileInfo,
+               boost::uint32_t contentHash,
+               const boost::shared_ptr<RSourceIndex>& pIndex);
+
+   // remove the entry for a file (and, for directories, the files beneath it)
+   void remove(const std::string& path);
+
+   void clear() { entries_.clear(); }
+   std::size_t size() const { return entries_.size(); }
+
+private:
+   std::map<std::string, Entry> entries_;
+};
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
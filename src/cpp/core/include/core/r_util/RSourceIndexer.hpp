@@ -0,0 +1,118 @@
+/*
+ * RSourceIndexer.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_INDEXER_HPP
+#define CORE_R_UTIL_R_SOURCE_INDEXER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileInfo.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace thread {
+class ThreadPool;
+}
+
+namespace r_util {
+
+class RSourceIndex;
+class RSourceIndexCache;
+
+// builds RSourceIndexes on a pool of worker threads. files are enqueued and
+// finished indexes collected on the main thread; a file which is enqueued
+// again (or removed) before its index has been collected has that index
+// discarded, so collected indexes always reflect the latest request
+class RSourceIndexer : boost::noncopyable
+{
+public:
+   // reads the (UTF-8, \n delimited) code to index. called on a worker
+   // thread, so it must not call into R
+   typedef boost::function<Error(std::string*)> CodeReader;
+
+   struct Result
+   {
+      Result() : cached(false), contentHash(0) {}
+
+      std::string path;
+      boost::shared_ptr<RSourceIndex> pIndex;
+      Error error;
+      bool cached;                  // recreated from the cache
+      boost::uint32_t contentHash;  // see RSourceIndexCache::contentHash
+   };
+
+   struct Progress
+   {
+      Progress() : queued(0), indexed(0), cached(0), pending(0) {}
+
+      std::size_t queued;     // files enqueued since indexing last went idle
+      std::size_t indexed;    // of which indexes have been collected
+      std::size_t cached;     // of which were recreated from the cache
+      std::size_t pending;    // not yet collected
+      boost::posix_time::time_duration elapsed;
+   };
+
+   explicit RSourceIndexer(thread::ThreadPool* pPool);
+   ~RSourceIndexer();
+
+   void enque(const std::string& path,
+              const std::string& context,
+              const CodeReader& readCode);
+
+   // files which are unchanged since they were cached are recreated from
+   // the cache rather than tokenized
+   void enque(const FileInfo& fileInfo,
+              const std::string& context,
+              const CodeReader& readCode,
+              const boost::shared_ptr<const RSourceIndexCache>& pCache);
+
+   // discard any pending index for the path (and, for directories, for
+   // the files beneath it)
+   void remove(const std::string& path);
+
+   // collect the indexes finished since the last call. indexes are built
+   // with shareInferredPackages = false; they are shared here
+   void collect(std::vector<Result>* pResults);
+
+   bool pending() const { return !generations_.empty(); }
+
+   const Progress& progress() const { return progress_; }
+
+private:
+   struct Shared;
+
+   thread::ThreadPool* pPool_;
+   boost::shared_ptr<Shared> pShared_;
+   std::map<std::string, boost::uint64_t> generations_;
+   boost::uint64_t nextGeneration_;
+   boost::posix_time::ptime startTime_;
+   Progress progress_;
+};
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_R_UTIL_R_SOURCE_INDEXER_HPP
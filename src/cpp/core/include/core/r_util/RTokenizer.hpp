@@ -27,9 +27,11 @@
 #include <core/StringUtils.hpp>
 #include <core/collection/Position.hpp>
 
+#include <boost/cstdint.hpp>
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/regex.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <core/Macros.hpp>
 
@@ -45,13 +47,36 @@ class Error;
 
 namespace r_util {
 
+// The source code which a set of tokens refers to. Tokens store offsets
+// into the buffer rather than their own copy of their contents, and the
+// buffer converts token contents to UTF-8 on demand (caching the result).
+// Like the tokens themselves, this class is not synchronized
+class RTokenBuffer : boost::noncopyable
+{
+public:
+   explicit RTokenBuffer(const std::wstring& data)
+      : data_(data)
+   {
+   }
+
+   const std::wstring& data() const { return data_; }
+
+   const std::string& utf8(boost::uint32_t offset, boost::uint32_t length) const;
+
+private:
+   std::wstring data_;
+   mutable boost::unordered_map<boost::uint32_t, std::string> utf8_;
+};
+
 // Make RToken non-subclassable (since it has copy/byval semantics any
 // subclass would be sliced
 //
 // RToken. Note that RToken instances are only valid as long as the class
 // which yielded them (RTokenizer or RTokens) is alive. This is because
-// they contain iterators into the original source data rather than their
-// own copy of their contents.
+// they refer to the buffer holding the original source data rather than
+// having their own copy of their contents. Tokens are kept small (24 bytes)
+// since large scripts produce millions of them; columns beyond kMaxColumn
+// are clamped.
 class RToken final
 {
 public:
@@ -77,27 +102,37 @@ public:
       COMMENT
    };
 
+   static const std::size_t kMaxColumn = 0xFFFFFF;
+
 public:
 
-   RToken() = default;
+   RToken()
+      : pBuffer_(NULL), offset_(0), length_(0), row_(0), column_(0),
+        type_(ERR)
+   {
+   }
 
    RToken(TokenType type,
-          std::wstring::const_iterator begin,
-          std::wstring::const_iterator end,
+          const RTokenBuffer* pBuffer,
           std::size_t offset,
+          std::size_t length,
           std::size_t row,
           std::size_t column)
-      : type_(type), begin_(begin), end_(end),
-        offset_(offset), row_(row), column_(column)
+      : pBuffer_(pBuffer),
+        offset_(static_cast<boost::uint32_t>(offset)),
+        length_(static_cast<boost::uint32_t>(length)),
+        row_(static_cast<boost::uint32_t>(row)),
+        column_(static_cast<boost::uint32_t>(std::min(column, kMaxColumn))),
+        type_(type)
    {
    }
    
    // accessors
-   TokenType type() const { return type_; }
-   std::wstring content() const { return std::wstring(begin_, end_); }
+   TokenType type() const { return static_cast<TokenType>(type_); }
+   std::wstring content() const { return std::wstring(begin(), end()); }
    const std::string& contentAsUtf8() const;
    std::size_t offset() const { return offset_; }
-   std::size_t length() const { return end_ - begin_; }
+   std::size_t length() const { return length_; }
    std::size_t row() const { return row_; }
    std::size_t column() const { return column_; }
    
@@ -109,30 +144,29 @@ public:
    // efficient comparison operations
    bool contentEquals(const std::wstring& text) const
    {
-      std::size_t distance = std::distance(begin_, end_);
-      return distance == text.size() &&
-             std::equal(begin_, end_, text.begin());
+      return length_ == text.size() &&
+             std::equal(begin(), end(), text.begin());
    }
    
    bool contentEquals(wchar_t character) const
    {
-      return std::distance(begin_, end_) == 1 && *begin_ == character;
+      return length_ == 1 && *begin() == character;
    }
    
    bool contentContains(const wchar_t character) const
    {
-      return std::find(begin_, end_, character) != end_;
+      return std::find(begin(), end(), character) != end();
    }
 
    bool contentStartsWith(const std::wstring& text) const
    {
-      return std::search(begin_, end_, text.begin(), text.end()) == begin_;
+      return std::search(begin(), end(), text.begin(), text.end()) == begin();
    }
 
    bool isOperator(const std::wstring& op) const
    {
       return (type_ == RToken::OPER) &&
-              std::equal(begin_, end_, op.begin());
+              std::equal(begin(), end(), op.begin());
    }
 
    bool isType(TokenType type) const
@@ -145,28 +179,26 @@ public:
    static void unspecified_bool_true() {}
    operator unspecified_bool_type() const
    {
-      return offset_ == static_cast<std::size_t>(-1) ?
-                                             0 :
-                                             unspecified_bool_true;
+      return pBuffer_ == NULL ? 0 : unspecified_bool_true;
    }
    bool operator!() const
    {
-      return offset_ == static_cast<std::size_t>(-1);
+      return pBuffer_ == NULL;
    }
    
    std::wstring::const_iterator begin() const
    {
-      return begin_;
+      return data().begin() + offset_;
    }
    
    std::wstring::const_iterator end() const
    {
-      return end_;
+      return data().begin() + offset_ + length_;
    }
    
    std::pair<std::wstring::const_iterator, std::wstring::const_iterator> range() const
    {
-      return std::make_pair(begin_, end_);
+      return std::make_pair(begin(), end());
    }
    
    std::string asString() const;
@@ -177,27 +209,32 @@ public:
    }
 
 private:
-   std::wstring emptyToken_;
-   TokenType type_ = TokenType::ERR;
-   std::wstring::const_iterator begin_ = emptyToken_.cbegin();
-   std::wstring::const_iterator end_ = emptyToken_.cend();
-   std::size_t offset_ = -1;
-   std::size_t row_ = 0;
-   std::size_t column_ = 0;
+   static const std::wstring& emptyData();
+
+   const std::wstring& data() const
+   {
+      return pBuffer_ != NULL ? pBuffer_->data() : emptyData();
+   }
+
+   const RTokenBuffer* pBuffer_;
+   boost::uint32_t offset_;
+   boost::uint32_t length_;
+   boost::uint32_t row_;
+   boost::uint32_t column_ : 24;
+   boost::uint32_t type_ : 8;
 };
 
 // Tokenize R code. Note that the RToken instances which are returned are
 // valid only during the lifetime of the RTokenizer which yielded them
-// (because they store iterators into their content rather than making a copy
-// of the content)
+// (because they refer to its buffer rather than making a copy of the content)
 class RTokenizer : boost::noncopyable
 {
 public:
    explicit RTokenizer(const std::wstring& data)
-      : data_(data),
-        begin_(data_.begin()),
-        end_(data_.end()),
-        pos_(data_.begin()),
+      : buffer_(data),
+        begin_(buffer_.data().begin()),
+        end_(buffer_.data().end()),
+        pos_(buffer_.data().begin()),
         row_(0),
         column_(0)
    {
@@ -209,6 +246,20 @@ public:
 
    RToken nextToken();
 
+   // Resume tokenizing at a token boundary, given the position and the
+   // state of open brackets there (used to re-tokenize just the edited
+   // region of a document).
+   void seek(std::size_t offset,
+             std::size_t row,
+             std::size_t column,
+             const std::vector<char>& braceStack);
+
+   const RTokenBuffer& buffer() const { return buffer_; }
+   std::size_t offset() const { return pos_ - begin_; }
+   std::size_t row() const { return row_; }
+   std::size_t column() const { return column_; }
+   const std::vector<char>& braceStack() const { return braceStack_; }
+
 private:
    RToken matchWhitespace();
    RToken matchStringLiteral();
@@ -222,12 +273,10 @@ private:
    wchar_t peek();
    wchar_t peek(std::size_t lookahead);
    wchar_t eat();
-   std::size_t tokenLength(const boost::wregex& regex);
-   void eatUntil(const boost::wregex& regex);
    RToken consumeToken(RToken::TokenType tokenType, std::size_t length);
    
 private:
-   std::wstring data_;
+   RTokenBuffer buffer_;
    std::wstring::const_iterator begin_;
    std::wstring::const_iterator end_;
    std::wstring::const_iterator pos_;
@@ -281,20 +330,37 @@ public:
    const_iterator end() const { return tokens_.end(); }
    
    explicit RTokens(const std::wstring& code, int flags = None)
-      : tokenizer_(code)
+      : tokenizer_(code),
+        flags_(flags),
+        damageBegin_(0),
+        damageEnd_(0),
+        previousDamageEnd_(0)
    {
       while (RToken token = tokenizer_.nextToken())
       {
-         if ((flags & StripWhitespace) && token.type() == RToken::WHITESPACE)
-            continue;
-
-         if ((flags & StripComments) && token.type() == RToken::COMMENT)
-            continue;
-
-         push_back(token);
+         if (accept(token))
+            push_back(token);
       }
+      
+      damageEnd_ = size();
    }
    
+   // Tokenize 'code', an edited version of the code tokenized by 'previous'.
+   // Only the region of the code around the edit is re-tokenized; tokens
+   // before and after it are copied from 'previous' (with their positions
+   // adjusted for the edit).
+   RTokens(const std::wstring& code, const RTokens& previous, int flags = None);
+   
+   // Tokens in [damageBegin(), damageEnd()) were produced by re-tokenizing
+   // edited code; all others were reused. Tokens from damageEnd() onwards
+   // correspond to the tokens of the previous set from previousDamageEnd().
+   // (For a set tokenized from scratch, all tokens are 'damaged'.)
+   std::size_t damageBegin() const { return damageBegin_; }
+   std::size_t damageEnd() const { return damageEnd_; }
+   std::size_t previousDamageEnd() const { return previousDamageEnd_; }
+   
+   const std::wstring& code() const { return tokenizer_.buffer().data(); }
+   
    friend std::ostream& operator <<(std::ostream& os,
                                     const RTokens& rTokens)
    {
@@ -304,9 +370,29 @@ public:
    }
 
 private:
+   bool accept(const RToken& token) const
+   {
+      if ((flags_ & StripWhitespace) && token.type() == RToken::WHITESPACE)
+         return false;
+      
+      if ((flags_ & StripComments) && token.type() == RToken::COMMENT)
+         return false;
+      
+      return true;
+   }
+   
+   RToken rebase(const RToken& token,
+                 std::ptrdiff_t offsetDelta = 0,
+                 std::ptrdiff_t rowDelta = 0,
+                 std::ptrdiff_t columnDelta = 0) const;
+   
     RTokenizer tokenizer_;
     Tokens tokens_;
     RToken dummyToken_;
+    int flags_;
+    std::size_t damageBegin_;
+    std::size_t damageEnd_;
+    std::size_t previousDamageEnd_;
 };
 
 namespace token_utils {
@@ -0,0 +1,167 @@
+/*
+ * FuzzyMatch.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_FUZZY_MATCH_HPP
+#define CORE_TEXT_FUZZY_MATCH_HPP
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+// bitmask of the (ascii case folded) characters within a string. a string
+// can only contain a query as a subsequence if its mask is a superset of
+// the query's mask, which lets most candidates be rejected with one test
+boost::uint64_t characterMask(const char* begin, const char* end);
+
+// a query prepared for case insensitive subsequence matching
+class FuzzyQuery
+{
+public:
+   explicit FuzzyQuery(const std::string& query);
+
+   // does [begin, end) (which must already be lowercase) contain the query
+   // as a subsequence. at least 15 readable bytes must follow end (the
+   // scan reads 16 bytes at a time)
+   bool matchesLower(const char* begin,
+                     const char* end,
+                     boost::uint64_t mask) const;
+
+   // convenience for matching a single arbitrary string
+   bool matches(const std::string& text) const;
+
+   const std::string& lower() const { return lower_; }
+   boost::uint64_t mask() const { return mask_; }
+   bool empty() const { return lower_.empty(); }
+
+private:
+   std::string lower_;
+   boost::uint64_t mask_;
+};
+
+// flat table of names (e.g. file or symbol names) stored contiguously
+// along with a lowercase shadow and character masks, for fast fuzzy lookup
+class NameTable
+{
+public:
+   NameTable();
+
+   // returns the id of the name (ids are assigned sequentially from 0)
+   boost::uint32_t add(const std::string& name);
+
+   void reserve(std::size_t count, std::size_t bytes);
+   void clear();
+
+   std::size_t size() const { return masks_.size(); }
+   bool empty() const { return masks_.empty(); }
+
+   std::string name(boost::uint32_t id) const;
+
+   // the name's bytes within the table (not NUL terminated)
+   const char* nameData(boost::uint32_t id) const
+   {
+      return names_.data() + offsets_[id];
+   }
+
+   std::size_t nameSize(boost::uint32_t id) const
+   {
+      return offsets_[id + 1] - offsets_[id];
+   }
+
+   // append the ids of all names which contain the query as a (case
+   // insensitive) subsequence, in id order
+   void findMatches(const FuzzyQuery& query,
+                    std::vector<boost::uint32_t>* pIds) const;
+
+private:
+   std::string names_;
+   std::string lower_;
+   std::vector<boost::uint32_t> offsets_;
+   std::vector<boost::uint64_t> masks_;
+};
+
+// retains the k best (lowest) scoring items pushed into it, using a
+// bounded heap rather than sorting every score. ties are broken in
+// favor of the item pushed first
+template <typename T>
+class BestMatches
+{
+public:
+   explicit BestMatches(std::size_t k)
+      : k_(k), pushed_(0)
+   {
+   }
+
+   void push(int score, const T& value)
+   {
+      Item item(Key(score, pushed_++), value);
+      if (heap_.size() < k_)
+      {
+         heap_.push_back(item);
+         std::push_heap(heap_.begin(), heap_.end(), compare);
+      }
+      else if (k_ > 0 && item.first < heap_.front().first)
+      {
+         std::pop_heap(heap_.begin(), heap_.end(), compare);
+         heap_.back() = item;
+         std::push_heap(heap_.begin(), heap_.end(), compare);
+      }
+   }
+
+   // the number of items pushed (which may exceed the number retained)
+   std::size_t pushedCount() const { return pushed_; }
+
+   // the retained items, best first
+   std::vector<std::pair<int, T> > sorted() const
+   {
+      std::vector<Item> items(heap_);
+      std::sort_heap(items.begin(), items.end(), compare);
+
+      std::vector<std::pair<int, T> > result;
+      result.reserve(items.size());
+      for (typename std::vector<Item>::const_iterator it = items.begin();
+           it != items.end();
+           ++it)
+      {
+         result.push_back(std::make_pair(it->first.first, it->second));
+      }
+      return result;
+   }
+
+private:
+   typedef std::pair<int, std::size_t> Key;
+   typedef std::pair<Key, T> Item;
+
+   static bool compare(const Item& lhs, const Item& rhs)
+   {
+      return lhs.first < rhs.first;
+   }
+
+   std::size_t k_;
+   std::size_t pushed_;
+   std::vector<Item> heap_;
+};
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TEXT_FUZZY_MATCH_HPP
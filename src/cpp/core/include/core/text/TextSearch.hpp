@@ -0,0 +1,189 @@
+/*
+ * TextSearch.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_TEXT_SEARCH_HPP
+#define CORE_TEXT_TEXT_SEARCH_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+
+namespace text {
+
+// a line within a file which matched a search. contents are the raw
+// (undecoded) bytes of the line without its terminating newline and
+// matches are [begin, end) byte offsets of each match within contents
+struct LineMatch
+{
+   LineMatch() : lineNumber(0) {}
+
+   int lineNumber;
+   std::string contents;
+   std::vector<std::pair<std::size_t, std::size_t> > matches;
+};
+
+// matches lines against a search pattern. regular expressions use the
+// same (basic) syntax as grep. before any line is handed to the regex
+// engine a literal which every match must contain is located with a
+// vectorized scan, so most of a file is never seen by the regex engine
+class TextMatcher
+{
+public:
+   TextMatcher(const std::string& pattern, bool asRegex, bool ignoreCase);
+
+   // find the first position in [begin, end) where the required literal
+   // occurs (returns end if there is none). with no usable literal every
+   // position is a candidate and begin is returned
+   const char* nextCandidate(const char* begin, const char* end) const;
+
+   // search a single line (with no newline characters) for matches
+   bool matchLine(const char* begin,
+                  const char* end,
+                  std::vector<std::pair<std::size_t, std::size_t> >* pMatches) const;
+
+   bool isValid() const { return valid_; }
+   const std::string& literal() const { return literal_; }
+
+private:
+   bool equalsLiteral(const char* pos) const;
+
+   std::string pattern_;
+   bool asRegex_;
+   bool ignoreCase_;
+   bool valid_;
+   std::string literal_;
+   boost::regex regex_;
+};
+
+// extract the longest run of characters which every match of the passed
+// (basic syntax) regular expression must contain. returns an empty string
+// if no such run exists (e.g. the pattern uses alternation)
+std::string requiredLiteral(const std::string& pattern, bool ignoreCase);
+
+// search [begin, end) for matching lines. returns false if the search
+// was stopped early because maxMatches lines were found
+bool searchBuffer(const char* begin,
+                  const char* end,
+                  const TextMatcher& matcher,
+                  std::size_t maxMatches,
+                  std::vector<LineMatch>* pMatches);
+
+// search a file (which is memory mapped rather than read). files which
+// appear to be binary are skipped, as with grep --binary-files=without-match
+Error searchFile(const FilePath& filePath,
+                 const TextMatcher& matcher,
+                 std::size_t maxMatches,
+                 std::vector<LineMatch>* pMatches);
+
+// does the passed buffer look like binary (rather than text) content
+bool isBinaryContent(const char* begin, const char* end);
+
+// convert a glob (as passed to grep --include) to a regular expression
+boost::regex globToRegex(const std::string& glob);
+
+// recursively list the regular files beneath a directory which have a
+// filename matching one of the passed globs (all files if there are none).
+// symlinks are not followed. directories and files for which filter returns
+// false are skipped entirely. return false from onFile to stop listing
+typedef boost::function<bool(const FilePath&)> SearchPathFilter;
+typedef boost::function<bool(const FilePath&)> SearchFileHandler;
+Error listSearchableFiles(const FilePath& rootPath,
+                          const std::vector<std::string>& globs,
+                          const SearchPathFilter& filter,
+                          const SearchFileHandler& onFile);
+
+// the lines matched within a single file
+struct FileMatches
+{
+   FilePath filePath;
+   std::vector<LineMatch> matches;
+};
+
+// searches the files beneath a directory in parallel. the directory is
+// listed on one pool thread and each file is then searched as a separate
+// task; matches are queued as each file completes and can be collected
+// from any thread (typically the main thread, during idle time)
+class ParallelSearch : public boost::enable_shared_from_this<ParallelSearch>,
+                       boost::noncopyable
+{
+public:
+   static boost::shared_ptr<ParallelSearch> create(
+                                    const FilePath& rootPath,
+                                    const std::vector<std::string>& globs,
+                                    const SearchPathFilter& filter,
+                                    const TextMatcher& matcher,
+                                    std::size_t maxMatches);
+
+private:
+   ParallelSearch(const FilePath& rootPath,
+                  const std::vector<std::string>& globs,
+                  const SearchPathFilter& filter,
+                  const TextMatcher& matcher,
+                  std::size_t maxMatches);
+
+public:
+   void start(thread::ThreadPool* pPool);
+
+   // stop searching (files already being searched run to completion)
+   void cancel();
+
+   // move all queued results into pResults. returns true once the search
+   // has finished and every result has been collected
+   bool collect(std::vector<boost::shared_ptr<FileMatches> >* pResults);
+
+   // wait up to the specified duration for results to become available
+   void waitForResults(const boost::posix_time::time_duration& duration);
+
+   std::size_t filesSearched() const { return filesSearched_; }
+
+private:
+   void listFiles(thread::ThreadPool* pPool);
+   bool enqueFile(thread::ThreadPool* pPool, const FilePath& filePath);
+   void searchFile(const FilePath& filePath);
+   bool isStopped() const;
+
+   FilePath rootPath_;
+   std::vector<std::string> globs_;
+   SearchPathFilter filter_;
+   TextMatcher matcher_;
+   std::size_t maxMatches_;
+
+   std::atomic<bool> cancelled_;
+   std::atomic<bool> listingComplete_;
+   std::atomic<std::size_t> pendingFiles_;
+   std::atomic<std::size_t> filesSearched_;
+   std::atomic<std::size_t> matchCount_;
+   thread::ThreadsafeQueue<boost::shared_ptr<FileMatches> > results_;
+};
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TEXT_TEXT_SEARCH_HPP
@@ -0,0 +1,125 @@
+/*
+ * TrigramIndex.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_TRIGRAM_INDEX_HPP
+#define CORE_TEXT_TRIGRAM_INDEX_HPP
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace text {
+
+// index from the (ascii case folded) trigrams of a set of files to the
+// files containing them. used to narrow the files which need to be read
+// for a search: a file can only contain a literal if it contains every
+// trigram of that literal. files are identified by an opaque path string
+// (e.g. relative to a project) and updates are incremental; removed
+// files leave stale postings behind until the index is compacted.
+// this class is not synchronized
+class TrigramIndex : boost::noncopyable
+{
+public:
+   // files larger than this are tracked but not indexed (they are
+   // always returned as candidates)
+   static const uintmax_t kMaxIndexedFileSize;
+
+   TrigramIndex();
+
+   // compute the sorted, unique trigrams of a buffer
+   static void extractTrigrams(const char* begin,
+                               const char* end,
+                               std::vector<boost::uint32_t>* pTrigrams);
+
+   // read a file and compute its trigrams. binary files have no trigrams
+   // and are flagged as such (they can never match a search)
+   static Error readTrigrams(const FilePath& filePath,
+                             std::vector<boost::uint32_t>* pTrigrams,
+                             bool* pIsBinary,
+                             bool* pIsIndexed);
+
+   // add or replace a file
+   void update(const std::string& path,
+               uintmax_t size,
+               std::time_t lastWriteTime,
+               const std::vector<boost::uint32_t>& trigrams,
+               bool isBinary,
+               bool isIndexed);
+
+   void remove(const std::string& path);
+   void clear();
+   void swap(TrigramIndex& other);
+
+   // is the file tracked by the index
+   bool contains(const std::string& path) const;
+
+   // is the file tracked with the specified size and modification time
+   bool isCurrent(const std::string& path,
+                  uintmax_t size,
+                  std::time_t lastWriteTime) const;
+
+   // all tracked files
+   std::vector<std::string> paths() const;
+
+   // find files which might contain the passed literal. returns false
+   // if the literal has no trigrams (every file is then a candidate)
+   bool candidates(const std::string& literal,
+                   std::vector<std::string>* pPaths) const;
+
+   // drop removed files and their stale postings
+   void compact();
+   bool needsCompaction() const;
+
+   std::size_t fileCount() const { return files_.size() - removedCount_; }
+   std::size_t trigramCount() const { return postings_.size(); }
+   std::size_t postingCount() const;
+
+   // persist the index (written atomically, via a temporary file)
+   Error writeToFile(const FilePath& filePath) const;
+   Error readFromFile(const FilePath& filePath);
+
+private:
+   struct FileEntry
+   {
+      std::string path;
+      boost::uint64_t size;
+      boost::int64_t lastWriteTime;
+      boost::uint8_t flags;
+   };
+
+   bool isLive(boost::uint32_t id) const;
+
+   std::vector<FileEntry> files_;
+   std::map<std::string, boost::uint32_t> fileIds_;
+   boost::unordered_map<boost::uint32_t, std::vector<boost::uint32_t> > postings_;
+   std::size_t removedCount_;
+};
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TEXT_TRIGRAM_INDEX_HPP
@@ -0,0 +1,518 @@
+/*
+ * RPackageSymbolCache.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RPackageSymbolCache.hpp>
+
+#include <cstring>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/BinarySerializer.hpp>
+#include <core/Error.hpp>
+#include <core/Hash.hpp>
+#include <core/r_util/RPackageInfo.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+using namespace binary;
+
+// on disk format: header (identifying the installed package), then a table
+// of sections, each holding one kind of symbols or the package information
+const boost::uint32_t kCacheMagic = 0x52535053; // 'RSPS'
+const boost::uint32_t kCacheVersion = 1;
+
+const boost::uint32_t kPackageInformationSection = 100;
+
+// tribools are stored as 0 (false), 1 (true) or 2 (indeterminate)
+void writeTribool(std::ostream& ostr, boost::tribool value)
+{
+   boost::uint8_t encoded = boost::indeterminate(value) ? 2 : (value ? 1 : 0);
+   writeValue(ostr, encoded);
+}
+
+bool readTribool(Reader* pReader, boost::tribool* pValue)
+{
+   boost::uint8_t encoded;
+   if (!pReader->read(&encoded))
+      return false;
+   if (encoded > 2)
+      return pReader->fail();
+
+   if (encoded == 2)
+      *pValue = boost::indeterminate;
+   else
+      *pValue = encoded == 1;
+   return true;
+}
+
+void writeHeader(std::ostream& ostr, const InstalledPackage& package)
+{
+   writeValue(ostr, kCacheMagic);
+   writeValue(ostr, kCacheVersion);
+   writeString(ostr, package.name);
+   writeString(ostr, package.version);
+   writeString(ostr, package.libraryPath);
+   writeValue(ostr, static_cast<boost::int64_t>(package.installTime));
+}
+
+// does the header identify this install of the package?
+bool readHeader(Reader* pReader, const InstalledPackage& package)
+{
+   boost::uint32_t magic, version;
+   std::string name, packageVersion, libraryPath;
+   boost::int64_t installTime;
+   return pReader->read(&magic) && magic == kCacheMagic &&
+          pReader->read(&version) && version == kCacheVersion &&
+          pReader->read(&name) && name == package.name &&
+          pReader->read(&packageVersion) && packageVersion == package.version &&
+          pReader->read(&libraryPath) && libraryPath == package.libraryPath &&
+          pReader->read(&installTime) && installTime == package.installTime;
+}
+
+std::string encodePackageInformation(const PackageInformation& info)
+{
+   std::ostringstream ostr;
+
+   writeStrings(ostr, info.exports);
+
+   writeValue(ostr, static_cast<boost::uint32_t>(info.types.size()));
+   BOOST_FOREACH(int type, info.types)
+   {
+      writeValue(ostr, static_cast<boost::int32_t>(type));
+   }
+
+   writeStrings(ostr, info.datasets);
+
+   writeValue(ostr, static_cast<boost::uint32_t>(info.functionInfo.size()));
+   for (FunctionInformationMap::const_iterator it = info.functionInfo.begin();
+        it != info.functionInfo.end();
+        ++it)
+   {
+      // (the function information is mutated through a copy, as its
+      // accessors aren't all const)
+      FunctionInformation function = it->second;
+
+      writeString(ostr, it->first);
+
+      const boost::optional<Binding>& binding = function.binding();
+      writeValue(ostr, static_cast<boost::uint8_t>(binding ? 1 : 0));
+      if (binding)
+      {
+         writeString(ostr, binding->name);
+         writeString(ostr, binding->origin);
+      }
+
+      writeValue(ostr, static_cast<boost::uint8_t>(function.isPrimitive()));
+      writeTribool(ostr, function.performsNse());
+
+      writeValue(ostr, static_cast<boost::uint32_t>(function.formals().size()));
+      BOOST_FOREACH(const FormalInformation& formal, function.formals())
+      {
+         writeString(ostr, formal.name());
+         writeTribool(ostr, formal.hasDefault());
+
+         const boost::optional<std::string>& defaultValue = formal.defaultValue();
+         writeValue(ostr, static_cast<boost::uint8_t>(defaultValue ? 1 : 0));
+         if (defaultValue)
+            writeString(ostr, *defaultValue);
+
+         writeValue(ostr, static_cast<boost::uint8_t>(formal.isUsed()));
+         writeValue(ostr, static_cast<boost::uint8_t>(formal.isMissingnessHandled()));
+      }
+   }
+
+   return ostr.str();
+}
+
+bool decodeFunctionInformation(Reader* pReader, FunctionInformation* pInfo)
+{
+   boost::uint8_t hasBinding;
+   if (!pReader->read(&hasBinding))
+      return false;
+
+   if (hasBinding)
+   {
+      std::string name, origin;
+      if (!pReader->read(&name) || !pReader->read(&origin))
+         return false;
+      *pInfo = FunctionInformation(name, origin);
+   }
+
+   boost::uint8_t isPrimitive;
+   boost::tribool performsNse;
+   boost::uint32_t formalCount;
+   if (!pReader->read(&isPrimitive) ||
+       !readTribool(pReader, &performsNse) ||
+       !pReader->read(&formalCount))
+   {
+      return false;
+   }
+
+   pInfo->setIsPrimitive(isPrimitive != 0);
+   if (!boost::indeterminate(performsNse))
+      pInfo->setPerformsNse(bool(performsNse));
+
+   for (boost::uint32_t i = 0; i < formalCount; i++)
+   {
+      std::string name;
+      boost::tribool hasDefault;
+      boost::uint8_t hasDefaultValue;
+      if (!pReader->read(&name) ||
+          !readTribool(pReader, &hasDefault) ||
+          !pReader->read(&hasDefaultValue))
+      {
+         return false;
+      }
+
+      FormalInformation formal(name);
+      if (hasDefaultValue)
+      {
+         std::string defaultValue;
+         if (!pReader->read(&defaultValue))
+            return false;
+         formal.setDefaultValue(defaultValue);
+      }
+      if (!boost::indeterminate(hasDefault))
+         formal.setHasDefaultValue(bool(hasDefault));
+
+      boost::uint8_t isUsed, isMissingnessHandled;
+      if (!pReader->read(&isUsed) || !pReader->read(&isMissingnessHandled))
+         return false;
+
+      formal.setIsUsed(isUsed != 0);
+      formal.setMissingnessHandled(isMissingnessHandled != 0);
+      pInfo->addFormal(formal);
+   }
+
+   return true;
+}
+
+bool decodePackageInformation(Reader* pReader, PackageInformation* pInfo)
+{
+   boost::uint32_t typeCount;
+   if (!pReader->read(&pInfo->exports) || !pReader->read(&typeCount))
+      return false;
+
+   pInfo->types.reserve(typeCount);
+   for (boost::uint32_t i = 0; i < typeCount; i++)
+   {
+      boost::int32_t type;
+      if (!pReader->read(&type))
+         return false;
+      pInfo->types.push_back(type);
+   }
+
+   boost::uint32_t functionCount;
+   if (!pReader->read(&pInfo->datasets) || !pReader->read(&functionCount))
+      return false;
+
+   for (boost::uint32_t i = 0; i < functionCount; i++)
+   {
+      std::string name;
+      if (!pReader->read(&name))
+         return false;
+
+      if (!decodeFunctionInformation(pReader, &pInfo->functionInfo[name]))
+         return false;
+   }
+
+   return true;
+}
+
+} // anonymous namespace
+
+Error findInstalledPackage(const std::string& name,
+                           const std::vector<FilePath>& libPaths,
+                           InstalledPackage* pPackage)
+{
+   *pPackage = InstalledPackage();
+
+   BOOST_FOREACH(const FilePath& libPath, libPaths)
+   {
+      FilePath packageDir = libPath.childPath(name);
+      FilePath descFilePath = packageDir.childPath("DESCRIPTION");
+      if (!descFilePath.exists())
+         continue;
+
+      RPackageInfo packageInfo;
+      Error error = packageInfo.read(packageDir);
+      if (error)
+         return error;
+
+      pPackage->name = name;
+      pPackage->version = packageInfo.version();
+      pPackage->libraryPath = libPath.absolutePath();
+      pPackage->installTime = descFilePath.lastWriteTime();
+      return Success();
+   }
+
+   return Success();
+}
+
+// a package's (mapped) cache file, and the location of its sections
+class PackageSymbolCache::Entry : boost::noncopyable
+{
+public:
+   typedef std::map<boost::uint32_t, std::pair<const char*, const char*> > Sections;
+
+   void load(const FilePath& filePath, const InstalledPackage& package)
+   {
+      installTime_ = package.installTime;
+      if (!filePath.exists())
+         return;
+
+      try
+      {
+         file_.open(filePath.absolutePathNative());
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         error.addProperty("path", filePath);
+         LOG_ERROR(error);
+         return;
+      }
+
+      // entries for other installs of the package are ignored (and
+      // replaced when the package's symbols are next stored)
+      Reader reader(file_.data(), file_.data() + file_.size());
+      boost::uint32_t sectionCount;
+      if (!readHeader(&reader, package) || !reader.read(&sectionCount))
+      {
+         close();
+         return;
+      }
+
+      for (boost::uint32_t i = 0; i < sectionCount; i++)
+      {
+         boost::uint32_t section, size;
+         const char* begin = NULL;
+         if (!reader.read(&section) ||
+             !reader.read(&size) ||
+             !(begin = reader.position()) ||
+             !reader.skip(size))
+         {
+            close();
+            return;
+         }
+
+         sections_[section] = std::make_pair(begin, reader.position());
+      }
+   }
+
+   void close()
+   {
+      sections_.clear();
+      if (file_.is_open())
+         file_.close();
+   }
+
+   const Sections& sections() const { return sections_; }
+
+   // (the file name identifies everything else about the install)
+   bool isFor(const InstalledPackage& package) const
+   {
+      return installTime_ == package.installTime;
+   }
+
+private:
+   std::time_t installTime_;
+   boost::iostreams::mapped_file_source file_;
+   Sections sections_;
+};
+
+PackageSymbolCache::PackageSymbolCache(const FilePath& cacheDir)
+   : cacheDir_(cacheDir)
+{
+}
+
+PackageSymbolCache::~PackageSymbolCache()
+{
+}
+
+FilePath PackageSymbolCache::entryPath(const InstalledPackage& package) const
+{
+   // (package names and versions are safe to use in file names)
+   return cacheDir_.childPath(package.name + "_" +
+                              package.version + "_" +
+                              hash::crc32HexHash(package.libraryPath));
+}
+
+boost::shared_ptr<PackageSymbolCache::Entry> PackageSymbolCache::entry(
+                                             const InstalledPackage& package)
+{
+   FilePath filePath = entryPath(package);
+   std::map<std::string, boost::shared_ptr<Entry> >::const_iterator it =
+                                    entries_.find(filePath.absolutePath());
+   if (it != entries_.end() && it->second->isFor(package))
+      return it->second;
+
+   boost::shared_ptr<Entry> pEntry(new Entry());
+   pEntry->load(filePath, package);
+   entries_[filePath.absolutePath()] = pEntry;
+   return pEntry;
+}
+
+bool PackageSymbolCache::getSection(const InstalledPackage& package,
+                                    boost::uint32_t section,
+                                    const char** pBegin,
+                                    const char** pEnd)
+{
+   if (package.empty())
+      return false;
+
+   boost::shared_ptr<Entry> pEntry = entry(package);
+   Entry::Sections::const_iterator it = pEntry->sections().find(section);
+   if (it == pEntry->sections().end())
+      return false;
+
+   *pBegin = it->second.first;
+   *pEnd = it->second.second;
+   return true;
+}
+
+Error PackageSymbolCache::putSection(const InstalledPackage& package,
+                                     boost::uint32_t section,
+                                     const std::string& contents)
+{
+   Error error = cacheDir_.ensureDirectory();
+   if (error)
+      return error;
+
+   // re-read the entry, in case another session has updated it since
+   FilePath filePath = entryPath(package);
+   entries_.erase(filePath.absolutePath());
+   boost::shared_ptr<Entry> pEntry = entry(package);
+
+   FilePath tempPath = cacheDir_.complete(
+            filePath.filename() + "." + core::system::generateShortenedUuid());
+
+   {
+      boost::shared_ptr<std::ostream> pStream;
+      error = tempPath.open_w(&pStream);
+      if (error)
+         return error;
+      std::ostream& ostr = *pStream;
+
+      Entry::Sections sections = pEntry->sections();
+      sections.erase(section);
+
+      writeHeader(ostr, package);
+      writeValue(ostr, static_cast<boost::uint32_t>(sections.size() + 1));
+      for (Entry::Sections::const_iterator it = sections.begin();
+           it != sections.end();
+           ++it)
+      {
+         writeValue(ostr, it->first);
+         writeValue(ostr, static_cast<boost::uint32_t>(it->second.second - it->second.first));
+         ostr.write(it->second.first, it->second.second - it->second.first);
+      }
+
+      writeValue(ostr, section);
+      writeValue(ostr, static_cast<boost::uint32_t>(contents.size()));
+      ostr.write(contents.data(), contents.size());
+
+      ostr.flush();
+      if (!ostr.good())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", tempPath);
+         tempPath.removeIfExists();
+         return error;
+      }
+   }
+
+   // release the mapping of the previous version before replacing it
+   pEntry->close();
+   entries_.erase(filePath.absolutePath());
+
+   error = tempPath.move(filePath);
+   if (error)
+      tempPath.removeIfExists();
+   return error;
+}
+
+bool PackageSymbolCache::getSymbols(const InstalledPackage& package,
+                                    PackageSymbolKind kind,
+                                    std::vector<std::string>* pSymbols)
+{
+   const char* begin;
+   const char* end;
+   if (!getSection(package, kind, &begin, &end))
+      return false;
+
+   Reader reader(begin, end);
+   if (!reader.read(pSymbols))
+   {
+      pSymbols->clear();
+      return false;
+   }
+
+   return true;
+}
+
+Error PackageSymbolCache::putSymbols(const InstalledPackage& package,
+                                     PackageSymbolKind kind,
+                                     const std::vector<std::string>& symbols)
+{
+   if (package.empty())
+      return Success();
+
+   std::ostringstream ostr;
+   writeStrings(ostr, symbols);
+   return putSection(package, kind, ostr.str());
+}
+
+bool PackageSymbolCache::getPackageInformation(const InstalledPackage& package,
+                                               PackageInformation* pInfo)
+{
+   const char* begin;
+   const char* end;
+   if (!getSection(package, kPackageInformationSection, &begin, &end))
+      return false;
+
+   PackageInformation info;
+   info.package = package.name;
+
+   Reader reader(begin, end);
+   if (!decodePackageInformation(&reader, &info))
+      return false;
+
+   *pInfo = info;
+   return true;
+}
+
+Error PackageSymbolCache::putPackageInformation(const InstalledPackage& package,
+                                                const PackageInformation& info)
+{
+   if (package.empty())
+      return Success();
+
+   return putSection(package,
+                     kPackageInformationSection,
+                     encodePackageInformation(info));
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,206 @@
+/*
+ * RPackageSymbolCacheTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RPackageSymbolCache.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+using namespace r_util;
+
+namespace {
+
+InstalledPackage installedPackage(const std::string& name,
+                                  const std::string& version)
+{
+   InstalledPackage package;
+   package.name = name;
+   package.version = version;
+   package.libraryPath = "/library";
+   package.installTime = 1000;
+   return package;
+}
+
+std::vector<std::string> symbols(const char* first, const char* second)
+{
+   std::vector<std::string> result;
+   result.push_back(first);
+   result.push_back(second);
+   return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("PackageSymbolCache")
+{
+   FilePath cacheDir;
+   REQUIRE_FALSE(FilePath::tempFilePath(&cacheDir));
+
+   InstalledPackage dplyr = installedPackage("dplyr", "0.7.6");
+
+   SECTION("Symbols round trip through the cache, by kind")
+   {
+      PackageSymbolCache cache(cacheDir);
+      std::vector<std::string> result;
+      CHECK_FALSE(cache.getSymbols(dplyr, PackageSymbolsExports, &result));
+
+      REQUIRE_FALSE(cache.putSymbols(dplyr, PackageSymbolsExports,
+                                     symbols("filter", "mutate")));
+      REQUIRE_FALSE(cache.putSymbols(dplyr, PackageSymbolsNamespace,
+                                     symbols("filter_impl", "mutate_impl")));
+
+      // (read back through a fresh cache, as a new session would)
+      PackageSymbolCache loaded(cacheDir);
+      REQUIRE(loaded.getSymbols(dplyr, PackageSymbolsExports, &result));
+      CHECK(result == symbols("filter", "mutate"));
+      REQUIRE(loaded.getSymbols(dplyr, PackageSymbolsNamespace, &result));
+      CHECK(result == symbols("filter_impl", "mutate_impl"));
+      CHECK_FALSE(loaded.getSymbols(dplyr, PackageSymbolsAttached, &result));
+   }
+
+   SECTION("Entries are only valid for the install they were made from")
+   {
+      PackageSymbolCache cache(cacheDir);
+      REQUIRE_FALSE(cache.putSymbols(dplyr, PackageSymbolsExports,
+                                     symbols("filter", "mutate")));
+
+      std::vector<std::string> result;
+      InstalledPackage upgraded = installedPackage("dplyr", "0.8.0");
+      CHECK_FALSE(cache.getSymbols(upgraded, PackageSymbolsExports, &result));
+
+      InstalledPackage reinstalled = dplyr;
+      reinstalled.installTime = 2000;
+      PackageSymbolCache loaded(cacheDir);
+      CHECK_FALSE(loaded.getSymbols(reinstalled, PackageSymbolsExports, &result));
+
+      InstalledPackage elsewhere = dplyr;
+      elsewhere.libraryPath = "/other/library";
+      CHECK_FALSE(loaded.getSymbols(elsewhere, PackageSymbolsExports, &result));
+
+      // re-installs replace the previous entry
+      REQUIRE_FALSE(loaded.putSymbols(reinstalled, PackageSymbolsExports,
+                                      symbols("arrange", "select")));
+      PackageSymbolCache reloaded(cacheDir);
+      REQUIRE(reloaded.getSymbols(reinstalled, PackageSymbolsExports, &result));
+      CHECK(result == symbols("arrange", "select"));
+      CHECK_FALSE(reloaded.getSymbols(dplyr, PackageSymbolsExports, &result));
+   }
+
+   SECTION("Package information round trips through the cache")
+   {
+      PackageInformation info;
+      info.package = "dplyr";
+      info.exports = symbols("filter", "starwars");
+      info.types.push_back(6);
+      info.types.push_back(4);
+      info.datasets.push_back("starwars");
+
+      FunctionInformation filter("filter", "dplyr");
+      FormalInformation data(".data");
+      data.setHasDefaultValue(false);
+      data.setIsUsed(true);
+      data.setMissingnessHandled(false);
+      filter.addFormal(data);
+      FormalInformation dots("...");
+      dots.setHasDefaultValue(false);
+      filter.addFormal(dots);
+      filter.setPerformsNse(true);
+      filter.setIsPrimitive(false);
+      info.functionInfo["filter"] = filter;
+
+      PackageSymbolCache cache(cacheDir);
+      REQUIRE_FALSE(cache.putPackageInformation(dplyr, info));
+      REQUIRE_FALSE(cache.putSymbols(dplyr, PackageSymbolsExports,
+                                     symbols("filter", "mutate")));
+
+      PackageSymbolCache loaded(cacheDir);
+      PackageInformation result;
+      REQUIRE(loaded.getPackageInformation(dplyr, &result));
+      CHECK(result.package == "dplyr");
+      CHECK(result.exports == info.exports);
+      CHECK(result.types == info.types);
+      CHECK(result.datasets == info.datasets);
+      REQUIRE(result.functionInfo.count("filter"));
+
+      FunctionInformation& loadedFilter = result.functionInfo["filter"];
+      REQUIRE(bool(loadedFilter.binding()));
+      CHECK(loadedFilter.binding()->origin == "dplyr");
+      CHECK(bool(loadedFilter.performsNse()));
+      CHECK_FALSE(loadedFilter.isPrimitive());
+      REQUIRE(loadedFilter.getFormalNames().size() == 2);
+      CHECK(loadedFilter.getFormalNames()[1] == "...");
+      CHECK(loadedFilter.formals()[0].isUsed());
+      CHECK_FALSE(bool(loadedFilter.formals()[0].hasDefault()));
+
+      // storing one section preserves the others
+      std::vector<std::string> exports;
+      REQUIRE(loaded.getSymbols(dplyr, PackageSymbolsExports, &exports));
+      CHECK(exports == symbols("filter", "mutate"));
+   }
+
+   SECTION("Corrupt entries are ignored")
+   {
+      PackageSymbolCache cache(cacheDir);
+      REQUIRE_FALSE(cache.putSymbols(dplyr, PackageSymbolsExports,
+                                     symbols("filter", "mutate")));
+
+      std::string contents;
+      FilePath entryPath = cache.entryPath(dplyr);
+      REQUIRE_FALSE(readStringFromFile(entryPath, &contents));
+      REQUIRE_FALSE(writeStringToFile(entryPath,
+                                      contents.substr(0, contents.size() - 3)));
+
+      PackageSymbolCache loaded(cacheDir);
+      std::vector<std::string> result;
+      CHECK_FALSE(loaded.getSymbols(dplyr, PackageSymbolsExports, &result));
+   }
+
+   SECTION("Installed packages are found on the library paths, in order")
+   {
+      FilePath firstLib = cacheDir.complete("first");
+      FilePath secondLib = cacheDir.complete("second");
+      REQUIRE_FALSE(secondLib.complete("rlang").ensureDirectory());
+      REQUIRE_FALSE(writeStringToFile(
+                       secondLib.complete("rlang/DESCRIPTION"),
+                       "Package: rlang\nVersion: 0.2.2\n"));
+
+      std::vector<FilePath> libPaths;
+      libPaths.push_back(firstLib);
+      libPaths.push_back(secondLib);
+
+      InstalledPackage package;
+      REQUIRE_FALSE(findInstalledPackage("rlang", libPaths, &package));
+      CHECK(package.name == "rlang");
+      CHECK(package.version == "0.2.2");
+      CHECK(package.libraryPath == secondLib.absolutePath());
+
+      REQUIRE_FALSE(findInstalledPackage("purrr", libPaths, &package));
+      CHECK(package.empty());
+   }
+
+   cacheDir.removeIfExists();
+}
+
+} // end namespace tests
+} // end namespace core
+} // end namespace rstudio
@@ -41,6 +41,7 @@ std::set<std::string> RSourceIndex::s_importedPackages_;
 RSourceIndex::ImportFromMap RSourceIndex::s_importFromDirectives_;
 std::map<std::string, PackageInformation> RSourceIndex::s_packageInformation_;
 FunctionInformation RSourceIndex::s_noSuchFunction_;
+PackageInformation RSourceIndex::s_noSuchPackage_;
 
 namespace {
 
@@ -446,8 +447,10 @@ std::vector<Indexer> makeIndexers()
 
 }  // anonymous namespace
 
-RSourceIndex::RSourceIndex(const std::string& context, const std::string& code)
-   : context_(context)
+RSourceIndex::RSourceIndex(const std::string& context,
+                           const std::string& code,
+                           bool shareInferredPackages)
+   : context_(context), shareInferredPackages_(shareInferredPackages)
 {
    static std::vector<Indexer> indexers = makeIndexers();
    
@@ -476,6 +479,19 @@ RSourceIndex::RSourceIndex(const std::string& context, const std::string& code)
    
 }
 
+RSourceIndex::RSourceIndex(const std::string& context,
+                           const std::vector<RSourceItem>& items,
+                           const std::vector<std::string>& inferredPackages,
+                           bool shareInferredPackages)
+   : context_(context),
+     items_(items),
+     inferredPkgNames_(inferredPackages),
+     shareInferredPackages_(false)
+{
+   if (shareInferredPackages)
+      this->shareInferredPackages();
+}
+
 } // namespace r_util
 } // namespace core 
 } // namespace rstudio
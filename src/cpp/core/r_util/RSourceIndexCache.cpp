@@ -0,0 +1,303 @@
+/*
+ * RSourceIndexCache.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceIndexCache.hpp>
+
+#include <boost/crc.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/BinarySerializer.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/r_util/RSourceIndex.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+using namespace binary;
+
+// on disk format: header, then for each file its key (path, size,
+// modification time and content hash), context, items and inferred packages
+const boost::uint32_t kCacheMagic = 0x52534943; // 'RSIC'
+const boost::uint32_t kCacheVersion = 1;
+
+void writeItem(std::ostream& ostr, const RSourceItem& item)
+{
+   writeValue(ostr, static_cast<boost::int32_t>(item.type()));
+   writeString(ostr, item.name());
+   writeValue(ostr, static_cast<boost::uint32_t>(item.signature().size()));
+   BOOST_FOREACH(const RS4MethodParam& param, item.signature())
+   {
+      writeString(ostr, param.name());
+      writeString(ostr, param.type());
+   }
+   writeValue(ostr, static_cast<boost::int32_t>(item.braceLevel()));
+   writeValue(ostr, static_cast<boost::int32_t>(item.line()));
+   writeValue(ostr, static_cast<boost::int32_t>(item.column()));
+}
+
+bool readItem(Reader* pReader, RSourceItem* pItem)
+{
+   boost::int32_t type, braceLevel, line, column;
+   std::string name;
+   boost::uint32_t paramCount;
+   if (!pReader->read(&type) ||
+       !pReader->read(&name) ||
+       !pReader->readCount(&paramCount))
+   {
+      return false;
+   }
+
+   std::vector<RS4MethodParam> signature;
+   for (boost::uint32_t i = 0; i < paramCount; i++)
+   {
+      std::string paramName, paramType;
+      if (!pReader->read(&paramName) || !pReader->read(&paramType))
+         return false;
+      signature.push_back(RS4MethodParam(paramName, paramType));
+   }
+
+   if (!pReader->read(&braceLevel) ||
+       !pReader->read(&line) ||
+       !pReader->read(&column))
+   {
+      return false;
+   }
+
+   *pItem = RSourceItem(type, name, signature, braceLevel, line, column);
+   return true;
+}
+
+bool readEntry(Reader* pReader,
+               std::string* pPath,
+               RSourceIndexCache::Entry* pEntry)
+{
+   boost::uint64_t size;
+   boost::int64_t lastWriteTime;
+   std::string context;
+   boost::uint32_t itemCount;
+   if (!pReader->read(pPath) ||
+       !pReader->read(&size) ||
+       !pReader->read(&lastWriteTime) ||
+       !pReader->read(&pEntry->contentHash) ||
+       !pReader->read(&context) ||
+       !pReader->readCount(&itemCount))
+   {
+      return false;
+   }
+
+   pEntry->size = size;
+   pEntry->lastWriteTime = static_cast<std::time_t>(lastWriteTime);
+
+   std::vector<RSourceItem> items(itemCount);
+   for (boost::uint32_t i = 0; i < itemCount; i++)
+   {
+      if (!readItem(pReader, &items[i]))
+         return false;
+   }
+
+   boost::uint32_t packageCount;
+   if (!pReader->readCount(&packageCount))
+      return false;
+
+   std::vector<std::string> packages(packageCount);
+   for (boost::uint32_t i = 0; i < packageCount; i++)
+   {
+      if (!pReader->read(&packages[i]))
+         return false;
+   }
+
+   pEntry->pIndex.reset(new RSourceIndex(context, items, packages, false));
+   return true;
+}
+
+} // anonymous namespace
+
+boost::uint32_t RSourceIndexCache::contentHash(const std::string& code)
+{
+   boost::crc_32_type crc;
+   crc.process_bytes(code.data(), code.size());
+   return crc.checksum();
+}
+
+Error RSourceIndexCache::read(const FilePath& cacheFile)
+{
+   entries_.clear();
+   if (!cacheFile.exists() || cacheFile.size() == 0)
+      return Success();
+
+   boost::iostreams::mapped_file_source file;
+   try
+   {
+      file.open(cacheFile.absolutePathNative());
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", cacheFile);
+      return error;
+   }
+
+   Reader reader(file.data(), file.data() + file.size());
+   boost::uint32_t magic, version, count;
+   if (!reader.read(&magic) || magic != kCacheMagic ||
+       !reader.read(&version) || version != kCacheVersion ||
+       !reader.readCount(&count))
+   {
+      return Success();
+   }
+
+   for (boost::uint32_t i = 0; i < count; i++)
+   {
+      std::string path;
+      Entry entry;
+      if (!readEntry(&reader, &path, &entry))
+      {
+         entries_.clear();
+         return Success();
+      }
+      entries_[path] = entry;
+   }
+
+   if (!reader.atEnd())
+      entries_.clear();
+
+   return Success();
+}
+
+Error RSourceIndexCache::write(const FilePath& cacheFile) const
+{
+   Error error = cacheFile.parent().ensureDirectory();
+   if (error)
+      return error;
+
+   FilePath tempPath = cacheFile.parent().complete(
+            cacheFile.filename() + "." + core::system::generateShortenedUuid());
+
+   {
+      boost::shared_ptr<std::ostream> pStream;
+      error = tempPath.open_w(&pStream);
+      if (error)
+         return error;
+      std::ostream& ostr = *pStream;
+
+      writeValue(ostr, kCacheMagic);
+      writeValue(ostr, kCacheVersion);
+      writeValue(ostr, static_cast<boost::uint32_t>(entries_.size()));
+      for (std::map<std::string, Entry>::const_iterator it = entries_.begin();
+           it != entries_.end();
+           ++it)
+      {
+         const Entry& entry = it->second;
+         writeString(ostr, it->first);
+         writeValue(ostr, static_cast<boost::uint64_t>(entry.size));
+         writeValue(ostr, static_cast<boost::int64_t>(entry.lastWriteTime));
+         writeValue(ostr, entry.contentHash);
+         writeString(ostr, entry.pIndex->context());
+
+         const std::vector<RSourceItem>& items = entry.pIndex->items();
+         writeValue(ostr, static_cast<boost::uint32_t>(items.size()));
+         BOOST_FOREACH(const RSourceItem& item, items)
+         {
+            writeItem(ostr, item);
+         }
+
+         const std::vector<std::string>& packages =
+                                    entry.pIndex->getInferredPackages();
+         writeValue(ostr, static_cast<boost::uint32_t>(packages.size()));
+         BOOST_FOREACH(const std::string& package, packages)
+         {
+            writeString(ostr, package);
+         }
+      }
+
+      ostr.flush();
+      if (!ostr.good())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", tempPath);
+         tempPath.removeIfExists();
+         return error;
+      }
+   }
+
+   error = tempPath.move(cacheFile);
+   if (error)
+      tempPath.removeIfExists();
+   return error;
+}
+
+const RSourceIndexCache::Entry* RSourceIndexCache::find(
+                                       const FileInfo& fileInfo) const
+{
+   std::map<std::string, Entry>::const_iterator it =
+                                    entries_.find(fileInfo.absolutePath());
+   if (it == entries_.end() ||
+       it->second.size != fileInfo.size() ||
+       it->second.lastWriteTime != fileInfo.lastWriteTime())
+   {
+      return NULL;
+   }
+
+   return &it->second;
+}
+
+const RSourceIndexCache::Entry* RSourceIndexCache::find(
+                                       const FileInfo& fileInfo,
+                                       boost::uint32_t contentHash) const
+{
+   std::map<std::string, Entry>::const_iterator it =
+                                    entries_.find(fileInfo.absolutePath());
+   if (it == entries_.end() ||
+       it->second.size != fileInfo.size() ||
+       it->second.contentHash != contentHash)
+   {
+      return NULL;
+   }
+
+   return &it->second;
+}
+
+void RSourceIndexCache::insert(const FileInfo& fileInfo,
+                               boost::uint32_t contentHash,
+                               const boost::shared_ptr<RSourceIndex>& pIndex)
+{
+   Entry& entry = entries_[fileInfo.absolutePath()];
+   entry.size = fileInfo.size();
+   entry.lastWriteTime = fileInfo.lastWriteTime();
+   entry.contentHash = contentHash;
+   entry.pIndex = pIndex;
+}
+
+void RSourceIndexCache::remove(const std::string& path)
+{
+   entries_.erase(path);
+
+   std::string prefix = path + "/";
+   std::map<std::string, Entry>::iterator it = entries_.lower_bound(prefix);
+   while (it != entries_.end() && boost::algorithm::starts_with(it->first, prefix))
+      entries_.erase(it++);
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
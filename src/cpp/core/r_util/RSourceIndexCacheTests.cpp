@@ -0,0 +1,158 @@
+/*
+ * RSourceIndexCacheTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceIndexCache.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/r_util/RSourceIndex.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+using namespace r_util;
+
+namespace {
+
+const char* const kCode =
+      "library(dplyr)\n"
+      "setGeneric(\"area\", function(shape) standardGeneric(\"area\"))\n"
+      "setMethod(\"area\", signature(shape = \"Circle\"), function(shape) pi)\n"
+      "f <- function(x) {\n"
+      "   g <- function(y) y\n"
+      "}\n";
+
+boost::shared_ptr<RSourceIndex> index(const std::string& code)
+{
+   return boost::shared_ptr<RSourceIndex>(new RSourceIndex("~/a.R", code, false));
+}
+
+bool sameItems(const RSourceIndex& lhs, const RSourceIndex& rhs)
+{
+   if (lhs.items().size() != rhs.items().size())
+      return false;
+
+   for (std::size_t i = 0; i < lhs.items().size(); i++)
+   {
+      const RSourceItem& l = lhs.items()[i];
+      const RSourceItem& r = rhs.items()[i];
+      if (l.type() != r.type() || l.name() != r.name() ||
+          l.braceLevel() != r.braceLevel() ||
+          l.line() != r.line() || l.column() != r.column() ||
+          l.signature().size() != r.signature().size())
+      {
+         return false;
+      }
+
+      for (std::size_t j = 0; j < l.signature().size(); j++)
+      {
+         if (l.signature()[j].name() != r.signature()[j].name() ||
+             l.signature()[j].type() != r.signature()[j].type())
+         {
+            return false;
+         }
+      }
+   }
+
+   return lhs.getInferredPackages() == rhs.getInferredPackages();
+}
+
+} // anonymous namespace
+
+TEST_CASE("RSourceIndexCache")
+{
+   FilePath cacheFile;
+   REQUIRE_FALSE(FilePath::tempFilePath(&cacheFile));
+
+   FileInfo file("/project/R/a.R", false, 200, 1000);
+   boost::uint32_t hash = RSourceIndexCache::contentHash(kCode);
+   boost::shared_ptr<RSourceIndex> pIndex = index(kCode);
+   REQUIRE(pIndex->items().size() >= 3);
+
+   SECTION("Entries round trip through the cache file")
+   {
+      RSourceIndexCache cache;
+      cache.insert(file, hash, pIndex);
+      REQUIRE_FALSE(cache.write(cacheFile));
+
+      RSourceIndexCache loaded;
+      REQUIRE_FALSE(loaded.read(cacheFile));
+      REQUIRE(loaded.size() == 1);
+
+      const RSourceIndexCache::Entry* pEntry = loaded.find(file);
+      REQUIRE(pEntry != NULL);
+      CHECK(pEntry->contentHash == hash);
+      CHECK(pEntry->pIndex->context() == "~/a.R");
+      CHECK(sameItems(*pEntry->pIndex, *pIndex));
+   }
+
+   SECTION("Entries are keyed by size and modification time, or content")
+   {
+      RSourceIndexCache cache;
+      cache.insert(file, hash, pIndex);
+
+      FileInfo touched("/project/R/a.R", false, 200, 2000);
+      CHECK(cache.find(touched) == NULL);
+      CHECK(cache.find(touched, hash) != NULL);
+      CHECK(cache.find(touched, RSourceIndexCache::contentHash("f <- 1\n")) == NULL);
+
+      FileInfo resized("/project/R/a.R", false, 201, 1000);
+      CHECK(cache.find(resized) == NULL);
+      CHECK(cache.find(resized, hash) == NULL);
+
+      FileInfo other("/project/R/b.R", false, 200, 1000);
+      CHECK(cache.find(other) == NULL);
+   }
+
+   SECTION("Removing a directory removes the files beneath it")
+   {
+      RSourceIndexCache cache;
+      cache.insert(file, hash, pIndex);
+      cache.insert(FileInfo("/project/R-old/b.R", false, 200, 1000), hash, pIndex);
+      cache.remove("/project/R");
+      CHECK(cache.find(file) == NULL);
+      CHECK(cache.size() == 1);
+   }
+
+   SECTION("Missing and corrupt cache files read as empty")
+   {
+      RSourceIndexCache cache;
+      REQUIRE_FALSE(cache.read(cacheFile));
+      CHECK(cache.size() == 0);
+
+      cache.insert(file, hash, pIndex);
+      REQUIRE_FALSE(cache.write(cacheFile));
+
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(cacheFile, &contents));
+      REQUIRE_FALSE(writeStringToFile(cacheFile,
+                                      contents.substr(0, contents.size() - 2)));
+
+      RSourceIndexCache loaded;
+      REQUIRE_FALSE(loaded.read(cacheFile));
+      CHECK(loaded.size() == 0);
+   }
+
+   cacheFile.removeIfExists();
+}
+
+} // namespace tests
+} // namespace core
+} // namespace rstudio
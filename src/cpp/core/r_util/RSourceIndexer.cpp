@@ -0,0 +1,221 @@
+/*
+ * RSourceIndexer.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceIndexer.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Thread.hpp>
+#include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceIndexCache.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+struct IndexedFile
+{
+   IndexedFile() : generation(0), cached(false), contentHash(0) {}
+
+   std::string path;
+   boost::uint64_t generation;
+   boost::shared_ptr<RSourceIndex> pIndex;
+   Error error;
+   bool cached;
+   boost::uint32_t contentHash;
+};
+
+boost::shared_ptr<RSourceIndex> fromCache(
+                                    const std::string& context,
+                                    const RSourceIndexCache::Entry& entry)
+{
+   return boost::shared_ptr<RSourceIndex>(
+            new RSourceIndex(context,
+                             entry.pIndex->items(),
+                             entry.pIndex->getInferredPackages(),
+                             false));
+}
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+} // anonymous namespace
+
+// state shared with the worker threads (which may outlive the indexer)
+struct RSourceIndexer::Shared
+{
+   Shared() : indexed(true) {}
+
+   thread::ThreadsafeQueue<IndexedFile> indexed;
+   thread::ThreadsafeValue<bool> cancelled;
+
+   static void indexFile(boost::shared_ptr<Shared> pShared,
+                         const FileInfo& fileInfo,
+                         boost::uint64_t generation,
+                         const std::string& context,
+                         const CodeReader& readCode,
+                         boost::shared_ptr<const RSourceIndexCache> pCache)
+   {
+      if (pShared->cancelled.get())
+         return;
+
+      IndexedFile file;
+      file.path = fileInfo.absolutePath();
+      file.generation = generation;
+
+      // unchanged since cached?
+      const RSourceIndexCache::Entry* pEntry =
+                              pCache ? pCache->find(fileInfo) : NULL;
+
+      if (!pEntry)
+      {
+         std::string code;
+         file.error = readCode(&code);
+         if (file.error)
+         {
+            pShared->indexed.enque(file);
+            return;
+         }
+
+         // changed contents since cached?
+         file.contentHash = RSourceIndexCache::contentHash(code);
+         pEntry = pCache ? pCache->find(fileInfo, file.contentHash) : NULL;
+         if (!pEntry)
+            file.pIndex.reset(new RSourceIndex(context, code, false));
+      }
+
+      if (pEntry)
+      {
+         file.pIndex = fromCache(context, *pEntry);
+         file.contentHash = pEntry->contentHash;
+         file.cached = true;
+      }
+
+      pShared->indexed.enque(file);
+   }
+};
+
+RSourceIndexer::RSourceIndexer(thread::ThreadPool* pPool)
+   : pPool_(pPool), pShared_(new Shared()), nextGeneration_(0)
+{
+}
+
+RSourceIndexer::~RSourceIndexer()
+{
+   // workers skip any of our files which they haven't yet started
+   pShared_->cancelled.set(true);
+}
+
+void RSourceIndexer::enque(const std::string& path,
+                           const std::string& context,
+                           const CodeReader& readCode)
+{
+   enque(FileInfo(path, false),
+         context,
+         readCode,
+         boost::shared_ptr<const RSourceIndexCache>());
+}
+
+void RSourceIndexer::enque(const FileInfo& fileInfo,
+                           const std::string& context,
+                           const CodeReader& readCode,
+                           const boost::shared_ptr<const RSourceIndexCache>& pCache)
+{
+   const std::string& path = fileInfo.absolutePath();
+   if (!pending())
+   {
+      progress_ = Progress();
+      startTime_ = now();
+   }
+
+   // a later request for the same file supersedes an earlier one
+   boost::uint64_t generation = ++nextGeneration_;
+   if (generations_.count(path) == 0)
+      progress_.queued++;
+   generations_[path] = generation;
+   progress_.pending = generations_.size();
+
+   pPool_->enque(boost::bind(Shared::indexFile,
+                             pShared_,
+                             fileInfo,
+                             generation,
+                             context,
+                             readCode,
+                             pCache));
+}
+
+void RSourceIndexer::remove(const std::string& path)
+{
+   if (generations_.erase(path))
+      progress_.queued--;
+
+   std::string prefix = path + "/";
+   std::map<std::string, boost::uint64_t>::iterator it =
+                                       generations_.lower_bound(prefix);
+   while (it != generations_.end() &&
+          boost::algorithm::starts_with(it->first, prefix))
+   {
+      generations_.erase(it++);
+      progress_.queued--;
+   }
+   progress_.pending = generations_.size();
+}
+
+void RSourceIndexer::collect(std::vector<Result>* pResults)
+{
+   std::size_t collected = 0;
+   IndexedFile file;
+   while (pShared_->indexed.deque(&file))
+   {
+      // ignore indexes which have since been superseded (or removed)
+      std::map<std::string, boost::uint64_t>::iterator it =
+                                          generations_.find(file.path);
+      if (it == generations_.end() || it->second != file.generation)
+         continue;
+      generations_.erase(it);
+
+      if (file.pIndex)
+         file.pIndex->shareInferredPackages();
+
+      Result result;
+      result.path = file.path;
+      result.pIndex = file.pIndex;
+      result.error = file.error;
+      result.cached = file.cached;
+      result.contentHash = file.contentHash;
+      pResults->push_back(result);
+
+      progress_.indexed++;
+      if (file.cached)
+         progress_.cached++;
+      collected++;
+   }
+
+   progress_.pending = generations_.size();
+
+   // (elapsed stops advancing once everything has been indexed)
+   if (collected > 0 || pending())
+      progress_.elapsed = now() - startTime_;
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,255 @@
+/*
+ * RSourceIndexerTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceIndexer.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceIndexCache.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+using namespace r_util;
+
+namespace {
+
+Error readString(const std::string& code, std::string* pCode)
+{
+   *pCode = code;
+   return Success();
+}
+
+Error readFailure(std::string* pCode)
+{
+   return systemError(boost::system::errc::no_such_file_or_directory,
+                      ERROR_LOCATION);
+}
+
+RSourceIndexer::CodeReader codeReader(const std::string& code)
+{
+   return boost::bind(readString, code, _1);
+}
+
+// collect until everything enqueued has been indexed
+std::vector<RSourceIndexer::Result> collectAll(RSourceIndexer* pIndexer)
+{
+   std::vector<RSourceIndexer::Result> results;
+   for (int i = 0; i < 1000 && pIndexer->pending(); i++)
+   {
+      pIndexer->collect(&results);
+      if (pIndexer->pending())
+         boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+   }
+   return results;
+}
+
+bool indexesFunction(const RSourceIndexer::Result& result,
+                     const std::string& name)
+{
+   if (!result.pIndex)
+      return false;
+
+   BOOST_FOREACH(const RSourceItem& item, result.pIndex->items())
+   {
+      if (item.isFunction() && item.name() == name)
+         return true;
+   }
+   return false;
+}
+
+// a project of many files each defining a handful of functions
+std::string syntheticFile(int index)
+{
+   std::string code;
+   for (int i = 0; i < 20; i++)
+   {
+      std::string name = "fn" + safe_convert::numberToString(index) +
+                         "_" + safe_convert::numberToString(i);
+      code += name + " <- function(data, n = 10, ...) {\n";
+      code += "   library(stats)\n";
+      code += "   value <- data[[n]] * 2\n";
+      code += "   if (is.na(value)) value <- mean(data, na.rm = TRUE)\n";
+      code += "   list(value = value, total = sum(data))\n";
+      code += "}\n";
+   }
+   return code;
+}
+
+} // anonymous namespace
+
+TEST_CASE("RSourceIndexer")
+{
+   thread::ThreadPool pool(2);
+
+   SECTION("Files are indexed off the main thread")
+   {
+      RSourceIndexer indexer(&pool);
+      indexer.enque("/project/a.R", "~/project/a.R", codeReader("a <- function() {}\n"));
+      indexer.enque("/project/b.R", "~/project/b.R", codeReader("b <- function() {}\n"));
+      CHECK(indexer.pending());
+      CHECK(indexer.progress().queued == 2);
+
+      std::vector<RSourceIndexer::Result> results = collectAll(&indexer);
+      REQUIRE(results.size() == 2);
+      CHECK_FALSE(indexer.pending());
+
+      for (std::size_t i = 0; i < results.size(); i++)
+      {
+         CHECK_FALSE(results[i].error);
+         if (results[i].path == "/project/a.R")
+         {
+            CHECK(results[i].pIndex->context() == "~/project/a.R");
+            CHECK(indexesFunction(results[i], "a"));
+         }
+         else
+         {
+            CHECK(indexesFunction(results[i], "b"));
+         }
+      }
+
+      CHECK(indexer.progress().indexed == 2);
+      CHECK(indexer.progress().pending == 0);
+   }
+
+   SECTION("Only the latest request for a file is collected")
+   {
+      RSourceIndexer indexer(&pool);
+      indexer.enque("/project/a.R", "a.R", codeReader("old <- function() {}\n"));
+      indexer.enque("/project/a.R", "a.R", codeReader("new <- function() {}\n"));
+      CHECK(indexer.progress().queued == 1);
+
+      std::vector<RSourceIndexer::Result> results = collectAll(&indexer);
+      REQUIRE(results.size() == 1);
+      CHECK(indexesFunction(results[0], "new"));
+      CHECK_FALSE(indexesFunction(results[0], "old"));
+   }
+
+   SECTION("Removed files are not collected")
+   {
+      RSourceIndexer indexer(&pool);
+      indexer.enque("/project/R/a.R", "a.R", codeReader("a <- function() {}\n"));
+      indexer.enque("/project/R-old/b.R", "b.R", codeReader("b <- function() {}\n"));
+      indexer.enque("/project/c.R", "c.R", codeReader("c <- function() {}\n"));
+      indexer.remove("/project/R");
+      indexer.remove("/project/c.R");
+      CHECK(indexer.progress().queued == 1);
+
+      std::vector<RSourceIndexer::Result> results = collectAll(&indexer);
+      REQUIRE(results.size() == 1);
+      CHECK(results[0].path == "/project/R-old/b.R");
+
+      // let the discarded work drain
+      pool.stop();
+      results.clear();
+      indexer.collect(&results);
+      CHECK(results.empty());
+   }
+
+   SECTION("Unchanged files are recreated from the cache")
+   {
+      std::string code = "cached <- function() {}\n";
+      boost::shared_ptr<RSourceIndexCache> pCache(new RSourceIndexCache());
+      pCache->insert(FileInfo("/project/a.R", false, 100, 1000),
+                     RSourceIndexCache::contentHash(code),
+                     boost::shared_ptr<RSourceIndex>(new RSourceIndex("a.R", code)));
+
+      RSourceIndexer indexer(&pool);
+
+      // unchanged: not even read
+      indexer.enque(FileInfo("/project/a.R", false, 100, 1000), "~/a.R",
+                    readFailure, pCache);
+      std::vector<RSourceIndexer::Result> results = collectAll(&indexer);
+      REQUIRE(results.size() == 1);
+      CHECK(results[0].cached);
+      CHECK(results[0].pIndex->context() == "~/a.R");
+      CHECK(indexesFunction(results[0], "cached"));
+      CHECK(indexer.progress().cached == 1);
+
+      // touched, but with the same contents
+      indexer.enque(FileInfo("/project/a.R", false, 100, 2000), "~/a.R",
+                    codeReader(code), pCache);
+      results = collectAll(&indexer);
+      REQUIRE(results.size() == 1);
+      CHECK(results[0].cached);
+
+      // changed
+      std::string changed = "changed <- function() {}\n";
+      indexer.enque(FileInfo("/project/a.R", false, 100, 3000), "~/a.R",
+                    codeReader(changed), pCache);
+      results = collectAll(&indexer);
+      REQUIRE(results.size() == 1);
+      CHECK_FALSE(results[0].cached);
+      CHECK(results[0].contentHash == RSourceIndexCache::contentHash(changed));
+      CHECK(indexesFunction(results[0], "changed"));
+      CHECK(indexer.progress().cached == 0);
+   }
+
+   SECTION("Read errors are reported")
+   {
+      RSourceIndexer indexer(&pool);
+      indexer.enque("/project/missing.R", "missing.R", readFailure);
+
+      std::vector<RSourceIndexer::Result> results = collectAll(&indexer);
+      REQUIRE(results.size() == 1);
+      CHECK(results[0].error);
+      CHECK_FALSE(results[0].pIndex);
+   }
+}
+
+// run with the [.benchmark] tag to measure time-to-fully-indexed
+TEST_CASE("RSourceIndexer throughput", "[.benchmark]")
+{
+   const int fileCount = 2000;
+   std::vector<std::string> files;
+   for (int i = 0; i < fileCount; i++)
+      files.push_back(syntheticFile(i));
+
+   boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+   for (int i = 0; i < fileCount; i++)
+      RSourceIndex index("file.R", files[i]);
+   boost::posix_time::time_duration serial =
+         boost::posix_time::microsec_clock::universal_time() - start;
+
+   thread::ThreadPool pool;
+   RSourceIndexer indexer(&pool);
+   for (int i = 0; i < fileCount; i++)
+   {
+      std::string path = "/project/R/file" + safe_convert::numberToString(i) + ".R";
+      indexer.enque(path, path, codeReader(files[i]));
+   }
+   std::vector<RSourceIndexer::Result> results = collectAll(&indexer);
+   CHECK(results.size() == static_cast<std::size_t>(fileCount));
+
+   std::cerr << "Indexed " << fileCount << " files in "
+             << indexer.progress().elapsed.total_milliseconds() << "ms on "
+             << pool.threadCount() << " threads (serially: "
+             << serial.total_milliseconds() << "ms)" << std::endl;
+}
+
+} // namespace tests
+} // namespace core
+} // namespace rstudio
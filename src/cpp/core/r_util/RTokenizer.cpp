@@ -13,24 +13,9 @@
  *
  */
 
-// A very low level assertion (line 595 of cpp_regex_traits.hpp) is firing
-// on WindowsXP when we create a boost::wregex within R session. This code
-// is part of boost attempting to detect the sort syntax, and the assertion
-// is that there are no nulls in a buffer after a call to locale->transform.
-// Within the same method there are workarounds for both borland c++ and
-// dinkumware c++ std library to strip embedded nulls, so it seems as if
-// there is some variation in whether nulls come out of the call to transforn.
-// Note also that boost has a macro titled BOOST_REGEX_NO_WIN32 which we are
-// not using, which means that boost regex does call into native windows APIs
-// for locale oriented functions (thus explaining a difference in runtime
-// behavior across platforms). Tokenization appears to continue to work
-// correctly in the presence of the assertion (with the annoying side effect
-// of logging an assertion every time the product starts up)
-
 #include <core/r_util/RTokenizer.hpp>
 
-#include <boost/regex.hpp>
-
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -38,6 +23,13 @@
 #include <core/Log.hpp>
 #include <core/StringUtils.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64)
+# define RSTUDIO_TOKENIZER_SSE2
+# include <emmintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
 
 namespace rstudio {
 namespace core {
@@ -45,37 +37,234 @@ namespace r_util {
 
 namespace {
 
-class TokenPatterns
+// character classes of the ascii range (everything else is looked up
+// individually); this replaces the regular expressions used previously
+enum CharClass
 {
-private:
-   friend TokenPatterns& tokenPatterns();
-   TokenPatterns()
-      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
-        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
-        USER_OPERATOR(L"%[^%]*%"),
-        QUOTED_IDENTIFIER(L"`[^`]*`"),
-        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
-        WHITESPACE(L"[\\s\x00A0\x3000]+"),
-        COMMENT(L"#[^\\n]*$")
+   kDigit      = 1 << 0,
+   kHexDigit   = 1 << 1,
+   kWhitespace = 1 << 2,
+   kIdentifier = 1 << 3
+};
+
+class CharClassTable
+{
+public:
+   CharClassTable()
    {
+      std::fill(classes_, classes_ + 128, 0);
+      for (int ch = '0'; ch <= '9'; ch++)
+         classes_[ch] |= kDigit | kHexDigit;
+      for (int ch = 'a'; ch <= 'f'; ch++)
+         classes_[ch] |= kHexDigit;
+      for (int ch = 'A'; ch <= 'F'; ch++)
+         classes_[ch] |= kHexDigit;
+
+      for (int ch = 0; ch < 128; ch++)
+         if (string_utils::isalnum(static_cast<wchar_t>(ch)))
+            classes_[ch] |= kIdentifier;
+      classes_[static_cast<int>('.')] |= kIdentifier;
+      classes_[static_cast<int>('_')] |= kIdentifier;
+
+      // the characters matched by \s in the "C" locale
+      const char whitespace[] = { ' ', '\t', '\n', '\v', '\f', '\r' };
+      for (std::size_t i = 0; i < sizeof(whitespace); i++)
+         classes_[static_cast<int>(whitespace[i])] |= kWhitespace;
    }
 
-public:
-   const boost::wregex NUMBER;
-   const boost::wregex HEX_NUMBER;
-   const boost::wregex USER_OPERATOR;
-   const boost::wregex QUOTED_IDENTIFIER;
-   const boost::wregex UNTIL_END_QUOTE;
-   const boost::wregex WHITESPACE;
-   const boost::wregex COMMENT;
+   bool is(wchar_t ch, int charClass) const
+   {
+      return ch >= 0 && ch < 128 && (classes_[ch] & charClass);
+   }
+
+private:
+   unsigned char classes_[128];
 };
 
-TokenPatterns& tokenPatterns()
+const CharClassTable& charClasses()
 {
-   static TokenPatterns instance;
+   static CharClassTable instance;
    return instance;
 }
 
+inline bool isDigit(wchar_t ch)
+{
+   return ch >= L'0' && ch <= L'9';
+}
+
+// characters which can continue an identifier
+inline bool isIdentifierChar(const CharClassTable& classes, wchar_t ch)
+{
+   if (ch >= 0 && ch < 128)
+      return classes.is(ch, kIdentifier);
+   return string_utils::isalnum(ch);
+}
+
+inline bool isWhitespace(const CharClassTable& classes, wchar_t ch)
+{
+   return classes.is(ch, kWhitespace) || ch == L'\x00A0' || ch == L'\x3000';
+}
+
+#ifdef RSTUDIO_TOKENIZER_SSE2
+
+// wide characters per 16 byte block
+const std::size_t kBlockChars = 16 / sizeof(wchar_t);
+
+inline __m128i broadcast(wchar_t ch)
+{
+   return sizeof(wchar_t) == 2 ? _mm_set1_epi16(static_cast<short>(ch))
+                               : _mm_set1_epi32(static_cast<int>(ch));
+}
+
+inline unsigned int equalMask(const wchar_t* pos, __m128i needle)
+{
+   __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+   __m128i result = sizeof(wchar_t) == 2 ? _mm_cmpeq_epi16(block, needle)
+                                         : _mm_cmpeq_epi32(block, needle);
+   return static_cast<unsigned int>(_mm_movemask_epi8(result));
+}
+
+inline std::size_t firstSetByte(unsigned int mask)
+{
+# ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward(&index, mask);
+   return index;
+# else
+   return __builtin_ctz(mask);
+# endif
+}
+
+#endif
+
+// find the first newline in [pos, end)
+std::wstring::const_iterator findNewline(std::wstring::const_iterator pos,
+                                         std::wstring::const_iterator end)
+{
+#ifdef RSTUDIO_TOKENIZER_SSE2
+   const __m128i newline = broadcast(L'\n');
+   while (static_cast<std::size_t>(end - pos) >= kBlockChars)
+   {
+      unsigned int mask = equalMask(&*pos, newline);
+      if (mask != 0)
+         return pos + firstSetByte(mask) / sizeof(wchar_t);
+      pos += kBlockChars;
+   }
+#endif
+
+   return std::find(pos, end, L'\n');
+}
+
+// length of the run of whitespace at pos ([\s\x00A0\x3000]+)
+std::size_t whitespaceLength(std::wstring::const_iterator pos,
+                             std::wstring::const_iterator end)
+{
+   const CharClassTable& classes = charClasses();
+   std::wstring::const_iterator it = pos;
+   while (it != end)
+   {
+#ifdef RSTUDIO_TOKENIZER_SSE2
+      // indentation is mostly runs of spaces: skip them a block at a time
+      const __m128i space = broadcast(L' ');
+      while (static_cast<std::size_t>(end - it) >= kBlockChars)
+      {
+         unsigned int mask = equalMask(&*it, space);
+         if (mask != 0xFFFF)
+         {
+            it += firstSetByte(~mask & 0xFFFF) / sizeof(wchar_t);
+            break;
+         }
+         it += kBlockChars;
+      }
+      if (it == end)
+         break;
+#endif
+
+      if (!isWhitespace(classes, *it))
+         break;
+      ++it;
+   }
+
+   return it - pos;
+}
+
+// length of the comment at pos (#[^\n]*$). as with the regular expression
+// this was previously matched with, a comment on a line ending in \r\n
+// does not include the \r
+std::size_t commentLength(std::wstring::const_iterator pos,
+                          std::wstring::const_iterator end)
+{
+   std::wstring::const_iterator newline = findNewline(pos + 1, end);
+   if (newline != end && newline - pos > 1 && *(newline - 1) == L'\r')
+      --newline;
+   return newline - pos;
+}
+
+// length of the number at pos, either hexadecimal (0x[0-9a-fA-F]*L?) or
+// decimal ([0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?)
+std::size_t numberLength(std::wstring::const_iterator pos,
+                         std::wstring::const_iterator end)
+{
+   const CharClassTable& classes = charClasses();
+   std::wstring::const_iterator it = pos;
+
+   if (end - it >= 2 && *it == L'0' && *(it + 1) == L'x')
+   {
+      it += 2;
+      while (it != end && classes.is(*it, kHexDigit))
+         ++it;
+      if (it != end && *it == L'L')
+         ++it;
+      return it - pos;
+   }
+
+   while (it != end && isDigit(*it))
+      ++it;
+
+   if (it != end && *it == L'.')
+   {
+      ++it;
+      while (it != end && isDigit(*it))
+         ++it;
+   }
+
+   if (it != end && (*it == L'e' || *it == L'E'))
+   {
+      ++it;
+      if (it != end && (*it == L'+' || *it == L'-'))
+         ++it;
+      while (it != end && isDigit(*it))
+         ++it;
+   }
+
+   if (it != end && (*it == L'L' || *it == L'i'))
+      ++it;
+
+   return it - pos;
+}
+
+// length of a token delimited by the character at pos (e.g. `name` or
+// %op%), or 0 if the closing delimiter is missing
+std::size_t delimitedLength(std::wstring::const_iterator pos,
+                            std::wstring::const_iterator end)
+{
+   std::wstring::const_iterator close = std::find(pos + 1, end, *pos);
+   return close == end ? 0 : (close - pos) + 1;
+}
+
+// find the next character which may end a string literal
+std::wstring::const_iterator findStringSpecial(std::wstring::const_iterator pos,
+                                               std::wstring::const_iterator end)
+{
+   for (; pos != end; ++pos)
+   {
+      wchar_t ch = *pos;
+      if (ch == L'\\' || ch == L'\'' || ch == L'"')
+         break;
+   }
+   return pos;
+}
+
 void updatePosition(std::wstring::const_iterator pos,
                     std::size_t length,
                     std::size_t* pRow,
@@ -99,6 +288,38 @@ void updatePosition(std::wstring::const_iterator pos,
    }
 }
 
+// the tokenizer looks at most this many characters past the end of a token
+// when deciding where that token ends (e.g. to tell '<' from '<<-')
+const std::size_t kTokenizerLookahead = 4;
+
+// track open brackets the way RTokenizer::nextToken does
+void updateBraceStack(const RToken& token, std::vector<char>* pBraceStack)
+{
+   switch (token.type())
+   {
+   case RToken::LBRACKET:
+   case RToken::LDBRACKET:
+      pBraceStack->push_back(static_cast<char>(token.type()));
+      break;
+   case RToken::RBRACKET:
+   case RToken::RDBRACKET:
+      if (!pBraceStack->empty())
+         pBraceStack->pop_back();
+      break;
+   default:
+      break;
+   }
+}
+
+// an unmatched '`' or '%' is tokenized as an error only after searching the
+// rest of the document for a matching delimiter, so an edit anywhere after
+// it can change how it is tokenized
+bool isUnmatchedDelimiter(const RToken& token)
+{
+   return token.isType(RToken::ERR) &&
+          (token.contentEquals(L'`') || token.contentEquals(L'%'));
+}
+
 } // anonymous namespace
 
 RToken RTokenizer::nextToken()
@@ -214,7 +435,7 @@ RToken RTokenizer::nextToken()
 
 RToken RTokenizer::matchWhitespace()
 {
-   return consumeToken(RToken::WHITESPACE, tokenLength(tokenPatterns().WHITESPACE));
+   return consumeToken(RToken::WHITESPACE, whitespaceLength(pos_, end_));
 }
 
 RToken RTokenizer::matchStringLiteral()
@@ -224,7 +445,7 @@ RToken RTokenizer::matchStringLiteral()
 
    while (!eol())
    {
-      eatUntil(tokenPatterns().UNTIL_END_QUOTE);
+      pos_ = findStringSpecial(pos_, end_);
 
       if (eol())
          break ;
@@ -259,27 +480,24 @@ RToken RTokenizer::matchStringLiteral()
    // (because they will be sliced when copied). If we need the well
    // formed flag we can just add it onto RToken.
    return RToken(RToken::STRING,
-                 start,
-                 pos_,
-                 start - data_.begin(),
+                 &buffer_,
+                 start - begin_,
+                 pos_ - start,
                  row,
                  column);
 }
 
 RToken RTokenizer::matchNumber()
 {
-   std::size_t length = tokenLength(tokenPatterns().HEX_NUMBER);
-   if (length == 0)
-      length = tokenLength(tokenPatterns().NUMBER);
-
-   return consumeToken(RToken::NUMBER, length);
+   return consumeToken(RToken::NUMBER, numberLength(pos_, end_));
 }
 
 RToken RTokenizer::matchIdentifier()
 {
    std::wstring::const_iterator start = pos_ ;
+   const CharClassTable& classes = charClasses();
    eat();
-   while (string_utils::isalnum(peek()) || peek() == L'.' || peek() == L'_')
+   while (pos_ != end_ && isIdentifierChar(classes, *pos_))
       eat();
    
    std::size_t row = row_;
@@ -287,16 +505,16 @@ RToken RTokenizer::matchIdentifier()
    updatePosition(start, pos_ - start, &row_, &column_);
    
    return RToken(RToken::ID,
-                 start,
-                 pos_,
-                 start - data_.begin(),
+                 &buffer_,
+                 start - begin_,
+                 pos_ - start,
                  row,
                  column);
 }
 
 RToken RTokenizer::matchQuotedIdentifier()
 {
-   std::size_t length = tokenLength(tokenPatterns().QUOTED_IDENTIFIER);
+   std::size_t length = delimitedLength(pos_, end_);
    if (length == 0)
       return consumeToken(RToken::ERR, 1);
    else
@@ -305,12 +523,12 @@ RToken RTokenizer::matchQuotedIdentifier()
 
 RToken RTokenizer::matchComment()
 {
-   return consumeToken(RToken::COMMENT, tokenLength(tokenPatterns().COMMENT));
+   return consumeToken(RToken::COMMENT, commentLength(pos_, end_));
 }
 
 RToken RTokenizer::matchUserOperator()
 {
-   std::size_t length = tokenLength(tokenPatterns().USER_OPERATOR);
+   std::size_t length = delimitedLength(pos_, end_);
    if (length == 0)
       return consumeToken(RToken::ERR, 1);
    else
@@ -379,7 +597,7 @@ RToken RTokenizer::matchOperator()
 
 bool RTokenizer::eol()
 {
-   return pos_ >= data_.end();
+   return pos_ >= end_;
 }
 
 wchar_t RTokenizer::peek()
@@ -389,7 +607,7 @@ wchar_t RTokenizer::peek()
 
 wchar_t RTokenizer::peek(std::size_t lookahead)
 {
-   if ((pos_ + lookahead) >= data_.end())
+   if ((pos_ + lookahead) >= end_)
       return 0 ;
    else
       return *(pos_ + lookahead) ;
@@ -402,33 +620,6 @@ wchar_t RTokenizer::eat()
    return result ;
 }
 
-std::size_t RTokenizer::tokenLength(const boost::wregex& regex)
-{
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   boost::match_flag_type flg = boost::match_default | boost::match_continuous;
-   if (regex_utils::search(pos_, end, match, regex, flg))
-      return match.length();
-   else
-      return 0;
-}
-
-void RTokenizer::eatUntil(const boost::wregex& regex)
-{
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   if (regex_utils::search(pos_, end, match, regex))
-   {
-      pos_ = match[0].first;
-   }
-   else
-   {
-      // eat all on failure to match
-      pos_ = data_.end();
-   }
-}
-
-
 RToken RTokenizer::consumeToken(RToken::TokenType tokenType,
                                 std::size_t length)
 {
@@ -437,7 +628,7 @@ RToken RTokenizer::consumeToken(RToken::TokenType tokenType,
       LOG_WARNING_MESSAGE("Can't create zero-length token");
       return RToken();
    }
-   else if ((pos_ + length) > data_.end())
+   else if ((pos_ + length) > end_)
    {
       LOG_WARNING_MESSAGE("Premature EOF");
       return RToken();
@@ -453,54 +644,205 @@ RToken RTokenizer::consumeToken(RToken::TokenType tokenType,
    std::wstring::const_iterator start = pos_ ;
    pos_ += length ;
    return RToken(tokenType,
-                 start,
-                 pos_,
-                 start - data_.begin(),
+                 &buffer_,
+                 start - begin_,
+                 length,
                  row,
                  column);
 }
 
-class ConversionCache
+void RTokenizer::seek(std::size_t offset,
+                      std::size_t row,
+                      std::size_t column,
+                      const std::vector<char>& braceStack)
 {
-public:
+   pos_ = begin_ + std::min(offset, static_cast<std::size_t>(end_ - begin_));
+   row_ = row;
+   column_ = column;
+   braceStack_ = braceStack;
+}
+
+RTokens::RTokens(const std::wstring& code, const RTokens& previous, int flags)
+   : tokenizer_(code),
+     flags_(flags),
+     damageBegin_(0),
+     damageEnd_(0),
+     previousDamageEnd_(0)
+{
+   const std::wstring& previousCode = previous.code();
+   const Tokens& previousTokens = previous.tokens_;
+   
+   // tokens can only be reused if they were filtered in the same way
+   bool reuse = flags == previous.flags_ && !previousTokens.empty();
    
-   typedef std::wstring key_type;
-   typedef std::string mapped_type;
+   // find the edited region: everything before and after it is unchanged
+   std::size_t n = std::min(code.size(), previousCode.size());
+   std::size_t prefix = std::mismatch(code.begin(),
+                                      code.begin() + n,
+                                      previousCode.begin()).first - code.begin();
    
-   bool contains(const RToken& token) const
+   std::size_t suffix = 0;
+   while (suffix < n - prefix &&
+          code[code.size() - suffix - 1] ==
+          previousCode[previousCode.size() - suffix - 1])
    {
-      return database_.count(token.content());
+      ++suffix;
    }
    
-   std::string& get(const RToken& token)
+   std::size_t editEnd = code.size() - suffix;
+   std::ptrdiff_t offsetDelta =
+         static_cast<std::ptrdiff_t>(code.size()) -
+         static_cast<std::ptrdiff_t>(previousCode.size());
+   
+   // restart tokenization at the last token far enough ahead of the edit
+   // that the tokens before it can't have been influenced by it
+   std::size_t restart = 0;
+   if (reuse)
    {
-      return database_[token.content()];
+      while (restart + 1 < previousTokens.size() &&
+             previousTokens[restart + 1].offset() + kTokenizerLookahead <= prefix)
+      {
+         ++restart;
+      }
+      
+      for (std::size_t i = 0; i < restart; ++i)
+      {
+         if (isUnmatchedDelimiter(previousTokens[i]))
+         {
+            restart = i;
+            break;
+         }
+      }
+      
+      if (previousTokens[restart].column() >= RToken::kMaxColumn)
+         restart = 0;
    }
    
-   void put(const RToken& token, const mapped_type& value)
+   // copy the tokens preceding the restart point, tracking the brackets
+   // left open by them
+   std::vector<char> braceStack;
+   tokens_.reserve(previousTokens.size());
+   for (std::size_t i = 0; i < restart; ++i)
    {
-      database_[token.content()] = value;
+      const RToken& token = previousTokens[i];
+      tokens_.push_back(rebase(token));
+      updateBraceStack(token, &braceStack);
    }
    
-private:
-   std::map<key_type, mapped_type> database_;
-};
+   if (restart > 0)
+   {
+      const RToken& token = previousTokens[restart];
+      tokenizer_.seek(token.offset(), token.row(), token.column(), braceStack);
+   }
+   
+   damageBegin_ = restart;
+   
+   // re-tokenize until we're back in step with the previous tokens: that
+   // is, past the edit at the start of a previous token, with the same
+   // brackets open
+   std::size_t previousIndex = restart;
+   std::vector<char> previousBraceStack = braceStack;
+   while (true)
+   {
+      std::size_t offset = tokenizer_.offset();
+      if (reuse && offset >= editEnd)
+      {
+         std::size_t previousOffset = offset - offsetDelta;
+         while (previousIndex < previousTokens.size() &&
+                previousTokens[previousIndex].offset() < previousOffset)
+         {
+            updateBraceStack(previousTokens[previousIndex], &previousBraceStack);
+            ++previousIndex;
+         }
+         
+         if (previousIndex < previousTokens.size() &&
+             previousTokens[previousIndex].offset() == previousOffset &&
+             previousTokens[previousIndex].column() < RToken::kMaxColumn &&
+             previousBraceStack == tokenizer_.braceStack())
+         {
+            const RToken& resync = previousTokens[previousIndex];
+            std::ptrdiff_t rowDelta =
+                  static_cast<std::ptrdiff_t>(tokenizer_.row()) -
+                  static_cast<std::ptrdiff_t>(resync.row());
+            std::ptrdiff_t columnDelta =
+                  static_cast<std::ptrdiff_t>(tokenizer_.column()) -
+                  static_cast<std::ptrdiff_t>(resync.column());
+            
+            damageEnd_ = size();
+            previousDamageEnd_ = previousIndex;
+            
+            // only tokens on the same row as the edit move horizontally
+            for (std::size_t i = previousIndex; i < previousTokens.size(); ++i)
+            {
+               const RToken& token = previousTokens[i];
+               tokens_.push_back(rebase(
+                        token,
+                        offsetDelta,
+                        rowDelta,
+                        token.row() == resync.row() ? columnDelta : 0));
+            }
+            
+            return;
+         }
+      }
+      
+      RToken token = tokenizer_.nextToken();
+      if (!token)
+         break;
+      
+      if (accept(token))
+         push_back(token);
+   }
+   
+   damageEnd_ = size();
+   previousDamageEnd_ = previousTokens.size();
+}
 
-ConversionCache& conversionCache()
+RToken RTokens::rebase(const RToken& token,
+                       std::ptrdiff_t offsetDelta,
+                       std::ptrdiff_t rowDelta,
+                       std::ptrdiff_t columnDelta) const
 {
-   static ConversionCache instance;
+   return RToken(token.type(),
+                 &tokenizer_.buffer(),
+                 token.offset() + offsetDelta,
+                 token.length(),
+                 token.row() + rowDelta,
+                 token.column() + columnDelta);
+}
+
+const std::size_t RToken::kMaxColumn;
+
+const std::wstring& RToken::emptyData()
+{
+   static const std::wstring instance;
    return instance;
 }
 
 const std::string& RToken::contentAsUtf8() const
 {
-   ConversionCache& cache = conversionCache();
-   if (cache.contains(*this))
-      return cache.get(*this);
-   
-   std::string result = string_utils::wideToUtf8(content());
-   cache.put(*this, result);
-   return cache.get(*this);
+   if (pBuffer_ == NULL)
+   {
+      static const std::string empty;
+      return empty;
+   }
+
+   return pBuffer_->utf8(offset_, length_);
+}
+
+const std::string& RTokenBuffer::utf8(boost::uint32_t offset,
+                                      boost::uint32_t length) const
+{
+   // tokens are identified by their offset within the buffer
+   boost::unordered_map<boost::uint32_t, std::string>::iterator it =
+         utf8_.find(offset);
+   if (it != utf8_.end())
+      return it->second;
+
+   std::string& result = utf8_[offset];
+   result = string_utils::wideToUtf8(
+            std::wstring(data_.begin() + offset, data_.begin() + offset + length));
+   return result;
 }
 
 std::string RToken::asString() const
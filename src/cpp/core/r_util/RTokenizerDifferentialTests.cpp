@@ -0,0 +1,583 @@
+/*
+ * RTokenizerDifferentialTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RTokenizer.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/StringUtils.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+struct TokenRecord
+{
+   int type;
+   std::size_t offset;
+   std::size_t length;
+   std::size_t row;
+   std::size_t column;
+
+   bool operator==(const TokenRecord& other) const
+   {
+      return type == other.type && offset == other.offset &&
+             length == other.length && row == other.row &&
+             column == other.column;
+   }
+};
+
+// the regular expression driven tokenizer which RTokenizer replaced,
+// kept as a reference implementation for differential testing
+class ReferenceTokenizer
+{
+public:
+   explicit ReferenceTokenizer(const std::wstring& data)
+      : data_(data), pos_(data_.begin()), row_(0), column_(0),
+        number_(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
+        hexNumber_(L"0x[0-9a-fA-F]*L?"),
+        userOperator_(L"%[^%]*%"),
+        quotedIdentifier_(L"`[^`]*`"),
+        untilEndQuote_(L"[\\\\\'\"]"),
+        whitespace_(L"[\\s\x00A0\x3000]+"),
+        comment_(L"#[^\\n]*$")
+   {
+   }
+
+   std::vector<TokenRecord> tokenize()
+   {
+      std::vector<TokenRecord> tokens;
+      while (pos_ < data_.end())
+      {
+         TokenRecord token = nextToken();
+         if (token.length == 0)
+            break;
+         tokens.push_back(token);
+      }
+      return tokens;
+   }
+
+private:
+   TokenRecord nextToken()
+   {
+      wchar_t c = peek(0);
+      switch (c)
+      {
+      case L'(': return consume(RToken::LPAREN, 1);
+      case L')': return consume(RToken::RPAREN, 1);
+      case L'{': return consume(RToken::LBRACE, 1);
+      case L'}': return consume(RToken::RBRACE, 1);
+      case L';': return consume(RToken::SEMI, 1);
+      case L',': return consume(RToken::COMMA, 1);
+      case L'[':
+         if (peek(1) == L'[')
+         {
+            braceStack_.push_back(RToken::LDBRACKET);
+            return consume(RToken::LDBRACKET, 2);
+         }
+         braceStack_.push_back(RToken::LBRACKET);
+         return consume(RToken::LBRACKET, 1);
+      case L']':
+      {
+         if (braceStack_.empty())
+            return peek(1) == L']' ? consume(RToken::RDBRACKET, 2)
+                                   : consume(RToken::RBRACKET, 1);
+         TokenRecord token;
+         if (peek(1) == L']' && braceStack_.back() == RToken::LDBRACKET)
+            token = consume(RToken::RDBRACKET, 2);
+         else
+            token = consume(RToken::RBRACKET, 1);
+         braceStack_.pop_back();
+         return token;
+      }
+      case L'"':
+      case L'\'':
+         return matchString();
+      case L'`':
+      {
+         std::size_t length = tokenLength(quotedIdentifier_);
+         return length == 0 ? consume(RToken::ERR, 1) : consume(RToken::ID, length);
+      }
+      case L'#':
+         return consume(RToken::COMMENT, tokenLength(comment_));
+      case L'%':
+      {
+         std::size_t length = tokenLength(userOperator_);
+         return length == 0 ? consume(RToken::ERR, 1) : consume(RToken::UOPER, length);
+      }
+      case L' ': case L'\t': case L'\r': case L'\n':
+      case L'\x00A0': case L'\x3000':
+         return consume(RToken::WHITESPACE, tokenLength(whitespace_));
+      }
+
+      wchar_t cNext = peek(1);
+      if ((c >= L'0' && c <= L'9') || (c == L'.' && cNext >= L'0' && cNext <= L'9'))
+      {
+         std::size_t length = tokenLength(hexNumber_);
+         if (length == 0)
+            length = tokenLength(number_);
+         if (length > 0)
+            return consume(RToken::NUMBER, length);
+      }
+
+      if (string_utils::isalnum(c) || c == L'.')
+      {
+         std::size_t length = 1;
+         while (string_utils::isalnum(peek(length)) ||
+                peek(length) == L'.' || peek(length) == L'_')
+            length++;
+         return consume(RToken::ID, length);
+      }
+
+      std::size_t length = operatorLength();
+      if (length > 0)
+         return consume(RToken::OPER, length);
+
+      return consume(RToken::ERR, 1);
+   }
+
+   std::size_t operatorLength()
+   {
+      wchar_t cNext = peek(1);
+      wchar_t cNextNext = peek(2);
+      switch (peek(0))
+      {
+      case L':':
+         return cNext == L'=' ? 2 : 1 + (cNext == L':') + (cNextNext == L':');
+      case L'|': return cNext == L'|' ? 2 : 1;
+      case L'&': return cNext == L'&' ? 2 : 1;
+      case L'<':
+         if (cNext == L'=' || cNext == L'-')
+            return 2;
+         else if (cNext == L'<')
+            return cNextNext == L'-' ? 3 : (cNext == L'>' ? (cNextNext == L'>' ? 3 : 2) : 1);
+         return 1;
+      case L'-':
+         return cNext == L'>' ? (cNextNext == L'>' ? 3 : 2) : 1;
+      case L'*': return cNext == L'*' ? 2 : 1;
+      case L'+': case L'/': case L'?': case L'^': case L'~': case L'$': case L'@':
+         return 1;
+      case L'>': case L'=': case L'!':
+         return cNext == L'=' ? 2 : 1;
+      default:
+         return 0;
+      }
+   }
+
+   TokenRecord matchString()
+   {
+      std::wstring::const_iterator start = pos_;
+      wchar_t quot = *pos_++;
+      while (pos_ < data_.end())
+      {
+         boost::wsmatch match;
+         std::wstring::const_iterator end = data_.end();
+         if (boost::regex_search(pos_, end, match, untilEndQuote_))
+            pos_ = match[0].first;
+         else
+            pos_ = data_.end();
+
+         if (pos_ >= data_.end())
+            break;
+
+         wchar_t c = *pos_++;
+         if (c == quot)
+            break;
+         if (c == L'\\' && pos_ < data_.end())
+            ++pos_;
+      }
+
+      TokenRecord token = { RToken::STRING,
+                            static_cast<std::size_t>(start - data_.begin()),
+                            static_cast<std::size_t>(pos_ - start),
+                            row_, column_ };
+      advance(start, pos_ - start);
+      return token;
+   }
+
+   std::size_t tokenLength(const boost::wregex& regex)
+   {
+      boost::wsmatch match;
+      std::wstring::const_iterator end = data_.end();
+      if (boost::regex_search(pos_, end, match, regex,
+                              boost::match_default | boost::match_continuous))
+         return match.length();
+      return 0;
+   }
+
+   TokenRecord consume(int type, std::size_t length)
+   {
+      if (length == 0 || pos_ + length > data_.end())
+      {
+         TokenRecord empty = { RToken::ERR, 0, 0, 0, 0 };
+         pos_ = data_.end();
+         return empty;
+      }
+
+      TokenRecord token = { type,
+                            static_cast<std::size_t>(pos_ - data_.begin()),
+                            length, row_, column_ };
+      advance(pos_, length);
+      pos_ += length;
+      return token;
+   }
+
+   void advance(std::wstring::const_iterator pos, std::size_t length)
+   {
+      std::size_t newlineCount;
+      std::wstring::const_iterator it =
+            string_utils::countNewlines(pos, pos + length, &newlineCount);
+      if (newlineCount == 0)
+      {
+         column_ += length;
+      }
+      else
+      {
+         row_ += newlineCount;
+         column_ = length - (it - pos) - 1;
+      }
+   }
+
+   wchar_t peek(std::size_t lookahead)
+   {
+      return pos_ + lookahead >= data_.end() ? 0 : *(pos_ + lookahead);
+   }
+
+   std::wstring data_;
+   std::wstring::const_iterator pos_;
+   std::size_t row_;
+   std::size_t column_;
+   std::vector<int> braceStack_;
+
+   boost::wregex number_;
+   boost::wregex hexNumber_;
+   boost::wregex userOperator_;
+   boost::wregex quotedIdentifier_;
+   boost::wregex untilEndQuote_;
+   boost::wregex whitespace_;
+   boost::wregex comment_;
+};
+
+std::vector<TokenRecord> tokenize(const std::wstring& code)
+{
+   std::vector<TokenRecord> tokens;
+   RTokenizer tokenizer(code);
+   while (RToken token = tokenizer.nextToken())
+   {
+      TokenRecord record = { token.type(), token.offset(), token.length(),
+                             token.row(), token.column() };
+      tokens.push_back(record);
+   }
+   return tokens;
+}
+
+void printToken(const std::vector<TokenRecord>& tokens, std::size_t i)
+{
+   if (i >= tokens.size())
+   {
+      std::cerr << "<end>";
+      return;
+   }
+
+   const TokenRecord& token = tokens[i];
+   std::cerr << "{type " << token.type << ", offset " << token.offset
+             << ", length " << token.length << ", row " << token.row
+             << ", column " << token.column << "}";
+}
+
+bool tokenizesIdentically(const std::wstring& code)
+{
+   std::vector<TokenRecord> expected = ReferenceTokenizer(code).tokenize();
+   std::vector<TokenRecord> actual = tokenize(code);
+   if (expected == actual)
+      return true;
+
+   std::size_t i = 0;
+   while (i < expected.size() && i < actual.size() && expected[i] == actual[i])
+      i++;
+   std::cerr << "Token streams differ at token " << i << ": expected ";
+   printToken(expected, i);
+   std::cerr << ", got ";
+   printToken(actual, i);
+   std::cerr << std::endl;
+   return false;
+}
+
+// the R sources within the repository (located relative to this file)
+std::vector<FilePath> bundledRSources()
+{
+   std::vector<FilePath> sources;
+   FilePath srcDir = FilePath(__FILE__).parent().parent().parent();
+   const char* dirs[] = { "r/R", "session/modules", "tests/testthat" };
+   for (std::size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++)
+   {
+      std::vector<FilePath> children;
+      FilePath dir = srcDir.childPath(dirs[i]);
+      if (!dir.exists() || dir.children(&children))
+         continue;
+
+      BOOST_FOREACH(const FilePath& child, children)
+      {
+         if (child.extensionLowerCase() == ".r")
+            sources.push_back(child);
+      }
+   }
+   return sources;
+}
+
+std::wstring readCode(const FilePath& filePath)
+{
+   std::string contents;
+   Error error = readStringFromFile(filePath, &contents);
+   if (error)
+      return std::wstring();
+   return string_utils::utf8ToWide(contents);
+}
+
+std::vector<TokenRecord> records(const RTokens& rTokens)
+{
+   std::vector<TokenRecord> tokens;
+   BOOST_FOREACH(const RToken& token, rTokens)
+   {
+      TokenRecord record = { token.type(), token.offset(), token.length(),
+                             token.row(), token.column() };
+      tokens.push_back(record);
+   }
+   return tokens;
+}
+
+// re-tokenize a sequence of edits of some code incrementally, checking the
+// tokens against those produced by tokenizing each revision from scratch
+bool retokenizesIdentically(const std::vector<std::wstring>& revisions, int flags)
+{
+   boost::shared_ptr<RTokens> pTokens(new RTokens(revisions[0], flags));
+   for (std::size_t i = 1; i < revisions.size(); i++)
+   {
+      boost::shared_ptr<RTokens> pNext(new RTokens(revisions[i], *pTokens, flags));
+      std::vector<TokenRecord> expected = records(RTokens(revisions[i], flags));
+      std::vector<TokenRecord> actual = records(*pNext);
+      if (expected != actual)
+      {
+         std::size_t j = 0;
+         while (j < expected.size() && j < actual.size() && expected[j] == actual[j])
+            j++;
+         std::cerr << "Token streams differ after edit " << i << " at token "
+                   << j << ": expected ";
+         printToken(expected, j);
+         std::cerr << ", got ";
+         printToken(actual, j);
+         std::cerr << std::endl;
+         return false;
+      }
+      pTokens = pNext;
+   }
+   return true;
+}
+
+std::wstring randomEdit(const std::wstring& code,
+                        const wchar_t* alphabet,
+                        std::size_t alphabetSize)
+{
+   std::size_t start = code.empty() ? 0 : std::rand() % (code.size() + 1);
+   std::size_t removed = std::min(static_cast<std::size_t>(std::rand() % 4),
+                                  code.size() - start);
+   std::wstring inserted;
+   int length = std::rand() % 4;
+   for (int i = 0; i < length; i++)
+      inserted.push_back(alphabet[std::rand() % alphabetSize]);
+
+   std::wstring edited = code;
+   edited.replace(start, removed, inserted);
+   return edited;
+}
+
+} // anonymous namespace
+
+TEST_CASE("RTokenizer matches the reference tokenizer")
+{
+   SECTION("Edge cases")
+   {
+      const wchar_t* cases[] = {
+         L"# comment\r\nx <- 1",
+         L"#\r\n#\n#",
+         L"# a\r\r\nb",
+         L"# trailing \r",
+         L"x\v\f\r\n \t\x00A0\x3000 y",
+         L"                                        x",
+         L"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t  \n\n\n\n\n\n\n\n\n\n\n\n\n\n\nz",
+         L"0x 0x1fL 0X1 0xZ 1e 1e+ 1.e-3L .5i 1.2.3 12L3 007 1e5e5",
+         L"`unterminated",
+         L"`a b`c %in% %unterminated\nx",
+         L"\"unterminated \\\"string",
+         L"'esc \\' quote' \"a\\\\\" 'multi\nline'",
+         L"a[[b[1]]][c[[2]]]]]",
+         L"x <<- y ->> z <= a >= b != c == d && e || f :: g ::: h := i",
+         L"\x00E9t\x00E9 <- \"caf\x00E9\" # \x65E5\x672C\n",
+         L"",
+         L"\n",
+         L"#"
+      };
+
+      for (std::size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+         CHECK(tokenizesIdentically(cases[i]));
+   }
+
+   SECTION("Random input")
+   {
+      const wchar_t alphabet[] = L" \t\r\n\v\f#'\"`%\\[]{}()0123456789.eExXLiabc_<->=!:&|*+/^~$@?,;\x00A0\x3000\x00E9";
+      std::size_t alphabetSize = sizeof(alphabet) / sizeof(wchar_t) - 1;
+
+      std::srand(42);
+      for (int i = 0; i < 2000; i++)
+      {
+         std::wstring code;
+         int length = std::rand() % 64;
+         for (int j = 0; j < length; j++)
+            code.push_back(alphabet[std::rand() % alphabetSize]);
+
+         if (!tokenizesIdentically(code))
+         {
+            FAIL("token streams differ for random input " << i);
+         }
+      }
+   }
+
+   SECTION("Bundled R sources")
+   {
+      std::vector<FilePath> sources = bundledRSources();
+      BOOST_FOREACH(const FilePath& source, sources)
+      {
+         INFO(source.absolutePath());
+         CHECK(tokenizesIdentically(readCode(source)));
+      }
+   }
+}
+
+TEST_CASE("RTokens can be re-tokenized incrementally after an edit")
+{
+   const wchar_t alphabet[] = L" \t\r\n#'\"`%\\[]{}()019.eLab_<->=!:&|,;\x00E9";
+   std::size_t alphabetSize = sizeof(alphabet) / sizeof(wchar_t) - 1;
+   const int flags[] = { RTokens::None, RTokens::StripComments };
+
+   SECTION("Edits are located and only their region is re-tokenized")
+   {
+      RTokens before(L"x <- 1\ny <- foo[[1]]\nz <- 3\n");
+      RTokens after(L"x <- 1\ny <- foo[[12]]\nz <- 3\n", before);
+
+      REQUIRE(after.size() == before.size());
+      CHECK(after.damageBegin() > 0);
+      CHECK(after.damageEnd() < after.size());
+      CHECK(after.previousDamageEnd() == after.damageEnd());
+      CHECK(after.at(after.size() - 2).contentEquals(L"3"));
+      CHECK(after.at(after.size() - 2).offset() ==
+            before.at(before.size() - 2).offset() + 1);
+
+      RTokens inserted(L"x <- 1\nw <- 2\ny <- foo[[1]]\nz <- 3\n", before);
+      const RToken& z = inserted.at(inserted.size() - 6);
+      CHECK(z.contentEquals(L"z"));
+      CHECK(z.row() == 3);
+      CHECK(z.column() == 0);
+   }
+
+   SECTION("Random edits of random input")
+   {
+      std::srand(42);
+      for (int i = 0; i < 2000; i++)
+      {
+         std::vector<std::wstring> revisions;
+         std::wstring code;
+         int length = std::rand() % 48;
+         for (int j = 0; j < length; j++)
+            code.push_back(alphabet[std::rand() % alphabetSize]);
+
+         revisions.push_back(code);
+         for (int j = 0; j < 4; j++)
+            revisions.push_back(randomEdit(revisions.back(), alphabet, alphabetSize));
+
+         for (std::size_t j = 0; j < sizeof(flags) / sizeof(flags[0]); j++)
+         {
+            if (!retokenizesIdentically(revisions, flags[j]))
+            {
+               FAIL("token streams differ for random input " << i);
+            }
+         }
+      }
+   }
+
+   SECTION("Random edits of bundled R sources")
+   {
+      std::srand(7);
+      BOOST_FOREACH(const FilePath& source, bundledRSources())
+      {
+         INFO(source.absolutePath());
+         std::vector<std::wstring> revisions;
+         revisions.push_back(readCode(source));
+         for (int j = 0; j < 8; j++)
+            revisions.push_back(randomEdit(revisions.back(), alphabet, alphabetSize));
+
+         for (std::size_t j = 0; j < sizeof(flags) / sizeof(flags[0]); j++)
+            CHECK(retokenizesIdentically(revisions, flags[j]));
+      }
+   }
+}
+
+// run with the [.benchmark] tag to compare throughput
+TEST_CASE("RTokenizer throughput", "[.benchmark]")
+{
+   std::wstring code;
+   BOOST_FOREACH(const FilePath& source, bundledRSources())
+   {
+      code.append(readCode(source));
+   }
+   REQUIRE(!code.empty());
+
+   const int iterations = 10;
+   std::size_t tokenCount = 0;
+
+   boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+      tokenCount += tokenize(code).size();
+   double tokenizerSeconds =
+      (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1E6;
+
+   start = boost::posix_time::microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+      ReferenceTokenizer(code).tokenize();
+   double referenceSeconds =
+      (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1E6;
+
+   double megabytes = iterations * code.size() / (1024.0 * 1024.0);
+   std::cerr << "RTokenizer: " << megabytes / tokenizerSeconds << " M chars/s ("
+             << tokenCount / iterations << " tokens); reference: "
+             << megabytes / referenceSeconds << " M chars/s" << std::endl;
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
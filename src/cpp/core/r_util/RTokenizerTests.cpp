@@ -269,6 +269,23 @@ context("RTokenizer")
       expect_true(rTokens.at(2).isType(RToken::OPER));
       expect_true(rTokens.at(2).contentEquals(L"**"));
    }
+
+   test_that("Tokens are compact views into the tokenized code")
+   {
+      expect_true(sizeof(RToken) <= 24);
+
+      RTokens rTokens(L"f <- function(\x00E9t\x00E9) {}");
+      expect_true(rTokens.at(6).contentAsUtf8() == "\xC3\xA9t\xC3\xA9");
+      expect_true(&rTokens.at(6).contentAsUtf8() == &rTokens.at(6).contentAsUtf8());
+      expect_true(rTokens.at(6).offset() == 14);
+      expect_true(rTokens.at(6).column() == 14);
+
+      RToken empty;
+      expect_false(empty);
+      expect_true(empty.content().empty());
+      expect_true(empty.contentAsUtf8().empty());
+      expect_true(rTokens.at(100).length() == 0);
+   }
 }
 
 } // namespace r_util
@@ -0,0 +1,212 @@
+/*
+ * FuzzyMatch.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/FuzzyMatch.hpp>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+# define RSTUDIO_FUZZY_MATCH_SSE2
+# include <emmintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+// bytes of readable padding kept after the lowercase names
+const std::size_t kPadding = 16;
+
+inline char asciiLower(char ch)
+{
+   return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+inline int maskBit(unsigned char ch)
+{
+   if (ch >= 'a' && ch <= 'z')
+      return ch - 'a';
+   else if (ch >= 'A' && ch <= 'Z')
+      return ch - 'A';
+   else if (ch >= '0' && ch <= '9')
+      return 26 + (ch - '0');
+   else if (ch == '_')
+      return 36;
+   else if (ch == '.')
+      return 37;
+   else if (ch == '-')
+      return 38;
+   else
+      return 39 + (ch % 25);
+}
+
+void appendLower(const std::string& text, std::string* pLower)
+{
+   for (std::string::const_iterator it = text.begin(); it != text.end(); ++it)
+      pLower->push_back(asciiLower(*it));
+}
+
+// find the first occurrence of ch in [begin, end), or end if there is none
+inline const char* findChar(const char* begin, const char* end, char ch)
+{
+#ifdef RSTUDIO_FUZZY_MATCH_SSE2
+   const __m128i needle = _mm_set1_epi8(ch);
+   for (const char* pos = begin; pos < end; pos += 16)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+      unsigned int bits = static_cast<unsigned int>(
+               _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+      if (bits != 0)
+      {
+# ifdef _MSC_VER
+         unsigned long index;
+         _BitScanForward(&index, bits);
+# else
+         int index = __builtin_ctz(bits);
+# endif
+         const char* match = pos + index;
+         return match < end ? match : end;
+      }
+   }
+   return end;
+#else
+   const void* match = std::memchr(begin, ch, end - begin);
+   return match ? static_cast<const char*>(match) : end;
+#endif
+}
+
+} // anonymous namespace
+
+boost::uint64_t characterMask(const char* begin, const char* end)
+{
+   boost::uint64_t mask = 0;
+   for (const char* it = begin; it != end; ++it)
+      mask |= boost::uint64_t(1) << maskBit(static_cast<unsigned char>(*it));
+   return mask;
+}
+
+FuzzyQuery::FuzzyQuery(const std::string& query)
+{
+   appendLower(query, &lower_);
+   mask_ = characterMask(lower_.data(), lower_.data() + lower_.size());
+}
+
+bool FuzzyQuery::matchesLower(const char* begin,
+                              const char* end,
+                              boost::uint64_t mask) const
+{
+   if ((mask_ & ~mask) != 0)
+      return false;
+
+   if (lower_.size() > static_cast<std::size_t>(end - begin))
+      return false;
+
+   const char* pos = begin;
+   for (std::string::const_iterator it = lower_.begin(); it != lower_.end(); ++it)
+   {
+      pos = findChar(pos, end, *it);
+      if (pos == end)
+         return false;
+      ++pos;
+   }
+
+   return true;
+}
+
+bool FuzzyQuery::matches(const std::string& text) const
+{
+   std::string lower;
+   lower.reserve(text.size() + kPadding);
+   appendLower(text, &lower);
+   std::size_t size = lower.size();
+   lower.append(kPadding, '\0');
+
+   const char* begin = lower.data();
+   return matchesLower(begin,
+                       begin + size,
+                       characterMask(begin, begin + size));
+}
+
+NameTable::NameTable()
+{
+   clear();
+}
+
+boost::uint32_t NameTable::add(const std::string& name)
+{
+   boost::uint32_t id = static_cast<boost::uint32_t>(masks_.size());
+
+   names_.append(name);
+
+   std::string lower;
+   lower.reserve(name.size());
+   appendLower(name, &lower);
+   lower_.insert(lower_.size() - kPadding, lower);
+
+   offsets_.push_back(static_cast<boost::uint32_t>(names_.size()));
+   masks_.push_back(characterMask(lower.data(), lower.data() + lower.size()));
+
+   return id;
+}
+
+void NameTable::reserve(std::size_t count, std::size_t bytes)
+{
+   names_.reserve(bytes);
+   lower_.reserve(bytes + kPadding);
+   offsets_.reserve(count + 1);
+   masks_.reserve(count);
+}
+
+void NameTable::clear()
+{
+   names_.clear();
+   lower_.assign(kPadding, '\0');
+   offsets_.assign(1, 0);
+   masks_.clear();
+}
+
+std::string NameTable::name(boost::uint32_t id) const
+{
+   return names_.substr(offsets_[id], offsets_[id + 1] - offsets_[id]);
+}
+
+void NameTable::findMatches(const FuzzyQuery& query,
+                            std::vector<boost::uint32_t>* pIds) const
+{
+   const char* lower = lower_.data();
+   const boost::uint64_t queryMask = query.mask();
+   for (std::size_t i = 0, n = masks_.size(); i < n; i++)
+   {
+      // cheap rejection before looking at the name itself
+      if ((queryMask & ~masks_[i]) != 0)
+         continue;
+
+      if (query.matchesLower(lower + offsets_[i],
+                             lower + offsets_[i + 1],
+                             masks_[i]))
+      {
+         pIds->push_back(static_cast<boost::uint32_t>(i));
+      }
+   }
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,98 @@
+/*
+ * FuzzyMatchTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/FuzzyMatch.hpp>
+
+#include <core/StringUtils.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+TEST_CASE("FuzzyMatch")
+{
+   SECTION("Queries match case insensitive subsequences")
+   {
+      text::FuzzyQuery query("rSI");
+      CHECK(query.matches("RSourceIndex.cpp"));
+      CHECK(query.matches("rsi"));
+      CHECK_FALSE(query.matches("sir"));
+      CHECK_FALSE(query.matches("rs"));
+      CHECK(text::FuzzyQuery("").matches("anything"));
+   }
+
+   SECTION("Matching agrees with string_utils::isSubsequence")
+   {
+      const char* names[] = {
+         "SessionCodeSearch.cpp", "read.csv", "dplyr_filter",
+         "a", "", "this_is_a_rather_long_function_name_exceeding_sixteen",
+         "RcppExports.R", "zzz"
+      };
+      const char* queries[] = {
+         "scs", "csv", "filter", "A", "x", "longsixteen", "rcppexp", "zzzz",
+         "this_is_a_rather_long_function_name_exceeding_sixteen"
+      };
+
+      text::NameTable table;
+      for (std::size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+         table.add(names[i]);
+      REQUIRE(table.size() == sizeof(names) / sizeof(names[0]));
+
+      for (std::size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+      {
+         text::FuzzyQuery query(queries[i]);
+         std::vector<boost::uint32_t> ids;
+         table.findMatches(query, &ids);
+
+         std::vector<boost::uint32_t> expected;
+         for (std::size_t j = 0; j < sizeof(names) / sizeof(names[0]); j++)
+         {
+            CHECK(table.name(static_cast<boost::uint32_t>(j)) == names[j]);
+            if (string_utils::isSubsequence(names[j], queries[i], true))
+               expected.push_back(static_cast<boost::uint32_t>(j));
+         }
+         CHECK(ids == expected);
+      }
+   }
+
+   SECTION("Only the best scoring matches are retained")
+   {
+      text::BestMatches<std::string> best(3);
+      best.push(5, "e");
+      best.push(1, "a");
+      best.push(3, "c");
+      best.push(1, "b");
+      best.push(9, "z");
+      best.push(2, "x");
+
+      std::vector<std::pair<int, std::string> > sorted = best.sorted();
+      REQUIRE(sorted.size() == 3);
+      CHECK(sorted[0].second == "a");
+      CHECK(sorted[1].second == "b");
+      CHECK(sorted[2].second == "x");
+      CHECK(best.pushedCount() == 6);
+
+      text::BestMatches<int> none(0);
+      none.push(1, 1);
+      CHECK(none.sorted().empty());
+   }
+}
+
+} // end namespace tests
+} // end namespace core
+} // end namespace rstudio
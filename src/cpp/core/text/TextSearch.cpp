@@ -0,0 +1,747 @@
+/*
+ * TextSearch.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TextSearch.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Log.hpp>
+#include <core/RegexUtils.hpp>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+# define RSTUDIO_TEXT_SEARCH_SSE2
+# include <emmintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+// grep considers a file binary if a NUL appears in its first buffer
+const std::size_t kBinaryCheckLength = 32768;
+
+inline char asciiLower(char ch)
+{
+   return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+inline bool isAsciiAlpha(char ch)
+{
+   return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+inline bool isUtf8Continuation(char ch)
+{
+   return (static_cast<unsigned char>(ch) & 0xC0) == 0x80;
+}
+
+#ifdef RSTUDIO_TEXT_SEARCH_SSE2
+inline int countTrailingZeros(unsigned int value)
+{
+# ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward(&index, value);
+   return static_cast<int>(index);
+# else
+   return __builtin_ctz(value);
+# endif
+}
+#endif
+
+// remove the last character (which may be multi-byte) from a literal run;
+// used when a repetition operator makes that character optional
+void dropLastCharacter(std::string* pRun)
+{
+   while (!pRun->empty() && isUtf8Continuation(*pRun->rbegin()))
+      pRun->erase(pRun->size() - 1);
+   if (!pRun->empty())
+      pRun->erase(pRun->size() - 1);
+}
+
+void commitRun(std::string* pRun, std::string* pBest)
+{
+   if (pRun->size() > pBest->size())
+      *pBest = *pRun;
+   pRun->clear();
+}
+
+} // anonymous namespace
+
+std::string requiredLiteral(const std::string& pattern, bool ignoreCase)
+{
+   // each line of a grep pattern is a separate alternative
+   if (pattern.find('\n') != std::string::npos)
+      return std::string();
+
+   std::string best, run;
+   int groupDepth = 0;
+
+   for (std::size_t i = 0, n = pattern.size(); i < n; i++)
+   {
+      char ch = pattern[i];
+
+      if (ch == '\\' && i + 1 < n)
+      {
+         char next = pattern[++i];
+
+         // alternation means no single literal is required
+         if (next == '|')
+            return std::string();
+
+         if (std::strchr(".[]\\*^$", next))
+         {
+            if (groupDepth == 0)
+               run.push_back(next);
+         }
+         else if (next == '(')
+         {
+            commitRun(&run, &best);
+            groupDepth++;
+         }
+         else if (next == ')')
+         {
+            groupDepth = std::max(0, groupDepth - 1);
+         }
+         else if (next == '{' || next == '?')
+         {
+            dropLastCharacter(&run);
+            commitRun(&run, &best);
+            if (next == '{')
+            {
+               std::size_t close = pattern.find("\\}", i);
+               i = (close == std::string::npos) ? n : close + 1;
+            }
+         }
+         else
+         {
+            // '\+' keeps the preceding character; word boundaries, back
+            // references and character classes simply end the run
+            commitRun(&run, &best);
+         }
+      }
+      else if (ch == '*')
+      {
+         dropLastCharacter(&run);
+         commitRun(&run, &best);
+      }
+      else if (ch == '[')
+      {
+         commitRun(&run, &best);
+
+         // skip the bracket expression (a leading ']' is literal)
+         std::size_t j = i + 1;
+         if (j < n && pattern[j] == '^')
+            j++;
+         if (j < n && pattern[j] == ']')
+            j++;
+         while (j < n && pattern[j] != ']')
+         {
+            if (pattern[j] == '[' && j + 1 < n && std::strchr(":.=", pattern[j + 1]))
+            {
+               std::size_t close = pattern.find(std::string(1, pattern[j + 1]) + "]", j + 2);
+               j = (close == std::string::npos) ? n : close + 2;
+            }
+            else
+            {
+               j++;
+            }
+         }
+         i = j;
+      }
+      else if (ch == '.' || ch == '^' || ch == '$')
+      {
+         commitRun(&run, &best);
+      }
+      else if (ignoreCase && static_cast<unsigned char>(ch) >= 0x80)
+      {
+         // we only fold ascii case in the prefilter
+         commitRun(&run, &best);
+      }
+      else if (groupDepth == 0)
+      {
+         run.push_back(ch);
+      }
+   }
+   commitRun(&run, &best);
+
+   if (ignoreCase)
+      std::transform(best.begin(), best.end(), best.begin(), asciiLower);
+
+   return best;
+}
+
+TextMatcher::TextMatcher(const std::string& pattern,
+                         bool asRegex,
+                         bool ignoreCase)
+   : pattern_(pattern),
+     asRegex_(asRegex),
+     ignoreCase_(ignoreCase),
+     valid_(true)
+{
+   if (asRegex_)
+   {
+      literal_ = requiredLiteral(pattern_, ignoreCase_);
+
+      try
+      {
+         // grep defaults to basic regular expressions (with the GNU
+         // extensions for \?, \+ and \|)
+         boost::regex::flag_type flags = boost::regex::basic |
+                                         boost::regex::bk_plus_qm |
+                                         boost::regex::bk_vbar;
+         if (ignoreCase_)
+            flags |= boost::regex::icase;
+         regex_ = boost::regex(pattern_, flags);
+      }
+      catch(const std::exception& e)
+      {
+         LOG_WARNING_MESSAGE("Invalid search pattern '" + pattern_ + "': " +
+                             e.what());
+         valid_ = false;
+      }
+   }
+   else
+   {
+      if (ignoreCase_)
+      {
+         std::transform(pattern_.begin(), pattern_.end(), pattern_.begin(),
+                        asciiLower);
+
+         // the prefilter only folds ascii so use the longest ascii run
+         std::string run;
+         BOOST_FOREACH(char ch, pattern_)
+         {
+            if (static_cast<unsigned char>(ch) >= 0x80)
+               commitRun(&run, &literal_);
+            else
+               run.push_back(ch);
+         }
+         commitRun(&run, &literal_);
+      }
+      else
+      {
+         literal_ = pattern_;
+      }
+   }
+
+   // a literal spanning lines can never be found within a single line
+   if (literal_.find_first_of("\r\n") != std::string::npos)
+      literal_.clear();
+}
+
+bool TextMatcher::equalsLiteral(const char* pos) const
+{
+   const std::size_t n = literal_.size();
+   if (!ignoreCase_)
+      return std::memcmp(pos, literal_.data(), n) == 0;
+
+   for (std::size_t i = 0; i < n; i++)
+   {
+      if (asciiLower(pos[i]) != literal_[i])
+         return false;
+   }
+   return true;
+}
+
+const char* TextMatcher::nextCandidate(const char* begin, const char* end) const
+{
+   const std::size_t n = literal_.size();
+   if (n == 0)
+      return begin;
+
+   if (static_cast<std::size_t>(end - begin) < n)
+      return end;
+
+   // last position at which the literal could begin (exclusive)
+   const char* limit = end - n + 1;
+   const char* pos = begin;
+
+#ifdef RSTUDIO_TEXT_SEARCH_SSE2
+   // compare 16 positions at a time against the first and last bytes of
+   // the literal; only positions where both agree are verified in full.
+   // for case insensitive searches letters are folded by setting 0x20
+   char first = literal_[0];
+   char last = literal_[n - 1];
+   char firstFold = (ignoreCase_ && isAsciiAlpha(first)) ? 0x20 : 0;
+   char lastFold = (ignoreCase_ && isAsciiAlpha(last)) ? 0x20 : 0;
+
+   const __m128i firstValue = _mm_set1_epi8(first | firstFold);
+   const __m128i lastValue = _mm_set1_epi8(last | lastFold);
+   const __m128i firstMask = _mm_set1_epi8(firstFold);
+   const __m128i lastMask = _mm_set1_epi8(lastFold);
+
+   while (limit - pos >= 16)
+   {
+      __m128i firstBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+      __m128i lastBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos + n - 1));
+
+      __m128i firstEq = _mm_cmpeq_epi8(_mm_or_si128(firstBlock, firstMask), firstValue);
+      __m128i lastEq = _mm_cmpeq_epi8(_mm_or_si128(lastBlock, lastMask), lastValue);
+
+      unsigned int mask = static_cast<unsigned int>(
+               _mm_movemask_epi8(_mm_and_si128(firstEq, lastEq)));
+      while (mask != 0)
+      {
+         const char* candidate = pos + countTrailingZeros(mask);
+         if (equalsLiteral(candidate))
+            return candidate;
+         mask &= mask - 1;
+      }
+
+      pos += 16;
+   }
+#endif
+
+   for (; pos < limit; ++pos)
+   {
+      if (equalsLiteral(pos))
+         return pos;
+   }
+
+   return end;
+}
+
+bool TextMatcher::matchLine(
+      const char* begin,
+      const char* end,
+      std::vector<std::pair<std::size_t, std::size_t> >* pMatches) const
+{
+   if (!valid_)
+      return false;
+
+   if (!asRegex_)
+   {
+      // an empty fixed string matches every line
+      if (pattern_.empty())
+         return true;
+
+      const std::size_t n = pattern_.size();
+      bool matched = false;
+      for (const char* pos = begin; end - pos >= static_cast<std::ptrdiff_t>(n); )
+      {
+         bool equal = true;
+         for (std::size_t i = 0; i < n && equal; i++)
+            equal = (ignoreCase_ ? asciiLower(pos[i]) : pos[i]) == pattern_[i];
+
+         if (equal)
+         {
+            matched = true;
+            pMatches->push_back(std::make_pair(pos - begin, pos - begin + n));
+            pos += n;
+         }
+         else
+         {
+            ++pos;
+         }
+      }
+      return matched;
+   }
+
+   bool matched = false;
+   boost::cmatch match;
+   boost::match_flag_type flags = boost::match_default | boost::match_not_dot_newline;
+   const char* pos = begin;
+   while (pos <= end && regex_utils::search(pos, end, match, regex_, flags))
+   {
+      matched = true;
+
+      const char* matchBegin = match[0].first;
+      const char* matchEnd = match[0].second;
+      if (matchBegin == matchEnd)
+      {
+         // empty matches select the line but aren't highlighted
+         if (matchEnd == end)
+            break;
+         pos = matchEnd + 1;
+      }
+      else
+      {
+         pMatches->push_back(std::make_pair(matchBegin - begin, matchEnd - begin));
+         pos = matchEnd;
+      }
+
+      flags |= boost::match_prev_avail;
+   }
+
+   return matched;
+}
+
+bool searchBuffer(const char* begin,
+                  const char* end,
+                  const TextMatcher& matcher,
+                  std::size_t maxMatches,
+                  std::vector<LineMatch>* pMatches)
+{
+   int lineNumber = 1;
+   const char* counted = begin;
+   const char* pos = begin;
+   std::vector<std::pair<std::size_t, std::size_t> > ranges;
+
+   while (pos < end)
+   {
+      // pos is always at the start of a line
+      const char* candidate = matcher.nextCandidate(pos, end);
+      if (candidate == end)
+         break;
+
+      const char* lineBegin = candidate;
+      while (lineBegin > pos && lineBegin[-1] != '\n')
+         --lineBegin;
+
+      const char* lineEnd = static_cast<const char*>(
+               std::memchr(candidate, '\n', end - candidate));
+      if (lineEnd == NULL)
+         lineEnd = end;
+
+      ranges.clear();
+      if (matcher.matchLine(lineBegin, lineEnd, &ranges))
+      {
+         if (pMatches->size() >= maxMatches)
+            return false;
+
+         lineNumber += static_cast<int>(std::count(counted, lineBegin, '\n'));
+         counted = lineBegin;
+
+         LineMatch lineMatch;
+         lineMatch.lineNumber = lineNumber;
+         lineMatch.contents.assign(lineBegin, lineEnd);
+         lineMatch.matches = ranges;
+         pMatches->push_back(lineMatch);
+      }
+
+      pos = (lineEnd < end) ? lineEnd + 1 : end;
+   }
+
+   return true;
+}
+
+bool isBinaryContent(const char* begin, const char* end)
+{
+   std::size_t length = std::min(static_cast<std::size_t>(end - begin),
+                                 kBinaryCheckLength);
+   return std::memchr(begin, '\0', length) != NULL;
+}
+
+Error searchFile(const FilePath& filePath,
+                 const TextMatcher& matcher,
+                 std::size_t maxMatches,
+                 std::vector<LineMatch>* pMatches)
+{
+   // empty files can't be mapped (and can't match)
+   if (filePath.size() == 0)
+      return Success();
+
+   try
+   {
+      boost::iostreams::mapped_file_source file(filePath.absolutePathNative());
+      const char* begin = file.data();
+      const char* end = begin + file.size();
+
+      if (!isBinaryContent(begin, end))
+         searchBuffer(begin, end, matcher, maxMatches, pMatches);
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   return Success();
+}
+
+boost::regex globToRegex(const std::string& glob)
+{
+   std::string regex;
+   for (std::size_t i = 0, n = glob.size(); i < n; i++)
+   {
+      char ch = glob[i];
+      if (ch == '*')
+      {
+         regex.append(".*");
+      }
+      else if (ch == '?')
+      {
+         regex.push_back('.');
+      }
+      else if (ch == '[' && glob.find(']', i + 1) != std::string::npos)
+      {
+         std::size_t close = glob.find(']', i + 1);
+         std::string set = glob.substr(i + 1, close - i - 1);
+         if (!set.empty() && set[0] == '!')
+            set[0] = '^';
+         regex.append("[" + set + "]");
+         i = close;
+      }
+      else
+      {
+         if (std::strchr("\\^$.|+(){}[]", ch))
+            regex.push_back('\\');
+         regex.push_back(ch);
+      }
+   }
+
+   return boost::regex(regex);
+}
+
+namespace {
+
+bool isRegularFile(const FilePath& filePath)
+{
+#ifndef _WIN32
+   // skip devices, fifos and sockets (opening a fifo would block)
+   struct stat info;
+   if (::stat(filePath.absolutePathNative().c_str(), &info) != 0)
+      return false;
+   return S_ISREG(info.st_mode);
+#else
+   return !filePath.isDirectory();
+#endif
+}
+
+} // anonymous namespace
+
+Error listSearchableFiles(const FilePath& rootPath,
+                          const std::vector<std::string>& globs,
+                          const SearchPathFilter& filter,
+                          const SearchFileHandler& onFile)
+{
+   std::vector<boost::regex> patterns;
+   try
+   {
+      BOOST_FOREACH(const std::string& glob, globs)
+      {
+         patterns.push_back(globToRegex(glob));
+      }
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      return error;
+   }
+
+   std::vector<FilePath> pending;
+   pending.push_back(rootPath);
+   while (!pending.empty())
+   {
+      FilePath dirPath = pending.back();
+      pending.pop_back();
+
+      std::vector<FilePath> children;
+      Error error = dirPath.children(&children);
+      if (error)
+      {
+         // unreadable directories are skipped, as with grep
+         if (dirPath == rootPath)
+            return error;
+         continue;
+      }
+
+      // visit children in name order (pushing directories in reverse
+      // so that they are popped in order as well)
+      std::sort(children.begin(), children.end());
+      std::vector<FilePath> childDirs;
+      BOOST_FOREACH(const FilePath& child, children)
+      {
+         if (child.isSymlink())
+            continue;
+
+         if (filter && !filter(child))
+            continue;
+
+         if (child.isDirectory())
+         {
+            childDirs.push_back(child);
+            continue;
+         }
+
+         if (!patterns.empty())
+         {
+            std::string filename = child.filename();
+            bool matches = false;
+            BOOST_FOREACH(const boost::regex& pattern, patterns)
+            {
+               if (regex_utils::match(filename, pattern))
+               {
+                  matches = true;
+                  break;
+               }
+            }
+            if (!matches)
+               continue;
+         }
+
+         if (!isRegularFile(child))
+            continue;
+
+         if (!onFile(child))
+            return Success();
+      }
+
+      pending.insert(pending.end(), childDirs.rbegin(), childDirs.rend());
+   }
+
+   return Success();
+}
+
+boost::shared_ptr<ParallelSearch> ParallelSearch::create(
+                                    const FilePath& rootPath,
+                                    const std::vector<std::string>& globs,
+                                    const SearchPathFilter& filter,
+                                    const TextMatcher& matcher,
+                                    std::size_t maxMatches)
+{
+   return boost::shared_ptr<ParallelSearch>(
+            new ParallelSearch(rootPath, globs, filter, matcher, maxMatches));
+}
+
+ParallelSearch::ParallelSearch(const FilePath& rootPath,
+                               const std::vector<std::string>& globs,
+                               const SearchPathFilter& filter,
+                               const TextMatcher& matcher,
+                               std::size_t maxMatches)
+   : rootPath_(rootPath),
+     globs_(globs),
+     filter_(filter),
+     matcher_(matcher),
+     maxMatches_(maxMatches),
+     cancelled_(false),
+     listingComplete_(false),
+     pendingFiles_(0),
+     filesSearched_(0),
+     matchCount_(0),
+     results_(true)
+{
+}
+
+void ParallelSearch::start(thread::ThreadPool* pPool)
+{
+   pPool->enque(boost::bind(&ParallelSearch::listFiles,
+                            shared_from_this(),
+                            pPool));
+}
+
+void ParallelSearch::cancel()
+{
+   cancelled_ = true;
+}
+
+bool ParallelSearch::isStopped() const
+{
+   return cancelled_ || matchCount_ >= maxMatches_;
+}
+
+void ParallelSearch::listFiles(thread::ThreadPool* pPool)
+{
+   if (!isStopped())
+   {
+      Error error = listSearchableFiles(
+               rootPath_,
+               globs_,
+               filter_,
+               boost::bind(&ParallelSearch::enqueFile, this, pPool, _1));
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   listingComplete_ = true;
+
+   // wake up anyone waiting in case there were no files to search
+   results_.enque(boost::shared_ptr<FileMatches>());
+}
+
+bool ParallelSearch::enqueFile(thread::ThreadPool* pPool,
+                               const FilePath& filePath)
+{
+   if (isStopped())
+      return false;
+
+   pendingFiles_++;
+   pPool->enque(boost::bind(&ParallelSearch::searchFile,
+                            shared_from_this(),
+                            filePath));
+   return true;
+}
+
+void ParallelSearch::searchFile(const FilePath& filePath)
+{
+   if (!isStopped())
+   {
+      boost::shared_ptr<FileMatches> pMatches(new FileMatches());
+      pMatches->filePath = filePath;
+
+      // files which can't be read are skipped (grep only warns for these)
+      Error error = text::searchFile(filePath,
+                                     matcher_,
+                                     maxMatches_,
+                                     &pMatches->matches);
+      filesSearched_++;
+
+      if (!error && !pMatches->matches.empty())
+      {
+         matchCount_ += pMatches->matches.size();
+         results_.enque(pMatches);
+      }
+   }
+
+   // this must follow queueing of the result so that collect never sees
+   // the search as complete before its final results are available
+   if (--pendingFiles_ == 0 && listingComplete_)
+      results_.enque(boost::shared_ptr<FileMatches>());
+}
+
+bool ParallelSearch::collect(std::vector<boost::shared_ptr<FileMatches> >* pResults)
+{
+   // read completion state before draining the queue (see searchFile)
+   bool complete = listingComplete_ && pendingFiles_ == 0;
+
+   boost::shared_ptr<FileMatches> pMatches;
+   while (results_.deque(&pMatches))
+   {
+      if (pMatches)
+         pResults->push_back(pMatches);
+   }
+
+   return complete;
+}
+
+void ParallelSearch::waitForResults(const boost::posix_time::time_duration& duration)
+{
+   if (results_.isEmpty())
+      results_.wait(duration);
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,130 @@
+/*
+ * TextSearchTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TextSearch.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+namespace {
+
+std::vector<text::LineMatch> search(const std::string& contents,
+                                    const std::string& pattern,
+                                    bool asRegex,
+                                    bool ignoreCase)
+{
+   std::vector<text::LineMatch> matches;
+   text::TextMatcher matcher(pattern, asRegex, ignoreCase);
+   text::searchBuffer(contents.data(),
+                      contents.data() + contents.size(),
+                      matcher,
+                      1000,
+                      &matches);
+   return matches;
+}
+
+} // anonymous namespace
+
+TEST_CASE("TextSearch")
+{
+   SECTION("Required literals are extracted from basic regular expressions")
+   {
+      CHECK(text::requiredLiteral("foo", false) == "foo");
+      CHECK(text::requiredLiteral("ab*cdef", false) == "cdef");
+      CHECK(text::requiredLiteral("a[bc]defg.h", false) == "defg");
+      CHECK(text::requiredLiteral("x\\(abcdef\\)*yz", false) == "yz");
+      CHECK(text::requiredLiteral("abc\\|defgh", false) == "");
+      CHECK(text::requiredLiteral("a\\.bc", false) == "a.bc");
+      CHECK(text::requiredLiteral("FooBar", true) == "foobar");
+   }
+
+   SECTION("Fixed strings are found on every line, with all occurrences")
+   {
+      std::string contents = "hello world\nnothing here\nworld, world\n";
+      std::vector<text::LineMatch> matches = search(contents, "world", false, false);
+
+      REQUIRE(matches.size() == 2);
+      CHECK(matches[0].lineNumber == 1);
+      CHECK(matches[0].contents == "hello world");
+      REQUIRE(matches[0].matches.size() == 1);
+      CHECK(matches[0].matches[0].first == 6);
+      CHECK(matches[0].matches[0].second == 11);
+
+      CHECK(matches[1].lineNumber == 3);
+      REQUIRE(matches[1].matches.size() == 2);
+      CHECK(matches[1].matches[1].first == 7);
+   }
+
+   SECTION("Case insensitive searches fold ascii case")
+   {
+      // long enough lines to exercise the vectorized prefilter
+      std::string contents =
+            "the quick brown fox jumps over the lazy dog\n"
+            "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG\n"
+            "no match on this particular line at all, sorry\n";
+
+      CHECK(search(contents, "Lazy Dog", false, true).size() == 2);
+      CHECK(search(contents, "Lazy Dog", false, false).size() == 0);
+      CHECK(search(contents, "L[a-z]*Y dOG", true, true).size() == 2);
+   }
+
+   SECTION("Regular expressions use grep's basic syntax")
+   {
+      std::string contents = "f(x)\nfoo <- function(x) x\nfooo\n";
+
+      std::vector<text::LineMatch> matches = search(contents, "fo\\+", true, false);
+      REQUIRE(matches.size() == 2);
+      CHECK(matches[0].lineNumber == 2);
+      CHECK(matches[1].lineNumber == 3);
+
+      // parentheses are literal in basic regular expressions
+      matches = search(contents, "f(x)", true, false);
+      REQUIRE(matches.size() == 1);
+      CHECK(matches[0].lineNumber == 1);
+
+      matches = search(contents, "^fo*$", true, false);
+      REQUIRE(matches.size() == 1);
+      CHECK(matches[0].lineNumber == 3);
+   }
+
+   SECTION("Searches stop once the match limit is reached")
+   {
+      std::string contents = "a\na\na\na\n";
+      std::vector<text::LineMatch> matches;
+      text::TextMatcher matcher("a", false, false);
+      CHECK_FALSE(text::searchBuffer(contents.data(),
+                                     contents.data() + contents.size(),
+                                     matcher,
+                                     2,
+                                     &matches));
+      CHECK(matches.size() == 2);
+   }
+
+   SECTION("Globs are converted to regular expressions")
+   {
+      boost::regex regex = text::globToRegex("*.[Rr]");
+      CHECK(boost::regex_match(std::string("analysis.R"), regex));
+      CHECK(boost::regex_match(std::string("analysis.r"), regex));
+      CHECK_FALSE(boost::regex_match(std::string("analysis.Rmd"), regex));
+   }
+}
+
+} // end namespace tests
+} // end namespace core
+} // end namespace rstudio
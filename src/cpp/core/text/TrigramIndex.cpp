@@ -0,0 +1,509 @@
+/*
+ * TrigramIndex.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TrigramIndex.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/BinarySerializer.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/text/TextSearch.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+using namespace binary;
+
+// on disk format: header, file table, then delta encoded postings
+const boost::uint32_t kIndexMagic = 0x52535449; // 'RSTI'
+const boost::uint32_t kIndexVersion = 1;
+
+enum FileFlags
+{
+   kFileRemoved   = 1 << 0,
+   kFileBinary    = 1 << 1,
+   kFileUnindexed = 1 << 2
+};
+
+// above this size trigrams are deduplicated with a bitmap over the
+// trigram space rather than by sorting
+const std::ptrdiff_t kBitmapThreshold = 65536;
+
+inline unsigned char foldCase(char ch)
+{
+   return static_cast<unsigned char>((ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch);
+}
+
+Error invalidIndexError(const FilePath& filePath, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::invalid_argument, location);
+   error.addProperty("description", "invalid trigram index");
+   error.addProperty("path", filePath);
+   return error;
+}
+
+} // anonymous namespace
+
+const uintmax_t TrigramIndex::kMaxIndexedFileSize = 16 * 1024 * 1024;
+
+TrigramIndex::TrigramIndex()
+   : removedCount_(0)
+{
+}
+
+void TrigramIndex::extractTrigrams(const char* begin,
+                                   const char* end,
+                                   std::vector<boost::uint32_t>* pTrigrams)
+{
+   pTrigrams->clear();
+   if (end - begin < 3)
+      return;
+
+   bool useBitmap = (end - begin) > kBitmapThreshold;
+   std::vector<bool> seen;
+   if (useBitmap)
+      seen.resize(1 << 24);
+
+   // trigrams never span lines (search literals never contain newlines)
+   boost::uint32_t trigram = 0;
+   int length = 0;
+   for (const char* it = begin; it != end; ++it)
+   {
+      unsigned char ch = foldCase(*it);
+      if (ch == '\n')
+      {
+         length = 0;
+         continue;
+      }
+
+      trigram = ((trigram << 8) | ch) & 0xFFFFFF;
+      if (++length < 3)
+         continue;
+
+      if (useBitmap)
+      {
+         if (seen[trigram])
+            continue;
+         seen[trigram] = true;
+      }
+      pTrigrams->push_back(trigram);
+   }
+
+   std::sort(pTrigrams->begin(), pTrigrams->end());
+   if (!useBitmap)
+   {
+      pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                       pTrigrams->end());
+   }
+}
+
+Error TrigramIndex::readTrigrams(const FilePath& filePath,
+                                 std::vector<boost::uint32_t>* pTrigrams,
+                                 bool* pIsBinary,
+                                 bool* pIsIndexed)
+{
+   pTrigrams->clear();
+   *pIsBinary = false;
+   *pIsIndexed = true;
+
+   uintmax_t size = filePath.size();
+   if (size == 0)
+      return Success();
+
+   if (size > kMaxIndexedFileSize)
+   {
+      *pIsIndexed = false;
+      return Success();
+   }
+
+   try
+   {
+      boost::iostreams::mapped_file_source file(filePath.absolutePathNative());
+      const char* begin = file.data();
+      const char* end = begin + file.size();
+
+      *pIsBinary = isBinaryContent(begin, end);
+      if (!*pIsBinary)
+         extractTrigrams(begin, end, pTrigrams);
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   return Success();
+}
+
+void TrigramIndex::update(const std::string& path,
+                          uintmax_t size,
+                          std::time_t lastWriteTime,
+                          const std::vector<boost::uint32_t>& trigrams,
+                          bool isBinary,
+                          bool isIndexed)
+{
+   remove(path);
+
+   // ids are assigned in increasing order so posting lists stay sorted
+   boost::uint32_t id = static_cast<boost::uint32_t>(files_.size());
+
+   FileEntry entry;
+   entry.path = path;
+   entry.size = size;
+   entry.lastWriteTime = lastWriteTime;
+   entry.flags = 0;
+   if (isBinary)
+      entry.flags |= kFileBinary;
+   if (!isIndexed)
+      entry.flags |= kFileUnindexed;
+
+   files_.push_back(entry);
+   fileIds_[path] = id;
+
+   BOOST_FOREACH(boost::uint32_t trigram, trigrams)
+   {
+      postings_[trigram].push_back(id);
+   }
+}
+
+void TrigramIndex::remove(const std::string& path)
+{
+   std::map<std::string, boost::uint32_t>::iterator it = fileIds_.find(path);
+   if (it == fileIds_.end())
+      return;
+
+   files_[it->second].flags |= kFileRemoved;
+   removedCount_++;
+   fileIds_.erase(it);
+}
+
+void TrigramIndex::clear()
+{
+   files_.clear();
+   fileIds_.clear();
+   postings_.clear();
+   removedCount_ = 0;
+}
+
+void TrigramIndex::swap(TrigramIndex& other)
+{
+   files_.swap(other.files_);
+   fileIds_.swap(other.fileIds_);
+   postings_.swap(other.postings_);
+   std::swap(removedCount_, other.removedCount_);
+}
+
+bool TrigramIndex::contains(const std::string& path) const
+{
+   return fileIds_.find(path) != fileIds_.end();
+}
+
+bool TrigramIndex::isCurrent(const std::string& path,
+                             uintmax_t size,
+                             std::time_t lastWriteTime) const
+{
+   std::map<std::string, boost::uint32_t>::const_iterator it = fileIds_.find(path);
+   if (it == fileIds_.end())
+      return false;
+
+   const FileEntry& entry = files_[it->second];
+   return entry.size == size && entry.lastWriteTime == lastWriteTime;
+}
+
+std::vector<std::string> TrigramIndex::paths() const
+{
+   std::vector<std::string> paths;
+   paths.reserve(fileIds_.size());
+   for (std::map<std::string, boost::uint32_t>::const_iterator it = fileIds_.begin();
+        it != fileIds_.end();
+        ++it)
+   {
+      paths.push_back(it->first);
+   }
+   return paths;
+}
+
+bool TrigramIndex::isLive(boost::uint32_t id) const
+{
+   return (files_[id].flags & (kFileRemoved | kFileBinary)) == 0;
+}
+
+bool TrigramIndex::candidates(const std::string& literal,
+                              std::vector<std::string>* pPaths) const
+{
+   std::vector<boost::uint32_t> trigrams;
+   extractTrigrams(literal.data(), literal.data() + literal.size(), &trigrams);
+   if (trigrams.empty())
+      return false;
+
+   // gather the posting lists, intersecting the shortest first
+   std::vector<const std::vector<boost::uint32_t>*> lists;
+   bool missing = false;
+   BOOST_FOREACH(boost::uint32_t trigram, trigrams)
+   {
+      boost::unordered_map<boost::uint32_t, std::vector<boost::uint32_t> >::const_iterator
+            it = postings_.find(trigram);
+      if (it == postings_.end())
+      {
+         missing = true;
+         break;
+      }
+      lists.push_back(&it->second);
+   }
+
+   std::vector<boost::uint32_t> ids;
+   if (!missing)
+   {
+      std::sort(lists.begin(),
+                lists.end(),
+                boost::bind(&std::vector<boost::uint32_t>::size, _1) <
+                boost::bind(&std::vector<boost::uint32_t>::size, _2));
+
+      ids = *lists[0];
+      std::vector<boost::uint32_t> intersection;
+      for (std::size_t i = 1; i < lists.size() && !ids.empty(); i++)
+      {
+         intersection.clear();
+         std::set_intersection(ids.begin(), ids.end(),
+                               lists[i]->begin(), lists[i]->end(),
+                               std::back_inserter(intersection));
+         ids.swap(intersection);
+      }
+   }
+
+   BOOST_FOREACH(boost::uint32_t id, ids)
+   {
+      if (isLive(id))
+         pPaths->push_back(files_[id].path);
+   }
+
+   // files too large to index could contain anything
+   for (boost::uint32_t id = 0; id < files_.size(); id++)
+   {
+      if (isLive(id) && (files_[id].flags & kFileUnindexed))
+         pPaths->push_back(files_[id].path);
+   }
+
+   return true;
+}
+
+bool TrigramIndex::needsCompaction() const
+{
+   return removedCount_ > 0 && removedCount_ * 4 > files_.size();
+}
+
+void TrigramIndex::compact()
+{
+   if (removedCount_ == 0)
+      return;
+
+   std::vector<boost::uint32_t> idMap(files_.size(), 0);
+   std::vector<FileEntry> files;
+   files.reserve(files_.size() - removedCount_);
+   for (std::size_t i = 0; i < files_.size(); i++)
+   {
+      if (files_[i].flags & kFileRemoved)
+         continue;
+
+      // new ids are 1-based in the map so 0 can mark removed files
+      idMap[i] = static_cast<boost::uint32_t>(files.size()) + 1;
+      files.push_back(files_[i]);
+   }
+
+   typedef boost::unordered_map<boost::uint32_t, std::vector<boost::uint32_t> > Postings;
+   for (Postings::iterator it = postings_.begin(); it != postings_.end(); )
+   {
+      std::vector<boost::uint32_t> ids;
+      BOOST_FOREACH(boost::uint32_t id, it->second)
+      {
+         if (idMap[id] != 0)
+            ids.push_back(idMap[id] - 1);
+      }
+
+      if (ids.empty())
+      {
+         it = postings_.erase(it);
+      }
+      else
+      {
+         it->second.swap(ids);
+         ++it;
+      }
+   }
+
+   files_.swap(files);
+   fileIds_.clear();
+   for (std::size_t i = 0; i < files_.size(); i++)
+      fileIds_[files_[i].path] = static_cast<boost::uint32_t>(i);
+   removedCount_ = 0;
+}
+
+std::size_t TrigramIndex::postingCount() const
+{
+   std::size_t count = 0;
+   typedef boost::unordered_map<boost::uint32_t, std::vector<boost::uint32_t> > Postings;
+   for (Postings::const_iterator it = postings_.begin(); it != postings_.end(); ++it)
+      count += it->second.size();
+   return count;
+}
+
+Error TrigramIndex::writeToFile(const FilePath& filePath) const
+{
+   FilePath tempPath = filePath.parent().complete(filePath.filename() + ".tmp");
+
+   {
+      boost::shared_ptr<std::ostream> pStream;
+      Error error = tempPath.open_w(&pStream);
+      if (error)
+         return error;
+      std::ostream& ostr = *pStream;
+
+      writeValue(ostr, kIndexMagic);
+      writeValue(ostr, kIndexVersion);
+
+      writeValue(ostr, static_cast<boost::uint32_t>(files_.size()));
+      BOOST_FOREACH(const FileEntry& entry, files_)
+      {
+         writeString(ostr, entry.path);
+         writeValue(ostr, entry.size);
+         writeValue(ostr, entry.lastWriteTime);
+         writeValue(ostr, entry.flags);
+      }
+
+      writeValue(ostr, static_cast<boost::uint32_t>(postings_.size()));
+      typedef boost::unordered_map<boost::uint32_t, std::vector<boost::uint32_t> > Postings;
+      for (Postings::const_iterator it = postings_.begin(); it != postings_.end(); ++it)
+      {
+         writeValue(ostr, it->first);
+         writeVarint(ostr, static_cast<boost::uint32_t>(it->second.size()));
+
+         boost::uint32_t previous = 0;
+         BOOST_FOREACH(boost::uint32_t id, it->second)
+         {
+            writeVarint(ostr, id - previous);
+            previous = id;
+         }
+      }
+
+      ostr.flush();
+      if (!ostr.good())
+      {
+         Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", tempPath);
+         return error;
+      }
+   }
+
+   return tempPath.move(filePath);
+}
+
+Error TrigramIndex::readFromFile(const FilePath& filePath)
+{
+   clear();
+
+   if (!filePath.exists())
+      return systemError(boost::system::errc::no_such_file_or_directory,
+                         ERROR_LOCATION);
+   if (filePath.size() == 0)
+      return invalidIndexError(filePath, ERROR_LOCATION);
+
+   boost::iostreams::mapped_file_source file;
+   try
+   {
+      file.open(filePath.absolutePathNative());
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   Reader reader(file.data(), file.data() + file.size());
+   boost::uint32_t magic, version, fileCount;
+   if (!reader.read(&magic) || magic != kIndexMagic ||
+       !reader.read(&version) || version != kIndexVersion ||
+       !reader.readCount(&fileCount))
+   {
+      return invalidIndexError(filePath, ERROR_LOCATION);
+   }
+
+   files_.reserve(fileCount);
+   for (boost::uint32_t i = 0; i < fileCount; i++)
+   {
+      FileEntry entry;
+      if (!reader.read(&entry.path) ||
+          !reader.read(&entry.size) ||
+          !reader.read(&entry.lastWriteTime) ||
+          !reader.read(&entry.flags))
+         break;
+
+      if (entry.flags & kFileRemoved)
+         removedCount_++;
+      else
+         fileIds_[entry.path] = i;
+      files_.push_back(entry);
+   }
+
+   boost::uint32_t trigramCount;
+   if (files_.size() != fileCount || !reader.read(&trigramCount))
+   {
+      clear();
+      return invalidIndexError(filePath, ERROR_LOCATION);
+   }
+
+   for (boost::uint32_t i = 0; i < trigramCount; i++)
+   {
+      boost::uint32_t trigram, count;
+      if (!reader.read(&trigram) || !reader.readVarint(&count))
+      {
+         clear();
+         return invalidIndexError(filePath, ERROR_LOCATION);
+      }
+
+      std::vector<boost::uint32_t>& ids = postings_[trigram];
+      ids.reserve(std::min(count, fileCount));
+      boost::uint32_t id = 0;
+      for (boost::uint32_t j = 0; j < count; j++)
+      {
+         boost::uint32_t delta;
+         if (!reader.readVarint(&delta) || id + delta >= fileCount)
+         {
+            clear();
+            return invalidIndexError(filePath, ERROR_LOCATION);
+         }
+         id += delta;
+         ids.push_back(id);
+      }
+   }
+
+   return Success();
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
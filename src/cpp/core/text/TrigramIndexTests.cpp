@@ -0,0 +1,150 @@
+/*
+ * TrigramIndexTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TrigramIndex.hpp>
+
+#include <algorithm>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+namespace {
+
+void addFile(text::TrigramIndex* pIndex,
+             const std::string& path,
+             const std::string& contents,
+             bool isBinary = false)
+{
+   std::vector<boost::uint32_t> trigrams;
+   if (!isBinary)
+   {
+      text::TrigramIndex::extractTrigrams(contents.data(),
+                                          contents.data() + contents.size(),
+                                          &trigrams);
+   }
+   pIndex->update(path, contents.size(), 0, trigrams, isBinary, true);
+}
+
+std::vector<std::string> candidates(const text::TrigramIndex& index,
+                                    const std::string& literal)
+{
+   std::vector<std::string> paths;
+   index.candidates(literal, &paths);
+   std::sort(paths.begin(), paths.end());
+   return paths;
+}
+
+} // anonymous namespace
+
+TEST_CASE("TrigramIndex")
+{
+   SECTION("Trigrams are case folded, unique and never span lines")
+   {
+      std::string contents = "AbCabc\nab";
+      std::vector<boost::uint32_t> trigrams;
+      text::TrigramIndex::extractTrigrams(contents.data(),
+                                          contents.data() + contents.size(),
+                                          &trigrams);
+      // abc, bca, cab
+      CHECK(trigrams.size() == 3);
+      CHECK(std::is_sorted(trigrams.begin(), trigrams.end()));
+   }
+
+   SECTION("Only files containing every trigram of a literal are candidates")
+   {
+      text::TrigramIndex index;
+      addFile(&index, "a.R", "foo <- function() bar()");
+      addFile(&index, "b.R", "barfoo");
+      addFile(&index, "c.R", "nothing to see");
+      addFile(&index, "d.bin", "function", true);
+
+      std::vector<std::string> paths = candidates(index, "FUNCTION");
+      REQUIRE(paths.size() == 1);
+      CHECK(paths[0] == "a.R");
+
+      CHECK(candidates(index, "bar").size() == 2);
+      CHECK(candidates(index, "zzz").empty());
+
+      std::vector<std::string> all;
+      CHECK_FALSE(index.candidates("ba", &all));
+   }
+
+   SECTION("Updates and removals are reflected in candidates")
+   {
+      text::TrigramIndex index;
+      addFile(&index, "a.R", "alpha");
+      addFile(&index, "b.R", "alpha beta");
+      addFile(&index, "a.R", "gamma");
+      index.remove("b.R");
+
+      CHECK(candidates(index, "alpha").empty());
+      CHECK(candidates(index, "gamma").size() == 1);
+      CHECK(index.fileCount() == 1);
+      CHECK(index.needsCompaction());
+
+      index.compact();
+      CHECK_FALSE(index.needsCompaction());
+      CHECK(candidates(index, "gamma").size() == 1);
+      CHECK(index.contains("a.R"));
+      CHECK_FALSE(index.contains("b.R"));
+   }
+
+   SECTION("Unindexed files are always candidates")
+   {
+      text::TrigramIndex index;
+      addFile(&index, "a.R", "alpha");
+      index.update("big.csv", 0, 0, std::vector<boost::uint32_t>(), false, false);
+      std::vector<std::string> paths = candidates(index, "omega");
+      REQUIRE(paths.size() == 1);
+      CHECK(paths[0] == "big.csv");
+   }
+
+   SECTION("Indexes round trip through a file")
+   {
+      text::TrigramIndex index;
+      addFile(&index, "a.R", "library(dplyr)");
+      addFile(&index, "b.R", "library(ggplot2)");
+      addFile(&index, "c.R", "removed");
+      index.remove("c.R");
+      index.update("a.R", 14, 42, std::vector<boost::uint32_t>(), false, true);
+      addFile(&index, "a.R", "library(dplyr)");
+
+      FilePath indexPath;
+      REQUIRE_FALSE(FilePath::tempFilePath(&indexPath));
+      REQUIRE_FALSE(index.writeToFile(indexPath));
+
+      text::TrigramIndex loaded;
+      REQUIRE_FALSE(loaded.readFromFile(indexPath));
+      CHECK(loaded.fileCount() == 2);
+      CHECK(loaded.trigramCount() == index.trigramCount());
+      CHECK(candidates(loaded, "library") == candidates(index, "library"));
+      CHECK(candidates(loaded, "ggplot").size() == 1);
+      CHECK(loaded.isCurrent("a.R", 14, 0));
+      CHECK_FALSE(loaded.isCurrent("a.R", 14, 42));
+
+      indexPath.remove();
+   }
+}
+
+} // end namespace tests
+} // end namespace core
+} // end namespace rstudio
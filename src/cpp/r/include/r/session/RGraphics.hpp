@@ -58,6 +58,7 @@ struct is_error_code_enum<rstudio::r::session::graphics::errc::errc_t>
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/BoostSignals.hpp>
 #include <core/Error.hpp>
@@ -147,6 +148,26 @@ public:
    virtual core::Error savePlotAsMetafile(const core::FilePath& filePath,
                                           int widthPx,
                                           int heightPx) = 0;
+
+   // render the active plot as a PNG (from the plot cache when possible),
+   // along with a strong entity tag for the image
+   virtual core::Error activePlotAsPng(
+                           int widthPx,
+                           int heightPx,
+                           double devicePixelRatio,
+                           boost::shared_ptr<const std::string>* pImage,
+                           std::string* pETag) = 0;
+
+   // speculatively render the active plot into the plot cache at the sizes
+   // it's likely to be zoomed or exported at next, one size per call.
+   // returns true if there are more sizes to render; pending renders are
+   // cancelled when code is executed
+   virtual bool hasPrerenderWork() const = 0;
+   virtual bool prerenderActivePlot() = 0;
+
+   // remove the oldest plots if the history exceeds its cap on disk, along
+   // with files no longer used by any plot
+   virtual void compactPlotHistory() = 0;
       
    // display
    virtual bool hasOutput() const = 0 ;
@@ -736,6 +736,41 @@ void setDeviceAttributes(pDevDesc pDev, pDevDesc pShadow)
    }
 }
 
+namespace {
+
+template <typename T>
+NewPageFunction exchangeNewPage(T pDD, NewPageFunction pNewPageFn)
+{
+   NewPageFunction pPreviousFn = pDD->newPage;
+   pDD->newPage = pNewPageFn;
+   return pPreviousFn;
+}
+
+} // end anonymous namespace
+
+NewPageFunction setNewPage(pDevDesc dd, NewPageFunction pNewPageFn)
+{
+   int engineVersion = ::R_GE_getVersion();
+   switch (engineVersion)
+   {
+   case 5:
+      return exchangeNewPage((DevDescVersion5*)dd, pNewPageFn);
+   case 6:
+      return exchangeNewPage((DevDescVersion6*)dd, pNewPageFn);
+   case 7:
+      return exchangeNewPage((DevDescVersion7*)dd, pNewPageFn);
+   case 8:
+      return exchangeNewPage((DevDescVersion8*)dd, pNewPageFn);
+   case 9:
+   case 10:
+   case 11:
+      return exchangeNewPage((DevDescVersion9*)dd, pNewPageFn);
+   case 12:
+   default:
+      return exchangeNewPage((DevDescVersion12*)dd, pNewPageFn);
+   }
+}
+
 void activate(const pDevDesc dd)
 {
    // get pointer to activate function
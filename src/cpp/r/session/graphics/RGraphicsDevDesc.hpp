@@ -135,6 +135,10 @@ pDevDesc allocate(const DevDescVersion12& devDescVersion12);
 void setSize(pDevDesc pDD);
 void setDeviceAttributes(pDevDesc pDev, pDevDesc pShadow);
 
+// replace a device's newPage function, returning the one replaced
+typedef void (*NewPageFunction)(const pGEcontext gc, pDevDesc dd);
+NewPageFunction setNewPage(pDevDesc dd, NewPageFunction pNewPageFn);
+
 /* Wrapper methods for graphics engine */
 void activate(const pDevDesc dd);
 void circle(double x, double y, double r, const pGEcontext gc, pDevDesc dd);
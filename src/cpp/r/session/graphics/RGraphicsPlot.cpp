@@ -20,7 +20,10 @@
 #include <boost/format.hpp>
 
 #include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
 #include <core/Log.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/system/System.hpp>
 #include <core/StringUtils.hpp>
@@ -40,6 +43,7 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
            SEXP manipulatorSEXP)
    : graphicsDevice_(graphicsDevice), 
      baseDirPath_(baseDirPath),
+     contentsUuid_(core::system::generateUuid()),
      needsUpdate_(false),
      manipulator_(manipulatorSEXP)
 {
@@ -48,10 +52,13 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
 Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
            const FilePath& baseDirPath, 
            const std::string& storageUuid,
-           const DisplaySize& renderedSize)
+           const DisplaySize& renderedSize,
+           const std::string& snapshotId)
    : graphicsDevice_(graphicsDevice), 
      baseDirPath_(baseDirPath), 
      storageUuid_(storageUuid),
+     snapshotId_(snapshotId.empty() ? storageUuid : snapshotId),
+     contentsUuid_(storageUuid),
      renderedSize_(renderedSize),
      needsUpdate_(false),
      manipulator_()
@@ -72,9 +79,22 @@ bool Plot::hasValidStorage() const
    return hasStorage() && snapshotFilePath().exists();
 }
 
-void Plot::invalidate()
+void Plot::storageFiles(std::vector<FilePath>* pFiles) const
+{
+   if (!hasStorage())
+      return;
+
+   pFiles->push_back(snapshotFilePath());
+   pFiles->push_back(imageFilePath(storageUuid_));
+   if (hasManipulatorFile())
+      pFiles->push_back(manipulatorFilePath(storageUuid_));
+}
+
+void Plot::invalidate(bool contentsChanged)
 {
    needsUpdate_ = true;
+   if (contentsChanged)
+      contentsUuid_ = core::system::generateUuid();
 }
 
 bool Plot::hasManipulator() const
@@ -119,7 +139,7 @@ void Plot::saveManipulator() const
       saveManipulator(storageUuid_);
 }
    
-Error Plot::renderFromDisplay()
+Error Plot::renderFromDisplay(PlotCache* pCache)
 {
    // we can use our cached representation if we don't need an update and our 
    // rendered size is the same as the current graphics device size
@@ -131,10 +151,36 @@ Error Plot::renderFromDisplay()
    
    // generate a new storage uuid
    std::string storageUuid = core::system::generateUuid();
-   
-   // generate snapshot and image files
-   Error error = graphicsDevice_.saveSnapshot(snapshotFilePath(storageUuid),
-                                              imageFilePath(storageUuid));
+
+   // if the contents have already been rendered at this size then reuse
+   // that image (and our snapshot, which doesn't depend on size)
+   DisplaySize displaySize = graphicsDevice_.displaySize();
+   PlotCacheKey cacheKey(contentsUuid_,
+                         displaySize.width,
+                         displaySize.height,
+                         r::session::graphics::device::devicePixelRatio());
+   boost::shared_ptr<const std::string> pImage;
+   std::string snapshotId = snapshotId_;
+   Error error;
+   if (hasStorage() && snapshotFilePath().exists() &&
+       pCache->get(cacheKey, &pImage))
+   {
+      error = writeStringToFile(imageFilePath(storageUuid), *pImage);
+   }
+   else
+   {
+      // generate snapshot and image files
+      FilePath snapshotFile = snapshotFilePath(storageUuid);
+      error = graphicsDevice_.saveSnapshot(snapshotFile,
+                                           imageFilePath(storageUuid));
+      if (!error)
+         error = storeSnapshot(snapshotFile, &snapshotId);
+
+      // cache the image
+      std::string image;
+      if (!error && !readStringFromFile(imageFilePath(storageUuid), &image))
+         pCache->insert(cacheKey, image);
+   }
    if (error)
       return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
    
@@ -149,6 +195,7 @@ Error Plot::renderFromDisplay()
         
    // update state
    storageUuid_ = storageUuid;
+   snapshotId_ = snapshotId;
    needsUpdate_ = false;
    
    // return error status 
@@ -174,6 +221,11 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
    if (error)
       return error ;
 
+   std::string snapshotId;
+   error = storeSnapshot(snapshotFile, &snapshotId);
+   if (error)
+      return error;
+
    //
    // we can't generate an image file at this point in the processing
    // because the GraphicsDevice has already moved on to the next page. this is
@@ -192,6 +244,7 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
    
    // update state
    storageUuid_ = storageUuid;
+   snapshotId_ = snapshotId;
    needsUpdate_ = true;
    
    // return error status
@@ -225,13 +278,12 @@ Error Plot::removeFiles()
    if (storageUuid_.empty())
       return Success();
    
-   Error snapshotError = snapshotFilePath(storageUuid_).removeIfExists();
+   // snapshots may be shared with other plots, so the plot manager removes
+   // them once no plot refers to them
    Error imageError = imageFilePath(storageUuid_).removeIfExists();
    Error manipulatorError = manipulatorFilePath(storageUuid_).removeIfExists();
    
-   if (snapshotError)
-      return Error(errc::PlotFileError, snapshotError, ERROR_LOCATION);
-   else if (imageError)
+   if (imageError)
       return Error(errc::PlotFileError, imageError, ERROR_LOCATION);
    else if (manipulatorError)
       return Error(errc::PlotFileError, manipulatorError, ERROR_LOCATION);
@@ -251,13 +303,53 @@ bool Plot::hasStorage() const
 
 FilePath Plot::snapshotFilePath() const
 {
-   return snapshotFilePath(storageUuid());
+   return snapshotFilePath(snapshotId_);
 }
 
 
-FilePath Plot::snapshotFilePath(const std::string& storageUuid) const
+FilePath Plot::snapshotFilePath(const std::string& snapshotId) const
+{
+   return baseDirPath_.complete(snapshotId + ".snapshot");
+}
+
+// rename a newly written snapshot for its contents, or remove it if an
+// identical snapshot is already stored
+Error Plot::storeSnapshot(const FilePath& snapshotFile,
+                          std::string* pSnapshotId) const
 {
-   return baseDirPath_.complete(storageUuid + ".snapshot");
+   std::string contents;
+   Error error = readStringFromFile(snapshotFile, &contents);
+   if (error)
+      return error;
+
+   std::string snapshotId = hash::crc32HexHash(contents) + "-" +
+                            safe_convert::numberToString(contents.size());
+   FilePath storedFile = snapshotFilePath(snapshotId);
+   if (storedFile.exists())
+   {
+      std::string storedContents;
+      error = readStringFromFile(storedFile, &storedContents);
+      if (error)
+         return error;
+
+      // on the (unlikely) collision of different contents keep the
+      // snapshot under its own name
+      if (storedContents != contents)
+      {
+         *pSnapshotId = snapshotFile.stem();
+         return Success();
+      }
+
+      *pSnapshotId = snapshotId;
+      return snapshotFile.remove();
+   }
+
+   error = snapshotFile.move(storedFile);
+   if (error)
+      return error;
+
+   *pSnapshotId = snapshotId;
+   return Success();
 }
    
 FilePath Plot::imageFilePath(const std::string& storageUuid) const
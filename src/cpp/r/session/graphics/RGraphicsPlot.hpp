@@ -17,6 +17,7 @@
 #define R_SESSION_GRAPHICS_PLOT_HPP
 
 #include <string>
+#include <vector>
 
 #include <boost/utility.hpp>
 
@@ -27,6 +28,7 @@
 #include <r/RSexp.hpp>
 
 #include "RGraphicsTypes.hpp"
+#include "RGraphicsPlotCache.hpp"
 #include "RGraphicsPlotManipulator.hpp"
 
 namespace rstudio {
@@ -52,10 +54,22 @@ public:
    Plot(const GraphicsDeviceFunctions& graphicsDevice,
         const core::FilePath& baseDirPath, 
         const std::string& storageUuid,
-        const DisplaySize& renderedSize);
+        const DisplaySize& renderedSize,
+        const std::string& snapshotId = std::string());
    
    std::string storageUuid() const;  
    bool hasValidStorage() const;
+
+   // identifies the plot's snapshot file, which is named for its contents
+   // so that plots with identical snapshots share one file
+   const std::string& snapshotId() const { return snapshotId_; }
+
+   // the files the plot is stored in
+   void storageFiles(std::vector<core::FilePath>* pFiles) const;
+
+   // identifies the plot's contents (unlike the storage id, unchanged when
+   // the plot is only rendered at a new size)
+   const std::string& contentsUuid() const { return contentsUuid_; }
    const DisplaySize& renderedSize() const { return renderedSize_; }
 
    bool hasManipulator() const;
@@ -63,9 +77,9 @@ public:
    void manipulatorAsJson(core::json::Value* pValue) const;
    void saveManipulator() const;
    
-   void invalidate();
+   void invalidate(bool contentsChanged = true);
    
-   core::Error renderFromDisplay();
+   core::Error renderFromDisplay(PlotCache* pCache);
    core::Error renderFromDisplaySnapshot(SEXP snapshot);
    std::string imageFilename() const;
    
@@ -79,7 +93,9 @@ private:
    bool hasStorage() const;
 
    core::FilePath snapshotFilePath() const ;
-   core::FilePath snapshotFilePath(const std::string& storageUuid) const;
+   core::FilePath snapshotFilePath(const std::string& snapshotId) const;
+   core::Error storeSnapshot(const core::FilePath& snapshotFile,
+                             std::string* pSnapshotId) const;
    core::FilePath imageFilePath(const std::string& storageUuid) const;
 
    bool hasManipulatorFile() const;
@@ -91,6 +107,8 @@ private:
    GraphicsDeviceFunctions graphicsDevice_;
    core::FilePath baseDirPath_;
    std::string storageUuid_ ;
+   std::string snapshotId_;
+   std::string contentsUuid_;
    DisplaySize renderedSize_ ;
    bool needsUpdate_;
 
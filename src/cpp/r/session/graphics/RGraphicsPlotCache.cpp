@@ -0,0 +1,115 @@
+/*
+ * RGraphicsPlotCache.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsPlotCache.hpp"
+
+#include <limits>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+
+bool PlotCacheKey::operator<(const PlotCacheKey& other) const
+{
+   return boost::tie(contentsUuid, width, height, devicePixelRatio) <
+          boost::tie(other.contentsUuid, other.width, other.height,
+                     other.devicePixelRatio);
+}
+
+std::string PlotCacheKey::eTag() const
+{
+   boost::format fmt("\"%1%-%2%x%3%@%4%\"");
+   return boost::str(fmt % contentsUuid % width % height % devicePixelRatio);
+}
+
+// entries are evicted by size alone, so the underlying cache isn't bounded
+// by count
+PlotCache::PlotCache(std::size_t maxBytes)
+   : images_(std::numeric_limits<unsigned int>::max()),
+     maxBytes_(maxBytes),
+     bytes_(0)
+{
+}
+
+void PlotCache::insert(const PlotCacheKey& key, const std::string& image)
+{
+   // don't let one image flush the whole cache
+   if (image.size() > maxBytes_ / 2)
+      return;
+
+   remove(key);
+   images_.insert(key, boost::shared_ptr<const std::string>(
+                                             new std::string(image)));
+   sizes_[key] = image.size();
+   bytes_ += image.size();
+
+   PlotCacheKey oldest;
+   while (bytes_ > maxBytes_ && images_.removeOldest(&oldest))
+   {
+      bytes_ -= sizes_[oldest];
+      sizes_.erase(oldest);
+   }
+}
+
+bool PlotCache::get(const PlotCacheKey& key,
+                    boost::shared_ptr<const std::string>* pImage)
+{
+   return images_.get(key, pImage);
+}
+
+void PlotCache::remove(const std::string& contentsUuid)
+{
+   // keys are ordered by contents id first
+   std::vector<PlotCacheKey> keys;
+   for (std::map<PlotCacheKey, std::size_t>::const_iterator it =
+           sizes_.lower_bound(PlotCacheKey(contentsUuid, 0, 0, 0));
+        it != sizes_.end() && it->first.contentsUuid == contentsUuid;
+        ++it)
+   {
+      keys.push_back(it->first);
+   }
+
+   for (std::size_t i = 0; i < keys.size(); i++)
+      remove(keys[i]);
+}
+
+void PlotCache::remove(const PlotCacheKey& key)
+{
+   std::map<PlotCacheKey, std::size_t>::iterator it = sizes_.find(key);
+   if (it == sizes_.end())
+      return;
+
+   images_.remove(key);
+   bytes_ -= it->second;
+   sizes_.erase(it);
+}
+
+void PlotCache::clear()
+{
+   images_.clear();
+   sizes_.clear();
+   bytes_ = 0;
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
@@ -0,0 +1,97 @@
+/*
+ * RGraphicsPlotCache.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_PLOT_CACHE_HPP
+#define R_SESSION_GRAPHICS_PLOT_CACHE_HPP
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/collection/LruCache.hpp>
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+
+// identifies a rendering of a plot: the plot's contents (which are given a
+// new id whenever they change, while its storage id changes with every
+// rendering) and the size it was rendered at
+struct PlotCacheKey
+{
+   PlotCacheKey()
+      : width(0), height(0), devicePixelRatio(1)
+   {
+   }
+
+   PlotCacheKey(const std::string& contentsUuid,
+                int width,
+                int height,
+                double devicePixelRatio)
+      : contentsUuid(contentsUuid),
+        width(width),
+        height(height),
+        devicePixelRatio(devicePixelRatio)
+   {
+   }
+
+   bool operator<(const PlotCacheKey& other) const;
+
+   // a strong entity tag for the rendering
+   std::string eTag() const;
+
+   std::string contentsUuid;
+   int width;
+   int height;
+   double devicePixelRatio;
+};
+
+// PlotCache keeps recently rendered plot images (encoded PNG bytes) in
+// memory, evicting the least recently used once they exceed a budget
+class PlotCache : boost::noncopyable
+{
+public:
+   explicit PlotCache(std::size_t maxBytes);
+
+   void insert(const PlotCacheKey& key, const std::string& image);
+   bool get(const PlotCacheKey& key,
+            boost::shared_ptr<const std::string>* pImage);
+
+   // remove all renderings of the given plot contents
+   void remove(const std::string& contentsUuid);
+   void clear();
+
+   std::size_t bytes() const { return bytes_; }
+
+private:
+   void remove(const PlotCacheKey& key);
+
+   core::collection::LruCache<PlotCacheKey,
+                              boost::shared_ptr<const std::string> > images_;
+   std::map<PlotCacheKey, std::size_t> sizes_;
+   std::size_t maxBytes_;
+   std::size_t bytes_;
+};
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
+
+#endif // R_SESSION_GRAPHICS_PLOT_CACHE_HPP
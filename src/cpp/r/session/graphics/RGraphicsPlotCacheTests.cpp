@@ -0,0 +1,125 @@
+/*
+ * RGraphicsPlotCacheTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "RGraphicsPlotCache.hpp"
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+
+namespace {
+
+std::string image(std::size_t size)
+{
+   return std::string(size, 'x');
+}
+
+bool cached(PlotCache* pCache, const PlotCacheKey& key)
+{
+   boost::shared_ptr<const std::string> pImage;
+   return pCache->get(key, &pImage);
+}
+
+} // anonymous namespace
+
+TEST_CASE("Plot Cache")
+{
+   PlotCacheKey small("plot1", 400, 300, 1);
+   PlotCacheKey large("plot1", 800, 600, 2);
+   PlotCacheKey other("plot2", 400, 300, 1);
+
+   SECTION("Images are accounted for by size")
+   {
+      PlotCache cache(1000);
+      cache.insert(small, image(100));
+      cache.insert(large, image(200));
+      CHECK(cache.bytes() == 300);
+
+      boost::shared_ptr<const std::string> pImage;
+      REQUIRE(cache.get(large, &pImage));
+      CHECK(pImage->size() == 200);
+
+      // replacing an image accounts for the new one only
+      cache.insert(small, image(50));
+      CHECK(cache.bytes() == 250);
+
+      cache.clear();
+      CHECK(cache.bytes() == 0);
+      CHECK_FALSE(cached(&cache, small));
+   }
+
+   SECTION("The least recently used images are evicted to stay in budget")
+   {
+      PlotCache cache(500);
+      cache.insert(small, image(200));
+      cache.insert(large, image(200));
+
+      // using the first image makes the second the oldest
+      CHECK(cached(&cache, small));
+      cache.insert(other, image(200));
+
+      CHECK(cache.bytes() == 400);
+      CHECK(cached(&cache, small));
+      CHECK_FALSE(cached(&cache, large));
+      CHECK(cached(&cache, other));
+   }
+
+   SECTION("Images larger than half the budget aren't cached")
+   {
+      PlotCache cache(500);
+      cache.insert(small, image(200));
+      cache.insert(large, image(300));
+
+      CHECK(cache.bytes() == 200);
+      CHECK(cached(&cache, small));
+      CHECK_FALSE(cached(&cache, large));
+   }
+
+   SECTION("All renderings of a plot's contents are removed together")
+   {
+      PlotCache cache(1000);
+      cache.insert(small, image(100));
+      cache.insert(large, image(100));
+      cache.insert(other, image(100));
+
+      cache.remove("plot1");
+      CHECK(cache.bytes() == 100);
+      CHECK_FALSE(cached(&cache, small));
+      CHECK_FALSE(cached(&cache, large));
+      CHECK(cached(&cache, other));
+
+      // removing contents which aren't cached does nothing
+      cache.remove("plot3");
+      CHECK(cache.bytes() == 100);
+   }
+
+   SECTION("Renderings differ by size and pixel ratio")
+   {
+      PlotCache cache(1000);
+      cache.insert(small, image(10));
+      CHECK_FALSE(cached(&cache, PlotCacheKey("plot1", 400, 300, 2)));
+      CHECK_FALSE(cached(&cache, PlotCacheKey("plot1", 401, 300, 1)));
+      CHECK(small.eTag() != PlotCacheKey("plot1", 400, 300, 2).eTag());
+   }
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
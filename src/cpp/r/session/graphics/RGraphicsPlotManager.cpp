@@ -16,6 +16,7 @@
 #include "RGraphicsPlotManager.hpp"
 
 #include <algorithm>
+#include <map>
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
@@ -27,6 +28,7 @@
 #include <core/Error.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/RegexUtils.hpp>
+#include <core/system/System.hpp>
 
 #include <r/RExec.hpp>
 #include <r/RUtil.hpp>
@@ -47,6 +49,21 @@ namespace graphics {
 
 namespace {
 
+// the memory used by cached plot images
+const std::size_t kPlotCacheBytes = 64 * 1024 * 1024;
+
+// the number of recently requested sizes plots are pre-rendered at
+const std::size_t kMaxRequestedSizes = 3;
+
+// option giving the cap (in MB) on the disk used by plot history, beyond
+// which the oldest plots are removed
+const char * const kHistoryMaxMbOption = "rstudio.plotHistoryMaxMb";
+const int kDefaultHistoryMaxMb = 256;
+
+// option giving additional export sizes to pre-render plots at, as
+// width, height pairs (in pixels)
+const char * const kPrerenderSizesOption = "rstudio.plotPrerenderSizes";
+
 double pixelsToInches(int pixels)
 {
    return (double)pixels / 96.0;
@@ -79,7 +96,9 @@ PlotManager::PlotManager()
       lastChange_(boost::posix_time::not_a_date_time),
       suppressDeviceEvents_(false),
       activePlot_(-1),
-      plotInfoRegex_("([A-Za-z0-9\\-]+):([0-9]+),([0-9]+)")
+      plotCache_(kPlotCacheBytes),
+      plotInfoRegex_("([A-Za-z0-9\\-]+):([0-9]+),([0-9]+)"),
+      plotSnapshotRegex_("([A-Za-z0-9\\-]+):([A-Za-z0-9\\-]+)")
 {
    plots_.set_capacity(100);
 }
@@ -101,6 +120,10 @@ Error PlotManager::initialize(const FilePath& graphicsPath,
 
    // save reference to plots state file
    plotsStateFile_ = graphicsPath_.complete("INDEX");
+
+   // snapshot ids are kept apart from the index so that it remains readable
+   // by versions which predate shared snapshots
+   plotSnapshotsStateFile_ = graphicsPath_.complete("SNAPSHOTS");
    
    // save reference to graphics device functions
    graphicsDevice_ = graphicsDevice;
@@ -181,13 +204,16 @@ Error PlotManager::removePlot(int index)
    if (!isValidPlotIndex(index))
       return plotIndexError(index, ERROR_LOCATION);
    
-   // remove the plot files 
+   // remove the plot files and images
+   uncachePlot(*plots_[index]);
    Error removeError = plots_[index]->removeFiles();
    if (removeError)
       logAndReportError(removeError, ERROR_LOCATION);
    
    // erase the plot from the internal list
+   std::string snapshotId = plots_[index]->snapshotId();
    plots_.erase(plots_.begin() + index);
+   removeSnapshotIfUnreferenced(snapshotId);
    
    // trip changes flag (removing a plot will affect the number of plots
    // and the active plot index so we need a new changed event)
@@ -273,8 +299,17 @@ Error PlotManager::savePlotAsImage(const FilePath& filePath,
                                    int heightPx,
                                    double pixelRatio)
 {
-   if (format == kPngFormat ||
-       format == kBmpFormat ||
+   if (format == kPngFormat)
+   {
+      boost::shared_ptr<const std::string> pImage;
+      std::string eTag;
+      Error error = activePlotAsPng(widthPx, heightPx, pixelRatio,
+                                    &pImage, &eTag);
+      if (error)
+         return error;
+      return writeStringToFile(filePath, *pImage);
+   }
+   else if (format == kBmpFormat ||
        format == kJpegFormat ||
        format == kTiffFormat)
    {
@@ -424,6 +459,149 @@ Error PlotManager::savePlotAsMetafile(const core::FilePath& filePath,
 }
 
 
+Error PlotManager::activePlotAsPng(int widthPx,
+                                   int heightPx,
+                                   double devicePixelRatio,
+                                   boost::shared_ptr<const std::string>* pImage,
+                                   std::string* pETag)
+{
+   if (!hasPlot())
+      return Error(errc::NoActivePlot, ERROR_LOCATION);
+
+   noteRequestedSize(widthPx, heightPx, devicePixelRatio);
+
+   PlotCacheKey cacheKey(activePlot().contentsUuid(),
+                         widthPx,
+                         heightPx,
+                         devicePixelRatio);
+   Error error = renderActivePlotAsPng(cacheKey, pImage);
+   if (error)
+      return error;
+
+   *pETag = cacheKey.eTag();
+   return Success();
+}
+
+Error PlotManager::renderActivePlotAsPng(
+                           const PlotCacheKey& cacheKey,
+                           boost::shared_ptr<const std::string>* pImage)
+{
+   if (plotCache_.get(cacheKey, pImage))
+      return Success();
+
+   // render to a scratch file
+   FilePath imagePath = graphicsPath_.complete(
+                           core::system::generateUuid() + ".render.png");
+   Error error = savePlotAsBitmapFile(imagePath,
+                                      kPngFormat,
+                                      cacheKey.width,
+                                      cacheKey.height,
+                                      cacheKey.devicePixelRatio);
+   std::string image;
+   if (!error)
+      error = readStringFromFile(imagePath, &image);
+
+   Error removeError = imagePath.removeIfExists();
+   if (removeError)
+      LOG_ERROR(removeError);
+   if (error)
+      return error;
+
+   pImage->reset(new std::string(image));
+   plotCache_.insert(cacheKey, image);
+   return Success();
+}
+
+void PlotManager::noteRequestedSize(int widthPx,
+                                    int heightPx,
+                                    double devicePixelRatio)
+{
+   PlotCacheKey size(std::string(), widthPx, heightPx, devicePixelRatio);
+   for (std::deque<PlotCacheKey>::iterator it = requestedSizes_.begin();
+        it != requestedSizes_.end();
+        ++it)
+   {
+      if (!(*it < size) && !(size < *it))
+      {
+         requestedSizes_.erase(it);
+         break;
+      }
+   }
+
+   requestedSizes_.push_front(size);
+   if (requestedSizes_.size() > kMaxRequestedSizes)
+      requestedSizes_.pop_back();
+}
+
+void PlotManager::queuePrerender()
+{
+   prerenderQueue_.clear();
+   if (!hasPlot())
+      return;
+
+   std::vector<PlotCacheKey> sizes(requestedSizes_.begin(),
+                                   requestedSizes_.end());
+
+   std::vector<int> exportSizes = r::options::getOption<std::vector<int> >(
+                                    kPrerenderSizesOption,
+                                    std::vector<int>(),
+                                    false);
+   for (std::size_t i = 0; i + 1 < exportSizes.size(); i += 2)
+   {
+      if (exportSizes[i] > 0 && exportSizes[i + 1] > 0)
+      {
+         sizes.push_back(PlotCacheKey(std::string(),
+                                      exportSizes[i],
+                                      exportSizes[i + 1],
+                                      1));
+      }
+   }
+
+   boost::shared_ptr<const std::string> pImage;
+   BOOST_FOREACH(const PlotCacheKey& size, sizes)
+   {
+      PlotCacheKey cacheKey(activePlot().contentsUuid(),
+                            size.width,
+                            size.height,
+                            size.devicePixelRatio);
+      if (!plotCache_.get(cacheKey, &pImage))
+         prerenderQueue_.push_back(cacheKey);
+   }
+}
+
+bool PlotManager::hasPrerenderWork() const
+{
+   return !prerenderQueue_.empty();
+}
+
+bool PlotManager::prerenderActivePlot()
+{
+   if (prerenderQueue_.empty())
+      return false;
+
+   PlotCacheKey cacheKey = prerenderQueue_.front();
+   prerenderQueue_.pop_front();
+
+   // the queue is for a plot which is no longer active
+   if (!hasPlot() || cacheKey.contentsUuid != activePlot().contentsUuid())
+   {
+      prerenderQueue_.clear();
+      return false;
+   }
+
+   boost::shared_ptr<const std::string> pImage;
+   Error error = renderActivePlotAsPng(cacheKey, &pImage);
+   if (error)
+   {
+      // a plot that can't be rendered at one size likely can't be at others
+      if (!r::isCodeExecutionError(error))
+         LOG_ERROR(error);
+      prerenderQueue_.clear();
+   }
+
+   return !prerenderQueue_.empty();
+}
+
 bool PlotManager::hasOutput() const   
 {
    return hasPlot();
@@ -465,7 +643,9 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
    if (hasPlot()) // write image for active plot
    {
       // copy current contents of the display to the active plot files
-      Error error = activePlot().renderFromDisplay();
+      std::string snapshotId = activePlot().snapshotId();
+      Error error = activePlot().renderFromDisplay(&plotCache_);
+      removeSnapshotIfUnreferenced(snapshotId);
       if (error)
       {
          // no such file error expected in the case of an invalid graphics
@@ -487,6 +667,9 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
 
       // get manipulator
       activePlot().manipulatorAsJson(&plotManipulatorJson);
+
+      // render it ahead of being zoomed or exported
+      queuePrerender();
    }
    else  // write "empty" image 
    {
@@ -560,15 +743,100 @@ void PlotManager::manipulatorPlotClicked(int x, int y)
 
 void PlotManager::onBeforeExecute()
 {
+   // R is about to be busy
+   prerenderQueue_.clear();
+
    graphicsDevice_.onBeforeExecute();
 }
 
+void PlotManager::compactPlotHistory()
+{
+   if (!graphicsPath_.exists())
+      return;
+
+   // remove the oldest plots (never the active one) while the history
+   // exceeds its cap
+   uintmax_t maxBytes = r::options::getOption<int>(kHistoryMaxMbOption,
+                                                   kDefaultHistoryMaxMb,
+                                                   false);
+   maxBytes *= 1024 * 1024;
+   std::set<std::string> filenames;
+   uintmax_t bytes = historyFiles(&filenames);
+   while (bytes > maxBytes && plots_.size() > 1)
+   {
+      int index = (activePlot_ == 0) ? 1 : 0;
+      uncachePlot(*plots_[index]);
+      Error error = plots_[index]->removeFiles();
+      if (error)
+         LOG_ERROR(error);
+      std::string snapshotId = plots_[index]->snapshotId();
+      plots_.erase(plots_.begin() + index);
+      removeSnapshotIfUnreferenced(snapshotId);
+      if (index < activePlot_)
+         activePlot_--;
+      setDisplayHasChanges(true);
+
+      filenames.clear();
+      bytes = historyFiles(&filenames);
+   }
+
+   // remove plot files no plot refers to (e.g. the files of plots replaced
+   // by manipulators, or left by an earlier session)
+   std::vector<FilePath> children;
+   Error error = graphicsPath_.children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   std::string imageExtension = "." + graphicsDevice_.imageFileExtension();
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      std::string extension = child.extensionLowerCase();
+      bool isPlotFile = extension == ".snapshot" ||
+                        extension == ".manip" ||
+                        extension == imageExtension;
+      if (isPlotFile &&
+          child.filename() != emptyImageFilename() &&
+          filenames.find(child.filename()) == filenames.end())
+      {
+         error = child.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+}
+
+uintmax_t PlotManager::historyFiles(std::set<std::string>* pFilenames) const
+{
+   std::vector<FilePath> files;
+   BOOST_FOREACH(const PtrPlot& ptrPlot, plots_)
+   {
+      ptrPlot->storageFiles(&files);
+   }
+
+   // snapshots shared by plots are counted once
+   uintmax_t bytes = 0;
+   BOOST_FOREACH(const FilePath& file, files)
+   {
+      if (pFilenames->insert(file.filename()).second && file.exists())
+         bytes += file.size();
+   }
+   return bytes;
+}
+
 Error PlotManager::savePlotsState()
 {
    // exit if we don't have a graphics path
    if (!graphicsPath_.exists())
       return Success() ;
 
+   boost::posix_time::ptime startTime =
+                           boost::posix_time::microsec_clock::universal_time();
+
+   // don't save what's no longer needed
+   compactPlotHistory();
+
    // list to write
    std::vector<std::string> plots ;
    
@@ -576,7 +844,9 @@ Error PlotManager::savePlotsState()
    if (hasPlot())
       plots.push_back(activePlot().storageUuid());
 
-   // build sequence of plot info (id:width,height)
+   // build sequence of plot info (id:width,height), and of the snapshot
+   // ids of plots whose snapshots are shared (id:snapshot id)
+   std::vector<std::string> snapshots;
    for (boost::circular_buffer<PtrPlot>::const_iterator it = plots_.begin();
         it != plots_.end();
         ++it)
@@ -588,13 +858,34 @@ Error PlotManager::savePlotsState()
                                               plot.renderedSize().width %
                                               plot.renderedSize().height);
       plots.push_back(plotInfo);
+
+      if (plot.snapshotId() != plot.storageUuid())
+         snapshots.push_back(plot.storageUuid() + ":" + plot.snapshotId());
    }
    
    // suppres all device events after suspend
    suppressDeviceEvents_ = true ;
    
    // write plot list
-   return writeStringVectorToFile(plotsStateFile_, plots);
+   Error error = writeStringVectorToFile(plotsStateFile_, plots);
+   if (error)
+      return error;
+
+   error = writeStringVectorToFile(plotSnapshotsStateFile_, snapshots);
+   if (error)
+      return error;
+
+   // report the footprint of the plot history and the time taken
+   std::set<std::string> filenames;
+   uintmax_t bytes = historyFiles(&filenames);
+   boost::posix_time::time_duration elapsed =
+         boost::posix_time::microsec_clock::universal_time() - startTime;
+   boost::format fmt("Saved %1% plots (%2% KB in %3% files) in %4% ms");
+   LOG_INFO_MESSAGE(boost::str(fmt % plots_.size() %
+                                     (bytes / 1024) %
+                                     filenames.size() %
+                                     elapsed.total_milliseconds()));
+   return Success();
 }
    
 Error PlotManager::restorePlotsState()
@@ -621,6 +912,29 @@ Error PlotManager::restorePlotsState()
       plots.erase(plots.begin());
    }
    
+   // read the snapshot ids of plots whose snapshots are shared (absent
+   // for plots stored before snapshots were shared)
+   std::map<std::string,std::string> snapshotIds;
+   if (plotSnapshotsStateFile_.exists())
+   {
+      std::vector<std::string> snapshots;
+      error = readStringVectorFromFile(plotSnapshotsStateFile_, &snapshots);
+      if (error)
+         LOG_ERROR(error);
+
+      BOOST_FOREACH(const std::string& snapshotInfo, snapshots)
+      {
+         boost::cmatch matches;
+         if (regex_utils::match(snapshotInfo.c_str(),
+                                matches,
+                                plotSnapshotRegex_) &&
+             (matches.size() > 2))
+         {
+            snapshotIds[matches[1]] = matches[2];
+         }
+      }
+   }
+
    // initialize plot list
    std::string plotInfo;
    for (int i=0; i<(int)plots.size(); ++i)
@@ -643,7 +957,8 @@ Error PlotManager::restorePlotsState()
       PtrPlot ptrPlot(new Plot(graphicsDevice_,
                                graphicsPath_,
                                plotStorageId,
-                               renderedSize));
+                               renderedSize,
+                               snapshotIds[plotStorageId]));
 
       // ensure it actually exists on disk before we add it
       if (ptrPlot->hasValidStorage())
@@ -709,7 +1024,17 @@ Error PlotManager::serialize(const FilePath& saveToPath)
       return error;
 
    // copy the plots dir to the save to path
-   return copyDirectory(graphicsPath_, saveToPath);
+   boost::posix_time::ptime startTime =
+                           boost::posix_time::microsec_clock::universal_time();
+   error = copyDirectory(graphicsPath_, saveToPath);
+   if (error)
+      return error;
+
+   boost::posix_time::time_duration elapsed =
+         boost::posix_time::microsec_clock::universal_time() - startTime;
+   boost::format fmt("Copied plot history in %1% ms");
+   LOG_INFO_MESSAGE(boost::str(fmt % elapsed.total_milliseconds()));
+   return Success();
 }
 
 Error PlotManager::deserialize(const FilePath& restoreFromPath)
@@ -735,8 +1060,10 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
       if (previousPageSnapshot != R_NilValue)
       {
          r::sexp::Protect protectSnapshot(previousPageSnapshot);
+         std::string snapshotId = activePlot().snapshotId();
          Error error = activePlot().renderFromDisplaySnapshot(
                                                          previousPageSnapshot);
+         removeSnapshotIfUnreferenced(snapshotId);
          if (error)
             logAndReportError(error, ERROR_LOCATION);
       }
@@ -757,8 +1084,13 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
                                graphicsPath_,
                                activePlot().manipulatorSEXP()));
 
+      // the replaced plot's images are stale
+      uncachePlot(activePlot());
+
       // replace active plot
+      std::string snapshotId = activePlot().snapshotId();
       plots_[activePlotIndex()] = ptrPlot;
+      removeSnapshotIfUnreferenced(snapshotId);
    }
    else
    {
@@ -773,15 +1105,19 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
                                plotManipulatorManager().pendingManipulatorSEXP()));
 
       // if we're full then remove the first plot's files before adding a new one
+      std::string snapshotId;
       if (plots_.full())
       {
+         uncachePlot(*plots_.front());
          Error error = plots_.front()->removeFiles();
          if (error)
             LOG_ERROR(error);
+         snapshotId = plots_.front()->snapshotId();
       }
 
       // add the plot
       plots_.push_back(ptrPlot);
+      removeSnapshotIfUnreferenced(snapshotId);
       activePlot_ = plots_.size() - 1  ;
    }
 
@@ -805,7 +1141,7 @@ void PlotManager::onDeviceResized()
    if (suppressDeviceEvents_)
       return;
    
-   invalidateActivePlot();
+   invalidateActivePlot(false);
 }
 
 void PlotManager::onDeviceClosed()
@@ -816,6 +1152,7 @@ void PlotManager::onDeviceClosed()
    // clear plots
    activePlot_ = -1;
    plots_.clear();
+   plotCache_.clear();
    
    // trip changes flag to ensure repaint
    setDisplayHasChanges(true);
@@ -825,6 +1162,10 @@ void PlotManager::onDeviceClosed()
    if (error)
       LOG_ERROR(error);
 
+   error = plotSnapshotsStateFile_.removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
    error = graphicsPath_.removeIfExists();
    if (error)
       LOG_ERROR(error);
@@ -856,12 +1197,40 @@ void PlotManager::setDisplayHasChanges(bool hasChanges)
 }
 
    
-void PlotManager::invalidateActivePlot()
+void PlotManager::invalidateActivePlot(bool contentsChanged)
 {
    setDisplayHasChanges(true);
    
    if (hasPlot())
-      activePlot().invalidate();
+   {
+      // images of the previous contents won't be shown again
+      if (contentsChanged)
+         uncachePlot(activePlot());
+
+      activePlot().invalidate(contentsChanged);
+   }
+}
+
+void PlotManager::uncachePlot(const Plot& plot)
+{
+   plotCache_.remove(plot.contentsUuid());
+}
+
+void PlotManager::removeSnapshotIfUnreferenced(const std::string& snapshotId)
+{
+   if (snapshotId.empty())
+      return;
+
+   BOOST_FOREACH(const PtrPlot& ptrPlot, plots_)
+   {
+      if (ptrPlot->snapshotId() == snapshotId)
+         return;
+   }
+
+   Error error = graphicsPath_.complete(snapshotId + ".snapshot")
+                                                         .removeIfExists();
+   if (error)
+      LOG_ERROR(error);
 }
    
 // render active plot to display (used in setActivePlot and onSessionResume)
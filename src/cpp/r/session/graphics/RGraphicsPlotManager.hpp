@@ -16,6 +16,8 @@
 #ifndef R_SESSION_GRAPHICS_PLOT_MANAGER_HPP
 #define R_SESSION_GRAPHICS_PLOT_MANAGER_HPP
 
+#include <deque>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -33,6 +35,7 @@
 
 #include "RGraphicsTypes.hpp"
 #include "RGraphicsPlot.hpp"
+#include "RGraphicsPlotCache.hpp"
 
 namespace rstudio {
 namespace r {
@@ -96,6 +99,18 @@ public:
                                           int widthPx,
                                           int heightPx);
 
+   virtual core::Error activePlotAsPng(
+                           int widthPx,
+                           int heightPx,
+                           double devicePixelRatio,
+                           boost::shared_ptr<const std::string>* pImage,
+                           std::string* pETag);
+
+   virtual bool hasPrerenderWork() const;
+   virtual bool prerenderActivePlot();
+
+   virtual void compactPlotHistory();
+
    // display
    virtual bool hasOutput() const;
    virtual bool hasChanges() const;
@@ -146,8 +161,29 @@ private:
    // set change flag
    void setDisplayHasChanges(bool hasChanges);
 
-   // invalidate the active plot
-   void invalidateActivePlot();
+   // invalidate the active plot (its contents are unchanged if it's only
+   // being resized)
+   void invalidateActivePlot(bool contentsChanged = true);
+
+   // remove a plot's rendered images from the cache
+   void uncachePlot(const Plot& plot);
+
+   // remove a snapshot once no plot refers to it
+   void removeSnapshotIfUnreferenced(const std::string& snapshotId);
+
+   // render the active plot as a PNG, via the cache
+   core::Error renderActivePlotAsPng(
+                           const PlotCacheKey& cacheKey,
+                           boost::shared_ptr<const std::string>* pImage);
+
+   // remember a size the active plot was requested at
+   void noteRequestedSize(int widthPx, int heightPx, double devicePixelRatio);
+
+   // queue speculative renders of the active plot
+   void queuePrerender();
+
+   // the files plots are stored in, and their total size
+   uintmax_t historyFiles(std::set<std::string>* pFilenames) const;
 
    // render active plot to display (used in setActivePlot and onSessionResume)
    void renderActivePlotToDisplay();
@@ -183,6 +219,7 @@ private:
 
    // storage paths
    core::FilePath plotsStateFile_;
+   core::FilePath plotSnapshotsStateFile_;
    core::FilePath graphicsPath_;
   
    // interface to graphics device
@@ -195,8 +232,18 @@ private:
    
    int activePlot_;
    boost::circular_buffer<PtrPlot> plots_ ;
+
+   // recently rendered images of plots
+   PlotCache plotCache_;
+
+   // sizes plots were recently requested at (most recent first; the keys
+   // have no contents id), and renders of the active plot at those sizes
+   // and any configured export sizes not yet in the cache
+   std::deque<PlotCacheKey> requestedSizes_;
+   std::deque<PlotCacheKey> prerenderQueue_;
    
    boost::regex plotInfoRegex_;
+   boost::regex plotSnapshotRegex_;
 };
 
 class SuppressDeviceEventsScope
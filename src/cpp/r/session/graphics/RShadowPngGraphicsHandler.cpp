@@ -13,12 +13,16 @@
  *
  */
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 
 #include <core/system/System.hpp>
+#include <core/SafeConvert.hpp>
 #include <core/StringUtils.hpp>
 
 #include <r/RExec.hpp>
@@ -70,10 +74,28 @@ private:
 
 struct ShadowDeviceData
 {
-   ShadowDeviceData() : pShadowPngDevice(NULL) {}
+   ShadowDeviceData() : pShadowPngDevice(NULL), pageFlushed(false) {}
    pDevDesc pShadowPngDevice;
+
+   // has the current page been written out (leaving the device blank)?
+   bool pageFlushed;
 };
 
+// the shadow device writes each page to its own file in the directory at
+// pDC->targetPath, numbered by page (a page is written when the next
+// one begins, so we can take a finished page without closing the device)
+const char * const kPageFilePattern = "%d.png";
+
+int pageNumber(const FilePath& pageFile)
+{
+   return safe_convert::stringTo<int>(pageFile.stem(), -1);
+}
+
+bool comparePageNumbers(const FilePath& a, const FilePath& b)
+{
+   return pageNumber(a) < pageNumber(b);
+}
+
 void shadowDevOff(DeviceContext* pDC)
 {
    ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
@@ -105,6 +127,13 @@ Error shadowDevDesc(DeviceContext* pDC, pDevDesc* pDev)
        ndevNumber(pDevData->pShadowPngDevice) == 0)
    {
       pDevData->pShadowPngDevice = NULL;
+      pDevData->pageFlushed = false;
+
+      // page numbers start over with the device, so clear out pages
+      // left by any previous one
+      Error error = pDC->targetPath.resetDirectory();
+      if (error)
+         return error;
 
       PreserveCurrentDeviceScope preserveCurrentDeviceScope;
 
@@ -116,7 +145,9 @@ Error shadowDevDesc(DeviceContext* pDC, pDevDesc* pDev)
       // create PNG device (completely bail on error)
       boost::format fmt("grDevices:::png(\"%1%\", %2%, %3%, res = %4% %5%)");
       std::string code = boost::str(fmt %
-                                    string_utils::utf8ToSystem(pDC->targetPath.absolutePath()) %
+                                    string_utils::utf8ToSystem(
+                                       pDC->targetPath.complete(kPageFilePattern)
+                                                      .absolutePath()) %
                                     width %
                                     height %
                                     res %
@@ -162,6 +193,48 @@ pDevDesc shadowDevDesc(pDevDesc dev)
    return NULL;
 }
 
+// the shadow device to draw on (whose page is no longer blank once drawn on)
+pDevDesc shadowDevPageDesc(pDevDesc dev)
+{
+   pDevDesc shadowDev = shadowDevDesc(dev);
+
+   DeviceContext* pDC = (DeviceContext*)dev->deviceSpecific;
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   pDevData->pageFlushed = false;
+
+   return shadowDev;
+}
+
+// a page written out by shadowDevFlushPage leaves the shadow device on a
+// blank page (painted the canvas colour, its file already begun). starting
+// another page would have the device write the blank one out as a page of
+// its own, so instead the blank page is reused, painted with the new
+// page's background
+void paintBlankPage(const pGEcontext gc, pDevDesc dev)
+{
+   if (!R_OPAQUE(gc->fill))
+      return;
+
+   R_GE_gcontext background = *gc;
+   background.col = R_TRANWHITE;
+   dev_desc::clip(dev->left, dev->right, dev->bottom, dev->top, dev);
+   dev_desc::rect(dev->left, dev->bottom, dev->right, dev->top,
+                  &background, dev);
+}
+
+// the shadow device's own newPage, while replayNewPage stands in for it
+dev_desc::NewPageFunction s_pngNewPage = NULL;
+
+// the shadow device's newPage while the display list is replayed onto a
+// blank page (only the first page replayed can reuse it)
+void replayNewPage(const pGEcontext gc, pDevDesc dev)
+{
+   dev_desc::setNewPage(dev, s_pngNewPage);
+   s_pngNewPage = NULL;
+
+   paintBlankPage(gc, dev);
+}
+
 FilePath tempFile(const std::string& extension)
 {
    FilePath tempFileDir(string_utils::systemToUtf8(R_TempDir));
@@ -189,6 +262,11 @@ void shadowDevSync(DeviceContext* pDC)
    }
    selectDevice(ndevNumber(dev));
 
+   // replay onto the blank page left by a flush rather than writing it out
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   if (pDevData->pageFlushed)
+      s_pngNewPage = dev_desc::setNewPage(dev, replayNewPage);
+
    // copy display list (ignore R errors because they can happen in the normal
    // course of things for invalid graphics states). also suppress output
    // in scope because R 3.0 seems to sneak out error messages from within
@@ -199,6 +277,65 @@ void shadowDevSync(DeviceContext* pDC)
       if (error && !r::isCodeExecutionError(error))
          LOG_ERROR(error);
    }
+
+   // restore the device's newPage if the display list had no page
+   if (s_pngNewPage != NULL)
+   {
+      dev_desc::setNewPage(dev, s_pngNewPage);
+      s_pngNewPage = NULL;
+   }
+
+   pDevData->pageFlushed = false;
+}
+
+// write out the shadow device's current page by starting a new one, and
+// return the file it was written to. the device stays open (with a blank
+// page) so it needn't be recreated and replayed onto afterwards
+Error shadowDevFlushPage(DeviceContext* pDC, FilePath* pPageFile)
+{
+   pDevDesc dev = NULL;
+   Error error = shadowDevDesc(pDC, &dev);
+   if (error)
+      return error;
+
+   R_GE_gcontext gc = R_GE_gcontext();
+   gc.col = R_TRANWHITE;
+   gc.fill = R_TRANWHITE;
+   gc.gamma = 1;
+   gc.lwd = 1;
+   gc.cex = 1;
+   gc.ps = 12;
+   gc.lineheight = 1;
+   error = r::exec::executeSafely(boost::bind(dev_desc::newPage, &gc, dev));
+   if (error)
+      return error;
+
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   pDevData->pageFlushed = true;
+
+   // the newest page file is the one just begun; the one before it is
+   // the page we want and any older ones are stale
+   std::vector<FilePath> pageFiles;
+   error = pDC->targetPath.children(&pageFiles);
+   if (error)
+      return error;
+   std::sort(pageFiles.begin(), pageFiles.end(), comparePageNumbers);
+
+   *pPageFile = FilePath();
+   if (pageFiles.size() >= 2)
+   {
+      *pPageFile = pageFiles[pageFiles.size() - 2];
+      pageFiles.resize(pageFiles.size() - 2);
+   }
+
+   BOOST_FOREACH(const FilePath& staleFile, pageFiles)
+   {
+      Error removeError = staleFile.remove();
+      if (removeError)
+         LOG_ERROR(removeError);
+   }
+
+   return Success();
 }
 
 } // anonymous namespace
@@ -206,7 +343,7 @@ void shadowDevSync(DeviceContext* pDC)
 
 bool initialize(int width, int height, double devicePixelRatio, DeviceContext* pDC)
 {
-   pDC->targetPath = tempFile("png");
+   pDC->targetPath = tempFile("pages");
    pDC->width = width;
    pDC->height = height;
    pDC->devicePixelRatio = devicePixelRatio;
@@ -226,8 +363,14 @@ DeviceContext* allocate(pDevDesc dev)
 
 void destroy(DeviceContext* pDC)
 {
-   // nix the shadow device
+   // nix the shadow device and its pages
    shadowDevOff(pDC);
+   if (!pDC->targetPath.empty())
+   {
+      Error error = pDC->targetPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
 
    // delete pointers
    ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
@@ -275,50 +418,19 @@ Error writeToPNG(const FilePath& targetPath, DeviceContext* pDC)
    // sync the shadow device to ensure we have the full playlist,
    shadowDevSync(pDC);
 
-   // turn the shadow device off to write the file
-   shadowDevOff(pDC);
-
-   // if the targetPath != the bitmap path then copy it
-   Error error;
-   if (targetPath != pDC->targetPath)
-   {
-      // the target path would not exist if R failed to write the PNG
-      // (e.g. because the graphics device was too small for the content)
-      if (!pDC->targetPath.exists())
-      {
-         error = pathNotFoundError(ERROR_LOCATION);
-      }
-      else
-      {
-         error = pDC->targetPath.copy(targetPath);
-
-         Error deleteError = pDC->targetPath.remove();
-         if (deleteError)
-            LOG_ERROR(error);
-      }
-   }
-
-   // regenerate the shadow device
-   pDevDesc dev = pDC->dev;
-   int width = pDC->width;
-   int height = pDC->height;
-   double devicePixelRatio = pDC->devicePixelRatio;
-   handler::destroy(pDC);
-   pDC = handler::allocate(dev);
-   dev->deviceSpecific = pDC;
-
-   // re-create with the correct size
-   if (!handler::initialize(width, height, devicePixelRatio, pDC))
-      return systemError(boost::system::errc::not_connected, ERROR_LOCATION);
-
-   // now update the device structure
-   handler::setSize(dev);
+   // write out the page while keeping the device (and its state) alive
+   FilePath pageFile;
+   Error error = shadowDevFlushPage(pDC, &pageFile);
+   if (error)
+      return error;
 
-   // replay the rstudio graphics device context onto the png
-   shadowDevSync(pDC);
+   // the page file would not exist if R failed to write the PNG
+   // (e.g. because the graphics device was too small for the content)
+   if (pageFile.empty() || !pageFile.exists())
+      return pathNotFoundError(ERROR_LOCATION);
 
-   // return status
-   return error;
+   // move it into place (a rename unless the target is on another device)
+   return pageFile.move(targetPath);
 }
 
 
@@ -328,7 +440,7 @@ void circle(double x,
             const pGEcontext gc,
             pDevDesc dev)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dev);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dev);
    if (pngDevDesc == NULL)
       return;
    
@@ -342,7 +454,7 @@ void line(double x1,
           const pGEcontext gc,
           pDevDesc dev)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dev);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dev);
    if (pngDevDesc == NULL)
       return;
  
@@ -355,7 +467,7 @@ void polygon(int n,
              const pGEcontext gc,
              pDevDesc dev)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dev);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dev);
    if (pngDevDesc == NULL)
       return;
    
@@ -368,7 +480,7 @@ void polyline(int n,
               const pGEcontext gc,
               pDevDesc dev)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dev);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dev);
    if (pngDevDesc == NULL)
       return;
    
@@ -382,7 +494,7 @@ void rect(double x0,
           const pGEcontext gc,
           pDevDesc dev)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dev);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dev);
    if (pngDevDesc == NULL)
       return;
    
@@ -397,7 +509,7 @@ void path(double *x,
           const pGEcontext gc,
           pDevDesc dd)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dd);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dd);
    if (pngDevDesc == NULL)
       return;
    
@@ -416,7 +528,7 @@ void raster(unsigned int *raster,
             const pGEcontext gc,
             pDevDesc dd)
 {
-   pDevDesc pngDevDesc = shadowDevDesc(dd);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dd);
    if (pngDevDesc == NULL)
       return;
    
@@ -435,6 +547,12 @@ void raster(unsigned int *raster,
 
 SEXP cap(pDevDesc dd)
 {
+   // if the page was written out then restore it before capturing
+   DeviceContext* pDC = (DeviceContext*)dd->deviceSpecific;
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   if (pDevData->pageFlushed)
+      shadowDevSync(pDC);
+
    pDevDesc pngDevDesc = shadowDevDesc(dd);
    if (pngDevDesc == NULL)
       return R_NilValue;
@@ -473,7 +591,7 @@ void text(double x,
           const pGEcontext gc,
           pDevDesc dev)
 {   
-   pDevDesc pngDevDesc = shadowDevDesc(dev);
+   pDevDesc pngDevDesc = shadowDevPageDesc(dev);
    if (pngDevDesc == NULL)
       return;
    
@@ -494,8 +612,18 @@ void newPage(const pGEcontext gc, pDevDesc dev)
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
-   
-   dev_desc::newPage(gc, pngDevDesc);
+
+   DeviceContext* pDC = (DeviceContext*)dev->deviceSpecific;
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   if (pDevData->pageFlushed)
+   {
+      paintBlankPage(gc, pngDevDesc);
+      pDevData->pageFlushed = false;
+   }
+   else
+   {
+      dev_desc::newPage(gc, pngDevDesc);
+   }
 }
 
 void mode(int mode, pDevDesc dev)
@@ -0,0 +1,89 @@
+/*
+ * RShadowPngGraphicsHandlerTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+
+#include <r/RExec.hpp>
+#include <r/session/RGraphics.hpp>
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+
+namespace {
+
+void ignoreDisplayState(DisplayState)
+{
+}
+
+} // anonymous namespace
+
+TEST_CASE("Plot Refresh Benchmark", "[.benchmark]")
+{
+   bool hasGgplot2 = false;
+   core::Error error = r::exec::evaluateString(
+            "requireNamespace('ggplot2', quietly = TRUE)", &hasGgplot2);
+   if (error || !hasGgplot2)
+   {
+      WARN("ggplot2 is not installed; skipping the plot refresh benchmark");
+      return;
+   }
+
+   // a heavy figure: many points over nine facets, each with a smoother
+   REQUIRE_FALSE(r::exec::executeString(
+      ".rs.plotRefreshBenchmark <- local({\n"
+      "   set.seed(1)\n"
+      "   n <- 100000\n"
+      "   data <- data.frame(x = rnorm(n), y = rnorm(n),\n"
+      "                      g = sample(letters[1:9], n, replace = TRUE))\n"
+      "   ggplot2::ggplot(data, ggplot2::aes(x, y)) +\n"
+      "      ggplot2::geom_point(alpha = 0.1) +\n"
+      "      ggplot2::geom_smooth(method = 'lm') +\n"
+      "      ggplot2::facet_wrap(~ g)\n"
+      "})"));
+
+   // each refresh writes the drawn plot out to the plots pane's image
+   const int kRefreshes = 10;
+   boost::posix_time::time_duration elapsed;
+   for (int i = 0; i < kRefreshes; i++)
+   {
+      REQUIRE_FALSE(r::exec::executeString("print(.rs.plotRefreshBenchmark)"));
+
+      boost::posix_time::ptime start =
+            boost::posix_time::microsec_clock::universal_time();
+      display().render(ignoreDisplayState);
+      elapsed += boost::posix_time::microsec_clock::universal_time() - start;
+
+      CHECK(display().hasOutput());
+      CHECK(!display().hasChanges());
+   }
+
+   WARN("Refreshed a ggplot2 plot in "
+        << elapsed.total_milliseconds() / kRefreshes << "ms on average");
+
+   r::exec::executeString("grDevices::dev.off(); "
+                          "rm(.rs.plotRefreshBenchmark)");
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
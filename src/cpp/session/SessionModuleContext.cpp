@@ -846,6 +846,21 @@ void scheduleDelayedWork(const boost::posix_time::time_duration& period,
                         false);
 }
 
+core::thread::ThreadPool& workerThreadPool()
+{
+   // never freed, so that it outlives work still running at exit
+   static core::thread::ThreadPool* s_pPool = NULL;
+   if (s_pPool == NULL)
+   {
+      const std::size_t kMaxWorkerThreads = 8;
+      std::size_t threads = std::min<std::size_t>(
+                        boost::thread::hardware_concurrency(),
+                        kMaxWorkerThreads);
+      s_pPool = new core::thread::ThreadPool(std::max<std::size_t>(threads, 1));
+   }
+   return *s_pPool;
+}
+
 
 void onBackgroundProcessing(bool isIdle)
 {
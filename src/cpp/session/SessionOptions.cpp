@@ -232,6 +232,12 @@ core::ProgramStatus Options::read(int argc, char * const argv[], std::ostream& o
       ("session-first-project-template-path",
        value<std::string>(&firstProjectTemplatePath_)->default_value(""),
        "first project template path")
+      ("session-libclang-pch-cache-path",
+       value<std::string>(&libclangPchCachePath_)->default_value(""),
+       "directory for sharing libclang precompiled headers between users")
+      ("session-libclang-pch-cache-max-mb",
+       value<int>(&libclangPchCacheMaxMb_)->default_value(1024),
+       "maximum size of the libclang precompiled header cache (MB)")
       ("default-rsconnect-server",
        value<std::string>(&defaultRSConnectServer_)->default_value(""),
        "default RStudio Connect server URL")
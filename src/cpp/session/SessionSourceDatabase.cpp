@@ -47,8 +47,7 @@
 #include <session/projects/SessionProjects.hpp>
 
 #include "SessionSourceDatabaseSupervisor.hpp"
-
-#define kContentsSuffix "-contents"
+#include "SessionSourceDatabaseJournal.hpp"
 
 // NOTE: if a file is deleted then its properties database entry is not
 // deleted. this has two implications:
@@ -81,6 +80,59 @@ namespace {
 // lookup)
 std::map<std::string, std::string> s_idToPath;
 
+// the documents of this session's source database
+SourceDatabaseJournal& journal()
+{
+   static SourceDatabaseJournal instance(source_database::path(),
+                                         options().sourceLineEnding());
+   return instance;
+}
+
+// checkpoint the journal a while after it was written to
+bool s_checkpointScheduled = false;
+
+void checkpointJournal()
+{
+   s_checkpointScheduled = false;
+   Error error = journal().checkpoint();
+   if (error)
+      LOG_ERROR(error);
+}
+
+void scheduleCheckpoint()
+{
+   if (!s_checkpointScheduled && journal().journalBytes() > 0)
+   {
+      s_checkpointScheduled = true;
+      module_context::scheduleDelayedWork(boost::posix_time::minutes(5),
+                                          checkpointJournal);
+   }
+}
+
+// the properties file written for each path (so unchanged properties
+// aren't rewritten)
+std::map<std::string, FilePath> s_durablePropertiesFiles;
+
+// are the properties of a path already on disk? (they are compared with
+// its file as another session may have rewritten it)
+bool isDurable(const std::string& path, const std::string& properties)
+{
+   std::map<std::string, FilePath>::const_iterator it =
+                                       s_durablePropertiesFiles.find(path);
+   if (it == s_durablePropertiesFiles.end() || !it->second.exists())
+      return false;
+
+   std::string durableProperties;
+   Error error = readStringFromFile(it->second, &durableProperties);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return durableProperties == properties;
+}
+
 struct PropertiesDatabase
 {
    FilePath path;
@@ -105,6 +157,12 @@ Error getPropertiesDatabase(PropertiesDatabase* pDatabase)
 
 Error putProperties(const std::string& path, const json::Object& properties)
 {
+   // nothing to do if the properties haven't changed
+   std::ostringstream ostr ;
+   json::writeFormatted(properties, ostr);
+   if (isDurable(path, ostr.str()))
+      return Success();
+
    // url escape path (so we can use key=value persistence)
    std::string escapedPath = http::util::urlEncode(path);
 
@@ -126,12 +184,11 @@ Error putProperties(const std::string& path, const json::Object& properties)
    }
 
    // write the file
-   std::ostringstream ostr ;
-   json::writeFormatted(properties, ostr);
    FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
    error = writeStringToFile(propertiesFilePath, ostr.str());
    if (error)
       return error;
+   s_durablePropertiesFiles[path] = propertiesFilePath;
 
    // update the index if necessary
    if (updateIndex)
@@ -220,8 +277,11 @@ std::string pathFromProjectPath(json::Value projPathJson)
 }
 
 Error attemptContentsMigration(json::Object& propertiesJson,
-                               const FilePath& propertiesPath)
+                               const FilePath& propertiesPath,
+                               bool* pMigrated)
 {
+   *pMigrated = false;
+
    // extract contents from properties (if it exists)
    if (!propertiesJson.count("contents"))
       return Success();
@@ -242,7 +302,12 @@ Error attemptContentsMigration(json::Object& propertiesJson,
       return Success();
    
    // write contents sidecar file
-   return writeStringToFile(contentsPath, contents);
+   Error error = writeStringToFile(contentsPath, contents);
+   if (error)
+      return error;
+
+   *pMigrated = true;
+   return Success();
 }
 
 bool isIntendedAsReadOnly(const std::string& contents,
@@ -642,31 +707,13 @@ Error get(const std::string& id, bool includeContents, boost::shared_ptr<SourceD
 {
    FilePath propertiesPath = source_database::path().complete(id);
    
-   // attempt to read file contents from sidecar file if available
-   std::string contents;
-   if (includeContents)
-   {
-      FilePath contentsPath(propertiesPath.absolutePath() + kContentsSuffix);
-      if (contentsPath.exists())
-      {
-         Error error = readStringFromFile(contentsPath,
-                                          &contents,
-                                          options().sourceLineEnding());
-         if (error)
-            LOG_ERROR(error);
-      }
-   }
-   
-   if (propertiesPath.exists())
+   // read the document (as of its latest journaled changes)
+   std::string properties, contents;
+   Error error = journal().read(id,
+                                &properties,
+                                includeContents ? &contents : NULL);
+   if (!error)
    {
-      // read the contents of the file
-      std::string properties;
-      Error error = readStringFromFile(propertiesPath,
-                                       &properties,
-                                       options().sourceLineEnding());
-      if (error)
-         return error;
-   
       // parse the json
       json::Value value;
       if (!json::parse(properties, &value))
@@ -680,9 +727,14 @@ Error get(const std::string& id, bool includeContents, boost::shared_ptr<SourceD
       
       // migration: if we have a 'contents' field, but no '-contents' side-car
       // file, perform a one-time generation of that sidecar file from contents
-      error = attemptContentsMigration(jsonDoc, propertiesPath);
+      bool migrated = false;
+      error = attemptContentsMigration(jsonDoc, propertiesPath, &migrated);
       if (error)
          LOG_ERROR(error);
+
+      // the journal read the document before it had a contents file
+      if (migrated)
+         journal().invalidate(id);
       
       if (includeContents && !contents.empty())
          jsonDoc["contents"] = contents;
@@ -694,8 +746,7 @@ Error get(const std::string& id, bool includeContents, boost::shared_ptr<SourceD
    }
    else
    {
-      return systemError(boost::system::errc::no_such_file_or_directory,
-                         ERROR_LOCATION);
+      return error;
    }
 }
 
@@ -714,6 +765,7 @@ bool isSourceDocument(const FilePath& filePath)
        filename == "lock_file" ||
        filename == "suspend_file" ||
        filename == "restart_file" ||
+       filename == kJournalFile ||
        boost::algorithm::ends_with(filename, kContentsSuffix))
    {
       return false;
@@ -838,11 +890,19 @@ Error list(std::vector<FilePath>* pPaths)
    
 Error put(boost::shared_ptr<SourceDocument> pDoc, bool writeContents)
 {   
-   // write to file
-   FilePath filePath = source_database::path().complete(pDoc->id());
-   Error error = pDoc->writeToFile(filePath, writeContents);
+   // get document properties as json
+   json::Object jsonProperties;
+   pDoc->writeToJson(&jsonProperties, false);
+   std::ostringstream oss;
+   json::writeFormatted(jsonProperties, oss);
+
+   // write to the journal (checkpointing it once we're idle)
+   Error error = journal().write(pDoc->id(),
+                                 oss.str(),
+                                 writeContents ? &pDoc->contents() : NULL);
    if (error)
       return error ;
+   scheduleCheckpoint();
 
    // write properties to durable storage (if there is a path)
    if (!pDoc->path().empty())
@@ -857,7 +917,12 @@ Error put(boost::shared_ptr<SourceDocument> pDoc, bool writeContents)
    
 Error remove(const std::string& id)
 {
-   return source_database::path().complete(id).removeIfExists();
+   Error error = source_database::path().complete(id).removeIfExists();
+   if (error)
+      return error;
+
+   journal().remove(id);
+   return Success();
 }
    
 Error removeAll()
@@ -873,7 +938,8 @@ Error removeAll()
       if (error)
          return error ;
    }
-   
+
+   journal().clear();
    return Success();
 }
 
@@ -970,6 +1036,11 @@ void onQuit()
 
 void onSuspend(const r::session::RSuspendOptions& options, core::Settings*)
 {
+   // the suspended session resumes from the documents' files
+   Error error = journal().checkpoint();
+   if (error)
+      LOG_ERROR(error);
+
    supervisor::suspendSourceDatabase(options.status);
 }
 
@@ -1043,6 +1114,12 @@ Error initialize()
    if (error)
       return error;
 
+   // apply changes journaled by a session which didn't live to checkpoint
+   // them (if we adopted its source database)
+   error = journal().recover();
+   if (error)
+      LOG_ERROR(error);
+
    RS_REGISTER_CALL_METHOD(rs_getDocumentProperties, 2);
 
    events().onDocUpdated.connect(onDocUpdated);
@@ -0,0 +1,418 @@
+/*
+ * SessionSourceDatabaseJournal.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionSourceDatabaseJournal.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include <boost/format.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/Log.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+
+namespace {
+
+// checkpoint once the journal grows past this size
+const boost::uintmax_t kCheckpointBytes = 4 * 1024 * 1024;
+
+// journal records are a header line followed by a payload and a newline:
+//
+//    <type> <id> <offset> <length> <base hash> <hash> <payload size>
+//
+// properties records replace a document's properties with the payload;
+// contents records replace the range [offset, offset + length) of contents
+// hashing to the base hash with the payload, giving contents with the hash
+const char kPropertiesRecord = 'p';
+const char kContentsRecord = 'c';
+
+std::string record(char type,
+                   const std::string& id,
+                   std::size_t offset,
+                   std::size_t length,
+                   const std::string& baseHash,
+                   const std::string& hash,
+                   const std::string& payload)
+{
+   boost::format fmt("%1% %2% %3% %4% %5% %6% %7%\n");
+   return boost::str(fmt % type % id % offset % length % baseHash % hash %
+                           payload.size()) + payload + "\n";
+}
+
+std::string contentsRecord(const std::string& id,
+                           const std::string& from,
+                           const std::string& to)
+{
+   // the changed range is what lies between the common prefix and suffix
+   std::size_t common = std::min(from.size(), to.size());
+   std::size_t prefix = 0;
+   while (prefix < common && from[prefix] == to[prefix])
+      prefix++;
+   std::size_t suffix = 0;
+   while (suffix < common - prefix &&
+          from[from.size() - suffix - 1] == to[to.size() - suffix - 1])
+   {
+      suffix++;
+   }
+
+   return record(kContentsRecord,
+                 id,
+                 prefix,
+                 from.size() - prefix - suffix,
+                 hash::crc32HexHash(from),
+                 hash::crc32HexHash(to),
+                 to.substr(prefix, to.size() - prefix - suffix));
+}
+
+} // anonymous namespace
+
+void SourceDatabaseJournal::Document::setContents(const std::string& value)
+{
+   contents = value;
+   hasContents = true;
+}
+
+void SourceDatabaseJournal::Document::releaseContents()
+{
+   std::string().swap(contents);
+   hasContents = false;
+}
+
+SourceDatabaseJournal::SourceDatabaseJournal(
+                                 const FilePath& dirPath,
+                                 string_utils::LineEnding lineEnding)
+   : dirPath_(dirPath),
+     lineEnding_(lineEnding),
+     journalBytes_(0)
+{
+}
+
+Error SourceDatabaseJournal::read(const std::string& id,
+                                  std::string* pProperties,
+                                  std::string* pContents)
+{
+   Document* pDocument = NULL;
+   Error error = load(id, pContents != NULL, &pDocument);
+   if (error)
+      return error;
+
+   *pProperties = pDocument->properties;
+   if (pContents != NULL)
+   {
+      *pContents = pDocument->contents;
+      if (!pDocument->contentsChanged)
+         pDocument->releaseContents();
+   }
+   return Success();
+}
+
+Error SourceDatabaseJournal::write(const std::string& id,
+                                   const std::string& properties,
+                                   const std::string* pContents)
+{
+   // documents not yet stored are written whole
+   FilePath documentPath = propertiesPath(id);
+   if (documents_.find(id) == documents_.end() && !documentPath.exists())
+   {
+      Document document;
+      if (pContents != NULL)
+      {
+         Error error = writeStringToFile(contentsPath(id), *pContents);
+         if (error)
+            return error;
+      }
+
+      Error error = writeStringToFile(documentPath, properties);
+      if (error)
+         return error;
+
+      document.properties = properties;
+      documents_[id] = document;
+      return Success();
+   }
+
+   // otherwise journal what changed (the contents are compared with those
+   // held or, once written through, with the contents file; a hash of them
+   // could collide and lose an edit)
+   Document* pDocument = NULL;
+   Error error = load(id, pContents != NULL, &pDocument);
+   if (error)
+      return error;
+
+   bool contentsChanged = pContents != NULL &&
+                          *pContents != pDocument->contents;
+
+   std::string records;
+   if (contentsChanged)
+      records += contentsRecord(id, pDocument->contents, *pContents);
+   if (properties != pDocument->properties)
+   {
+      records += record(kPropertiesRecord, id, 0, 0, "-", "-", properties);
+   }
+   // contents without changes to write through needn't be held
+   if (!pDocument->contentsChanged && !contentsChanged)
+      pDocument->releaseContents();
+   if (records.empty())
+      return Success();
+
+   error = appendToFile(journalPath(), records);
+   if (error)
+      return error;
+   journalBytes_ += records.size();
+
+   if (contentsChanged)
+   {
+      pDocument->setContents(*pContents);
+      pDocument->contentsChanged = true;
+   }
+   pDocument->properties = properties;
+   pDocument->changed = true;
+
+   if (journalBytes_ > kCheckpointBytes)
+      return checkpoint();
+   else
+      return Success();
+}
+
+void SourceDatabaseJournal::remove(const std::string& id)
+{
+   // records of the document left in the journal are skipped on recovery
+   // (as it no longer has a properties file)
+   documents_.erase(id);
+}
+
+void SourceDatabaseJournal::invalidate(const std::string& id)
+{
+   std::map<std::string, Document>::iterator it = documents_.find(id);
+   if (it == documents_.end())
+      return;
+
+   Document& document = it->second;
+   if (!document.changed)
+   {
+      documents_.erase(it);
+   }
+   else if (!document.contentsChanged)
+   {
+      document.releaseContents();
+   }
+}
+
+void SourceDatabaseJournal::clear()
+{
+   documents_.clear();
+   journalBytes_ = 0;
+}
+
+Error SourceDatabaseJournal::checkpoint()
+{
+   for (std::map<std::string, Document>::iterator it = documents_.begin();
+        it != documents_.end();
+        ++it)
+   {
+      Document& document = it->second;
+      if (!document.changed)
+         continue;
+
+      // skip documents removed from under us
+      FilePath documentPath = propertiesPath(it->first);
+      if (!documentPath.exists())
+         continue;
+
+      if (document.contentsChanged)
+      {
+         Error error = writeStringToFile(contentsPath(it->first),
+                                         document.contents);
+         if (error)
+            return error;
+      }
+
+      Error error = writeStringToFile(documentPath, document.properties);
+      if (error)
+         return error;
+
+      document.releaseContents();
+      document.changed = false;
+      document.contentsChanged = false;
+   }
+
+   // only now that the files are up to date is the journal redundant
+   Error error = journalPath().removeIfExists();
+   if (error)
+      return error;
+
+   journalBytes_ = 0;
+   return Success();
+}
+
+Error SourceDatabaseJournal::recover()
+{
+   FilePath journal = journalPath();
+   if (!journal.exists())
+      return Success();
+
+   std::string records;
+   Error error = readStringFromFile(journal, &records);
+   if (error)
+      return error;
+
+   std::size_t pos = 0;
+   while (pos < records.size())
+   {
+      std::size_t headerEnd = records.find('\n', pos);
+      if (headerEnd == std::string::npos)
+         break;
+
+      char type = 0;
+      std::string id, baseHash, hash;
+      std::size_t offset = 0, length = 0, size = 0;
+      std::istringstream header(records.substr(pos, headerEnd - pos));
+      if (!(header >> type >> id >> offset >> length >> baseHash >> hash >>
+            size))
+      {
+         LOG_WARNING_MESSAGE("Invalid source database journal record");
+         break;
+      }
+
+      // a record cut short was being written when the process went away
+      std::size_t payloadStart = headerEnd + 1;
+      if (payloadStart + size + 1 > records.size())
+         break;
+
+      applyRecord(type, id, offset, length, baseHash, hash,
+                  records.substr(payloadStart, size));
+
+      pos = payloadStart + size + 1;
+   }
+
+   return checkpoint();
+}
+
+Error SourceDatabaseJournal::load(const std::string& id,
+                                  bool withContents,
+                                  Document** ppDocument)
+{
+   std::map<std::string, Document>::iterator it = documents_.find(id);
+   if (it == documents_.end())
+   {
+      FilePath documentPath = propertiesPath(id);
+      if (!documentPath.exists())
+      {
+         return systemError(boost::system::errc::no_such_file_or_directory,
+                            ERROR_LOCATION);
+      }
+
+      Document document;
+      Error error = readStringFromFile(documentPath,
+                                       &document.properties,
+                                       lineEnding_);
+      if (error)
+         return error;
+
+      it = documents_.insert(std::make_pair(id, document)).first;
+   }
+
+   Document& document = it->second;
+   if (withContents && !document.hasContents)
+   {
+      std::string contents;
+      FilePath documentContentsPath = contentsPath(id);
+      if (documentContentsPath.exists())
+      {
+         Error error = readStringFromFile(documentContentsPath,
+                                          &contents,
+                                          lineEnding_);
+         if (error)
+            return error;
+      }
+      document.setContents(contents);
+   }
+
+   *ppDocument = &document;
+   return Success();
+}
+
+void SourceDatabaseJournal::applyRecord(char type,
+                                        const std::string& id,
+                                        std::size_t offset,
+                                        std::size_t length,
+                                        const std::string& baseHash,
+                                        const std::string& hash,
+                                        const std::string& payload)
+{
+   // records of removed documents are skipped
+   Document* pDocument = NULL;
+   Error error = load(id, type == kContentsRecord, &pDocument);
+   if (error)
+      return;
+
+   if (type == kPropertiesRecord)
+   {
+      pDocument->properties = payload;
+      pDocument->changed = true;
+   }
+   else if (type == kContentsRecord)
+   {
+      // only apply changes to the contents they were made to (those
+      // already written through by a checkpoint which the process
+      // didn't live to complete won't match)
+      std::string& contents = pDocument->contents;
+      if (hash::crc32HexHash(contents) != baseHash ||
+          offset + length > contents.size())
+      {
+         return;
+      }
+
+      std::string updated = contents.substr(0, offset) + payload +
+                            contents.substr(offset + length);
+      if (hash::crc32HexHash(updated) != hash)
+      {
+         LOG_WARNING_MESSAGE("Source database journal record for " + id +
+                             " does not match its contents");
+         return;
+      }
+
+      pDocument->setContents(updated);
+      pDocument->changed = true;
+      pDocument->contentsChanged = true;
+   }
+}
+
+FilePath SourceDatabaseJournal::propertiesPath(const std::string& id) const
+{
+   return dirPath_.complete(id);
+}
+
+FilePath SourceDatabaseJournal::contentsPath(const std::string& id) const
+{
+   return FilePath(propertiesPath(id).absolutePath() + kContentsSuffix);
+}
+
+FilePath SourceDatabaseJournal::journalPath() const
+{
+   return dirPath_.complete(kJournalFile);
+}
+
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,130 @@
+/*
+ * SessionSourceDatabaseJournal.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SOURCE_DATABASE_JOURNAL_HPP
+#define SESSION_SOURCE_DATABASE_JOURNAL_HPP
+
+#include <map>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/StringUtils.hpp>
+
+#define kContentsSuffix "-contents"
+#define kJournalFile "journal"
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+
+// SourceDatabaseJournal stores the documents of a source database directory,
+// each as a properties file and a '-contents' file. Once a document is
+// stored, changes to it are appended to a journal (its properties when they
+// change, and the range of its contents which changed) rather than rewriting
+// its files, and are written through to the files at checkpoints
+class SourceDatabaseJournal : boost::noncopyable
+{
+public:
+   SourceDatabaseJournal(const core::FilePath& dirPath,
+                         core::string_utils::LineEnding lineEnding);
+
+   // read a document's properties (json) and, if requested, its contents
+   // (empty if it has no contents file)
+   core::Error read(const std::string& id,
+                    std::string* pProperties,
+                    std::string* pContents = NULL);
+
+   // write a document's properties and, if provided, its contents
+   core::Error write(const std::string& id,
+                     const std::string& properties,
+                     const std::string* pContents = NULL);
+
+   // forget a document, or all documents (once their files are removed)
+   void remove(const std::string& id);
+   void clear();
+
+   // re-read a document from its files when next used (once they're written
+   // by other means); journaled changes to the document are kept
+   void invalidate(const std::string& id);
+
+   // write journaled changes through to the documents' files and empty
+   // the journal
+   core::Error checkpoint();
+
+   // apply a journal left behind by a process which didn't checkpoint it
+   // (e.g. because it crashed)
+   core::Error recover();
+
+   // the size of the journal
+   boost::uintmax_t journalBytes() const { return journalBytes_; }
+
+private:
+   // contents are only held while they have changes not yet written
+   // through to the contents file (writes are otherwise compared with the
+   // contents file)
+   struct Document
+   {
+      Document()
+         : hasContents(false), changed(false), contentsChanged(false)
+      {
+      }
+
+      void setContents(const std::string& value);
+      void releaseContents();
+
+      std::string properties;
+      std::string contents;
+      bool hasContents;
+      bool changed;
+      bool contentsChanged;
+   };
+
+   core::Error load(const std::string& id,
+                    bool withContents,
+                    Document** ppDocument);
+
+   void applyRecord(char type,
+                    const std::string& id,
+                    std::size_t offset,
+                    std::size_t length,
+                    const std::string& baseHash,
+                    const std::string& hash,
+                    const std::string& payload);
+
+   core::FilePath propertiesPath(const std::string& id) const;
+   core::FilePath contentsPath(const std::string& id) const;
+   core::FilePath journalPath() const;
+
+private:
+   core::FilePath dirPath_;
+   core::string_utils::LineEnding lineEnding_;
+   std::map<std::string, Document> documents_;
+   boost::uintmax_t journalBytes_;
+};
+
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_SOURCE_DATABASE_JOURNAL_HPP
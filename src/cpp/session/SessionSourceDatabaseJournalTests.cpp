@@ -0,0 +1,270 @@
+/*
+ * SessionSourceDatabaseJournalTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "SessionSourceDatabaseJournal.hpp"
+
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+
+using namespace rstudio::core;
+
+namespace {
+
+// a scratch source database directory
+class ScratchDatabase
+{
+public:
+   ScratchDatabase()
+   {
+      REQUIRE_FALSE(FilePath::tempFilePath(&path_));
+      REQUIRE_FALSE(path_.ensureDirectory());
+   }
+
+   ~ScratchDatabase()
+   {
+      path_.removeIfExists();
+   }
+
+   const FilePath& path() const { return path_; }
+
+   std::string readFile(const std::string& name) const
+   {
+      std::string contents;
+      readStringFromFile(path_.complete(name), &contents);
+      return contents;
+   }
+
+private:
+   FilePath path_;
+};
+
+std::string largeContents()
+{
+   std::string contents;
+   for (int i = 0; i < 100000; i++)
+      contents += "select * from table where id = 1;\n";
+   return contents;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Source Database Journal")
+{
+   SECTION("New documents are written whole")
+   {
+      ScratchDatabase db;
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+
+      std::string contents("x <- 1\n");
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+      CHECK(db.readFile("doc1") == "{}");
+      CHECK(db.readFile("doc1" kContentsSuffix) == contents);
+      CHECK(!db.path().complete(kJournalFile).exists());
+   }
+
+   SECTION("Edits are journaled in proportion to their size")
+   {
+      ScratchDatabase db;
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+
+      std::string contents = largeContents();
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+
+      contents.insert(contents.size() / 2, "-- a comment\n");
+      REQUIRE(!journal.write("doc1", "{\"dirty\":true}", &contents));
+      CHECK(journal.journalBytes() > 0);
+      CHECK(journal.journalBytes() < 200);
+
+      // the files are untouched but reads see the edit
+      CHECK(db.readFile("doc1") == "{}");
+      std::string properties, read;
+      REQUIRE(!journal.read("doc1", &properties, &read));
+      CHECK(properties == "{\"dirty\":true}");
+      CHECK(read == contents);
+
+      // until a checkpoint writes them through
+      REQUIRE(!journal.checkpoint());
+      CHECK(journal.journalBytes() == 0);
+      CHECK(db.readFile("doc1") == "{\"dirty\":true}");
+      CHECK(db.readFile("doc1" kContentsSuffix) == contents);
+   }
+
+   SECTION("Unchanged documents aren't journaled")
+   {
+      ScratchDatabase db;
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+
+      std::string contents("y <- 2\n");
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+      REQUIRE(!journal.write("doc1", "{}"));
+      CHECK(journal.journalBytes() == 0);
+   }
+
+   SECTION("Edits with the same hash as the contents are journaled")
+   {
+      ScratchDatabase db;
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+
+      // contents of the same size and CRC32 (once written through, the
+      // contents aren't held, so the edit must be checked against the file)
+      std::string contents("doc29685295");
+      std::string collision("doc32060020");
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+      REQUIRE(!journal.write("doc1", "{}", &collision));
+      CHECK(journal.journalBytes() > 0);
+
+      std::string properties, read;
+      REQUIRE(!journal.read("doc1", &properties, &read));
+      CHECK(read == collision);
+      REQUIRE(!journal.checkpoint());
+      CHECK(db.readFile("doc1" kContentsSuffix) == collision);
+   }
+
+   SECTION("A journal left by a crash is recovered")
+   {
+      ScratchDatabase db;
+      std::string contents = "a <- 1\nb <- 2\n";
+      {
+         SourceDatabaseJournal journal(db.path(),
+                                       string_utils::LineEndingPosix);
+         REQUIRE(!journal.write("doc1", "{}", &contents));
+         REQUIRE(!journal.write("doc2", "{}"));
+
+         contents.replace(0, 1, "alpha");
+         REQUIRE(!journal.write("doc1", "{\"v\":1}", &contents));
+         contents += "c <- 3\n";
+         REQUIRE(!journal.write("doc1", "{\"v\":2}", &contents));
+         REQUIRE(!journal.write("doc2", "{\"v\":3}"));
+      }
+
+      // a record cut short by the crash is ignored
+      REQUIRE(!appendToFile(db.path().complete(kJournalFile),
+                            std::string("c doc1 0 1 1234 5678 100\nabc")));
+
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+      REQUIRE(!journal.recover());
+      CHECK(!db.path().complete(kJournalFile).exists());
+      CHECK(db.readFile("doc1") == "{\"v\":2}");
+      CHECK(db.readFile("doc1" kContentsSuffix) == contents);
+      CHECK(db.readFile("doc2") == "{\"v\":3}");
+   }
+
+   SECTION("Recovery after a partial checkpoint doesn't reapply edits")
+   {
+      ScratchDatabase db;
+      std::string contents = "x <- 1\n";
+      std::string journalContents;
+      {
+         SourceDatabaseJournal journal(db.path(),
+                                       string_utils::LineEndingPosix);
+         REQUIRE(!journal.write("doc1", "{}", &contents));
+         contents.insert(0, "# header\n");
+         REQUIRE(!journal.write("doc1", "{}", &contents));
+
+         // checkpoint, but keep the journal as if we crashed before
+         // removing it
+         readStringFromFile(db.path().complete(kJournalFile),
+                            &journalContents);
+         REQUIRE(!journal.checkpoint());
+      }
+      REQUIRE(!writeStringToFile(db.path().complete(kJournalFile),
+                                 journalContents));
+
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+      REQUIRE(!journal.recover());
+      CHECK(db.readFile("doc1" kContentsSuffix) == contents);
+   }
+
+   SECTION("Contents are re-read from their files once checkpointed")
+   {
+      ScratchDatabase db;
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+
+      std::string contents("x <- 1\n");
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+      contents += "y <- 2\n";
+      REQUIRE(!journal.write("doc1", "{}", &contents));
+      REQUIRE(!journal.checkpoint());
+
+      // the contents aren't held once they're written through
+      REQUIRE(!writeStringToFile(db.path().complete("doc1" kContentsSuffix),
+                                 "z <- 3\n"));
+      std::string properties, read;
+      REQUIRE(!journal.read("doc1", &properties, &read));
+      CHECK(read == "z <- 3\n");
+
+      // and edits are journaled against the contents re-read
+      read += "w <- 4\n";
+      REQUIRE(!journal.write("doc1", "{}", &read));
+      CHECK(journal.journalBytes() < 100);
+      REQUIRE(!journal.checkpoint());
+      CHECK(db.readFile("doc1" kContentsSuffix) == read);
+   }
+
+   SECTION("Invalidated documents are re-read from their files")
+   {
+      ScratchDatabase db;
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+
+      REQUIRE(!journal.write("doc1", "{}"));
+      std::string properties, read;
+      REQUIRE(!journal.read("doc1", &properties, &read));
+      CHECK(read.empty());
+
+      // contents written by other means (as by a migration) are seen once
+      // the document is invalidated
+      REQUIRE(!journal.write("doc1", "{\"v\":1}"));
+      REQUIRE(!writeStringToFile(db.path().complete("doc1" kContentsSuffix),
+                                 "x <- 1\n"));
+      journal.invalidate("doc1");
+      REQUIRE(!journal.read("doc1", &properties, &read));
+      CHECK(read == "x <- 1\n");
+
+      // without losing journaled changes, or overwriting the contents
+      CHECK(properties == "{\"v\":1}");
+      REQUIRE(!journal.checkpoint());
+      CHECK(db.readFile("doc1") == "{\"v\":1}");
+      CHECK(db.readFile("doc1" kContentsSuffix) == "x <- 1\n");
+   }
+
+   SECTION("Records of removed documents are skipped")
+   {
+      ScratchDatabase db;
+      {
+         SourceDatabaseJournal journal(db.path(),
+                                       string_utils::LineEndingPosix);
+         REQUIRE(!journal.write("doc1", "{}"));
+         REQUIRE(!journal.write("doc1", "{\"v\":1}"));
+         REQUIRE(!db.path().complete("doc1").remove());
+         journal.remove("doc1");
+      }
+
+      SourceDatabaseJournal journal(db.path(), string_utils::LineEndingPosix);
+      REQUIRE(!journal.recover());
+      CHECK(!db.path().complete("doc1").exists());
+   }
+}
+
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
@@ -400,6 +400,11 @@ void scheduleDelayedWork(const boost::posix_time::time_duration& period,
                          const boost::function<void()> &execute,
                          bool idleOnly = true);
 
+// worker threads shared by the modules which search, index and lint files
+// in the background (created on first use, with at most one thread per
+// core and no more than a few threads in all)
+core::thread::ThreadPool& workerThreadPool();
+
 
 core::string_utils::LineEnding lineEndings(const core::FilePath& filePath);
 
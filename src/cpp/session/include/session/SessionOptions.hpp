@@ -570,6 +570,16 @@ public:
       return firstProjectTemplatePath_;
    }
 
+   std::string libclangPchCachePath() const
+   {
+      return libclangPchCachePath_;
+   }
+
+   int libclangPchCacheMaxMb() const
+   {
+      return libclangPchCacheMaxMb_;
+   }
+
    const std::string& signingKey() const
    {
       return signingKey_;
@@ -654,6 +664,8 @@ private:
    bool defaultCliColorForce_;
    bool quitChildProcessesOnExit_;
    std::string firstProjectTemplatePath_;
+   std::string libclangPchCachePath_;
+   int libclangPchCacheMaxMb_;
    std::string signingKey_;
    bool verifySignatures_;
    int webSocketPingSeconds_;
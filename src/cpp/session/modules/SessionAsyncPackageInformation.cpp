@@ -17,6 +17,7 @@
 // #define RSTUDIO_ENABLE_DEBUG_MACROS
 
 #include "SessionAsyncPackageInformation.hpp"
+#include "SessionPackageSymbolCache.hpp"
 
 #include <string>
 #include <vector>
@@ -28,6 +29,7 @@
 #include <core/Error.hpp>
 
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <session/SessionModuleContext.hpp>
@@ -240,8 +242,9 @@ void AsyncPackageInformationProcess::onCompleted(int exitStatus)
       if (!json::fillVectorString(datasetsJson, &(pkgInfo.datasets)))
          LOG_ERROR_MESSAGE("Failed to read JSON 'data' array to vector");
       
-      // Update the index
+      // Update the index, and persist for other sessions
       core::r_util::RSourceIndex::addPackageInformation(pkgInfo.package, pkgInfo);
+      package_symbols::putPackageInformation(pkgInfo);
    }
 
 }
@@ -260,6 +263,19 @@ void AsyncPackageInformationProcess::update()
    s_pkgsToUpdate_ =
       RSourceIndex::getAllUnindexedPackages();
    
+   // packages whose information was persisted by an earlier session
+   // (and which haven't since been re-installed) don't need an R process
+   std::vector<std::string> uncached;
+   BOOST_FOREACH(const std::string& pkg, s_pkgsToUpdate_)
+   {
+      PackageInformation pkgInfo;
+      if (package_symbols::getPackageInformation(pkg, &pkgInfo))
+         RSourceIndex::addPackageInformation(pkg, pkgInfo);
+      else
+         uncached.push_back(pkg);
+   }
+   s_pkgsToUpdate_.swap(uncached);
+   
    // alias for readability
    const std::vector<std::string>& pkgs = s_pkgsToUpdate_;
    
@@ -18,7 +18,9 @@
 
 #include "SessionCodeSearch.hpp"
 
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <set>
 
@@ -27,6 +29,7 @@
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/regex.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 
@@ -36,8 +39,12 @@
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
 #include <core/collection/Tree.hpp>
+#include <core/text/FuzzyMatch.hpp>
 
+#include <core/Thread.hpp>
 #include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceIndexCache.hpp>
+#include <core/r_util/RSourceIndexer.hpp>
 
 #include <core/system/FileChangeEvent.hpp>
 #include <core/system/FileMonitor.hpp>
@@ -125,6 +132,33 @@ bool isWithinIgnoredDirectory(const FilePath& filePath)
    return false;
 }
 
+bool isUtf8Encoding(const std::string& encoding)
+{
+   std::string name = boost::algorithm::to_lower_copy(encoding);
+   return name.empty() || name == "utf-8" || name == "utf8" ||
+          name == "ascii" || name == "us-ascii";
+}
+
+// read a UTF-8 source file for indexing (on a worker thread, so this
+// mirrors module_context::readAndDecodeFile without the call into R)
+Error readUtf8SourceFile(const FilePath& filePath,
+                         string_utils::LineEnding lineEnding,
+                         std::string* pCode)
+{
+   Error error = readStringFromFile(filePath, pCode, lineEnding);
+   if (error)
+      return error;
+
+   stripBOM(pCode);
+   return string_utils::utf8Clean(pCode->begin(), pCode->end(), '?');
+}
+
+Error readDecodedSourceFile(const std::string& code, std::string* pCode)
+{
+   *pCode = code;
+   return Success();
+}
+
 bool isGlobalFunctionNamed(const r_util::RSourceItem& sourceItem,
                            const std::string& name)
 {
@@ -450,7 +484,13 @@ class SourceFileIndex : boost::noncopyable
 {
 public:
    SourceFileIndex()
-      : pEntries_(new EntryTree()), indexing_(false)
+      : pEntries_(new EntryTree()),
+        indexing_(false),
+        collecting_(false),
+        cacheLoaded_(false),
+        cacheDirty_(false),
+        cacheStatsLogged_(false),
+        nameTablesDirty_(true)
    {
    }
 
@@ -476,6 +516,10 @@ public:
    template <typename ForwardIterator>
    void enqueFiles(ForwardIterator begin, ForwardIterator end)
    {
+      // files unchanged since the project was last open needn't be
+      // tokenized again
+      loadCache();
+
       // add all files to the indexing queue
       using namespace rstudio::core::system;
       for ( ; begin != end; ++begin)
@@ -519,6 +563,17 @@ public:
       }
    }
 
+   const r_util::RSourceIndexer::Progress& indexingProgress() const
+   {
+      static const r_util::RSourceIndexer::Progress s_noProgress;
+      return pIndexer_ ? pIndexer_->progress() : s_noProgress;
+   }
+
+   const boost::posix_time::time_duration& cacheLoadTime() const
+   {
+      return cacheLoadTime_;
+   }
+
    bool findGlobalFunction(const std::string& functionName,
                            const std::set<std::string>& excludeContexts,
                            r_util::RSourceItem* pFunctionItem)
@@ -795,11 +850,66 @@ public:
    {
       indexing_ = false;
       indexingQueue_ = std::queue<core::system::FileChangeEvent>();
+      pIndexer_.reset();
+      indexingFiles_.clear();
+      pLoadedCache_.reset();
+      cache_.clear();
+      cacheLoaded_ = false;
+      cacheDirty_ = false;
+      cacheStatsLogged_ = false;
       pEntries_->clear();
+
+      sourceFiles_.clear();
+      sourceIndexes_.clear();
+      nameTablesDirty_ = true;
+   }
+
+   // flat tables of the names of the project's source files and R symbols,
+   // used for fuzzy lookup (rebuilt on demand after the project changes)
+   const text::NameTable& sourceFileNames()
+   {
+      rebuildNameTables();
+      return sourceFileNames_;
+   }
+
+   const std::string& sourceFilePath(boost::uint32_t id) const
+   {
+      return sourceFilePaths_[id];
+   }
+
+   const text::NameTable& symbolNames()
+   {
+      rebuildNameTables();
+      return symbolNames_;
+   }
+
+   const std::string& symbolContext(boost::uint32_t id) const
+   {
+      return symbolIndexes_[symbols_[id].first]->context();
+   }
+
+   r_util::RSourceItem symbol(boost::uint32_t id) const
+   {
+      const boost::shared_ptr<r_util::RSourceIndex>& pIndex =
+                                          symbolIndexes_[symbols_[id].first];
+      return pIndex->items()[symbols_[id].second].withContext(pIndex->context());
    }
 
 private:
 
+   // the indexer (and the worker threads it uses) are created on first use
+   // rather than with the project index, which is constructed during
+   // static initialization
+   r_util::RSourceIndexer& indexer()
+   {
+      if (!pIndexer_)
+      {
+         pIndexer_.reset(new r_util::RSourceIndexer(
+                                    &module_context::workerThreadPool()));
+      }
+      return *pIndexer_;
+   }
+
    bool dequeAndIndex()
    {
       using namespace rstudio::core::system;
@@ -832,17 +942,130 @@ private:
          }
       }
 
+      // collect the indexes built by the workers (polling rather than
+      // incremental work, so that waiting on them doesn't occupy R)
+      if (pIndexer_ && pIndexer_->pending() && !collecting_)
+      {
+         collecting_ = true;
+         module_context::schedulePeriodicWork(
+                           boost::posix_time::milliseconds(50),
+                           boost::bind(&SourceFileIndex::collectIndexes, this),
+                           false /* allow indexing even when non-idle */);
+      }
+
       // return status
       indexing_ = !indexingQueue_.empty();
       return indexing_;
    }
 
-   void updateIndexEntry(const FileInfo& fileInfo)
+   bool collectIndexes()
    {
-      // index the source if necessary
-      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+      std::vector<r_util::RSourceIndexer::Result> results;
+      indexer().collect(&results);
+
+      BOOST_FOREACH(const r_util::RSourceIndexer::Result& result, results)
+      {
+         std::map<std::string, FileInfo>::iterator it =
+                                          indexingFiles_.find(result.path);
+         if (it == indexingFiles_.end())
+            continue;
+         FileInfo fileInfo = it->second;
+         indexingFiles_.erase(it);
+
+         if (result.error)
+         {
+            // log if not path not found error (this can happen if the
+            // file was removed after entering the indexing queue)
+            if (!core::isPathNotFoundError(result.error))
+            {
+               Error error = result.error;
+               error.addProperty("src-file", result.path);
+               LOG_ERROR(error);
+            }
+            continue;
+         }
+
+         pEntries_->insertEntry(Entry(fileInfo, result.pIndex));
+         updateNameRecords(fileInfo, result.pIndex);
+
+         cache_.insert(fileInfo, result.contentHash, result.pIndex);
+         if (!pLoadedCache_ || !pLoadedCache_->find(fileInfo))
+            cacheDirty_ = true;
+      }
+
+      // kick off an update
+      if (!results.empty())
+         r_packages::AsyncPackageInformationProcess::update();
+
+      collecting_ = indexer().pending();
+      if (!collecting_)
+      {
+         const r_util::RSourceIndexer::Progress& progress = indexer().progress();
+         logCacheStats(progress);
+         writeCache();
+      }
+      return collecting_;
+   }
 
-      // read the file
+   FilePath cachePath() const
+   {
+      return projects::projectContext().scratchPath().complete(
+                                                   "source-index-cache");
+   }
+
+   void loadCache()
+   {
+      if (cacheLoaded_ || !projects::projectContext().hasProject())
+         return;
+      cacheLoaded_ = true;
+
+      boost::posix_time::ptime start =
+                        boost::posix_time::microsec_clock::universal_time();
+
+      boost::shared_ptr<r_util::RSourceIndexCache> pCache(
+                                             new r_util::RSourceIndexCache());
+      Error error = pCache->read(cachePath());
+      if (error)
+         LOG_ERROR(error);
+      pLoadedCache_ = pCache;
+
+      cacheLoadTime_ = boost::posix_time::microsec_clock::universal_time() - start;
+   }
+
+   // log how well the cache served the initial indexing of the project
+   void logCacheStats(const r_util::RSourceIndexer::Progress& progress)
+   {
+      if (cacheStatsLogged_ || !pLoadedCache_ || progress.indexed == 0)
+         return;
+      cacheStatsLogged_ = true;
+
+      boost::format fmt("Indexed %1% project source files in %2%ms: "
+                        "%3% (%4%%%) from cache, loaded in %5%ms");
+      LOG_INFO_MESSAGE(boost::str(
+         fmt % progress.indexed
+             % progress.elapsed.total_milliseconds()
+             % progress.cached
+             % (progress.cached * 100 / progress.indexed)
+             % cacheLoadTime_.total_milliseconds()));
+   }
+
+   void writeCache()
+   {
+      if (!cacheDirty_ || !projects::projectContext().hasProject())
+         return;
+      cacheDirty_ = false;
+
+      Error error = cache_.write(cachePath());
+      if (error)
+         LOG_ERROR(error);
+
+      // later changes (e.g. checkouts which only touch files) are looked
+      // up in what was written (the indexes themselves are shared)
+      pLoadedCache_.reset(new r_util::RSourceIndexCache(cache_));
+   }
+
+   void updateIndexEntry(const FileInfo& fileInfo)
+   {
       FilePath filePath(fileInfo.absolutePath());
 
       // filter certain directories (e.g. those that exist in build directories)
@@ -851,39 +1074,69 @@ private:
 
       if (isIndexableSourceFile(fileInfo))
       {
-         std::string code;
-         Error error = module_context::readAndDecodeFile(
-                                 filePath,
-                                 projects::projectContext().defaultEncoding(),
-                                 true,
-                                 &code);
-         if (error)
+         // the file is indexed on a worker thread; files in encodings
+         // other than UTF-8 must be decoded (by R) here first
+         // (files unchanged since they were cached are never read)
+         r_util::RSourceIndexer::CodeReader readCode;
+         std::string encoding = projects::projectContext().defaultEncoding();
+         if (isUtf8Encoding(encoding) ||
+             (pLoadedCache_ && pLoadedCache_->find(fileInfo)))
          {
-            // log if not path not found error (this can happen if the
-            // file was removed after entering the indexing queue)
-            if (!core::isPathNotFoundError(error))
+            readCode = boost::bind(readUtf8SourceFile,
+                                   filePath,
+                                   session::options().sourceLineEnding(),
+                                   _1);
+         }
+         else
+         {
+            std::string code;
+            Error error = module_context::readAndDecodeFile(filePath,
+                                                            encoding,
+                                                            true,
+                                                            &code);
+            if (error)
             {
-               error.addProperty("src-file", filePath.absolutePath());
-               LOG_ERROR(error);
+               // log if not path not found error (this can happen if the
+               // file was removed after entering the indexing queue)
+               if (!core::isPathNotFoundError(error))
+               {
+                  error.addProperty("src-file", filePath.absolutePath());
+                  LOG_ERROR(error);
+               }
+               return;
             }
-            return;
+            readCode = boost::bind(readDecodedSourceFile, code, _1);
          }
 
-         // add index entry
-         std::string context = module_context::createAliasedPath(filePath);
-         pIndex.reset(new r_util::RSourceIndex(context, code));
+         indexer().enque(fileInfo,
+                         module_context::createAliasedPath(filePath),
+                         readCode,
+                         pLoadedCache_);
+         indexingFiles_[fileInfo.absolutePath()] = fileInfo;
+
+         // new files are listed immediately (and indexed once collected);
+         // modified files keep their previous index until then
+         if (get(filePath))
+            return;
       }
 
       // attempt to add the entry
-      Entry entry(fileInfo, pIndex);
+      Entry entry(fileInfo);
       pEntries_->insertEntry(entry);
-
-      // kick off an update
-      r_packages::AsyncPackageInformationProcess::update();
+      updateNameRecords(fileInfo, entry.pIndex);
    }
 
    void removeIndexEntry(const FileInfo& fileInfo)
    {
+      // discard any index still being built
+      if (pIndexer_)
+         pIndexer_->remove(fileInfo.absolutePath());
+      indexingFiles_.erase(fileInfo.absolutePath());
+      cache_.remove(fileInfo.absolutePath());
+      cacheDirty_ = true;
+      if (fileInfo.isDirectory())
+         eraseWithPrefix(fileInfo.absolutePath() + "/", &indexingFiles_);
+
       // create a fake entry with a null source index to pass to find
       Entry entry(fileInfo, boost::shared_ptr<r_util::RSourceIndex>());
 
@@ -895,6 +1148,103 @@ private:
          DEBUG("Failed to remove index entry for file: '" << fileInfo.absolutePath() << "'");
          print_tree(*pEntries_);
       }
+
+      removeNameRecords(fileInfo);
+   }
+
+   struct SourceFileRecord
+   {
+      std::string name;
+      std::string aliasedPath;
+   };
+
+   void updateNameRecords(const FileInfo& fileInfo,
+                          boost::shared_ptr<r_util::RSourceIndex> pIndex)
+   {
+      std::string absolutePath = fileInfo.absolutePath();
+      if (isSourceFile(fileInfo))
+      {
+         FilePath filePath(absolutePath);
+         SourceFileRecord& record = sourceFiles_[absolutePath];
+         record.name = filePath.filename();
+         record.aliasedPath = module_context::createAliasedPath(filePath);
+      }
+      else
+      {
+         sourceFiles_.erase(absolutePath);
+      }
+
+      if (pIndex)
+         sourceIndexes_[absolutePath] = pIndex;
+      else
+         sourceIndexes_.erase(absolutePath);
+
+      nameTablesDirty_ = true;
+   }
+
+   template <typename T>
+   static void eraseWithPrefix(const std::string& prefix,
+                               std::map<std::string, T>* pMap)
+   {
+      typename std::map<std::string, T>::iterator it = pMap->lower_bound(prefix);
+      while (it != pMap->end() && boost::algorithm::starts_with(it->first, prefix))
+         pMap->erase(it++);
+   }
+
+   void removeNameRecords(const FileInfo& fileInfo)
+   {
+      std::string absolutePath = fileInfo.absolutePath();
+      sourceFiles_.erase(absolutePath);
+      sourceIndexes_.erase(absolutePath);
+
+      // removing a directory removes everything beneath it
+      if (fileInfo.isDirectory())
+      {
+         eraseWithPrefix(absolutePath + "/", &sourceFiles_);
+         eraseWithPrefix(absolutePath + "/", &sourceIndexes_);
+      }
+
+      nameTablesDirty_ = true;
+   }
+
+   void rebuildNameTables()
+   {
+      if (!nameTablesDirty_)
+         return;
+
+      sourceFileNames_.clear();
+      sourceFilePaths_.clear();
+      sourceFilePaths_.reserve(sourceFiles_.size());
+      for (std::map<std::string, SourceFileRecord>::const_iterator it =
+              sourceFiles_.begin();
+           it != sourceFiles_.end();
+           ++it)
+      {
+         sourceFileNames_.add(it->second.name);
+         sourceFilePaths_.push_back(it->second.aliasedPath);
+      }
+
+      symbolNames_.clear();
+      symbolIndexes_.clear();
+      symbols_.clear();
+      for (std::map<std::string, boost::shared_ptr<r_util::RSourceIndex> >::const_iterator
+              it = sourceIndexes_.begin();
+           it != sourceIndexes_.end();
+           ++it)
+      {
+         boost::uint32_t indexId = static_cast<boost::uint32_t>(symbolIndexes_.size());
+         symbolIndexes_.push_back(it->second);
+
+         const std::vector<r_util::RSourceItem>& items = it->second->items();
+         for (std::size_t i = 0; i < items.size(); i++)
+         {
+            symbolNames_.add(items[i].name());
+            symbols_.push_back(
+                     std::make_pair(indexId, static_cast<boost::uint32_t>(i)));
+         }
+      }
+
+      nameTablesDirty_ = false;
    }
 
    static bool isSourceFile(const FileInfo& fileInfo)
@@ -961,6 +1311,29 @@ private:
    // indexing queue
    bool indexing_;
    std::queue<core::system::FileChangeEvent> indexingQueue_;
+   boost::shared_ptr<r_util::RSourceIndexer> pIndexer_;
+   std::map<std::string, FileInfo> indexingFiles_;
+   bool collecting_;
+
+   // cached indexes, as read at startup (or last written) and as they
+   // will next be written
+   boost::shared_ptr<const r_util::RSourceIndexCache> pLoadedCache_;
+   r_util::RSourceIndexCache cache_;
+   bool cacheLoaded_;
+   bool cacheDirty_;
+   bool cacheStatsLogged_;
+   boost::posix_time::time_duration cacheLoadTime_;
+
+   // source files and R source indexes (by absolute path), along with
+   // the name tables derived from them
+   std::map<std::string, SourceFileRecord> sourceFiles_;
+   std::map<std::string, boost::shared_ptr<r_util::RSourceIndex> > sourceIndexes_;
+   bool nameTablesDirty_;
+   text::NameTable sourceFileNames_;
+   std::vector<std::string> sourceFilePaths_;
+   text::NameTable symbolNames_;
+   std::vector<boost::shared_ptr<r_util::RSourceIndex> > symbolIndexes_;
+   std::vector<std::pair<boost::uint32_t, boost::uint32_t> > symbols_;
 };
 
 } // anonymous namespace
@@ -1282,23 +1655,53 @@ void searchFiles(const std::string& term,
 // NOTE: When modifying this code, you should ensure that corresponding
 // changes are made to the client side scoreMatch function as well
 // (See: CodeSearchOracle.java)
-int scoreMatch(std::string const& suggestion,
+int scoreMatch(const char* suggestion,
+               std::size_t suggestionSize,
                std::string const& query,
                bool isFile)
 {
    // No penalty for perfect matches
-   if (suggestion == query)
+   if (suggestionSize == query.size() &&
+       std::memcmp(suggestion, query.data(), suggestionSize) == 0)
       return 0;
+
+   const char* suggestionEnd = suggestion + suggestionSize;
    
-   std::vector<int> matches =
-         string_utils::subsequenceIndices(suggestion, query);
-   
+   // More penalty (per matched character) for 'uninteresting' files
+   // and 'uninteresting' extensions (e.g. .Rd)
+   int matchPenalty = 0;
+   if ((suggestionSize == 13 && std::memcmp(suggestion, "RcppExports.R", 13) == 0) ||
+       (suggestionSize == 15 && std::memcmp(suggestion, "RcppExports.cpp", 15) == 0))
+      matchPenalty += 6;
+
+   const char* lastDot = suggestionEnd;
+   for (const char* it = suggestion; it != suggestionEnd; ++it)
+   {
+      if (*it == '.')
+         lastDot = it;
+   }
+   if (suggestionEnd - lastDot == 3 &&
+       (lastDot[1] == 'r' || lastDot[1] == 'R') &&
+       (lastDot[2] == 'd' || lastDot[2] == 'D'))
+      matchPenalty += 6;
+
    int totalPenalty = 0;
+   int matchCount = 0;
 
-   // Loop over the matches and assign a score
-   for (int j = 0, n = static_cast<int>(matches.size()); j < n; j++)
+   // Loop over the (case sensitive) subsequence matches and assign a score;
+   // query characters with no match are skipped
+   const char* searchFrom = suggestion;
+   for (std::size_t i = 0, n = query.size(); i < n; i++)
    {
-      int matchPos = matches[j];
+      const void* found = std::memchr(searchFrom,
+                                      query[i],
+                                      suggestionEnd - searchFrom);
+      if (found == NULL)
+         continue;
+
+      const char* match = static_cast<const char*>(found);
+      int matchPos = static_cast<int>(match - suggestion);
+      int j = matchCount++;
       int penalty = matchPos;
 
       // Less penalty if character follows special delim
@@ -1313,18 +1716,9 @@ int scoreMatch(std::string const& suggestion,
 
       // Less penalty for perfect match (ie, reward case-sensitive match)
       penalty -= suggestion[matchPos] == query[j];
-      
-      // More penalty for 'uninteresting' files
-      if (suggestion == "RcppExports.R" ||
-          suggestion == "RcppExports.cpp")
-         penalty += 6;
-      
-      // More penalty for 'uninteresting' extensions (e.g. .Rd)
-      std::string extension = string_utils::getExtension(suggestion);
-      if (boost::algorithm::to_lower_copy(extension) == ".rd")
-         penalty += 6;
 
-      totalPenalty += penalty;
+      totalPenalty += penalty + matchPenalty;
+      searchFrom = match + 1;
    }
    
    // Penalize files
@@ -1332,19 +1726,17 @@ int scoreMatch(std::string const& suggestion,
       ++totalPenalty;
    
    // Penalize unmatched characters
-   totalPenalty += static_cast<int>((query.size() - matches.size()) * query.size());
+   totalPenalty += static_cast<int>((query.size() - matchCount) * query.size());
 
    return totalPenalty;
 }
 
-struct ScorePairComparator
+int scoreMatch(std::string const& suggestion,
+               std::string const& query,
+               bool isFile)
 {
-   inline bool operator()(const std::pair<int, int> lhs,
-                          const std::pair<int, int> rhs)
-   {
-      return lhs.second < rhs.second;
-   }
-};
+   return scoreMatch(suggestion.data(), suggestion.size(), query, isFile);
+}
 
 void filterScores(std::vector< std::pair<int, int> >* pScore1,
                   std::vector< std::pair<int, int> >* pScore2,
@@ -1557,6 +1949,181 @@ json::Array toJsonArray(
 
 
 
+// the flat name tables are used (rather than walking the project index)
+// whenever there is a project index and the term is not a wildcard pattern
+bool useNameTables(const std::string& term)
+{
+   return session::projects::projectContext().hasFileMonitor() &&
+          term.find('*') == std::string::npos;
+}
+
+// score the files matching the term, retaining only the best maxResults
+// (returns the total number of matching files)
+std::size_t scoreFiles(const std::string& term,
+                       std::size_t maxResults,
+                       std::vector<std::string>* pNames,
+                       std::vector<std::string>* pPaths,
+                       std::vector< std::pair<int, int> >* pScores)
+{
+   text::BestMatches<boost::uint32_t> best(maxResults);
+   std::vector<std::pair<int, boost::uint32_t> > sorted;
+
+   if (useNameTables(term))
+   {
+      // we allow the user to submit queries of the form e.g.
+      // <query>:<row><column>; only match on the part preceding ':'
+      text::FuzzyQuery query(term.substr(0, term.find(':')));
+      const text::NameTable& names = s_projectIndex.sourceFileNames();
+      std::vector<boost::uint32_t> ids;
+      names.findMatches(query, &ids);
+      BOOST_FOREACH(boost::uint32_t id, ids)
+      {
+         best.push(scoreMatch(names.nameData(id), names.nameSize(id), term, true),
+                   id);
+      }
+
+      sorted = best.sorted();
+      for (std::size_t i = 0; i < sorted.size(); i++)
+      {
+         pNames->push_back(names.name(sorted[i].second));
+         pPaths->push_back(s_projectIndex.sourceFilePath(sorted[i].second));
+         pScores->push_back(std::make_pair(static_cast<int>(i), sorted[i].first));
+      }
+   }
+   else
+   {
+      std::vector<std::string> names;
+      std::vector<std::string> paths;
+      bool moreAvailable = false;
+      searchFiles(term, 100, true, &names, &paths, &moreAvailable);
+      for (std::size_t i = 0; i < names.size(); i++)
+      {
+         best.push(scoreMatch(names[i], term, true),
+                   static_cast<boost::uint32_t>(i));
+      }
+
+      sorted = best.sorted();
+      for (std::size_t i = 0; i < sorted.size(); i++)
+      {
+         pNames->push_back(names[sorted[i].second]);
+         pPaths->push_back(paths[sorted[i].second]);
+         pScores->push_back(std::make_pair(static_cast<int>(i), sorted[i].first));
+      }
+   }
+
+   return best.pushedCount();
+}
+
+// where a scored source item came from
+enum SourceItemOrigin
+{
+   OriginSourceItems,
+   OriginProjectSymbols,
+   OriginCppDefinitions
+};
+
+typedef std::pair<SourceItemOrigin, boost::uint32_t> SourceItemRef;
+
+bool isGeneratedSourceContext(const std::string& context)
+{
+   return boost::algorithm::ends_with(context, "RcppExports.R") ||
+          boost::algorithm::ends_with(context, "RcppExports.cpp");
+}
+
+// score the source items (R and C++) matching the term, retaining only the
+// best maxResults (returns the total number of matching items)
+std::size_t scoreSourceItems(const std::string& term,
+                             std::size_t maxResults,
+                             std::vector<SourceItem>* pItems,
+                             std::vector< std::pair<int, int> >* pScores)
+{
+   text::BestMatches<SourceItemRef> best(maxResults);
+
+   // R source items (from the source database and, when there's no
+   // project index, the project)
+   std::vector<r_util::RSourceItem> rSrcItems;
+   std::set<std::string> srcDBContexts;
+   bool useTables = useNameTables(term);
+   if (useTables)
+   {
+      searchSourceDatabase(term,
+                           std::numeric_limits<std::size_t>::max(),
+                           false,
+                           &rSrcItems,
+                           &srcDBContexts);
+   }
+   else
+   {
+      bool moreAvailable = false;
+      searchSource(term, 100, false, &rSrcItems, &moreAvailable);
+   }
+
+   for (std::size_t i = 0; i < rSrcItems.size(); i++)
+   {
+      // don't index auto-generated files
+      if (isGeneratedSourceContext(rSrcItems[i].context()))
+         continue;
+
+      best.push(scoreMatch(rSrcItems[i].name(), term, false),
+                SourceItemRef(OriginSourceItems, static_cast<boost::uint32_t>(i)));
+   }
+
+   // project symbols (excluding documents already searched in the
+   // source database, which are more up to date)
+   if (useTables)
+   {
+      text::FuzzyQuery query(term);
+      const text::NameTable& names = s_projectIndex.symbolNames();
+      std::vector<boost::uint32_t> ids;
+      names.findMatches(query, &ids);
+      BOOST_FOREACH(boost::uint32_t id, ids)
+      {
+         const std::string& context = s_projectIndex.symbolContext(id);
+         if (srcDBContexts.count(context) || isGeneratedSourceContext(context))
+            continue;
+
+         best.push(scoreMatch(names.nameData(id), names.nameSize(id), term, false),
+                   SourceItemRef(OriginProjectSymbols, id));
+      }
+   }
+
+   // C++ definitions
+   std::vector<clang::CppDefinition> cppDefinitions;
+   clang::searchDefinitions(term, &cppDefinitions);
+   for (std::size_t i = 0; i < cppDefinitions.size(); i++)
+   {
+      std::string context = module_context::createAliasedPath(
+                                       cppDefinitions[i].location.filePath);
+      if (isGeneratedSourceContext(context))
+         continue;
+
+      best.push(scoreMatch(cppDefinitions[i].name, term, false),
+                SourceItemRef(OriginCppDefinitions, static_cast<boost::uint32_t>(i)));
+   }
+
+   // convert the retained items
+   std::vector<std::pair<int, SourceItemRef> > sorted = best.sorted();
+   for (std::size_t i = 0; i < sorted.size(); i++)
+   {
+      const SourceItemRef& ref = sorted[i].second;
+      switch (ref.first)
+      {
+      case OriginSourceItems:
+         pItems->push_back(fromRSourceItem(rSrcItems[ref.second]));
+         break;
+      case OriginProjectSymbols:
+         pItems->push_back(fromRSourceItem(s_projectIndex.symbol(ref.second)));
+         break;
+      case OriginCppDefinitions:
+         pItems->push_back(fromCppDefinition(cppDefinitions[ref.second]));
+         break;
+      }
+      pScores->push_back(std::make_pair(static_cast<int>(i), sorted[i].first));
+   }
+
+   return best.pushedCount();
+}
+
 Error searchCode(const json::JsonRpcRequest& request,
                  json::JsonRpcResponse* pResponse)
 {
@@ -1572,72 +2139,26 @@ Error searchCode(const json::JsonRpcRequest& request,
    // object to return
    json::Object result;
 
-   // search files
-   std::vector<std::string> names;
-   std::vector<std::string> paths;
-   bool moreFilesAvailable = false;
-
-   // TODO: Refactor searchSourceFiles, searchSource to no longer take maximum number
-   // of results (since we want to grab everything possible then filter before
-   // sending over the wire). Simiarly with the 'more*Available' bools
-   searchFiles(term, 100, true, &names, &paths, &moreFilesAvailable);
-
-   // search source and convert to source items
-   std::vector<SourceItem> srcItems;
-   std::vector<r_util::RSourceItem> rSrcItems;
-   bool moreSourceItemsAvailable = false;
-   searchSource(term, 100, false, &rSrcItems, &moreSourceItemsAvailable);
-   std::transform(rSrcItems.begin(),
-                  rSrcItems.end(),
-                  std::back_inserter(srcItems),
-                  fromRSourceItem);
-
-   // search cpp source and convert to source items
-   std::vector<clang::CppDefinition> cppDefinitions;
-   clang::searchDefinitions(term, &cppDefinitions);
-   std::transform(cppDefinitions.begin(),
-                  cppDefinitions.end(),
-                  std::back_inserter(srcItems),
-                  fromCppDefinition);
-
    // typedef necessary for BOOST_FOREACH to work with pairs
    typedef std::pair<int, int> PairIntInt;
 
-   // score matches -- returned as a pair, mapping index to score
+   // score matches, keeping the best maxResults of each kind (as pairs
+   // mapping index to score, sorted by score with lower being better)
+   std::vector<std::string> names;
+   std::vector<std::string> paths;
    std::vector<PairIntInt> fileScores;
-   for (std::size_t i = 0; i < paths.size(); ++i)
-   {
-      fileScores.push_back(std::make_pair(i, scoreMatch(names[i], term, true)));
-   }
-
-   // sort by score (lower is better)
-   std::sort(fileScores.begin(), fileScores.end(), ScorePairComparator());
+   std::size_t fileCount = scoreFiles(term, maxResults, &names, &paths, &fileScores);
 
+   std::vector<SourceItem> srcItems;
    std::vector<PairIntInt> srcItemScores;
-   for (std::size_t i = 0; i < srcItems.size(); ++i)
-   {
-      const SourceItem& item = srcItems[i];
-      
-      // don't index auto-generated files
-      const std::string& context = item.context();
-      if (boost::algorithm::ends_with(context, "RcppExports.R") ||
-          boost::algorithm::ends_with(context, "RcppExports.cpp"))
-         continue;
-         
-      int score = scoreMatch(item.name(), term, false);
-      srcItemScores.push_back(std::make_pair(i, score));
-   }
-   std::sort(srcItemScores.begin(), srcItemScores.end(), ScorePairComparator());
+   std::size_t srcItemCount = scoreSourceItems(term, maxResults, &srcItems, &srcItemScores);
 
    // filter so we keep only the top n results -- and proactively
    // update whether there are other entries we didn't report back
-   std::size_t srcItemScoresSizeBefore = srcItemScores.size();
-   std::size_t fileScoresSizeBefore = fileScores.size();
-
    filterScores(&fileScores, &srcItemScores, static_cast<int>(maxResults));
 
-   moreFilesAvailable = fileScoresSizeBefore > fileScores.size();
-   moreSourceItemsAvailable = srcItemScoresSizeBefore > srcItemScores.size();
+   bool moreFilesAvailable = fileCount > fileScores.size();
+   bool moreSourceItemsAvailable = srcItemCount > srcItemScores.size();
 
    // get filtered results
    std::vector<std::string> namesFiltered;
@@ -2347,6 +2868,27 @@ SEXP rs_scoreMatches(SEXP suggestionsSEXP,
    return r::sexp::create(scores, &protect);
 }
 
+// report the progress of project source indexing, e.g. to measure the
+// time taken to fully index a project after opening it:
+// .Call("rs_projectIndexStatus")
+SEXP rs_projectIndexStatus()
+{
+   const r_util::RSourceIndexer::Progress& progress =
+                                    s_projectIndex.indexingProgress();
+
+   r::sexp::Protect protect;
+   r::sexp::ListBuilder builder(&protect);
+   builder.add("files.queued", static_cast<int>(progress.queued));
+   builder.add("files.indexed", static_cast<int>(progress.indexed));
+   builder.add("files.pending", static_cast<int>(progress.pending));
+   builder.add("files.cached", static_cast<int>(progress.cached));
+   builder.add("cache.load.ms",
+               static_cast<double>(s_projectIndex.cacheLoadTime().total_milliseconds()));
+   builder.add("elapsed.ms", static_cast<double>(progress.elapsed.total_milliseconds()));
+   builder.add("threads", static_cast<int>(module_context::workerThreadPool().threadCount()));
+   return r::sexp::create(builder, &protect);
+}
+
 inline SEXP pathResultsSEXP(std::vector<std::string> const& paths,
                             bool moreAvailable)
 {
@@ -2492,6 +3034,11 @@ Error initialize()
             "rs_listIndexedFilesAndFolders",
             (DL_FUNC) rs_listIndexedFilesAndFolders,
             3);
+
+   r::routines::registerCallMethod(
+            "rs_projectIndexStatus",
+            (DL_FUNC) rs_projectIndexStatus,
+            0);
    
    // initialize r source indexes
    rSourceIndex().initialize();
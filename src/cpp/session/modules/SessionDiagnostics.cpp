@@ -22,14 +22,17 @@
 
 #include "SessionCodeSearch.hpp"
 #include "SessionAsyncPackageInformation.hpp"
+#include "SessionPackageSymbolCache.hpp"
 #include "SessionRParser.hpp"
 
+#include <deque>
 #include <set>
 
 #include <core/Debug.hpp>
 #include <core/Exec.hpp>
 #include <core/Error.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
 #include <core/YamlUtil.hpp>
 
 #include <session/SessionRUtil.hpp>
@@ -55,6 +58,7 @@
 #include <core/text/CsvParser.hpp>
 #include <core/collection/Tree.hpp>
 #include <core/collection/Stack.hpp>
+#include <core/collection/LruCache.hpp>
 
 namespace rstudio {
 namespace session {
@@ -126,10 +130,10 @@ void doCheckDefinedButNotUsed(ParseNode* pNode, ParseResults& results)
 
 void checkDefinedButNotUsed(ParseResults& results)
 {
-   ParseNode::Children children = results.parseTree()->getChildren();
-   BOOST_FOREACH(const boost::shared_ptr<ParseNode>& child, children)
+   const ParseNode::Children& children = results.parseTree()->getChildren();
+   BOOST_FOREACH(ParseNode* child, children)
    {
-      doCheckDefinedButNotUsed(child.get(), results);
+      doCheckDefinedButNotUsed(child, results);
    }
 }
 
@@ -209,56 +213,79 @@ class PackageSymbolRegistry : boost::noncopyable
 {
 public:
    
-   typedef std::map<std::string, std::vector<std::string> > Registry;
+   typedef std::pair<PackageSymbolKind, std::string> Key;
+   typedef std::map<Key, std::vector<std::string> > Registry;
    
    void fillPackageSymbols(const std::string& pkgName,
                            std::set<std::string>* pOutput)
    {
-      if (!registry_.count(pkgName))
-      {
-         SEXP envSEXP = r::sexp::asEnvironment(pkgName);
-         if (envSEXP == R_EmptyEnv)
-            return;
-         
-         Error error = r::sexp::objects(envSEXP, true, &registry_[pkgName]);
-         if (error) LOG_ERROR(error);
-      }
-      
-      const std::vector<std::string>& symbols = registry_[pkgName];
-      pOutput->insert(
-               symbols.begin(),
-               symbols.end());
+      fillSymbols(pkgName, PackageSymbolsAttached, pOutput);
    }
    
    void fillNamespaceSymbols(const std::string& pkgName,
                              std::set<std::string>* pOutput,
                              bool exportsOnly = true)
    {
-      if (!registry_.count(pkgName))
+      fillSymbols(pkgName,
+                  exportsOnly ?
+                     PackageSymbolsExports :
+                     PackageSymbolsNamespace,
+                  pOutput);
+   }
+   
+private:
+   
+   void fillSymbols(const std::string& pkgName,
+                    PackageSymbolKind kind,
+                    std::set<std::string>* pOutput)
+   {
+      Key key(kind, pkgName);
+      Registry::iterator it = registry_.find(key);
+      if (it == registry_.end())
       {
-         SEXP envSEXP = r::sexp::asNamespace(pkgName);
-         if (envSEXP == R_EmptyEnv)
-            return;
-
-         if (exportsOnly)
-         {
-            Error error = r::sexp::getNamespaceExports(envSEXP, &registry_[pkgName]);
-            if (error) LOG_ERROR(error);
-         }
-         else
+         // prefer the symbols persisted by an earlier session; these
+         // don't require the package to be loaded
+         std::vector<std::string> symbols;
+         if (!package_symbols::getSymbols(pkgName, kind, &symbols))
          {
-            Error error = r::sexp::objects(envSEXP, true, &registry_[pkgName]);
-            if (error) LOG_ERROR(error);
+            if (!readSymbols(pkgName, kind, &symbols))
+               return;
+            package_symbols::putSymbols(pkgName, kind, symbols);
          }
+         
+         it = registry_.insert(std::make_pair(key, symbols)).first;
       }
       
-      const std::vector<std::string>& symbols = registry_[pkgName];
+      const std::vector<std::string>& symbols = it->second;
       pOutput->insert(
                symbols.begin(),
                symbols.end());
    }
    
-private:
+   bool readSymbols(const std::string& pkgName,
+                    PackageSymbolKind kind,
+                    std::vector<std::string>* pSymbols)
+   {
+      SEXP envSEXP = kind == PackageSymbolsAttached ?
+               r::sexp::asEnvironment(pkgName) :
+               r::sexp::asNamespace(pkgName);
+      
+      if (envSEXP == R_EmptyEnv)
+         return false;
+      
+      Error error = kind == PackageSymbolsExports ?
+               r::sexp::getNamespaceExports(envSEXP, pSymbols) :
+               r::sexp::objects(envSEXP, true, pSymbols);
+      
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      
+      return true;
+   }
+   
    Registry registry_;
 };
 
@@ -327,9 +354,7 @@ void addRcppExportedSymbols(const FilePath& filePath,
 //
 // We don't want to search for symbols on the search path here,
 // since they would not get properly resolved at runtime.
-Error getAvailableSymbolsForPackage(const FilePath& filePath,
-                                    const std::string& documentId,
-                                    std::set<std::string>* pSymbols)
+Error getAvailableSymbolsForPackage(std::set<std::string>* pSymbols)
 {
    // Add project symbols (ie, top-level symbols within an R package)
    code_search::addAllProjectSymbols(pSymbols);
@@ -337,13 +362,6 @@ Error getAvailableSymbolsForPackage(const FilePath& filePath,
    // Symbols inferred from the NAMESPACE (importFrom, import)
    addNamespaceSymbols(pSymbols);
    
-   // Add symbols made available by explicit `library()` calls
-   // within this document.
-   addInferredSymbols(filePath, documentId, pSymbols);
-   
-   // Add in symbols that would be made available by `// [[Rcpp::export]]`
-   addRcppExportedSymbols(filePath, documentId, pSymbols);
-   
    // Symbols that are 'automatically' made available to packages. In other
    // words, symbols that packages can use without explicitly importing them.
    // In other words, symbols that `R CMD check` will silently resolve to one
@@ -360,23 +378,10 @@ Error getAvailableSymbolsForPackage(const FilePath& filePath,
 // For a generic R project, we are less strict on where we attempt
 // to discover objects -- we simply consider all symbols available on
 // the current search path.
-Error getAvailableSymbolsForProject(const FilePath& filePath,
-                                    const std::string& documentId,
-                                    std::set<std::string>* pSymbols)
+Error getAvailableSymbolsForProject(std::set<std::string>* pSymbols)
 {
    // Get all available symbols on the search path.
-   Error error = r::exec::RFunction(".rs.availableRSymbols").call(pSymbols);
-   if (error)
-      return error;
-   
-   // Add in symbols that would be made available by `// [[Rcpp::export]]`
-   addRcppExportedSymbols(filePath, documentId, pSymbols);
-   
-   // Get all of the symbols made available by `library()` calls
-   // within this document.
-   addInferredSymbols(filePath, documentId, pSymbols);
-   
-   return Success();
+   return r::exec::RFunction(".rs.availableRSymbols").call(pSymbols);
 }
 
 void addTestPackageSymbols(std::set<std::string>* pSymbols)
@@ -403,71 +408,114 @@ void addTestPackageSymbols(std::set<std::string>* pSymbols)
       registry.fillNamespaceSymbols("assertthat", pSymbols, false);
 }
 
-Error getAllAvailableRSymbols(const FilePath& filePath,
-                              const std::string& documentId,
-                              const ParseResults& results,
-                              std::set<std::string>* pSymbols)
+// The kinds of file which differ in the symbols available to them,
+// independently of their contents
+struct SharedSymbolsKind
 {
-   // If this file lies within the current project, then
-   // we want to pull symbols from specific places -- specifically,
-   // _not_ the current search path. We want to infer whether the
-   // functions in the package would work at runtime.
-   //
-   // For R package development, when linting a 'test' file, we can
-   // safely assume that the package itself will be loaded.
-   FilePath projDir = projects::projectContext().directory();
-   Error error;
+   explicit SharedSymbolsKind(const FilePath& filePath)
+   {
+      // If this file lies within the current project, then
+      // we want to pull symbols from specific places -- specifically,
+      // _not_ the current search path. We want to infer whether the
+      // functions in the package would work at runtime.
+      //
+      // For R package development, when linting a 'test' file, we can
+      // safely assume that the package itself will be loaded.
+      FilePath projDir = projects::projectContext().directory();
+      isPackageFile = projects::projectContext().isPackageProject() &&
+                      filePath.isWithin(projDir);
+      
+      isTestFile = filePath.isWithin(projDir.childPath("inst")) ||
+                   filePath.isWithin(projDir.childPath("tests"));
+      
+      isTestthatFile = filePath.isWithin(projDir.childPath("tests/testthat"));
+      
+      // If the file is named 'server.R', 'ui.R' or 'app.R', we'll implicitly
+      // assume that it depends on Shiny.
+      std::string basename = boost::algorithm::to_lower_copy(
+               filePath.filename());
+      
+      isShinyFile = basename == "server.r" ||
+                    basename == "ui.r" ||
+                    basename == "app.r";
+   }
    
-   if (projects::projectContext().isPackageProject() && filePath.isWithin(projDir))
+   bool operator<(const SharedSymbolsKind& other) const
    {
-      DEBUG("- Package file: '" << filePath.absolutePath() << "'");
-      error = getAvailableSymbolsForPackage(filePath, documentId, pSymbols);
+      return key() < other.key();
    }
-   else
+   
+   int key() const
    {
-      DEBUG("- Project file: '" << filePath.absolutePath() << "'");
-      error = getAvailableSymbolsForProject(filePath, documentId, pSymbols);
+      return isPackageFile | isTestFile << 1 | isTestthatFile << 2 | isShinyFile << 3;
    }
    
-   if (error) LOG_ERROR(error);
+   bool isPackageFile;
+   bool isTestFile;
+   bool isTestthatFile;
+   bool isShinyFile;
+};
+
+// The symbols available to a kind of file which don't depend on the file's
+// own contents (e.g. the package's imports, or everything on the search
+// path). These make up the bulk of the available symbols.
+Error getSharedRSymbols(const SharedSymbolsKind& kind,
+                        std::set<std::string>* pSymbols)
+{
+   Error error;
+   if (kind.isPackageFile)
+      error = getAvailableSymbolsForPackage(pSymbols);
+   else
+      error = getAvailableSymbolsForProject(pSymbols);
+   
+   if (error)
+      return error;
    
    // Add common 'testing' packages, based on the DESCRIPTION's
    // 'Imports' and 'Suggests' fields, and use that if we're within a
    // common 'test'ing directory.
-   if (filePath.isWithin(projDir.childPath("inst")) ||
-       filePath.isWithin(projDir.childPath("tests")))
-   {
+   if (kind.isTestFile)
       addTestPackageSymbols(pSymbols);
-   }
    
-   if (filePath.isWithin(projects::projectContext().directory().childPath("tests/testthat")))
+   if (kind.isTestthatFile)
    {
       PackageSymbolRegistry& registry = packageSymbolRegistry();
       registry.fillNamespaceSymbols("testthat", pSymbols, false);
    }
    
-   // If the file is named 'server.R', 'ui.R' or 'app.R', we'll implicitly
-   // assume that it depends on Shiny.
-   std::string basename = boost::algorithm::to_lower_copy(
-            filePath.filename());
-   
-   if (basename == "server.r" ||
-       basename == "ui.r" ||
-       basename == "app.r")
+   if (kind.isShinyFile)
    {
       PackageSymbolRegistry& registry = packageSymbolRegistry();
       registry.fillNamespaceSymbols("shiny", pSymbols, false);
    }
    
-   pSymbols->insert(results.globals().begin(), results.globals().end());
+   return Success();
+}
+
+// The symbols made available to a file by its own contents.
+void addFileRSymbols(const FilePath& filePath,
+                     const std::string& documentId,
+                     const ParseResults& results,
+                     std::set<std::string>* pSymbols)
+{
+   // Add symbols made available by explicit `library()` calls
+   // within this document.
+   addInferredSymbols(filePath, documentId, pSymbols);
    
-   return error;
-      
+   // Add in symbols that would be made available by `// [[Rcpp::export]]`
+   addRcppExportedSymbols(filePath, documentId, pSymbols);
+   
+   pSymbols->insert(results.globals().begin(), results.globals().end());
 }
 
+// Shared symbol sets, by kind of file, for re-use when linting many files.
+// (Only valid as long as the state of the R session is unchanged.)
+typedef std::map<SharedSymbolsKind, std::set<std::string> > SharedSymbolsCache;
+
 void checkNoDefinitionInScope(const FilePath& origin,
                               const std::string& documentId,
-                              ParseResults& results)
+                              ParseResults& results,
+                              SharedSymbolsCache* pCache = NULL)
 {
    ParseNode* pRoot = results.parseTree();
    
@@ -477,24 +525,48 @@ void checkNoDefinitionInScope(const FilePath& origin,
    // Now, find all available R symbols -- that is, objects on the search path,
    // or symbols that would otherwise be made available at runtime (e.g.
    // package imports)
-   std::set<std::string> objects;
-   Error error = getAllAvailableRSymbols(origin, documentId, results, &objects);
-   if (error)
+   SharedSymbolsKind kind(origin);
+   std::set<std::string> sharedObjects;
+   const std::set<std::string>* pSharedObjects = &sharedObjects;
+   
+   SharedSymbolsCache::const_iterator it;
+   if (pCache && (it = pCache->find(kind)) != pCache->end())
    {
-      LOG_ERROR(error);
-      return;
+      pSharedObjects = &it->second;
+   }
+   else
+   {
+      Error error = getSharedRSymbols(kind, &sharedObjects);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+      
+      if (pCache)
+      {
+         std::set<std::string>& cached = (*pCache)[kind];
+         cached.swap(sharedObjects);
+         pSharedObjects = &cached;
+      }
    }
    
+   std::set<std::string> objects;
+   addFileRSymbols(origin, documentId, results, &objects);
+   
    // For each unresolved symbol, add it to the lint if it's not on the search
    // path.
    BOOST_FOREACH(const ParseItem& item, unresolvedItems)
    {
-      if (!r::util::isRKeyword(item.symbol) &&
-          !r::util::isWindowsOnlyFunction(item.symbol) &&
-          objects.count(string_utils::strippedOfBackQuotes(item.symbol)) == 0)
+      if (r::util::isRKeyword(item.symbol) ||
+          r::util::isWindowsOnlyFunction(item.symbol))
       {
-         addUnreferencedSymbol(item, results.lint());
+         continue;
       }
+      
+      std::string symbol = string_utils::strippedOfBackQuotes(item.symbol);
+      if (pSharedObjects->count(symbol) == 0 && objects.count(symbol) == 0)
+         addUnreferencedSymbol(item, results.lint());
    }
 }
 
@@ -632,14 +704,8 @@ void setFileLocalParseOptions(const std::wstring& rCode,
    applyOptions(options, pOptions);
 }
 
-} // end anonymous namespace
-
-ParseResults parse(const std::wstring& rCode,
-                   const FilePath& origin,
-                   const std::string& documentId = std::string(),
-                   bool isExplicit = false)
+ParseOptions userParseOptions(bool isExplicit)
 {
-   ParseResults results;
    ParseOptions options;
    
    options.setLintRFunctions(
@@ -660,36 +726,72 @@ ParseResults parse(const std::wstring& rCode,
    options.setRecordStyleLint(
             userSettings().enableStyleDiagnostics());
    
-   bool noLint = false;
-   setFileLocalParseOptions(rCode, &options, &noLint);
-   if (noLint)
-      return ParseResults();
+   return options;
+}
+
+bool hasParseTree(const ParseResults& results, const std::wstring& rCode)
+{
+   if (results.parseTree())
+      return true;
    
-   results = rparser::parse(origin, rCode, options);
+   std::string codeSnippet;
+   if (rCode.length() > 40)
+      codeSnippet = string_utils::wideToUtf8(rCode.substr(0, 40)) + "...";
+   else
+      codeSnippet = string_utils::wideToUtf8(rCode);
    
-   ParseNode* pRoot = results.parseTree();
-   if (!pRoot)
-   {
-      std::string codeSnippet;
-      if (rCode.length() > 40)
-         codeSnippet = string_utils::wideToUtf8(rCode.substr(0, 40)) + "...";
-      else
-         codeSnippet = string_utils::wideToUtf8(rCode);
-      
-      std::string message = std::string() +
-            "Parse failed: no parse tree available for code " +
-            "'" + codeSnippet + "'";
-      
-      LOG_ERROR_MESSAGE(message);
-      return ParseResults();
-   }
+   std::string message = std::string() +
+         "Parse failed: no parse tree available for code " +
+         "'" + codeSnippet + "'";
    
+   LOG_ERROR_MESSAGE(message);
+   return false;
+}
+
+// Add the diagnostics which depend on the state of the R session
+void checkSymbols(const FilePath& origin,
+                  const std::string& documentId,
+                  const ParseOptions& options,
+                  ParseResults& results,
+                  SharedSymbolsCache* pCache = NULL)
+{
    if (options.warnIfNoSuchVariableInScope())
-      checkNoDefinitionInScope(origin, documentId, results);
+      checkNoDefinitionInScope(origin, documentId, results, pCache);
    
    if (options.warnIfVariableIsDefinedButNotUsed())
       checkDefinedButNotUsed(results);
+}
+
+} // end anonymous namespace
+
+// If 'pPrevious' is supplied, it should hold the results of parsing a previous
+// version of the document; only the statements around what's changed since
+// are re-parsed, and it's updated to hold the results of parsing this version.
+// (Note that it holds the results of parsing only: symbols are resolved from
+// scratch each time, as they depend on the state of the R session.)
+ParseResults parse(const std::wstring& rCode,
+                   const FilePath& origin,
+                   const std::string& documentId = std::string(),
+                   bool isExplicit = false,
+                   ParseResults* pPrevious = NULL)
+{
+   ParseResults results;
+   ParseOptions options = userParseOptions(isExplicit);
+   
+   bool noLint = false;
+   setFileLocalParseOptions(rCode, &options, &noLint);
+   if (noLint)
+   {
+      if (pPrevious)
+         *pPrevious = ParseResults();
+      return ParseResults();
+   }
    
+   results = rparser::parse(origin, rCode, options, pPrevious);
+   if (!hasParseTree(results, rCode))
+      return ParseResults();
+   
+   checkSymbols(origin, documentId, options, results);
    return results;
 }
 
@@ -702,6 +804,29 @@ ParseResults parse(const std::string& rCode,
 
 namespace {
 
+// The results of parsing recently linted documents, by document id. (These
+// are re-used when the document is next linted, to re-parse only what's
+// changed.)
+const unsigned int kMaxCachedParseResults = 8;
+
+collection::LruCache<std::string, boost::shared_ptr<ParseResults> >&
+documentParseCache()
+{
+   static collection::LruCache<std::string, boost::shared_ptr<ParseResults> >
+         instance(kMaxCachedParseResults);
+   return instance;
+}
+
+void onDocRemoved(const std::string& id, const std::string&)
+{
+   documentParseCache().remove(id);
+}
+
+void onRemoveAll()
+{
+   documentParseCache().clear();
+}
+
 json::Array lintAsJson(const LintItems& items)
 {
    json::Array jsonArray;
@@ -816,11 +941,19 @@ Error lintRSourceDocument(const json::JsonRpcRequest& request,
    if (error)
       return error;
    
+   boost::shared_ptr<ParseResults> pPrevious;
+   if (!documentParseCache().get(documentId, &pPrevious))
+   {
+      pPrevious.reset(new ParseResults());
+      documentParseCache().insert(documentId, pPrevious);
+   }
+   
    ParseResults results = diagnostics::parse(
             string_utils::utf8ToWide(content),
             origin,
             documentId,
-            isExplicit);
+            isExplicit,
+            pPrevious.get());
    
    pResponse->setResult(lintAsJson(results.lint()));
    
@@ -973,13 +1106,121 @@ void afterSessionInitHook(bool newSession)
    }
 }
 
-bool collectLint(int depth,
-                 const FilePath& path,
-                 std::map<FilePath, LintItems>* pLint)
+// Linting a directory: files are read, tokenized and parsed on a pool of
+// worker threads. The main thread meanwhile runs the R lookups the parsers
+// need (see RLookups), resolves the symbols of parsed files against symbol
+// sets shared between files, and publishes markers as files complete.
+
+// publish markers at most this often while linting
+const boost::posix_time::time_duration kLintMarkersInterval =
+                                       boost::posix_time::milliseconds(500);
+
+struct LintedFile
 {
-   if (path.extensionLowerCase() != ".r")
-      return true;
+   LintedFile(const FilePath& path,
+              boost::shared_ptr<ParseResults> pResults)
+      : path(path), pResults(pResults)
+   {}
+   
+   FilePath path;
+   
+   // NULL if the file wasn't parsed (e.g. diagnostics are turned off)
+   boost::shared_ptr<ParseResults> pResults;
+};
+
+class DirectoryLint : boost::noncopyable
+{
+public:
+   
+   explicit DirectoryLint(std::size_t fileCount)
+      : pRLookups_(new RLookups(
+                      boost::bind(&DirectoryLint::onLookupPending, this))),
+        remaining_(fileCount),
+        lookupsPending_(false)
+   {}
+   
+   const boost::shared_ptr<RLookups>& rLookups() const
+   {
+      return pRLookups_;
+   }
+   
+   // called on worker threads
+   void complete(const LintedFile& file)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         completed_.push_back(file);
+         remaining_--;
+      }
+      END_LOCK_MUTEX
+      
+      changed_.notify_all();
+   }
+   
+   // called on the main thread: wait (for at most 'timeout') until a file
+   // completes or R lookups are pending, and return the completed files.
+   // returns false once all files have completed
+   bool wait(const boost::posix_time::time_duration& timeout,
+             std::vector<LintedFile>* pCompleted)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      if (completed_.empty() && !lookupsPending_ && remaining_ > 0)
+         changed_.timed_wait(lock, timeout);
+      
+      pCompleted->assign(completed_.begin(), completed_.end());
+      completed_.clear();
+      lookupsPending_ = false;
+      return remaining_ > 0;
+   }
+   
+private:
+   
+   void onLookupPending()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         lookupsPending_ = true;
+      }
+      END_LOCK_MUTEX
+      
+      changed_.notify_all();
+   }
    
+   boost::shared_ptr<RLookups> pRLookups_;
+   
+   boost::mutex mutex_;
+   boost::condition_variable changed_;
+   std::deque<LintedFile> completed_;
+   std::size_t remaining_;
+   bool lookupsPending_;
+};
+
+// cancels R lookups when going out of scope, so that parsers still waiting
+// on R are released however linting ends
+class CancelRLookupsScope : boost::noncopyable
+{
+public:
+   explicit CancelRLookupsScope(const boost::shared_ptr<RLookups>& pRLookups)
+      : pRLookups_(pRLookups)
+   {}
+   
+   ~CancelRLookupsScope()
+   {
+      try
+      {
+         pRLookups_->cancel();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+   
+private:
+   boost::shared_ptr<RLookups> pRLookups_;
+};
+
+// runs on a worker thread
+boost::shared_ptr<ParseResults> parseFileForLint(const FilePath& path,
+                                                 const ParseOptions& options)
+{
    std::string contents;
    Error error = core::readStringFromFile(
             path,
@@ -989,36 +1230,128 @@ bool collectLint(int depth,
    if (error)
    {
       LOG_ERROR(error);
-      return true;
+      return boost::shared_ptr<ParseResults>();
    }
    
-   ParseResults results = diagnostics::parse(
-            string_utils::utf8ToWide(contents),
-            path,
-            std::string(),
-            true);
+   std::wstring rCode = string_utils::utf8ToWide(contents);
+   
+   ParseOptions fileOptions = options;
+   bool noLint = false;
+   setFileLocalParseOptions(rCode, &fileOptions, &noLint);
+   if (noLint)
+      return boost::shared_ptr<ParseResults>();
+   
+   boost::shared_ptr<ParseResults> pResults(
+            new ParseResults(rparser::parse(path, rCode, fileOptions)));
+   
+   if (!hasParseTree(*pResults, rCode))
+      return boost::shared_ptr<ParseResults>();
+   
+   return pResults;
+}
+
+void lintFile(boost::shared_ptr<DirectoryLint> pLint,
+              const FilePath& path,
+              const ParseOptions& options)
+{
+   boost::shared_ptr<ParseResults> pResults;
+   
+   // (skip parsing if the lint was abandoned)
+   if (!pLint->rLookups()->cancelled())
+   {
+      try
+      {
+         pResults = parseFileForLint(path, options);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+   
+   pLint->complete(LintedFile(path, pResults));
+}
+
+bool collectRFiles(int depth,
+                   const FilePath& path,
+                   std::vector<FilePath>* pFiles)
+{
+   if (path.extensionLowerCase() == ".r")
+      pFiles->push_back(path);
    
-   (*pLint)[path] = results.lint();
    return true;
 }
 
 SEXP rs_lintDirectory(SEXP directorySEXP)
 {
+   using namespace module_context;
+   using namespace boost::posix_time;
+   
    std::string directory = r::sexp::asString(directorySEXP);
    FilePath dirPath = module_context::resolveAliasedPath(directory);
    if (!dirPath.exists())
       return R_NilValue;
    
-   std::map<FilePath, LintItems> lint;
+   std::vector<FilePath> files;
    Error error = dirPath.childrenRecursive(
-            boost::bind(collectLint, _1, _2, &lint));
+            boost::bind(collectRFiles, _1, _2, &files));
    if (error)
    {
       LOG_ERROR(error);
       return R_NilValue;
    }
    
-   using namespace module_context;
+   boost::shared_ptr<DirectoryLint> pLint(new DirectoryLint(files.size()));
+   
+   ParseOptions options = userParseOptions(true);
+   options.setRLookups(pLint->rLookups());
+   CancelRLookupsScope cancelScope(pLint->rLookups());
+   
+   BOOST_FOREACH(const FilePath& file, files)
+   {
+      module_context::workerThreadPool().enque(
+               boost::bind(lintFile, pLint, file, options));
+   }
+   
+   std::map<FilePath, LintItems> lint;
+   SharedSymbolsCache symbolsCache;
+   ptime lastUpdate = microsec_clock::universal_time();
+   bool linting = !files.empty();
+   while (linting)
+   {
+      std::vector<LintedFile> completed;
+      linting = pLint->wait(milliseconds(100), &completed);
+      
+      pLint->rLookups()->runPending();
+      
+      BOOST_FOREACH(const LintedFile& file, completed)
+      {
+         if (!file.pResults)
+         {
+            lint[file.path] = LintItems();
+            continue;
+         }
+         
+         checkSymbols(file.path,
+                      std::string(),
+                      file.pResults->parseOptions(),
+                      *file.pResults,
+                      &symbolsCache);
+         
+         lint[file.path] = file.pResults->lint();
+      }
+      
+      // abandon the rest on interrupt (parsers waiting on R are released
+      // as we exit)
+      if (r::exec::interruptsPending())
+         break;
+      
+      ptime now = microsec_clock::universal_time();
+      if (linting && !completed.empty() &&
+          now - lastUpdate > kLintMarkersInterval)
+      {
+         showSourceMarkers(asSourceMarkerSet(lint), MarkerAutoSelectNone);
+         lastUpdate = now;
+      }
+   }
+   
    SourceMarkerSet markers = asSourceMarkerSet(lint);
    showSourceMarkers(markers, MarkerAutoSelectNone);
    return R_NilValue;
@@ -1034,6 +1367,9 @@ core::Error initialize()
    
    events().afterSessionInitHook.connect(afterSessionInitHook);
    
+   source_database::events().onDocRemoved.connect(onDocRemoved);
+   source_database::events().onRemoveAll.connect(onRemoveAll);
+   
    session::projects::FileMonitorCallbacks cb;
    cb.onFilesChanged = onFilesChanged;
    projects::projectContext().subscribeToFileMonitor("Diagnostics", cb);
@@ -1043,6 +1379,7 @@ core::Error initialize()
    
    ExecBlock initBlock;
    initBlock.addFunctions()
+         (package_symbols::initialize)
          (bind(sourceModuleRFile, "SessionDiagnostics.R"))
          (bind(registerRpcMethod, "lint_r_source_document", lintRSourceDocument));
    
@@ -23,10 +23,13 @@
 #include <core/FilePath.hpp>
 #include <core/system/FileScanner.hpp>
 #include <core/FileUtils.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 
 #include <session/SessionOptions.hpp>
 #include "SessionRParser.hpp"
@@ -114,6 +117,97 @@ void lintRFilesInSubdirectory(const FilePath& path)
    }
 }
 
+std::string describeLint(const LintItems& lint)
+{
+   std::string result;
+   BOOST_FOREACH(const LintItem& item, lint)
+   {
+      result += safe_convert::numberToString(item.startRow) + ":" +
+                safe_convert::numberToString(item.startColumn) + "-" +
+                safe_convert::numberToString(item.endRow) + ":" +
+                safe_convert::numberToString(item.endColumn) + " " +
+                item.message + "\n";
+   }
+   return result;
+}
+
+// re-lint each revision of a document incrementally, and check that the
+// lint matches that produced by linting it from scratch
+void expectIncrementalLintMatches(const std::vector<std::string>& revisions)
+{
+   ParseResults previous;
+   BOOST_FOREACH(const std::string& revision, revisions)
+   {
+      std::wstring code = string_utils::utf8ToWide(revision);
+      ParseResults incremental = parse(FilePath(), code, s_parseOptions, &previous);
+      ParseResults full = parse(FilePath(), code, s_parseOptions);
+      expect_true(describeLint(incremental.lint()) == describeLint(full.lint()));
+      expect_true(incremental.lint().errorCount() == full.lint().errorCount());
+   }
+}
+
+void parseInto(const std::string& code,
+               const ParseOptions& options,
+               ParseResults* pResults)
+{
+   *pResults = parse(FilePath(), string_utils::utf8ToWide(code), options);
+}
+
+// parse code on another thread, running the R lookups it needs on this
+// one; returns the number of lookups run
+std::size_t parseOnWorkerThread(const std::string& code,
+                                boost::shared_ptr<RLookups> pRLookups,
+                                ParseResults* pResults)
+{
+   ParseOptions options = s_parseOptions;
+   options.setRLookups(pRLookups);
+   
+   boost::thread worker(boost::bind(parseInto, code, options, pResults));
+   
+   std::size_t count = 0;
+   while (!worker.timed_join(boost::posix_time::milliseconds(1)))
+      count += pRLookups->runPending();
+   
+   return count;
+}
+
+int failingLookup()
+{
+   throw std::runtime_error("lookup failed");
+}
+
+int succeedingLookup()
+{
+   return 42;
+}
+
+void lookupInto(boost::shared_ptr<RLookups> pRLookups,
+                const boost::function<int()>& lookup,
+                int* pResult)
+{
+   *pResult = pRLookups->lookup<int>("key", lookup);
+}
+
+// run a lookup on another thread, running it on this one; returns false
+// if the worker didn't complete
+bool lookupOnWorkerThread(boost::shared_ptr<RLookups> pRLookups,
+                          const boost::function<int()>& lookup,
+                          int* pResult)
+{
+   boost::thread worker(boost::bind(lookupInto, pRLookups, lookup, pResult));
+   
+   for (int i = 0; i < 10000; i++)
+   {
+      if (worker.timed_join(boost::posix_time::milliseconds(1)))
+         return true;
+      pRLookups->runPending();
+   }
+   
+   pRLookups->cancel();
+   worker.join();
+   return false;
+}
+
 void lintRStudioRFiles()
 {
    lintRFilesInSubdirectory(options().coreRSourcePath());
@@ -281,6 +375,165 @@ context("Diagnostics")
    lintRStudioRFiles();
 }
 
+context("Incremental Diagnostics")
+{
+   std::string prefix =
+         "f <- function(a, b) {\n"
+         "   a + b\n"
+         "}\n"
+         "\n"
+         "g <- function(x) {\n"
+         "   y <- x * 2\n"
+         "   y\n"
+         "}\n"
+         "\n";
+   
+   std::string suffix =
+         "\n"
+         "h <- function(z) {\n"
+         "   list(z, z)\n"
+         "}\n"
+         "\n"
+         "f(1, 2)\n"
+         "g(h(1))\n";
+   
+   test_that("edits within a function body are re-linted incrementally")
+   {
+      std::vector<std::string> revisions;
+      revisions.push_back(prefix + suffix);
+      revisions.push_back(prefix + "k <- function() {\n   1\n}\n" + suffix);
+      revisions.push_back(prefix + "k <- function() {\n   1 +\n}\n" + suffix);
+      revisions.push_back(prefix + "k <- function() {\n   1 + 2\n}\n" + suffix);
+      revisions.push_back(prefix + "k <- function() {\n   (1 + 2\n}\n" + suffix);
+      revisions.push_back(prefix + suffix);
+      expectIncrementalLintMatches(revisions);
+   }
+   
+   test_that("edits changing the definitions used later are re-linted")
+   {
+      std::vector<std::string> revisions;
+      revisions.push_back(prefix + suffix);
+      revisions.push_back(prefix + suffix + "f(1, 2, 3)\n");
+      revisions.push_back("f <- function(a, b, c) {\n   a + b\n}\n" + prefix.substr(prefix.find('}') + 2) + suffix + "f(1, 2, 3)\n");
+      revisions.push_back(prefix + suffix + "f(1, 2, 3)\n");
+      expectIncrementalLintMatches(revisions);
+   }
+   
+   test_that("documents can be emptied and re-filled")
+   {
+      std::vector<std::string> revisions;
+      revisions.push_back(prefix + suffix);
+      revisions.push_back("");
+      revisions.push_back("   \n");
+      revisions.push_back(prefix);
+      revisions.push_back(prefix + suffix);
+      expectIncrementalLintMatches(revisions);
+   }
+}
+
+context("Threaded Diagnostics")
+{
+   std::string code =
+         "f <- function(a, b) {\n"
+         "   a + b\n"
+         "}\n"
+         "\n"
+         "f(1, 2)\n"
+         "x <- foo(1, 2)\n"
+         "y <- bar$baz(x)\n"
+         "z <- foo(3, 4)\n";
+   
+   test_that("parsing off the main thread runs R lookups on it")
+   {
+      boost::shared_ptr<RLookups> pRLookups(new RLookups());
+      ParseResults threaded;
+      std::size_t count = parseOnWorkerThread(code, pRLookups, &threaded);
+      
+      ParseResults direct = parse(code, s_parseOptions);
+      expect_true(describeLint(threaded.lint()) == describeLint(direct.lint()));
+      expect_true(count > 0);
+      
+      // repeated lookups are served from the cache
+      ParseResults again;
+      expect_true(parseOnWorkerThread(code, pRLookups, &again) == 0);
+      expect_true(describeLint(again.lint()) == describeLint(direct.lint()));
+   }
+   
+   test_that("cancelled lookups don't block parsing")
+   {
+      boost::shared_ptr<RLookups> pRLookups(new RLookups());
+      pRLookups->cancel();
+      
+      ParseOptions options = s_parseOptions;
+      options.setRLookups(pRLookups);
+      
+      ParseResults results;
+      boost::thread worker(boost::bind(parseInto, code, options, &results));
+      expect_true(worker.timed_join(boost::posix_time::seconds(10)));
+      expect_true(results.parseTree() != NULL);
+   }
+   
+   test_that("failing lookups release their worker and aren't cached")
+   {
+      boost::shared_ptr<RLookups> pRLookups(new RLookups());
+      
+      int result = -1;
+      expect_true(lookupOnWorkerThread(pRLookups, failingLookup, &result));
+      expect_true(result == 0);
+      
+      expect_true(lookupOnWorkerThread(pRLookups, succeedingLookup, &result));
+      expect_true(result == 42);
+   }
+}
+
+// run with the [.benchmark] tag to measure lint latency on a large file
+TEST_CASE("Diagnostics latency", "[.benchmark]")
+{
+   // ~5000 lines: 250 functions of 20 lines each
+   std::string code;
+   for (int i = 0; i < 250; i++)
+   {
+      std::string name = "fn" + safe_convert::numberToString(i);
+      code += name + " <- function(data, n = 10, ...) {\n";
+      for (int j = 0; j < 6; j++)
+      {
+         std::string var = "value" + safe_convert::numberToString(j);
+         code += "   " + var + " <- data[[" + safe_convert::numberToString(j) + "]] * n\n";
+         code += "   if (is.na(" + var + ")) " + var + " <- mean(data, na.rm = TRUE)\n";
+         code += "   result <- list(" + var + " = " + var + ", total = sum(data))\n";
+      }
+      code += "   result\n}\n";
+   }
+
+   const int iterations = 10;
+   boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      ParseResults results = parse(code, s_parseOptions);
+      CHECK_FALSE(results.lint().hasErrors());
+   }
+   boost::posix_time::time_duration elapsed =
+         boost::posix_time::microsec_clock::universal_time() - start;
+
+   WARN("Linted 5000 lines in "
+        << elapsed.total_milliseconds() / iterations << "ms");
+   
+   // re-lint after indenting a line within one of the functions
+   std::wstring wideCode = string_utils::utf8ToWide(code);
+   ParseResults previous = parse(FilePath(), wideCode, s_parseOptions);
+   start = boost::posix_time::microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      wideCode.insert(wideCode.find(L'\n', wideCode.size() / 2) + 1, L" ");
+      ParseResults results = parse(FilePath(), wideCode, s_parseOptions, &previous);
+      CHECK_FALSE(results.lint().hasErrors());
+   }
+   elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+   
+   WARN("Re-linted 5000 lines after an edit in "
+        << elapsed.total_milliseconds() / iterations << "ms");
+}
+
 } // namespace linter
 } // namespace modules
 } // namespace session
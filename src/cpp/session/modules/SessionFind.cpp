@@ -14,19 +14,29 @@
  */
 
 #include "SessionFind.hpp"
+#include "SessionFindIndex.hpp"
 
 #include <algorithm>
+#include <cctype>
+#include <limits>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/foreach.hpp>
 
 #include <core/Exec.hpp>
+#include <core/FileSerializer.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
 #include <core/system/Environment.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/ShellUtils.hpp>
+#include <core/system/System.hpp>
+#include <core/text/TextSearch.hpp>
 
+#include <r/RRoutines.hpp>
+#include <r/RSexp.hpp>
 #include <r/RUtil.hpp>
 
 #include <session/SessionModuleContext.hpp>
@@ -193,20 +203,74 @@ FindInFilesState& findResults()
    return *s_pFindResults;
 }
 
-class GrepOperation : public boost::enable_shared_from_this<GrepOperation>
+// paths which are never searched
+bool isSearchablePath(const FilePath& filePath,
+                      const std::string& websiteOutputDir)
+{
+   std::string filename = filePath.filename();
+   if (filename == ".Rproj.user" || filename == ".git" || filename == ".svn")
+      return false;
+
+   if (boost::algorithm::starts_with(filename, ".Rhistory"))
+      return false;
+
+   if ((filename == "lib" || filename == "src") &&
+       filePath.parent().filename() == "packrat")
+      return false;
+
+   if (!websiteOutputDir.empty() && filename == websiteOutputDir)
+      return false;
+
+   return true;
+}
+
+bool isSearchableCandidate(const FilePath& filePath,
+                           const std::string& websiteOutputDir,
+                           const text::SearchPathFilter& candidateFilter)
+{
+   return isSearchablePath(filePath, websiteOutputDir) &&
+          candidateFilter(filePath);
+}
+
+// optionally narrowed by a filter from the project's trigram index
+text::SearchPathFilter searchPathFilter(
+         const text::SearchPathFilter& candidateFilter = text::SearchPathFilter())
+{
+   if (!candidateFilter)
+      return boost::bind(isSearchablePath, _1, module_context::websiteOutputDir());
+
+   return boost::bind(isSearchableCandidate,
+                      _1,
+                      module_context::websiteOutputDir(),
+                      candidateFilter);
+}
+
+std::vector<std::string> filePatternsAsGlobs(const json::Array& filePatterns)
+{
+   std::vector<std::string> globs;
+   BOOST_FOREACH(const json::Value& filePattern, filePatterns)
+   {
+      if (json::isType<std::string>(filePattern))
+         globs.push_back(filePattern.get_str());
+   }
+   return globs;
+}
+
+class FindOperation : public boost::enable_shared_from_this<FindOperation>
 {
 public:
-   static boost::shared_ptr<GrepOperation> create(const std::string& encoding,
-                                                  const FilePath& tempFile)
+   static boost::shared_ptr<FindOperation> create(
+                        const std::string& encoding,
+                        const boost::shared_ptr<text::ParallelSearch>& pSearch)
    {
-      return boost::shared_ptr<GrepOperation>(new GrepOperation(encoding,
-                                                                tempFile));
+      return boost::shared_ptr<FindOperation>(new FindOperation(encoding,
+                                                                pSearch));
    }
 
 private:
-   GrepOperation(const std::string& encoding,
-                 const FilePath& tempFile)
-      : firstDecodeError_(true), encoding_(encoding), tempFile_(tempFile)
+   FindOperation(const std::string& encoding,
+                 const boost::shared_ptr<text::ParallelSearch>& pSearch)
+      : firstDecodeError_(true), encoding_(encoding), pSearch_(pSearch)
    {
       handle_ = core::system::generateUuid(false);
    }
@@ -217,30 +281,21 @@ public:
       return handle_;
    }
 
-   core::system::ProcessCallbacks createProcessCallbacks()
+   void start()
    {
-      core::system::ProcessCallbacks callbacks;
-      callbacks.onContinue = boost::bind(&GrepOperation::onContinue,
-                                         shared_from_this(),
-                                         _1);
-      callbacks.onStdout = boost::bind(&GrepOperation::onStdout,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onStderr = boost::bind(&GrepOperation::onStderr,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onExit = boost::bind(&GrepOperation::onExit,
-                                     shared_from_this(),
-                                     _1);
-      return callbacks;
+      pSearch_->start(&module_context::workerThreadPool());
+
+      // results are collected on the main thread (and not only when idle,
+      // so that they stream in while R is busy as well). they are polled
+      // for rather than collected as incremental work, which would keep
+      // the main thread spinning while it waits on the workers
+      module_context::schedulePeriodicWork(
+               boost::posix_time::milliseconds(20),
+               boost::bind(&FindOperation::processResults, shared_from_this()),
+               false);
    }
 
 private:
-   bool onContinue(const core::system::ProcessOperations& ops) const
-   {
-      return findResults().isRunning() && findResults().handle() == handle();
-   }
-
    std::string decode(const std::string& encoded)
    {
       if (encoded.empty())
@@ -250,7 +305,7 @@ private:
       Error error = r::util::iconvstr(encoded, encoding_, "UTF-8", true,
                                       &decoded);
 
-      // Log error, but only once per grep operation
+      // Log error, but only once per find operation
       if (error && firstDecodeError_)
       {
          firstDecodeError_ = false;
@@ -260,46 +315,62 @@ private:
       return decoded;
    }
 
-   void processContents(std::string* pContent,
+   // decode and append a segment of a line, returning the number of
+   // UTF-8 characters it contained
+   std::size_t appendDecoded(const std::string& encoded,
+                             std::string* pDecodedLine)
+   {
+      std::string decoded = decode(encoded);
+      pDecodedLine->append(decoded);
+
+      std::size_t charSize;
+      Error error = string_utils::utf8Distance(decoded.begin(),
+                                               decoded.end(),
+                                               &charSize);
+      if (error)
+         charSize = decoded.size();
+      return charSize;
+   }
+
+   void processContents(const text::LineMatch& lineMatch,
+                        std::string* pContent,
                         json::Array* pMatchOn,
                         json::Array* pMatchOff)
    {
-      // initialize some state
+      // trim the line, keeping track of how much was removed from the
+      // front so that match offsets can be adjusted accordingly
+      const std::string& line = lineMatch.contents;
+      std::size_t lineBegin = 0, lineEnd = line.size();
+      while (lineBegin < lineEnd && std::isspace(static_cast<unsigned char>(line[lineBegin])))
+         lineBegin++;
+      while (lineEnd > lineBegin && std::isspace(static_cast<unsigned char>(line[lineEnd - 1])))
+         lineEnd--;
+
       std::string decodedLine;
       std::size_t nUtf8CharactersProcessed = 0;
-      
-      const char* inputPos = pContent->c_str();
-      const char* end = inputPos + pContent->size();
-      
-      boost::cmatch match;
-      while (regex_utils::search(inputPos, match, boost::regex("\x1B\\[(\\d\\d)?m(\x1B\\[K)?")))
+      std::size_t pos = lineBegin;
+
+      typedef std::pair<std::size_t, std::size_t> Range;
+      BOOST_FOREACH(const Range& range, lineMatch.matches)
       {
-         // decode the current match, and append it
-         std::string matchedString(inputPos, inputPos + match.position());
-         std::string decoded = decode(matchedString);
-         
-         // append and update
-         decodedLine.append(decoded);
-         inputPos += match.position() + match.length();
-         
-         // count the number of UTF-8 characters processed
-         std::size_t charSize;
-         Error error = string_utils::utf8Distance(decoded.begin(),
-                                                  decoded.end(),
-                                                  &charSize);
-         if (error)
-            charSize = decoded.size();
-         nUtf8CharactersProcessed += charSize;
-
-         // update the match state
-         if (match[1] == "01")
-            pMatchOn->push_back(static_cast<int>(nUtf8CharactersProcessed));
-         else
-            pMatchOff->push_back(static_cast<int>(nUtf8CharactersProcessed));
+         std::size_t matchBegin = std::min(std::max(range.first, lineBegin), lineEnd);
+         std::size_t matchEnd = std::min(std::max(range.second, matchBegin), lineEnd);
+         if (matchBegin == matchEnd)
+            continue;
+
+         nUtf8CharactersProcessed += appendDecoded(
+                  line.substr(pos, matchBegin - pos), &decodedLine);
+         pMatchOn->push_back(static_cast<int>(nUtf8CharactersProcessed));
+
+         nUtf8CharactersProcessed += appendDecoded(
+                  line.substr(matchBegin, matchEnd - matchBegin), &decodedLine);
+         pMatchOff->push_back(static_cast<int>(nUtf8CharactersProcessed));
+
+         pos = matchEnd;
       }
-      
-      if (inputPos != end)
-         decodedLine.append(decode(std::string(inputPos, end)));
+
+      if (pos < lineEnd)
+         decodedLine.append(decode(line.substr(pos, lineEnd - pos)));
 
       if (decodedLine.size() > 300)
       {
@@ -310,8 +381,19 @@ private:
       *pContent = decodedLine;
    }
 
-   void onStdout(const core::system::ProcessOperations& ops, const std::string& data)
+   bool processResults()
    {
+      // stop if the find was cancelled (or superseded by another find)
+      if (!findResults().isRunning() || findResults().handle() != handle())
+      {
+         pSearch_->cancel();
+         onCompleted();
+         return false;
+      }
+
+      std::vector<boost::shared_ptr<text::FileMatches> > fileMatches;
+      bool complete = pSearch_->collect(&fileMatches);
+
       json::Array files;
       json::Array lineNums;
       json::Array contents;
@@ -322,50 +404,26 @@ private:
       if (recordsToProcess < 0)
          recordsToProcess = 0;
 
-      std::string websiteOutputDir = module_context::websiteOutputDir();
-      if (!websiteOutputDir.empty())
-         websiteOutputDir = "/" + websiteOutputDir + "/";
-
-      stdOutBuf_.append(data);
-      size_t nextLineStart = 0;
-      size_t pos = -1;
-      while (recordsToProcess &&
-             std::string::npos != (pos = stdOutBuf_.find('\n', pos + 1)))
+      BOOST_FOREACH(const boost::shared_ptr<text::FileMatches>& pMatches,
+                    fileMatches)
       {
-         std::string line = stdOutBuf_.substr(nextLineStart, pos - nextLineStart);
-         nextLineStart = pos + 1;
+         if (!recordsToProcess)
+            break;
+
+         std::string file = module_context::createAliasedPath(
+                                                      pMatches->filePath);
 
-         boost::smatch match;
-         if (regex_utils::match(line, match, boost::regex("^((?:[a-zA-Z]:)?[^:]+):(\\d+):(.*)")))
+         BOOST_FOREACH(const text::LineMatch& lineMatch, pMatches->matches)
          {
-            std::string file = module_context::createAliasedPath(
-                  FilePath(string_utils::systemToUtf8(match[1])));
-
-            if (file.find("/.Rproj.user/") != std::string::npos)
-               continue;
-            if (file.find("/.git/") != std::string::npos)
-               continue;
-            if (file.find("/.svn/") != std::string::npos)
-               continue;
-            if (file.find("/packrat/lib/") != std::string::npos)
-               continue;
-            if (file.find("/packrat/src/") != std::string::npos)
-               continue;
-            if (file.find("/.Rhistory") != std::string::npos)
-               continue;
-
-            if (!websiteOutputDir.empty() &&
-                file.find(websiteOutputDir) != std::string::npos)
-               continue;
-
-            int lineNum = safe_convert::stringTo<int>(std::string(match[2]), -1);
-            std::string lineContents = match[3];
-            boost::algorithm::trim(lineContents);
+            if (!recordsToProcess)
+               break;
+
+            std::string lineContents;
             json::Array matchOn, matchOff;
-            processContents(&lineContents, &matchOn, &matchOff);
+            processContents(lineMatch, &lineContents, &matchOn, &matchOff);
 
             files.push_back(file);
-            lineNums.push_back(lineNum);
+            lineNums.push_back(lineMatch.lineNumber);
             contents.push_back(lineContents);
             matchOns.push_back(matchOn);
             matchOffs.push_back(matchOff);
@@ -374,11 +432,6 @@ private:
          }
       }
 
-      if (nextLineStart)
-      {
-         stdOutBuf_.erase(0, nextLineStart);
-      }
-
       if (files.size() > 0)
       {
          json::Object result;
@@ -402,31 +455,80 @@ private:
                   ClientEvent(client_events::kFindResult, result));
       }
 
-      if (recordsToProcess <= 0)
-         findResults().onFindEnd(handle());
-   }
+      if (recordsToProcess <= 0 || complete)
+      {
+         pSearch_->cancel();
+         onCompleted();
+         return false;
+      }
 
-   void onStderr(const core::system::ProcessOperations& ops, const std::string& data)
-   {
-      LOG_ERROR_MESSAGE("grep: " + data);
+      return true;
    }
 
-   void onExit(int exitCode)
+   void onCompleted()
    {
       findResults().onFindEnd(handle());
       module_context::enqueClientEvent(
             ClientEvent(client_events::kFindOperationEnded, handle()));
-      if (!tempFile_.empty())
-         tempFile_.removeIfExists();
    }
 
    bool firstDecodeError_;
    std::string encoding_;
-   FilePath tempFile_;
-   std::string stdOutBuf_;
+   boost::shared_ptr<text::ParallelSearch> pSearch_;
    std::string handle_;
 };
 
+std::string findEncoding()
+{
+   return projects::projectContext().hasProject() ?
+                          projects::projectContext().defaultEncoding() :
+                          userSettings().defaultEncoding();
+}
+
+// files are searched in their on-disk encoding so the search string
+// must be converted from UTF-8 to match
+std::string encodeSearchString(const std::string& searchString,
+                               const std::string& encoding)
+{
+   std::string encodedString;
+   Error error = r::util::iconvstr(searchString,
+                                   "UTF-8",
+                                   encoding,
+                                   false,
+                                   &encodedString);
+   if (error)
+   {
+      LOG_ERROR(error);
+      encodedString = searchString;
+   }
+   return encodedString;
+}
+
+// run a search synchronously, returning the number of matching lines
+int runSearchToCompletion(boost::shared_ptr<text::ParallelSearch> pSearch)
+{
+   pSearch->start(&module_context::workerThreadPool());
+
+   int matchCount = 0;
+   while (true)
+   {
+      std::vector<boost::shared_ptr<text::FileMatches> > fileMatches;
+      bool complete = pSearch->collect(&fileMatches);
+      BOOST_FOREACH(const boost::shared_ptr<text::FileMatches>& pMatches,
+                    fileMatches)
+      {
+         matchCount += static_cast<int>(pMatches->matches.size());
+      }
+
+      if (complete)
+         break;
+
+      pSearch->waitForResults(boost::posix_time::milliseconds(50));
+   }
+
+   return matchCount;
+}
+
 } // namespace
 
 core::Error beginFind(const json::JsonRpcRequest& request,
@@ -446,97 +548,186 @@ core::Error beginFind(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   core::system::ProcessOptions options;
+   std::string encoding = findEncoding();
+   text::TextMatcher matcher(encodeSearchString(searchString, encoding),
+                             asRegex,
+                             ignoreCase);
 
-   core::system::Options childEnv;
-   core::system::environment(&childEnv);
-   core::system::setenv(&childEnv, "GREP_COLOR", "01");
-   core::system::setenv(&childEnv, "GREP_COLORS", "ne:fn=:ln=:se=:mt=01");
+   FilePath dirPath = module_context::resolveAliasedPath(directory);
+
+   // within a project, only read the files which can contain the literal
+   boost::shared_ptr<text::ParallelSearch> pSearch =
+         text::ParallelSearch::create(dirPath,
+                                      filePatternsAsGlobs(filePatterns),
+                                      searchPathFilter(index::candidateFilter(
+                                                   dirPath, matcher.literal())),
+                                      matcher,
+                                      MAX_COUNT + 1);
+
+   boost::shared_ptr<FindOperation> ptrFindOp = FindOperation::create(encoding,
+                                                                      pSearch);
+
+   // Clear existing results
+   findResults().clear();
+
+   findResults().onFindBegin(ptrFindOp->handle(),
+                             searchString,
+                             directory,
+                             asRegex);
+
+   ptrFindOp->start();
+
+   pResponse->setResult(ptrFindOp->handle());
+
+   return Success();
+}
+
+// compare the in-process search engine with the grep subprocess it replaced:
+// .Call("rs_benchmarkFindInFiles", "pattern", "~/project", FALSE, FALSE)
+SEXP rs_benchmarkFindInFiles(SEXP searchStringSEXP,
+                             SEXP directorySEXP,
+                             SEXP asRegexSEXP,
+                             SEXP ignoreCaseSEXP)
+{
+   using namespace boost::posix_time;
+
+   std::string searchString = r::sexp::safeAsString(searchStringSEXP);
+   FilePath dirPath = module_context::resolveAliasedPath(
+                                       r::sexp::safeAsString(directorySEXP));
+   bool asRegex = r::sexp::asLogical(asRegexSEXP);
+   bool ignoreCase = r::sexp::asLogical(ignoreCaseSEXP);
+
+   std::string encodedString = encodeSearchString(searchString, findEncoding());
+
+   // in-process search (without a limit on the number of matches)
+   ptime nativeStart = microsec_clock::universal_time();
+   boost::shared_ptr<text::ParallelSearch> pSearch =
+         text::ParallelSearch::create(
+            dirPath,
+            std::vector<std::string>(),
+            searchPathFilter(),
+            text::TextMatcher(encodedString, asRegex, ignoreCase),
+            std::numeric_limits<std::size_t>::max());
+   int nativeMatches = runSearchToCompletion(pSearch);
+   double nativeMs = (microsec_clock::universal_time() - nativeStart)
+                        .total_microseconds() / 1000.0;
+
+   // grep subprocess, invoked as beginFind used to
+   FilePath patternFile = module_context::tempFile("rs_grep", "txt");
+   Error error = core::writeStringToFile(patternFile, encodedString + "\n");
+   if (error)
+      LOG_ERROR(error);
+
+   core::system::ProcessOptions options;
 #ifdef _WIN32
    FilePath gnuGrepPath = session::options().gnugrepPath();
+   core::system::Options childEnv;
+   core::system::environment(&childEnv);
    core::system::addToPath(
             &childEnv,
             string_utils::utf8ToSystem(gnuGrepPath.absolutePath()));
-#endif
    options.environment = childEnv;
-
-   // Put the grep pattern in a file
-   FilePath tempFile = module_context::tempFile("rs_grep", "txt");
-   boost::shared_ptr<std::ostream> pStream;
-   error = tempFile.open_w(&pStream);
-   if (error)
-      return error;
-   std::string encoding = projects::projectContext().hasProject() ?
-                          projects::projectContext().defaultEncoding() :
-                          userSettings().defaultEncoding();
-   std::string encodedString;
-   error = r::util::iconvstr(searchString,
-                             "UTF-8",
-                             encoding,
-                             false,
-                             &encodedString);
-   if (error)
-   {
-      LOG_ERROR(error);
-      encodedString = searchString;
-   }
-
-   *pStream << encodedString << std::endl;
-   pStream.reset(); // release file handle
-
-   boost::shared_ptr<GrepOperation> ptrGrepOp = GrepOperation::create(encoding,
-                                                                      tempFile);
-   core::system::ProcessCallbacks callbacks =
-                                       ptrGrepOp->createProcessCallbacks();
-
-#ifdef _WIN32
    shell_utils::ShellCommand cmd(gnuGrepPath.complete("grep"));
 #else
    shell_utils::ShellCommand cmd("grep");
 #endif
-   cmd << "-rHn" << "--binary-files=without-match" << "--color=always";
+   cmd << "-rHn" << "--binary-files=without-match";
 #ifndef _WIN32
    cmd << "--devices=skip";
 #endif
-
    if (ignoreCase)
       cmd << "-i";
-
-   // Use -f to pass pattern via file, so we don't have to worry about
-   // escaping double quotes, etc.
-   cmd << "-f";
-   cmd << tempFile;
+   cmd << "-f" << patternFile;
    if (!asRegex)
       cmd << "-F";
-
-   BOOST_FOREACH(json::Value filePattern, filePatterns)
-   {
-      cmd << "--include=" + filePattern.get_str();
-   }
-
    cmd << shell_utils::EscapeFilesOnly << "--" << shell_utils::EscapeAll;
-   
-   // Filepaths received from the client will be UTF-8 encoded;
-   // convert to system encoding here.
-   FilePath dirPath = module_context::resolveAliasedPath(directory);
    cmd << string_utils::utf8ToSystem(dirPath.absolutePath());
 
-   // Clear existing results
-   findResults().clear();
-
-   error = module_context::processSupervisor().runCommand(cmd,
-                                                          options,
-                                                          callbacks);
+   ptime grepStart = microsec_clock::universal_time();
+   core::system::ProcessResult result;
+   error = core::system::runCommand(cmd, options, &result);
    if (error)
-      return error;
-
-   findResults().onFindBegin(ptrGrepOp->handle(),
-                             searchString,
-                             directory,
-                             asRegex);
-   pResponse->setResult(ptrGrepOp->handle());
+      LOG_ERROR(error);
+   double grepMs = (microsec_clock::universal_time() - grepStart)
+                        .total_microseconds() / 1000.0;
+   patternFile.removeIfExists();
+
+   int grepMatches = static_cast<int>(
+            std::count(result.stdOut.begin(), result.stdOut.end(), '\n'));
+
+   r::sexp::Protect protect;
+   r::sexp::ListBuilder builder(&protect);
+   builder.add("native.ms", nativeMs);
+   builder.add("native.matches", nativeMatches);
+   builder.add("native.files", static_cast<int>(pSearch->filesSearched()));
+   builder.add("native.threads", static_cast<int>(module_context::workerThreadPool().threadCount()));
+   builder.add("grep.ms", grepMs);
+   builder.add("grep.matches", grepMatches);
+   return r::sexp::create(builder, &protect);
+}
 
-   return Success();
+// measure the effect of the project trigram index on a search:
+// .Call("rs_benchmarkFindIndex", "pattern", "~/project", FALSE, FALSE)
+SEXP rs_benchmarkFindIndex(SEXP searchStringSEXP,
+                           SEXP directorySEXP,
+                           SEXP asRegexSEXP,
+                           SEXP ignoreCaseSEXP)
+{
+   using namespace boost::posix_time;
+
+   std::string searchString = r::sexp::safeAsString(searchStringSEXP);
+   FilePath dirPath = module_context::resolveAliasedPath(
+                                       r::sexp::safeAsString(directorySEXP));
+   text::TextMatcher matcher(encodeSearchString(searchString, findEncoding()),
+                             r::sexp::asLogical(asRegexSEXP),
+                             r::sexp::asLogical(ignoreCaseSEXP));
+
+   ptime queryStart = microsec_clock::universal_time();
+   text::SearchPathFilter candidateFilter =
+                        index::candidateFilter(dirPath, matcher.literal());
+   double queryMs = (microsec_clock::universal_time() - queryStart)
+                        .total_microseconds() / 1000.0;
+
+   ptime indexedStart = microsec_clock::universal_time();
+   boost::shared_ptr<text::ParallelSearch> pIndexedSearch =
+         text::ParallelSearch::create(dirPath,
+                                      std::vector<std::string>(),
+                                      searchPathFilter(candidateFilter),
+                                      matcher,
+                                      std::numeric_limits<std::size_t>::max());
+   int indexedMatches = runSearchToCompletion(pIndexedSearch);
+   double indexedMs = (microsec_clock::universal_time() - indexedStart)
+                        .total_microseconds() / 1000.0;
+
+   ptime fullStart = microsec_clock::universal_time();
+   boost::shared_ptr<text::ParallelSearch> pFullSearch =
+         text::ParallelSearch::create(dirPath,
+                                      std::vector<std::string>(),
+                                      searchPathFilter(),
+                                      matcher,
+                                      std::numeric_limits<std::size_t>::max());
+   int fullMatches = runSearchToCompletion(pFullSearch);
+   double fullMs = (microsec_clock::universal_time() - fullStart)
+                        .total_microseconds() / 1000.0;
+
+   index::IndexStatistics stats = index::statistics();
+
+   r::sexp::Protect protect;
+   r::sexp::ListBuilder builder(&protect);
+   builder.add("index.ready", stats.ready);
+   builder.add("index.used", !candidateFilter.empty());
+   builder.add("index.files", static_cast<int>(stats.files));
+   builder.add("index.trigrams", static_cast<int>(stats.trigrams));
+   builder.add("index.postings", static_cast<double>(stats.postings));
+   builder.add("index.bytes", static_cast<double>(stats.bytesOnDisk));
+   builder.add("query.ms", queryMs);
+   builder.add("indexed.ms", indexedMs);
+   builder.add("indexed.files", static_cast<int>(pIndexedSearch->filesSearched()));
+   builder.add("indexed.matches", indexedMatches);
+   builder.add("full.ms", fullMs);
+   builder.add("full.files", static_cast<int>(pFullSearch->filesSearched()));
+   builder.add("full.matches", fullMatches);
+   return r::sexp::create(builder, &protect);
 }
 
 core::Error stopFind(const json::JsonRpcRequest& request,
@@ -597,9 +788,13 @@ core::Error initialize()
    // register suspend handler
    addSuspendHandler(SuspendHandler(bind(onSuspend, _2), onResume));
 
+   RS_REGISTER_CALL_METHOD(rs_benchmarkFindInFiles, 4);
+   RS_REGISTER_CALL_METHOD(rs_benchmarkFindIndex, 4);
+
    // install handlers
    ExecBlock initBlock ;
    initBlock.addFunctions()
+      (index::initialize)
       (bind(registerRpcMethod, "begin_find", beginFind))
       (bind(registerRpcMethod, "stop_find", stopFind))
       (bind(registerRpcMethod, "clear_find_results", clearFindResults));
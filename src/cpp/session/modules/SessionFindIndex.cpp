@@ -0,0 +1,385 @@
+/*
+ * SessionFindIndex.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionFindIndex.hpp"
+
+#include <atomic>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileInfo.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+#include <core/system/FileChangeEvent.hpp>
+#include <core/text/TrigramIndex.hpp>
+
+#include <session/SessionModuleContext.hpp>
+#include <session/projects/SessionProjects.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace find {
+namespace index {
+
+namespace {
+
+// persist changes at most this often (and at shutdown)
+const boost::posix_time::time_duration kSaveInterval =
+                                       boost::posix_time::seconds(60);
+
+// state shared between the main thread and the indexing thread
+boost::mutex s_mutex;
+text::TrigramIndex s_index;
+bool s_ready = false;
+bool s_dirty = false;
+FilePath s_rootPath;
+boost::posix_time::ptime s_lastSave;
+
+// incremented whenever monitoring stops so that queued indexing work for
+// a previous project is discarded
+std::atomic<int> s_generation(0);
+
+// all indexing happens on a single background thread, so changes are
+// applied in the order the file monitor reported them
+core::thread::ThreadPool& indexThreadPool()
+{
+   static core::thread::ThreadPool* s_pPool = NULL;
+   if (s_pPool == NULL)
+      s_pPool = new core::thread::ThreadPool(1);
+   return *s_pPool;
+}
+
+FilePath indexFilePath()
+{
+   return projects::projectContext().scratchPath().complete("find-index");
+}
+
+std::string indexPath(const FilePath& rootPath, const std::string& absolutePath)
+{
+   return FilePath(absolutePath).relativePath(rootPath);
+}
+
+void indexFile(text::TrigramIndex* pIndex,
+               const std::string& path,
+               const FileInfo& fileInfo)
+{
+   std::vector<boost::uint32_t> trigrams;
+   bool isBinary = false, isIndexed = true;
+   Error error = text::TrigramIndex::readTrigrams(
+                                       FilePath(fileInfo.absolutePath()),
+                                       &trigrams,
+                                       &isBinary,
+                                       &isIndexed);
+   if (error)
+   {
+      // the file was likely removed from under us (a change event will
+      // follow); don't index it so it is always searched
+      pIndex->remove(path);
+      return;
+   }
+
+   pIndex->update(path,
+                  fileInfo.size(),
+                  fileInfo.lastWriteTime(),
+                  trigrams,
+                  isBinary,
+                  isIndexed);
+}
+
+// called with s_mutex held
+void saveIndex()
+{
+   if (s_index.needsCompaction())
+      s_index.compact();
+
+   Error error = s_index.writeToFile(indexFilePath());
+   if (error)
+      LOG_ERROR(error);
+
+   s_dirty = false;
+   s_lastSave = boost::posix_time::microsec_clock::universal_time();
+}
+
+void loadIndex(int generation,
+               const FilePath& rootPath,
+               const std::vector<FileInfo>& files)
+{
+   // read the index persisted by a previous session
+   text::TrigramIndex index;
+   FilePath savedPath = indexFilePath();
+   if (savedPath.exists())
+   {
+      Error error = index.readFromFile(savedPath);
+      if (error)
+      {
+         LOG_ERROR(error);
+         index.clear();
+      }
+   }
+
+   // drop files which no longer exist
+   std::set<std::string> currentPaths;
+   BOOST_FOREACH(const FileInfo& fileInfo, files)
+   {
+      currentPaths.insert(indexPath(rootPath, fileInfo.absolutePath()));
+   }
+   BOOST_FOREACH(const std::string& path, index.paths())
+   {
+      if (currentPaths.find(path) == currentPaths.end())
+         index.remove(path);
+   }
+
+   // (re)index files which have changed since the index was saved
+   BOOST_FOREACH(const FileInfo& fileInfo, files)
+   {
+      if (generation != s_generation)
+         return;
+
+      std::string path = indexPath(rootPath, fileInfo.absolutePath());
+      if (!index.isCurrent(path, fileInfo.size(), fileInfo.lastWriteTime()))
+         indexFile(&index, path, fileInfo);
+   }
+   index.compact();
+
+   LOCK_MUTEX(s_mutex)
+   {
+      if (generation != s_generation)
+         return;
+
+      s_index.swap(index);
+      s_rootPath = rootPath;
+      s_ready = true;
+      saveIndex();
+   }
+   END_LOCK_MUTEX
+}
+
+void updateIndex(int generation,
+                 const std::vector<core::system::FileChangeEvent>& events)
+{
+   using namespace core::system;
+
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      if (generation != s_generation)
+         return;
+
+      const FileInfo& fileInfo = event.fileInfo();
+      if (fileInfo.isDirectory())
+         continue;
+
+      // read the file (which may be slow) before taking the lock
+      std::vector<boost::uint32_t> trigrams;
+      bool isBinary = false, isIndexed = true, isValid = false;
+      if (event.type() != FileChangeEvent::FileRemoved)
+      {
+         Error error = text::TrigramIndex::readTrigrams(
+                                             FilePath(fileInfo.absolutePath()),
+                                             &trigrams,
+                                             &isBinary,
+                                             &isIndexed);
+         isValid = !error;
+      }
+
+      LOCK_MUTEX(s_mutex)
+      {
+         if (!s_ready || generation != s_generation)
+            return;
+
+         std::string path = indexPath(s_rootPath, fileInfo.absolutePath());
+         if (event.type() == FileChangeEvent::FileRemoved || !isValid)
+         {
+            s_index.remove(path);
+         }
+         else
+         {
+            s_index.update(path,
+                           fileInfo.size(),
+                           fileInfo.lastWriteTime(),
+                           trigrams,
+                           isBinary,
+                           isIndexed);
+         }
+         s_dirty = true;
+      }
+      END_LOCK_MUTEX
+   }
+
+   LOCK_MUTEX(s_mutex)
+   {
+      using namespace boost::posix_time;
+      if (s_dirty && generation == s_generation &&
+          microsec_clock::universal_time() - s_lastSave > kSaveInterval)
+      {
+         saveIndex();
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void onMonitoringEnabled(const tree<FileInfo>& files)
+{
+   std::vector<FileInfo> fileInfos;
+   for (tree<FileInfo>::leaf_iterator it = files.begin_leaf();
+        it != files.end_leaf();
+        ++it)
+   {
+      if (!it->isDirectory())
+         fileInfos.push_back(*it);
+   }
+
+   indexThreadPool().enque(boost::bind(loadIndex,
+                                       static_cast<int>(s_generation),
+                                       projects::projectContext().directory(),
+                                       fileInfos));
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   indexThreadPool().enque(boost::bind(updateIndex,
+                                       static_cast<int>(s_generation),
+                                       events));
+}
+
+void onMonitoringDisabled()
+{
+   s_generation++;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      s_index.clear();
+      s_ready = false;
+      s_dirty = false;
+   }
+   END_LOCK_MUTEX
+}
+
+void onShutdown(bool terminatedNormally)
+{
+   // wait for any in-progress indexing then persist what we have
+   s_generation++;
+   indexThreadPool().stop();
+
+   LOCK_MUTEX(s_mutex)
+   {
+      if (s_ready && s_dirty)
+         saveIndex();
+   }
+   END_LOCK_MUTEX
+}
+
+bool isCandidate(const FilePath& filePath,
+                 const FilePath& rootPath,
+                 boost::shared_ptr<std::set<std::string> > pCandidates)
+{
+   if (filePath.isDirectory())
+      return true;
+
+   std::string path = filePath.relativePath(rootPath);
+   if (path.empty() || pCandidates->count(path))
+      return true;
+
+   // the file can only be skipped if the index is current for it
+   LOCK_MUTEX(s_mutex)
+   {
+      return !s_ready ||
+             !s_index.isCurrent(path, filePath.size(), filePath.lastWriteTime());
+   }
+   END_LOCK_MUTEX
+
+   return true;
+}
+
+} // anonymous namespace
+
+text::SearchPathFilter candidateFilter(const FilePath& searchPath,
+                                       const std::string& literal)
+{
+   boost::shared_ptr<std::set<std::string> > pCandidates =
+                              boost::make_shared<std::set<std::string> >();
+   FilePath rootPath;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      if (!s_ready || s_rootPath.empty())
+         return text::SearchPathFilter();
+
+      if (searchPath != s_rootPath && !searchPath.isWithin(s_rootPath))
+         return text::SearchPathFilter();
+
+      std::vector<std::string> paths;
+      if (!s_index.candidates(literal, &paths))
+         return text::SearchPathFilter();
+
+      pCandidates->insert(paths.begin(), paths.end());
+      rootPath = s_rootPath;
+   }
+   END_LOCK_MUTEX
+
+   if (rootPath.empty())
+      return text::SearchPathFilter();
+
+   return boost::bind(isCandidate, _1, rootPath, pCandidates);
+}
+
+IndexStatistics statistics()
+{
+   IndexStatistics stats;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      stats.ready = s_ready;
+      stats.files = s_index.fileCount();
+      stats.trigrams = s_index.trigramCount();
+      stats.postings = s_index.postingCount();
+      if (s_ready && !s_dirty)
+      {
+         FilePath indexPath = indexFilePath();
+         if (indexPath.exists())
+            stats.bytesOnDisk = indexPath.size();
+      }
+   }
+   END_LOCK_MUTEX
+
+   return stats;
+}
+
+Error initialize()
+{
+   // (note that if there is no project this will no-op)
+   session::projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onMonitoringEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onMonitoringDisabled;
+   projects::projectContext().subscribeToFileMonitor("Find in files indexing",
+                                                     cb);
+
+   module_context::events().onShutdown.connect(onShutdown);
+
+   return Success();
+}
+
+} // namespace index
+} // namespace find
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,71 @@
+/*
+ * SessionFindIndex.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_FIND_INDEX_HPP
+#define SESSION_FIND_INDEX_HPP
+
+#include <string>
+
+#include <core/text/TextSearch.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+   class FilePath;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace find {
+namespace index {
+
+// trigram index of the files within the current project, kept up to date
+// by the project file monitor (and persisted in the project scratch path)
+
+// returns a filter which skips project files that cannot contain the passed
+// literal. returns an empty filter (i.e. search everything) if the index
+// is not yet ready, searchPath is not within the project, or the literal
+// is too short to be looked up. files which the index doesn't know about
+// (or which have changed since they were indexed) always pass the filter
+core::text::SearchPathFilter candidateFilter(const core::FilePath& searchPath,
+                                             const std::string& literal);
+
+struct IndexStatistics
+{
+   IndexStatistics()
+      : ready(false), files(0), trigrams(0), postings(0), bytesOnDisk(0)
+   {
+   }
+
+   bool ready;
+   std::size_t files;
+   std::size_t trigrams;
+   std::size_t postings;
+   uintmax_t bytesOnDisk;
+};
+
+IndexStatistics statistics();
+
+core::Error initialize();
+
+} // namespace index
+} // namespace find
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_FIND_INDEX_HPP
@@ -0,0 +1,171 @@
+/*
+ * SessionPackageSymbolCache.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionPackageSymbolCache.hpp"
+
+#include <boost/scoped_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+#include <r/RExec.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+using namespace rstudio::core;
+using namespace rstudio::core::r_util;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace package_symbols {
+
+namespace {
+
+// library paths, as of the last change notification (resolving them
+// requires a trip through R, and they change rarely)
+std::vector<FilePath> s_libPaths;
+bool s_libPathsInitialized = false;
+
+PackageSymbolCache& symbolCache()
+{
+   static boost::scoped_ptr<PackageSymbolCache> s_pCache;
+   if (!s_pCache)
+   {
+      s_pCache.reset(new PackageSymbolCache(
+         module_context::userScratchPath().complete("package-symbols")));
+   }
+   return *s_pCache;
+}
+
+const std::vector<FilePath>& libPaths()
+{
+   if (!s_libPathsInitialized)
+   {
+      s_libPaths = module_context::getLibPaths();
+      s_libPathsInitialized = true;
+   }
+   return s_libPaths;
+}
+
+bool installedPackage(const std::string& name, InstalledPackage* pPackage)
+{
+   if (name.empty())
+      return false;
+
+   Error error = findInstalledPackage(name, libPaths(), pPackage);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return !pPackage->empty();
+}
+
+// was the package's namespace loaded from the installed package? (it
+// isn't when loaded from sources, e.g. by devtools::load_all, or when the
+// package was upgraded after it was loaded)
+bool isLoadedFromInstalled(const InstalledPackage& installed)
+{
+   std::vector<std::string> library;
+   Error error = r::exec::RFunction(".rs.loadedNamespaceLibrary",
+                                    installed.name).call(&library);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return library.size() == 2 &&
+          FilePath(library[0]).isEquivalentTo(
+                                 FilePath(installed.libraryPath)) &&
+          library[1] == installed.version;
+}
+
+void onLibPathsChanged(const std::vector<std::string>& libPaths)
+{
+   s_libPaths.clear();
+   for (std::vector<std::string>::const_iterator it = libPaths.begin();
+        it != libPaths.end();
+        ++it)
+   {
+      s_libPaths.push_back(module_context::resolveAliasedPath(*it));
+   }
+   s_libPathsInitialized = true;
+}
+
+} // anonymous namespace
+
+bool getSymbols(const std::string& package,
+                PackageSymbolKind kind,
+                std::vector<std::string>* pSymbols)
+{
+   InstalledPackage installed;
+   if (!installedPackage(package, &installed))
+      return false;
+
+   return symbolCache().getSymbols(installed, kind, pSymbols);
+}
+
+void putSymbols(const std::string& package,
+                PackageSymbolKind kind,
+                const std::vector<std::string>& symbols)
+{
+   // the symbols are read from the loaded package, so they're only those of
+   // the installed package if that's what was loaded
+   InstalledPackage installed;
+   if (!installedPackage(package, &installed) ||
+       !isLoadedFromInstalled(installed))
+   {
+      return;
+   }
+
+   Error error = symbolCache().putSymbols(installed, kind, symbols);
+   if (error)
+      LOG_ERROR(error);
+}
+
+bool getPackageInformation(const std::string& package,
+                           PackageInformation* pInfo)
+{
+   InstalledPackage installed;
+   if (!installedPackage(package, &installed))
+      return false;
+
+   return symbolCache().getPackageInformation(installed, pInfo);
+}
+
+void putPackageInformation(const PackageInformation& info)
+{
+   InstalledPackage installed;
+   if (!installedPackage(info.package, &installed))
+      return;
+
+   Error error = symbolCache().putPackageInformation(installed, info);
+   if (error)
+      LOG_ERROR(error);
+}
+
+Error initialize()
+{
+   module_context::events().onLibPathsChanged.connect(onLibPathsChanged);
+   return Success();
+}
+
+} // namespace package_symbols
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,61 @@
+/*
+ * SessionPackageSymbolCache.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_PACKAGE_SYMBOL_CACHE_HPP
+#define SESSION_PACKAGE_SYMBOL_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include <core/r_util/RPackageSymbolCache.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace package_symbols {
+
+// symbols and function information for installed packages, persisted in
+// the user scratch path so that they are shared between sessions. packages
+// are resolved against the current library paths on each lookup, so that
+// upgrades and re-installs invalidate their entries
+bool getSymbols(const std::string& package,
+                core::r_util::PackageSymbolKind kind,
+                std::vector<std::string>* pSymbols);
+
+// symbols are read from the loaded package, and only saved if it was
+// loaded from the installed package
+void putSymbols(const std::string& package,
+                core::r_util::PackageSymbolKind kind,
+                const std::vector<std::string>& symbols);
+
+bool getPackageInformation(const std::string& package,
+                           core::r_util::PackageInformation* pInfo);
+
+void putPackageInformation(const core::r_util::PackageInformation& info);
+
+core::Error initialize();
+
+} // namespace package_symbols
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_PACKAGE_SYMBOL_CACHE_HPP
@@ -472,20 +472,31 @@ void setImageFileResponse(const FilePath& imageFilePath,
    }
 }
 
-void setTemporaryFileResponse(const FilePath& filePath, 
-                              const http::Request& request, 
-                              http::Response* pResponse)
-{
-   // no cache (dynamic content)
-   pResponse->setNoCacheHeaders();
-   
-   // return the file
-   pResponse->setFile(filePath, request);
-   
-   // delete the file
-   Error error = filePath.remove();
+// respond with a rendered image from the plot cache; the image is the same
+// for as long as its entity tag is, so the browser need only revalidate it
+void setCachedImageResponse(const std::string& image,
+                            const std::string& eTag,
+                            const http::Request& request,
+                            http::Response* pResponse)
+{
+   pResponse->setHeader("Cache-Control", "private, max-age=0, must-revalidate");
+   pResponse->setHeader("ETag", eTag);
+   pResponse->setContentType("image/png");
+
+   if (request.headerValue("If-None-Match") == eTag)
+   {
+      pResponse->removeHeader("Content-Type");
+      pResponse->setStatusCode(http::status::NotModified);
+      return;
+   }
+
+   Error error = pResponse->setBody(image);
    if (error)
+   {
       LOG_ERROR(error);
+      pResponse->setError(http::status::InternalServerError,
+                          error.code().message());
+   }
 }
 
 void handleZoomRequest(const http::Request& request, http::Response* pResponse)
@@ -564,28 +575,24 @@ void handleZoomPngRequest(const http::Request& request,
    if (!extractSizeParams(request, 100, 5000, &width, &height, pResponse))
      return ;
 
-   // generate the file
-   using namespace rstudio::r::session::graphics;
-   FilePath imagePath = module_context::tempFile("plot", "png");
-   Error saveError = graphics::display().savePlotAsImage(imagePath,
-                                                         kPngFormat,
-                                                         width,
-                                                         height,
-                                                         true);
-   if (saveError)
+   // render the image (or get it from the plot cache)
+   boost::shared_ptr<const std::string> pImage;
+   std::string eTag;
+   Error error = graphics::display().activePlotAsPng(
+                                    width,
+                                    height,
+                                    graphics::device::devicePixelRatio(),
+                                    &pImage,
+                                    &eTag);
+   if (error)
    {
       pResponse->setError(http::status::InternalServerError, 
-                          saveError.code().message());
+                          error.code().message());
       return;
    }
    
    // send it back
-   setImageFileResponse(imagePath, request, pResponse);
-   
-   // delete the temp file
-   Error error = imagePath.remove();
-   if (error)
-      LOG_ERROR(error);
+   setCachedImageResponse(*pImage, eTag, request, pResponse);
 }
 
 void handlePngRequest(const http::Request& request, 
@@ -596,13 +603,15 @@ void handlePngRequest(const http::Request& request,
    if (!extractSizeParams(request, 100, 5000, &width, &height, pResponse))
       return ;
 
-   // generate the image
+   // render the image (or get it from the plot cache)
    using namespace rstudio::r::session;
-   FilePath imagePath = module_context::tempFile("plot", "png");
-   Error error = graphics::display().savePlotAsImage(imagePath,
-                                                      graphics::kPngFormat,
-                                                      width,
-                                                      height);
+   boost::shared_ptr<const std::string> pImage;
+   std::string eTag;
+   Error error = graphics::display().activePlotAsPng(width,
+                                                     height,
+                                                     1.0,
+                                                     &pImage,
+                                                     &eTag);
    if (error)
    {
       pResponse->setError(http::status::InternalServerError,
@@ -615,12 +624,11 @@ void handlePngRequest(const http::Request& request,
    if (attachment)
    {
       pResponse->setHeader("Content-Disposition",
-                           "attachment; filename=rstudio-plot" +
-                           imagePath.extension());
+                           "attachment; filename=rstudio-plot.png");
    }
 
    // return it
-   setTemporaryFileResponse(imagePath, request, pResponse);
+   setCachedImageResponse(*pImage, eTag, request, pResponse);
 }
 
 
@@ -682,6 +690,48 @@ void handleGraphicsRequest(const http::Request& request,
 }
 
    
+bool s_prerenderScheduled = false;
+
+bool prerenderPlot()
+{
+   bool more = r::session::graphics::display().prerenderActivePlot();
+   if (!more)
+      s_prerenderScheduled = false;
+   return more;
+}
+
+// render the new plot ahead of it being zoomed or exported, while idle
+void schedulePrerender()
+{
+   using namespace rstudio::r::session;
+   if (!s_prerenderScheduled && graphics::display().hasPrerenderWork())
+   {
+      s_prerenderScheduled = true;
+      module_context::scheduleIncrementalWork(
+                              boost::posix_time::milliseconds(300),
+                              prerenderPlot);
+   }
+}
+
+bool s_compactionScheduled = false;
+
+void compactPlotHistory()
+{
+   s_compactionScheduled = false;
+   r::session::graphics::display().compactPlotHistory();
+}
+
+// trim the plot history once things have settled down
+void scheduleCompaction()
+{
+   if (!s_compactionScheduled)
+   {
+      s_compactionScheduled = true;
+      module_context::scheduleDelayedWork(boost::posix_time::seconds(30),
+                                          compactPlotHistory);
+   }
+}
+
 void enquePlotsChanged(const r::session::graphics::DisplayState& displayState,
                        bool activatePlots, bool showManipulator)
 {
@@ -701,7 +751,9 @@ void enquePlotsChanged(const r::session::graphics::DisplayState& displayState,
       
    // fire it
    module_context::enqueClientEvent(plotsStateChangedEvent);
-  
+
+   schedulePrerender();
+   scheduleCompaction();
 }
    
 void renderGraphicsOutput(bool activatePlots, bool showManipulator)
@@ -21,6 +21,7 @@
 #define R_INTERNAL_FUNCTIONS
 
 #include <core/Debug.hpp>
+#include <core/Error.hpp>
 #include <core/Macros.hpp>
 #include <core/algorithm/Set.hpp>
 #include <core/algorithm/Map.hpp>
@@ -44,6 +45,7 @@
 
 #include <boost/container/flat_set.hpp>
 #include <boost/bind.hpp>
+#include <boost/optional.hpp>
 
 namespace rstudio {
 namespace session {
@@ -56,6 +58,81 @@ void LintItems::dump()
       std::cerr << lintItems_[i].message << std::endl;
 }
 
+bool RLookups::run(const boost::function<void()>& function)
+{
+   boost::shared_ptr<Request> pRequest(new Request(function));
+   
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (cancelled_)
+         return false;
+      
+      pending_.push_back(pRequest);
+   }
+   
+   if (notify_)
+      notify_();
+   
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!pRequest->done && !cancelled_)
+      done_.wait(lock);
+   
+   return pRequest->done && pRequest->succeeded;
+}
+
+std::size_t RLookups::runPending()
+{
+   std::deque< boost::shared_ptr<Request> > requests;
+   
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      requests.swap(pending_);
+   }
+   
+   if (requests.empty())
+      return 0;
+   
+   BOOST_FOREACH(const boost::shared_ptr<Request>& pRequest, requests)
+   {
+      // a lookup which fails still completes (its worker gets a default
+      // value) so that the worker isn't left waiting on it
+      bool succeeded = false;
+      try
+      {
+         pRequest->function();
+         succeeded = true;
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+      
+      {
+         boost::mutex::scoped_lock lock(mutex_);
+         pRequest->done = true;
+         pRequest->succeeded = succeeded;
+      }
+      
+      done_.notify_all();
+   }
+   
+   return requests.size();
+}
+
+void RLookups::cancel()
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      cancelled_ = true;
+      pending_.clear();
+   }
+   
+   done_.notify_all();
+}
+
+bool RLookups::cancelled()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return cancelled_;
+}
+
 using namespace core;
 using namespace core::r_util;
 using namespace core::r_util::token_utils;
@@ -98,7 +175,53 @@ Error safeEvaluateString(const std::string& string,
    }
 }
 
-bool isDataTableSingleBracketCall(RTokenCursor& cursor)
+// Run a lookup which requires R: directly when parsing on the main thread,
+// otherwise marshalled to the main thread (and cached, by key) through the
+// RLookups object the parse options were supplied with.
+template <typename T>
+T lookupInR(const ParseStatus& status,
+            const std::string& key,
+            const boost::function<T()>& lookup)
+{
+   const boost::shared_ptr<RLookups>& pRLookups =
+         status.parseOptions().rLookups();
+   
+   if (!pRLookups)
+      return lookup();
+   
+   return pRLookups->lookup<T>(key, lookup);
+}
+
+// A key identifying the object a call resolves to (the text of the
+// evaluation forming the call).
+std::string callLookupKey(const RTokenCursor& cursor)
+{
+   std::string key = string_utils::wideToUtf8(
+            cursor.getEvaluationAssociatedWithCall());
+   
+   if (cursor.isAssignmentCall())
+      key += " <-";
+   
+   return key;
+}
+
+bool inheritsDataTable(const std::string& objectString)
+{
+   // avoid output leaking to console
+   r::session::utils::SuppressOutputInScope scope;
+   
+   // Get the object and check if it inherits from data.table
+   SEXP objectSEXP;
+   r::sexp::Protect protect;
+   Error error = safeEvaluateString(objectString, &objectSEXP, &protect);
+   if (error)
+      return false;
+   
+   return r::sexp::inherits(objectSEXP, "data.table");
+}
+
+bool isDataTableSingleBracketCall(RTokenCursor& cursor,
+                                  const ParseStatus& status)
 {
    if (!cursor.contentEquals(L"["))
       return false;
@@ -121,17 +244,9 @@ bool isDataTableSingleBracketCall(RTokenCursor& cursor)
    if (objectString.find('(') != std::string::npos)
       return false;
    
-   // avoid output leaking to console
-   r::session::utils::SuppressOutputInScope scope;
-   
-   // Get the object and check if it inherits from data.table
-   SEXP objectSEXP;
-   r::sexp::Protect protect;
-   Error error = safeEvaluateString(objectString, &objectSEXP, &protect);
-   if (error)
-      return false;
-   
-   return r::sexp::inherits(objectSEXP, "data.table");
+   return lookupInR<bool>(status,
+                          "data.table:" + objectString,
+                          boost::bind(inheritsDataTable, objectString));
 }
 
 class NSEDatabase : boost::noncopyable
@@ -335,6 +450,101 @@ bool maybePerformsNSE(RTokenCursor cursor)
    return false;
 }
 
+bool resolvedFunctionPerformsNse(const RTokenCursor& cursor)
+{
+   bool cacheable = true;
+   r::sexp::Protect protect;
+   SEXP symbolSEXP = resolveFunctionAssociatedWithCall(
+            cursor, &protect, &cacheable);
+   
+   if (symbolSEXP == R_UnboundValue)
+      return false;
+   
+   NSEDatabase& nseDb = nseDatabase();
+   if (cacheable)
+   {
+      if (nseDb.isKnownToPerformNSE(symbolSEXP))
+      {
+         DEBUG("-- Known to perform NSE");
+         return true;
+      }
+      else if (nseDb.isKnownNotToPerformNSE(symbolSEXP))
+      {
+         DEBUG("-- Known not to perform NSE");
+         return false;
+      }
+   }
+   
+   bool result = r::sexp::maybePerformsNSE(symbolSEXP);
+   DEBUG("----- Does '" << cursor << "' perform NSE? " << result);
+   if (cacheable)
+      nseDb.add(symbolSEXP, result);
+   
+   return result;
+}
+
+// The packages a source file is inferred to use.
+std::vector<std::string> inferredPackages(const FilePath& filePath)
+{
+   std::vector<std::string> inferredPkgs;
+   if (filePath.exists())
+   {
+      boost::shared_ptr<RSourceIndex> pIndex =
+            code_search::rSourceIndex().get(filePath);
+      
+      if (pIndex)
+         inferredPkgs = pIndex->getInferredPackages();
+   }
+   return inferredPkgs;
+}
+
+// Look up a function in the project's source index (if 'inProject' and
+// this is a package project) and then in the package information of the
+// packages the file uses. The project and the indexes are maintained on
+// the main thread, so this is run there as an R lookup would be.
+boost::optional<FunctionInformation> indexedFunctionInformation(
+                                                const std::string& fnName,
+                                                bool inProject,
+                                                const FilePath& filePath)
+{
+   if (inProject && projects::projectContext().isPackageProject())
+   {
+      std::string pkgName = projects::projectContext().packageInfo().name();
+      if (RSourceIndex::hasFunctionInformation(fnName, pkgName))
+         return RSourceIndex::getFunctionInformation(fnName, pkgName);
+   }
+   
+   bool lookupFailed = false;
+   FunctionInformation info =
+         RSourceIndex::getFunctionInformationAnywhere(
+            fnName,
+            inferredPackages(filePath),
+            &lookupFailed);
+   
+   if (lookupFailed)
+      return boost::none;
+   
+   return info;
+}
+
+boost::optional<FunctionInformation> lookupIndexedFunctionInformation(
+                                                const std::string& fnName,
+                                                bool inProject,
+                                                const ParseStatus& status)
+{
+   std::string key = "indexed:" + fnName + ":" +
+                     (inProject ? "project:" : "") +
+                     status.filePath().absolutePath();
+   
+   return lookupInR< boost::optional<FunctionInformation> >(
+            status,
+            key,
+            boost::bind(indexedFunctionInformation,
+                        fnName,
+                        inProject,
+                        status.filePath()));
+}
+
 bool mightPerformNonstandardEvaluation(const RTokenCursor& origin,
                                        ParseStatus& status)
 {
@@ -369,46 +579,26 @@ bool mightPerformNonstandardEvaluation(const RTokenCursor& origin,
    // Search the R source index if this is a simple call, and
    // we're within a package project.
    const std::string& symbol = cursor.contentAsUtf8();
-   if (cursor.isSimpleCall() &&
-       projects::projectContext().isPackageProject())
+   if (cursor.isSimpleCall())
    {
-      const PackageInformation& info = RSourceIndex::getPackageInformation(
-               projects::projectContext().packageInfo().name());
+      boost::optional<FunctionInformation> fnInfo =
+            lookupIndexedFunctionInformation(symbol, true, status);
       
-      if (info.functionInfo.count(symbol))
+      if (fnInfo && fnInfo->performsNse())
       {
          DEBUG("--- Found function in source index");
-         const FunctionInformation& fnInfo =
-               const_cast<FunctionInformationMap&>(info.functionInfo)[symbol];
-         
-         if (fnInfo.performsNse())
-            return true;
+         return true;
       }
    }
       
    // Search the whole index.
-   bool failed = false;
-   
-   std::vector<std::string> inferredPkgs;
-   if (status.filePath().exists())
-   {
-      boost::shared_ptr<RSourceIndex> pIndex =
-            code_search::rSourceIndex().get(status.filePath());
-      
-      if (pIndex)
-         inferredPkgs = pIndex->getInferredPackages();
-   }
-   
-   const FunctionInformation& fnInfo =
-         RSourceIndex::getFunctionInformationAnywhere(
-            symbol,
-            inferredPkgs,
-            &failed);
+   boost::optional<FunctionInformation> fnInfo =
+         lookupIndexedFunctionInformation(symbol, false, status);
 
-   if (!failed)
+   if (fnInfo)
    {
-      DEBUG("--- Found function in pkgInfo index: " << *fnInfo.binding());
-      return bool(fnInfo.performsNse());
+      DEBUG("--- Found function in pkgInfo index: " << *fnInfo->binding());
+      return bool(fnInfo->performsNse());
    }
    
    // Handle some special cases first.
@@ -416,35 +606,9 @@ bool mightPerformNonstandardEvaluation(const RTokenCursor& origin,
       return true;
    
    // Drop down into R.
-   bool cacheable = true;
-   r::sexp::Protect protect;
-   SEXP symbolSEXP = resolveFunctionAssociatedWithCall(
-            cursor, &protect, &cacheable);
-   
-   if (symbolSEXP == R_UnboundValue)
-      return false;
-   
-   NSEDatabase& nseDb = nseDatabase();
-   if (cacheable)
-   {
-      if (nseDb.isKnownToPerformNSE(symbolSEXP))
-      {
-         DEBUG("-- Known to perform NSE");
-         return true;
-      }
-      else if (nseDb.isKnownNotToPerformNSE(symbolSEXP))
-      {
-         DEBUG("-- Known not to perform NSE");
-         return false;
-      }
-   }
-   
-   bool result = r::sexp::maybePerformsNSE(symbolSEXP);
-   DEBUG("----- Does '" << cursor << "' perform NSE? " << result);
-   if (cacheable)
-      nseDb.add(symbolSEXP, result);
-   
-   return result;
+   return lookupInR<bool>(status,
+                          "nse:" + callLookupKey(cursor),
+                          boost::bind(resolvedFunctionPerformsNse, cursor));
 }
 
 } // end anonymous namespace
@@ -988,6 +1152,30 @@ bool extractInfoFromFunctionDefinition(
 //
 // This code will attempt to resolve `foo$bar` (which likely requires evaluation),
 // and then, if it's a function will extract the formals associated with that function.
+FunctionInformation resolveFunctionInformation(const RTokenCursor& cursor)
+{
+   r::sexp::Protect protect;
+   SEXP functionSEXP = resolveFunctionAssociatedWithCall(cursor, &protect);
+   if (functionSEXP == R_UnboundValue || !Rf_isFunction(functionSEXP))
+      return FunctionInformation();
+   
+   // Get the formals associated with this function.
+   FunctionInformation info(
+            string_utils::wideToUtf8(cursor.getEvaluationAssociatedWithCall()),
+            r::sexp::environmentName(functionSEXP));
+   
+   Error error = r::sexp::extractFunctionInfo(
+            functionSEXP,
+            &info,
+            true,
+            true);
+   
+   if (error)
+      LOG_ERROR(error);
+   
+   return info;
+}
+
 FunctionInformation getInfoAssociatedWithFunctionAtCursor(
       RTokenCursor cursor,
       ParseStatus& status)
@@ -1048,58 +1236,24 @@ FunctionInformation getInfoAssociatedWithFunctionAtCursor(
          return FunctionInformation();
       
       // If we're within a package project, then attempt searching the
-      // source index for the formals associated with this function.
-      const std::string& fnName = cursor.contentAsUtf8();
-      if (projects::projectContext().isPackageProject())
-      {
-         std::string pkgName = projects::projectContext().packageInfo().name();
-         if (RSourceIndex::hasFunctionInformation(fnName, pkgName))
-                  return RSourceIndex::getFunctionInformation(fnName, pkgName);
-      }
-      
-      // Try looking up the symbol by name.
-      bool lookupFailed = false;
-      std::vector<std::string> inferredPkgs;
-      if (status.filePath().exists())
-      {
-         boost::shared_ptr<RSourceIndex> pIndex =
-               code_search::rSourceIndex().get(status.filePath());
-
-         if (pIndex)
-            inferredPkgs = pIndex->getInferredPackages();
-      }
-      
-      FunctionInformation info =
-            RSourceIndex::getFunctionInformationAnywhere(fnName, inferredPkgs, &lookupFailed);
+      // source index for the formals associated with this function, and
+      // otherwise try looking up the symbol by name.
+      boost::optional<FunctionInformation> info =
+            lookupIndexedFunctionInformation(cursor.contentAsUtf8(),
+                                             true,
+                                             status);
       
-      if (!lookupFailed)
-         return info;
+      if (info)
+         return *info;
       
    }
    
    // If the above failed, we'll fall back to evaluating and looking up
    // the symbol on the search path.
-   r::sexp::Protect protect;
-   SEXP functionSEXP = resolveFunctionAssociatedWithCall(cursor, &protect);
-   if (functionSEXP == R_UnboundValue || !Rf_isFunction(functionSEXP))
-      return FunctionInformation();
-   
-   // Get the formals associated with this function.
-   FunctionInformation info(
-            string_utils::wideToUtf8(cursor.getEvaluationAssociatedWithCall()),
-            r::sexp::environmentName(functionSEXP));
-   
-   Error error = r::sexp::extractFunctionInfo(
-            functionSEXP,
-            &info,
-            true,
-            true);
-   
-   if (error)
-      LOG_ERROR(error);
-   
-   return info;
-   
+   return lookupInR<FunctionInformation>(
+            status,
+            "formals:" + callLookupKey(cursor),
+            boost::bind(resolveFunctionInformation, cursor));
 }
 
 // This class represents a matched call, similar to the result from R's
@@ -1414,6 +1568,220 @@ private:
 
 void doParse(RTokenCursor&, ParseStatus&);
 
+namespace {
+
+// When re-parsing an edited document, we start at least this many tokens
+// before the edit, and stop at least this many tokens after it (as the
+// parser looks around the current token when producing lint).
+const std::size_t kReparseMargin = 16;
+
+// Re-parses leave behind the parse nodes they replace in the arena; once
+// it has grown to this much more than twice its size after a full parse,
+// we parse from scratch.
+const std::size_t kReparseArenaSlack = 64 * 1024;
+
+// Functions are looked up by name and their formals read from the tokens
+// following their definition; we give up comparing formals after this
+// many tokens.
+const std::size_t kMaxSignatureTokens = 256;
+
+void finishParse(const RTokenCursor& cursor, ParseStatus& status)
+{
+   if (status.node()->getParent() != NULL)
+   {
+      DEBUG("** Parent is not null (not at top level): failed to close all scopes?");
+      status.lint().unexpectedEndOfDocument(cursor.currentToken());
+   }
+   
+   status.addLintIfBracketStackNotEmpty();
+}
+
+std::size_t tokenIndexAt(const RTokens& rTokens, const Position& position)
+{
+   std::size_t begin = 0, end = rTokens.size();
+   while (begin < end)
+   {
+      std::size_t middle = begin + (end - begin) / 2;
+      if (rTokens.atUnsafe(middle).position() < position)
+         begin = middle + 1;
+      else
+         end = middle;
+   }
+   return begin;
+}
+
+// The tokens of a function definition which later statements may depend
+// on: those from its name through to the end of its formals, e.g.
+//
+//    foo <- function(x, y = 1) { ... }
+//    ^^^^^^^^^^^^^^^^^^^^^^^^^
+//
+// Returns false if the formals couldn't be found.
+bool functionSignature(const RTokens& rTokens,
+                       const Position& position,
+                       std::wstring* pSignature)
+{
+   std::size_t offset = tokenIndexAt(rTokens, position);
+   std::size_t end = std::min(rTokens.size(), offset + kMaxSignatureTokens);
+   
+   bool seenFunction = false;
+   int depth = 0;
+   for (; offset < end; ++offset)
+   {
+      const RToken& token = rTokens.atUnsafe(offset);
+      if (isWhitespace(token))
+         continue;
+      
+      pSignature->append(token.content());
+      pSignature->push_back(L' ');
+      
+      if (!seenFunction)
+      {
+         seenFunction = token.contentEquals(L"function");
+         continue;
+      }
+      
+      if (token.isType(RToken::LPAREN))
+         ++depth;
+      else if (token.isType(RToken::RPAREN) && --depth <= 0)
+         return true;
+   }
+   
+   return false;
+}
+
+// Keys describing the definitions at the top level of a document which
+// later statements can see (through the parse tree): by name, the
+// variables and the signatures of functions defined.
+typedef std::map<std::string, std::wstring> DefinitionKeys;
+
+template <typename SymbolMap>
+void addVariableKeys(const SymbolMap& symbols,
+                     const Position& begin,
+                     const Position& end,
+                     DefinitionKeys* pKeys)
+{
+   for (typename SymbolMap::const_iterator it = symbols.begin();
+        it != symbols.end();
+        ++it)
+   {
+      BOOST_FOREACH(const Position& position, it->second)
+      {
+         if (begin <= position && position < end)
+         {
+            (*pKeys)[it->first].append(L"<variable>");
+            break;
+         }
+      }
+   }
+}
+
+void addFunctionKey(const ParseNode* pNode,
+                    const RTokens& rTokens,
+                    DefinitionKeys* pKeys)
+{
+   std::wstring signature;
+   if (!functionSignature(rTokens, pNode->position(), &signature))
+   {
+      // we can't tell what this function looks like; make sure the key
+      // won't match any other
+      signature = L"<unknown function> " +
+                  string_utils::utf8ToWide(pNode->position().toString());
+   }
+   
+   (*pKeys)[pNode->name()].append(signature);
+}
+
+// Determine whether the definitions made by the re-parsed region of a
+// document could change how the statements following it are parsed (in
+// which case they need to be re-parsed too).
+bool definitionsChangedForLaterStatements(
+      const ParseNode::DetachedState& detached,
+      const SyncPoint& start,
+      const SyncPoint& previousStop,
+      const Position& previousStopPosition,
+      const RTokens& previousTokens,
+      const ParseNode* pRoot,
+      const Position& startPosition,
+      const RTokens& rTokens,
+      std::size_t stopToken)
+{
+   // definitions made by the region before the edit
+   DefinitionKeys previousKeys;
+   addVariableKeys(detached.definedSymbols,
+                   startPosition,
+                   previousStopPosition,
+                   &previousKeys);
+   
+   std::size_t previousChildCount = previousStop.childCount - start.childCount;
+   for (std::size_t i = 0; i < previousChildCount; ++i)
+      addFunctionKey(detached.children[i], previousTokens, &previousKeys);
+   
+   // definitions made by the region after the edit
+   DefinitionKeys keys;
+   addVariableKeys(pRoot->getDefinedSymbols(),
+                   startPosition,
+                   rTokens.at(stopToken).position(),
+                   &keys);
+   
+   const ParseNode::Children& children = pRoot->getChildren();
+   for (std::size_t i = start.childCount; i < children.size(); ++i)
+      addFunctionKey(children[i], rTokens, &keys);
+   
+   if (keys == previousKeys)
+      return false;
+   
+   // collect the names whose definitions changed
+   std::set<std::wstring> changed;
+   for (DefinitionKeys::const_iterator it = keys.begin(); it != keys.end(); ++it)
+   {
+      DefinitionKeys::const_iterator previous = previousKeys.find(it->first);
+      if (previous == previousKeys.end() || previous->second != it->second)
+         changed.insert(string_utils::utf8ToWide(it->first));
+   }
+   
+   for (DefinitionKeys::const_iterator it = previousKeys.begin(); it != previousKeys.end(); ++it)
+   {
+      if (keys.find(it->first) == keys.end())
+         changed.insert(string_utils::utf8ToWide(it->first));
+   }
+   
+   // check whether any of the later statements reference them
+   for (std::size_t i = stopToken, n = rTokens.size(); i < n; ++i)
+   {
+      const RToken& token = rTokens.atUnsafe(i);
+      if ((token.isType(RToken::ID) || token.isType(RToken::STRING)) &&
+          changed.count(token.content()))
+      {
+         return true;
+      }
+   }
+   
+   return false;
+}
+
+ParseResults parseTokens(const FilePath& filePath,
+                         boost::shared_ptr<RTokens> pTokens,
+                         const ParseOptions& parseOptions)
+{
+   RTokenCursor cursor(*pTokens);
+   ParseStatus status(filePath, parseOptions);
+   
+   doParse(cursor, status);
+   finishParse(cursor, status);
+   
+   return ParseResults(status.arena(),
+                       status.root(),
+                       status.lint(),
+                       filePath,
+                       parseOptions,
+                       pTokens,
+                       status.syncPoints(),
+                       status.arena()->bytesAllocated());
+}
+
+} // anonymous namespace
+
 ParseResults parse(const FilePath& filePath,
                    const std::wstring& rCode,
                    const ParseOptions& parseOptions)
@@ -1421,24 +1789,209 @@ ParseResults parse(const FilePath& filePath,
    if (rCode.empty() || rCode.find_first_not_of(L" \r\n\t\v") == std::string::npos)
       return ParseResults();
    
-   RTokens rTokens(rCode, RTokens::StripComments);
-   if (rTokens.empty())
+   boost::shared_ptr<RTokens> pTokens(
+            new RTokens(rCode, RTokens::StripComments));
+   if (pTokens->empty())
       return ParseResults();
    
-   RTokenCursor cursor(rTokens);
-   ParseStatus status(filePath, parseOptions);
+   return parseTokens(filePath, pTokens, parseOptions);
+}
+
+namespace {
+
+ParseResults reparse(const FilePath& filePath,
+                     const std::wstring& rCode,
+                     const ParseOptions& parseOptions,
+                     ParseResults* pPrevious)
+{
+   if (!pPrevious->tokens() ||
+       pPrevious->parseTree() == NULL ||
+       pPrevious->filePath() != filePath ||
+       pPrevious->parseOptions() != parseOptions ||
+       pPrevious->arena()->bytesAllocated() >
+          2 * pPrevious->fullParseArenaSize() + kReparseArenaSlack)
+   {
+      return parse(filePath, rCode, parseOptions);
+   }
+   
+   if (rCode.empty() || rCode.find_first_not_of(L" \r\n\t\v") == std::string::npos)
+      return ParseResults();
+   
+   boost::shared_ptr<RTokens> pPreviousTokens = pPrevious->tokens();
+   boost::shared_ptr<RTokens> pTokens(
+            new RTokens(rCode, *pPreviousTokens, RTokens::StripComments));
+   if (pTokens->empty())
+      return ParseResults();
+   
+   const RTokens& previousTokens = *pPreviousTokens;
+   const RTokens& rTokens = *pTokens;
+   const std::vector<SyncPoint>& previousSyncPoints = pPrevious->syncPoints();
+   std::ptrdiff_t tokenDelta =
+         static_cast<std::ptrdiff_t>(rTokens.size()) -
+         static_cast<std::ptrdiff_t>(previousTokens.size());
+   
+   // find the statement to start re-parsing from (if there is none, we
+   // re-parse from the start of the document, but re-use the tree)
+   SyncPoint start(0, 0, 0);
+   bool resuming = false;
+   std::size_t startIndex = 0;
+   for (std::size_t i = previousSyncPoints.size(); i > 0; --i)
+   {
+      const SyncPoint& syncPoint = previousSyncPoints[i - 1];
+      if (syncPoint.token + kReparseMargin <= rTokens.damageBegin())
+      {
+         start = syncPoint;
+         startIndex = i - 1;
+         resuming = true;
+         break;
+      }
+   }
+   Position startPosition = resuming ?
+            previousTokens.at(start.token).position() :
+            Position(0, 0);
+   
+   // find the statements at which we can stop re-parsing: those after the
+   // edit, whose tokens (and tokens preceding them) are unchanged
+   std::vector<std::size_t> stopTokens;
+   if (rTokens.damageEnd() < rTokens.size())
+   {
+      BOOST_FOREACH(const SyncPoint& syncPoint, previousSyncPoints)
+      {
+         if (syncPoint.token < rTokens.previousDamageEnd())
+            continue;
+         
+         std::size_t token = syncPoint.token + tokenDelta;
+         if (token >= rTokens.damageEnd() + kReparseMargin)
+            stopTokens.push_back(token);
+      }
+   }
+   
+   // detach the part of the tree built from the statements we re-parse
+   ParseNode* pRoot = pPrevious->parseTree();
+   ParseNode::DetachedState detached;
+   pRoot->detach(start.childCount, startPosition, &detached);
+   
+   LintItems lint(parseOptions);
+   for (std::size_t i = 0; i < start.lintCount; ++i)
+      lint.push_back(pPrevious->lint().get()[i]);
+   
+   RTokenCursor cursor(rTokens, start.token);
+   ParseStatus status(filePath,
+                      parseOptions,
+                      pPrevious->arena(),
+                      pRoot,
+                      lint,
+                      resuming);
+   status.setStopTokens(&stopTokens);
    
    doParse(cursor, status);
    
-   if (status.node()->getParent() != NULL)
+   std::vector<SyncPoint> syncPoints(previousSyncPoints.begin(),
+                                     previousSyncPoints.begin() + startIndex);
+   
+   if (!status.stopped())
    {
-      DEBUG("** Parent is not null (not at top level): failed to close all scopes?");
-      status.lint().unexpectedEndOfDocument(cursor.currentToken());
+      finishParse(cursor, status);
+      syncPoints.insert(syncPoints.end(),
+                        status.syncPoints().begin(),
+                        status.syncPoints().end());
+   }
+   else
+   {
+      std::size_t stopToken = cursor.offset();
+      std::size_t previousStopToken = stopToken - tokenDelta;
+      std::size_t stopIndex = 0;
+      while (previousSyncPoints[stopIndex].token != previousStopToken)
+         ++stopIndex;
+      const SyncPoint& stop = previousSyncPoints[stopIndex];
+      Position previousStopPosition = previousTokens.at(stop.token).position();
+      
+      if (definitionsChangedForLaterStatements(detached,
+                                               start,
+                                               stop,
+                                               previousStopPosition,
+                                               previousTokens,
+                                               pRoot,
+                                               startPosition,
+                                               rTokens,
+                                               stopToken))
+      {
+         DEBUG("** Edit changes definitions used later: re-parsing document");
+         return parseTokens(filePath, pTokens, parseOptions);
+      }
+      
+      // the tokens following the edit have moved by a fixed number of rows,
+      // and on the row where the edit ends, by a fixed number of columns
+      const RToken& previousResync = previousTokens.at(rTokens.previousDamageEnd());
+      const RToken& resync = rTokens.at(rTokens.damageEnd());
+      PositionShift shift(
+               previousResync.row(),
+               static_cast<std::ptrdiff_t>(resync.row()) -
+                  static_cast<std::ptrdiff_t>(previousResync.row()),
+               static_cast<std::ptrdiff_t>(resync.column()) -
+                  static_cast<std::ptrdiff_t>(previousResync.column()));
+      
+      std::ptrdiff_t lintDelta =
+            static_cast<std::ptrdiff_t>(status.lint().size()) -
+            static_cast<std::ptrdiff_t>(stop.lintCount);
+      std::ptrdiff_t childDelta =
+            static_cast<std::ptrdiff_t>(pRoot->getChildren().size()) -
+            static_cast<std::ptrdiff_t>(stop.childCount);
+      
+      // re-use the tree and lint from the statements following the edit
+      pRoot->reattach(detached,
+                      stop.childCount - start.childCount,
+                      previousStopPosition,
+                      shift);
+      
+      const std::vector<LintItem>& previousLint = pPrevious->lint().get();
+      for (std::size_t i = stop.lintCount; i < previousLint.size(); ++i)
+      {
+         LintItem item = previousLint[i];
+         Position begin = shift(Position(item.startRow, item.startColumn));
+         Position end = shift(Position(item.endRow, item.endColumn));
+         item.startRow = begin.row;
+         item.startColumn = begin.column;
+         item.endRow = end.row;
+         item.endColumn = end.column;
+         status.lint().push_back(item);
+      }
+      
+      syncPoints.insert(syncPoints.end(),
+                        status.syncPoints().begin(),
+                        status.syncPoints().end());
+      for (std::size_t i = stopIndex; i < previousSyncPoints.size(); ++i)
+      {
+         const SyncPoint& syncPoint = previousSyncPoints[i];
+         syncPoints.push_back(SyncPoint(syncPoint.token + tokenDelta,
+                                        syncPoint.lintCount + lintDelta,
+                                        syncPoint.childCount + childDelta));
+      }
    }
    
-   status.addLintIfBracketStackNotEmpty();
+   return ParseResults(status.arena(),
+                       pRoot,
+                       status.lint(),
+                       filePath,
+                       parseOptions,
+                       pTokens,
+                       syncPoints,
+                       pPrevious->fullParseArenaSize());
+}
+
+} // anonymous namespace
+
+ParseResults parse(const FilePath& filePath,
+                   const std::wstring& rCode,
+                   const ParseOptions& parseOptions,
+                   ParseResults* pPrevious)
+{
+   if (pPrevious == NULL)
+      return parse(filePath, rCode, parseOptions);
    
-   return ParseResults(status.root(), status.lint(), parseOptions.globals());
+   ParseResults results = reparse(filePath, rCode, parseOptions, pPrevious);
+   *pPrevious = results;
+   return results;
 }
 
 ParseResults parse(const std::string& rCode,
@@ -1575,6 +2128,20 @@ void checkBinaryOperatorWhitespace(RTokenCursor& cursor,
    }
 }
 
+std::set<std::string> getExtraScopedSymbols(const std::string& function,
+                                            const std::string& call)
+{
+   std::set<std::string> symbols;
+   r::exec::RFunction getSymbols(function);
+   getSymbols.addParam(call);
+   
+   Error error = getSymbols.call(&symbols);
+   if (error)
+      LOG_ERROR(error);
+   
+   return symbols;
+}
+
 void addExtraScopedSymbolsForCall(RTokenCursor startCursor,
                                   ParseStatus& status)
 {
@@ -1582,61 +2149,33 @@ void addExtraScopedSymbolsForCall(RTokenCursor startCursor,
       if (!startCursor.moveToPreviousSignificantToken())
          return;
    
+   std::string function;
    if (startCursor.contentEquals(L"setRefClass"))
-   {
-      RTokenCursor endCursor = startCursor.clone();
-      if (!endCursor.moveToNextSignificantToken())
-         return;
-      
-      if (!endCursor.fwdToMatchingToken())
-         return;
-      
-      std::set<std::string> symbols;
-      r::exec::RFunction getSetRefClassCall(".rs.getSetRefClassSymbols");
-      getSetRefClassCall.addParam(
-               string_utils::wideToUtf8(
-                  std::wstring(startCursor.begin(), endCursor.end())));
-      
-      Error error = getSetRefClassCall.call(&symbols);
-      if (error)
-      {
-         LOG_ERROR(error);
-         return;
-      }
-      
-      status.makeSymbolsAvailableInRange(
-               symbols,
-               startCursor.currentPosition(),
-               endCursor.currentPosition());
-   }
+      function = ".rs.getSetRefClassSymbols";
+   else if (startCursor.contentEquals(L"R6Class"))
+      function = ".rs.getR6ClassSymbols";
+   else
+      return;
    
-   if (startCursor.contentEquals(L"R6Class"))
-   {
-      RTokenCursor endCursor = startCursor.clone();
-      if (!endCursor.moveToNextSignificantToken())
-         return;
-      
-      if (!endCursor.fwdToMatchingToken())
-         return;
-      
-      std::set<std::string> symbols;
-      r::exec::RFunction getR6ClassSymbols(".rs.getR6ClassSymbols");
-      getR6ClassSymbols.addParam(
-               string_utils::wideToUtf8(std::wstring(startCursor.begin(), endCursor.end())));
-      
-      Error error = getR6ClassSymbols.call(&symbols);
-      if (error)
-      {
-         LOG_ERROR(error);
-         return;
-      }
-      
-      status.makeSymbolsAvailableInRange(
-               symbols,
-               startCursor.currentPosition(),
-               endCursor.currentPosition());
-   }
+   RTokenCursor endCursor = startCursor.clone();
+   if (!endCursor.moveToNextSignificantToken())
+      return;
+   
+   if (!endCursor.fwdToMatchingToken())
+      return;
+   
+   std::string call = string_utils::wideToUtf8(
+            std::wstring(startCursor.begin(), endCursor.end()));
    
+   std::set<std::string> symbols = lookupInR< std::set<std::string> >(
+            status,
+            function + ":" + call,
+            boost::bind(getExtraScopedSymbols, function, call));
+   
+   status.makeSymbolsAvailableInRange(
+            symbols,
+            startCursor.currentPosition(),
+            endCursor.currentPosition());
 }
 
 void validateFunctionCall(RTokenCursor cursor,
@@ -2001,6 +2540,29 @@ bool handleElseToken(RTokenCursor& cursor,
    return true;
 }
 
+// The names of the object a call resolves to (if it resolves).
+typedef std::pair< bool, std::vector<std::string> > ObjectNames;
+
+ObjectNames getObjectNames(const RTokenCursor& cursor)
+{
+   ObjectNames result(false, std::vector<std::string>());
+   
+   r::sexp::Protect protect;
+   SEXP objectSEXP = resolveObjectAssociatedWithCall(cursor, &protect);
+   if (objectSEXP == R_UnboundValue)
+      return result;
+   
+   r::exec::RFunction getNames(".rs.getNames");
+   getNames.addParam(objectSEXP);
+   
+   Error error = getNames.call(&result.second);
+   if (error)
+      LOG_ERROR(error);
+   
+   result.first = true;
+   return result;
+}
+
 bool makeSymbolsAvailableInCallFromObjectNames(RTokenCursor cursor,
                                                ParseStatus& status)
 {
@@ -2012,24 +2574,47 @@ bool makeSymbolsAvailableInCallFromObjectNames(RTokenCursor cursor,
    if (!endCursor.fwdToMatchingToken())
       return false;
    
-   r::sexp::Protect protect;
-   SEXP objectSEXP = resolveObjectAssociatedWithCall(startCursor, &protect);
-   if (objectSEXP != R_UnboundValue)
+   ObjectNames names = lookupInR<ObjectNames>(
+            status,
+            "names:" + callLookupKey(startCursor),
+            boost::bind(getObjectNames, startCursor));
+   
+   if (!names.first)
+      return false;
+   
+   status.makeSymbolsAvailableInRange(
+            names.second,
+            startCursor.currentPosition(),
+            endCursor.currentPosition(true));
+   
+   return true;
+}
+
+// Is the cursor at the start of a top-level statement, with the parser
+// holding no state other than the parse tree and lint? (If so, the parse
+// of the statement is independent of the statements before it, other than
+// through the definitions they make.)
+bool isStatementStart(const RTokenCursor& cursor, const ParseStatus& status)
+{
+   if (!status.isAtTopLevelWithoutPendingState())
+      return false;
+   
+   if (cursor.contentEquals(L"else"))
+      return false;
+   
+   const RTokens& rTokens = cursor.tokens();
+   std::size_t offset = cursor.offset();
+   while (offset > 0)
    {
-      r::exec::RFunction getNames(".rs.getNames");
-      getNames.addParam(objectSEXP);
-      
-      std::vector<std::string> names;
-      Error error = getNames.call(&names);
-      if (error)
-         LOG_ERROR(error);
+      const RToken& previous = rTokens.atUnsafe(--offset);
+      if (isWhitespaceOrComment(previous))
+         continue;
       
-      status.makeSymbolsAvailableInRange(
-               names,
-               startCursor.currentPosition(),
-               endCursor.currentPosition(true));
+      if (isBinaryOp(previous))
+         return false;
       
-      return true;
+      return previous.isType(RToken::SEMI) ||
+             previous.row() < cursor.currentToken().row();
    }
    
    return false;
@@ -2047,11 +2632,17 @@ bool makeSymbolsAvailableInCallFromObjectNames(RTokenCursor cursor,
 void doParse(RTokenCursor& cursor, ParseStatus& status)
 {
    DEBUG("Beginning parse...");
-   // Return early if the document is empty (only whitespace or comments)
-   if (cursor.isAtEndOfDocument())
-      return;
    
-   cursor.fwdOverWhitespaceAndComments();
+   // When resuming a parse, the cursor is already at the start of a statement
+   if (!status.isResuming())
+   {
+      // Return early if the document is empty (only whitespace or comments)
+      if (cursor.isAtEndOfDocument())
+         return;
+      
+      cursor.fwdOverWhitespaceAndComments();
+   }
+   
    bool startedWithUnaryOperator = false;
    
    goto START;
@@ -2063,6 +2654,14 @@ START:
       
       DEBUG("== Current state: " << status.currentStateAsString());
       
+      // Record the start of top-level statements (and stop here if
+      // we're re-parsing an edited region which ends here).
+      if (isStatementStart(cursor, status) &&
+          status.addSyncPoint(cursor.offset()))
+      {
+         return;
+      }
+      
       checkIncorrectComparison(cursor, status);
       
       // We want to skip over formulas if necessary.
@@ -2468,7 +3067,7 @@ ARGUMENT_LIST:
       }
       
       // Skip over data.table `[` calls
-      if (isDataTableSingleBracketCall(cursor))
+      if (isDataTableSingleBracketCall(cursor, status))
          makeSymbolsAvailableInCallFromObjectNames(cursor, status);
       
       status.pushBracket(cursor);
@@ -24,6 +24,7 @@
 // #define RSTUDIO_DEBUG_LABEL "parser"
 // #define RSTUDIO_ENABLE_DEBUG_MACROS
 
+#include <deque>
 #include <vector>
 #include <map>
 #include <set>
@@ -39,11 +40,17 @@
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
 
+#include <boost/any.hpp>
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/container/flat_set.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include <core/Macros.hpp>
 
@@ -54,6 +61,85 @@ namespace rparser {
 
 using namespace core::collection;
 
+// The parser occasionally consults R (e.g. to discover whether a called
+// function performs non-standard evaluation). R may only be used from the
+// main thread, so a parse running on a worker thread routes those lookups
+// through an RLookups object: the worker queues the lookup and blocks while
+// the main thread runs it (via runPending()). Results are cached by key, so
+// each distinct lookup is evaluated in R at most once per RLookups object.
+class RLookups : boost::noncopyable
+{
+public:
+   
+   // 'notify' is invoked (on the worker thread) whenever a lookup is queued,
+   // so the owner can arrange for runPending() to be called
+   explicit RLookups(const boost::function<void()>& notify =
+                                                   boost::function<void()>())
+      : notify_(notify), cancelled_(false)
+   {}
+   
+   // return the cached value for 'key', or run 'lookup' on the main thread
+   // and cache its result. returns a default-constructed value if the
+   // lookups have been cancelled or the lookup failed
+   template <typename T>
+   T lookup(const std::string& key, const boost::function<T()>& lookup)
+   {
+      {
+         boost::mutex::scoped_lock lock(mutex_);
+         Cache::const_iterator it = cache_.find(key);
+         if (it != cache_.end())
+            return boost::any_cast<T>(it->second);
+      }
+      
+      T result = T();
+      if (!run(boost::bind(&RLookups::assign<T>, lookup, &result)))
+         return T();
+      
+      boost::mutex::scoped_lock lock(mutex_);
+      cache_[key] = result;
+      return result;
+   }
+   
+   // run queued lookups; must be called on the main thread. returns the
+   // number of lookups run
+   std::size_t runPending();
+   
+   // release any blocked workers; subsequent lookups return default values
+   void cancel();
+   
+   bool cancelled();
+   
+private:
+   
+   struct Request
+   {
+      explicit Request(const boost::function<void()>& function)
+         : function(function), done(false), succeeded(false)
+      {}
+      
+      boost::function<void()> function;
+      bool done;
+      bool succeeded;
+   };
+   
+   template <typename T>
+   static void assign(const boost::function<T()>& lookup, T* pResult)
+   {
+      *pResult = lookup();
+   }
+   
+   bool run(const boost::function<void()>& function);
+   
+   typedef std::map<std::string, boost::any> Cache;
+   
+   boost::function<void()> notify_;
+   boost::mutex mutex_;
+   boost::condition_variable done_;
+   std::deque< boost::shared_ptr<Request> > pending_;
+   Cache cache_;
+   bool cancelled_;
+};
+
 class ParseOptions
 {
 public:
@@ -161,6 +247,34 @@ public:
    
    std::set<std::string>& globals() { return globals_; }
    const std::set<std::string>& globals() const { return globals_; }
+   
+   // when set, lookups which require R are marshalled through this object
+   // (required when parsing off the main thread)
+   void setRLookups(const boost::shared_ptr<RLookups>& pRLookups)
+   {
+      pRLookups_ = pRLookups;
+   }
+   
+   const boost::shared_ptr<RLookups>& rLookups() const
+   {
+      return pRLookups_;
+   }
+   
+   bool operator==(const ParseOptions& other) const
+   {
+      return lintRFunctions_ == other.lintRFunctions_ &&
+             checkArgumentsToRFunctionCalls_ == other.checkArgumentsToRFunctionCalls_ &&
+             checkUnexpectedAssignmentInFunctionCall_ == other.checkUnexpectedAssignmentInFunctionCall_ &&
+             warnIfNoSuchVariableInScope_ == other.warnIfNoSuchVariableInScope_ &&
+             warnIfVariableIsDefinedButNotUsed_ == other.warnIfVariableIsDefinedButNotUsed_ &&
+             recordStyleLint_ == other.recordStyleLint_ &&
+             globals_ == other.globals_;
+   }
+   
+   bool operator!=(const ParseOptions& other) const
+   {
+      return !(*this == other);
+   }
 
 private:
    bool lintRFunctions_;
@@ -171,6 +285,7 @@ private:
    bool recordStyleLint_;
    
    std::set<std::string> globals_;
+   boost::shared_ptr<RLookups> pRLookups_;
 };
 
 struct ParseItem;
@@ -483,12 +598,13 @@ public:
    void push_back(const LintItem& item)
    {
       lintItems_.push_back(item);
+      errorCount_ += item.type == LintTypeError;
    }
    
    void push_back(const LintItems& items)
    {
       for (std::size_t i = 0, n = items.size(); i < n; ++i)
-         lintItems_.push_back(items.get()[i]);
+         push_back(items.get()[i]);
    }
    
    typedef std::vector<LintItem>::iterator iterator;
@@ -539,45 +655,250 @@ using namespace linter;
 
 std::string& complement(const std::string& bracket);
 
+// Monotonic arena owning the nodes of a single parse tree, along with the
+// memory used by their symbol tables. Memory is never returned to the arena
+// piecemeal; the whole tree is freed in one step when the arena (held by
+// ParseStatus and then ParseResults) is destroyed.
+class ParseArena : boost::noncopyable
+{
+public:
+   
+   ParseArena()
+      : pos_(NULL), end_(NULL), blockSize_(kInitialBlockSize), bytesAllocated_(0)
+   {
+   }
+   
+   ~ParseArena();
+   
+   void* allocate(std::size_t size, std::size_t alignment)
+   {
+      std::size_t padding = alignmentPadding(pos_, alignment);
+      if (pos_ == NULL || size + padding > static_cast<std::size_t>(end_ - pos_))
+      {
+         addBlock(size + alignment);
+         padding = alignmentPadding(pos_, alignment);
+      }
+      
+      char* pResult = pos_ + padding;
+      pos_ = pResult + size;
+      bytesAllocated_ += size;
+      return pResult;
+   }
+   
+   // number of heap allocations made by the arena
+   std::size_t blockCount() const { return blocks_.size(); }
+   
+   // total size of the allocations made from the arena (including those
+   // since discarded by incremental re-parses)
+   std::size_t bytesAllocated() const { return bytesAllocated_; }
+   
+private:
+   
+   friend class ParseNode;
+   
+   static const std::size_t kInitialBlockSize = 8192;
+   static const std::size_t kMaxBlockSize = 262144;
+   
+   static std::size_t alignmentPadding(const char* pos, std::size_t alignment)
+   {
+      std::size_t remainder = reinterpret_cast<std::size_t>(pos) % alignment;
+      return remainder == 0 ? 0 : alignment - remainder;
+   }
+   
+   void addBlock(std::size_t minimumSize)
+   {
+      std::size_t size = std::max(blockSize_, minimumSize);
+      blocks_.push_back(new char[size]);
+      pos_ = blocks_.back();
+      end_ = pos_ + size;
+      blockSize_ = std::min(blockSize_ * 2, kMaxBlockSize);
+   }
+   
+   std::vector<char*> blocks_;
+   char* pos_;
+   char* end_;
+   std::size_t blockSize_;
+   std::size_t bytesAllocated_;
+   
+   // nodes constructed within the arena (destroyed with it)
+   std::vector<ParseNode*> nodes_;
+};
+
+// Allocator handing out memory from a ParseArena (deallocation is a no-op)
+template <typename T>
+class ParseArenaAllocator
+{
+public:
+   
+   typedef T value_type;
+   typedef T* pointer;
+   typedef const T* const_pointer;
+   typedef T& reference;
+   typedef const T& const_reference;
+   typedef std::size_t size_type;
+   typedef std::ptrdiff_t difference_type;
+   
+   template <typename U>
+   struct rebind
+   {
+      typedef ParseArenaAllocator<U> other;
+   };
+   
+   explicit ParseArenaAllocator(ParseArena* pArena)
+      : pArena_(pArena)
+   {
+   }
+   
+   template <typename U>
+   ParseArenaAllocator(const ParseArenaAllocator<U>& other)
+      : pArena_(other.arena())
+   {
+   }
+   
+   T* allocate(std::size_t n, const void* = NULL)
+   {
+      return static_cast<T*>(pArena_->allocate(n * sizeof(T), alignof(T)));
+   }
+   
+   void deallocate(T*, std::size_t)
+   {
+   }
+   
+   template <typename U, typename... Args>
+   void construct(U* p, Args&&... args)
+   {
+      ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+   }
+   
+   template <typename U>
+   void destroy(U* p)
+   {
+      p->~U();
+   }
+   
+   std::size_t max_size() const
+   {
+      return static_cast<std::size_t>(-1) / sizeof(T);
+   }
+   
+   T* address(T& value) const { return &value; }
+   const T* address(const T& value) const { return &value; }
+   
+   ParseArena* arena() const { return pArena_; }
+   
+   template <typename U>
+   bool operator==(const ParseArenaAllocator<U>& other) const
+   {
+      return pArena_ == other.arena();
+   }
+   
+   template <typename U>
+   bool operator!=(const ParseArenaAllocator<U>& other) const
+   {
+      return pArena_ != other.arena();
+   }
+   
+private:
+   ParseArena* pArena_;
+};
+
+// Maps positions following an edited region of a document to where they
+// are after the edit: rows move by the number of lines the edit inserted (or
+// removed), and columns on the row where the edit ended by the number of
+// characters it inserted on that row.
+class PositionShift
+{
+public:
+   
+   PositionShift(std::size_t row,
+                 std::ptrdiff_t rowDelta,
+                 std::ptrdiff_t columnDelta)
+      : row_(row), rowDelta_(rowDelta), columnDelta_(columnDelta)
+   {
+   }
+   
+   Position operator()(const Position& position) const
+   {
+      return Position(position.row + rowDelta_,
+                      position.column + (position.row == row_ ? columnDelta_ : 0));
+   }
+   
+private:
+   std::size_t row_;
+   std::ptrdiff_t rowDelta_;
+   std::ptrdiff_t columnDelta_;
+};
+
 class ParseNode : public boost::noncopyable
 {
    
 public:
    
-   typedef std::vector< boost::shared_ptr<ParseNode> > Children;
-   typedef std::vector<Position> Positions;
-   typedef std::map<std::string, Positions> SymbolPositions;
+   typedef std::vector<ParseNode*, ParseArenaAllocator<ParseNode*> > Children;
+   
+   // most symbols are defined / referenced only once within a scope
+   typedef boost::container::small_vector<Position, 1> Positions;
+   
+   typedef std::map<
+      std::string,
+      Positions,
+      std::less<std::string>,
+      ParseArenaAllocator< std::pair<const std::string, Positions> >
+   > SymbolPositions;
    
    typedef std::string PackageName;
    typedef std::set<std::string> Symbols;
    typedef std::map<PackageName, Symbols> PackageSymbols;
    
+   // NOTE: This is kind of a hack based on the fact that only
+   // function scopes are parsed as explicit scopes; this is an
+   // alternative mechanism to make symbols available within
+   // given ranges. Ranges are recorded on the root node.
+   typedef std::map<Range, std::set<std::string> > SymbolRanges;
+   
 private:
    
    // private constructor: root node should be created through
    // 'createRootNode()', with future nodes appended to that node;
-   // child nodes with 'createChildNode()'.
+   // child nodes with 'createNode()'. nodes (and their symbol tables)
+   // live within the arena they were created in.
    //
    // 'start' refers to the location of the opening brace opening
    // the node (or, [0, 0] for the root node)
-   ParseNode(ParseNode* pParent,
+   ParseNode(ParseArena* pArena,
+             ParseNode* pParent,
              const std::string& name,
              Position position)
-      : pParent_(pParent), name_(name), position_(position) {}
+      : pParent_(pParent),
+        children_(ParseArenaAllocator<ParseNode*>(pArena)),
+        name_(name),
+        position_(position),
+        definedSymbols_(std::less<std::string>(), SymbolPositions::allocator_type(pArena)),
+        referencedSymbols_(std::less<std::string>(), SymbolPositions::allocator_type(pArena)),
+        nseReferencedSymbols_(std::less<std::string>(), SymbolPositions::allocator_type(pArena))
+   {
+   }
+   
+   static ParseNode* create(ParseArena* pArena,
+                            const std::string& name)
+   {
+      void* pMemory = pArena->allocate(sizeof(ParseNode), alignof(ParseNode));
+      ParseNode* pNode = new (pMemory) ParseNode(pArena, NULL, name, Position(0, 0));
+      pArena->nodes_.push_back(pNode);
+      return pNode;
+   }
    
 public:
    
-   static boost::shared_ptr<ParseNode> createRootNode()
+   static ParseNode* createRootNode(ParseArena* pArena)
    {
-      return boost::shared_ptr<ParseNode>(
-               new ParseNode(NULL, "<root>", Position(0, 0)));
+      return create(pArena, "<root>");
    }
    
-   static boost::shared_ptr<ParseNode> createNode(
-         const std::string& name)
+   static ParseNode* createNode(ParseArena* pArena,
+                                const std::string& name)
    {
-      return boost::shared_ptr<ParseNode>(
-               new ParseNode(NULL, name, Position(0, 0)));
+      return create(pArena, name);
    }
    
    bool isRootNode() const
@@ -673,7 +994,7 @@ public:
       return children_;
    }
    
-   void addChild(boost::shared_ptr<ParseNode>& pChild,
+   void addChild(ParseNode* pChild,
                  const Position& position)
    {
       pChild->pParent_ = this;
@@ -688,9 +1009,9 @@ public:
       pItems->insert(pItems->end(), unresolved.begin(), unresolved.end());
       
       // Apply this over all children on the node
-      Children children = getChildren();
+      const Children& children = getChildren();
       
-      for (Children::iterator it = children.begin();
+      for (Children::const_iterator it = children.begin();
            it != children.end();
            ++it)
       {
@@ -726,10 +1047,10 @@ private:
       for (std::size_t i = 0; i < n; i++)
       {
          std::size_t index = n - i - 1;
-         const boost::shared_ptr<ParseNode>& pChild = pNode->children_[index];
+         const ParseNode* pChild = pNode->children_[index];
          if (pChild->name_ == name && pChild->position_ <= position)
          {
-            if (ppFoundNode) *ppFoundNode = pChild.get();
+            if (ppFoundNode) *ppFoundNode = pChild;
             return true;
          }
       }
@@ -842,8 +1163,9 @@ public:
    bool symbolHasDefinitionInRange(const std::string& symbol,
                                    const Position& position) const
    {
-      for (SymbolRanges::const_iterator it = symbolRanges().begin();
-           it != symbolRanges().end();
+      const SymbolRanges& symbolRanges = getRoot()->symbolRanges_;
+      for (SymbolRanges::const_iterator it = symbolRanges.begin();
+           it != symbolRanges.end();
            ++it)
       {
          if (it->first.contains(position) &&
@@ -886,7 +1208,7 @@ public:
    
    bool isSymbolUsedInChildNode(const std::string& symbolName)
    {
-      BOOST_FOREACH(const boost::shared_ptr<ParseNode>& pChild, children_)
+      BOOST_FOREACH(ParseNode* pChild, children_)
       {
          if (pChild->getReferencedSymbols().count(symbolName))
             return true;
@@ -899,21 +1221,27 @@ public:
    
    bool isSymbolDefinedButNotUsed(const std::string& symbolName,
                                   bool checkChildNodes,
-                                  bool checkNseCalls)
+                                  bool checkNseCalls) const
    {
-      if (!definedSymbols_.count(symbolName))
+      // NOTE: avoid 'operator[]' here; the tree is re-used by incremental
+      // re-parses so checking a symbol must not add empty entries for it
+      const Positions* pDefinitions = findPositions(definedSymbols_, symbolName);
+      if (!pDefinitions)
          return false;
       
-      if (checkChildNodes && isSymbolUsedInChildNode(symbolName))
+      if (checkChildNodes &&
+          const_cast<ParseNode*>(this)->isSymbolUsedInChildNode(symbolName))
          return false;
       
-      std::size_t definitionCount =
-            definedSymbols_[symbolName].size();
+      const Positions* pReferences = findPositions(referencedSymbols_, symbolName);
+      const Positions* pNseReferences = findPositions(nseReferencedSymbols_, symbolName);
+      
+      std::size_t definitionCount = pDefinitions->size();
       
       std::size_t useCount = 0;
-      useCount += referencedSymbols_[symbolName].size();
+      useCount += pReferences ? pReferences->size() : 0;
       if (checkNseCalls)
-         useCount += nseReferencedSymbols_[symbolName].size();
+         useCount += pNseReferences ? pNseReferences->size() : 0;
       
       // NOTE: We record a definition at the same position of 
       // each reference as well, so a symbol is effectively defined
@@ -922,13 +1250,13 @@ public:
       if (definitionCount == 1 &&
           useCount == 1)
       {
-         Position defnPos = definedSymbols_[symbolName][0];
+         Position defnPos = (*pDefinitions)[0];
          Position usePos;
          
-         if (referencedSymbols_[symbolName].size())
-            usePos = referencedSymbols_[symbolName][0];
-         else if (nseReferencedSymbols_[symbolName].size())
-            usePos = nseReferencedSymbols_[symbolName][0];
+         if (pReferences && pReferences->size())
+            usePos = (*pReferences)[0];
+         else if (pNseReferences && pNseReferences->size())
+            usePos = (*pNseReferences)[0];
          
          return defnPos == usePos;
       }
@@ -970,7 +1298,7 @@ public:
          const Position& end)
    {
       core::algorithm::insert(
-            symbolRanges()[Range(begin, end)],
+            getRoot()->symbolRanges_[Range(begin, end)],
             symbols.begin(),
             symbols.end());
    }
@@ -980,6 +1308,162 @@ public:
    const std::string& name() const { return name_; }
    const Position& position() const { return position_; }
    
+   // Incremental re-parsing ----
+   
+   // Symbols removed from a node, by name (in the order they were added)
+   typedef std::map<std::string, std::vector<Position> > DetachedSymbols;
+   
+   // The state of a (root) node following some position, detached from
+   // the node while the statements after that position are re-parsed.
+   struct DetachedState
+   {
+      std::vector<ParseNode*> children;
+      DetachedSymbols definedSymbols;
+      DetachedSymbols referencedSymbols;
+      DetachedSymbols nseReferencedSymbols;
+      SymbolRanges symbolRanges;
+   };
+   
+   // Detach the children from 'childIndex' on, and the symbols (and symbol
+   // ranges) from 'position' on.
+   void detach(std::size_t childIndex,
+               const Position& position,
+               DetachedState* pState)
+   {
+      pState->children.assign(children_.begin() + childIndex, children_.end());
+      children_.erase(children_.begin() + childIndex, children_.end());
+      
+      detachSymbols(&definedSymbols_, position, &pState->definedSymbols);
+      detachSymbols(&referencedSymbols_, position, &pState->referencedSymbols);
+      detachSymbols(&nseReferencedSymbols_, position, &pState->nseReferencedSymbols);
+      
+      SymbolRanges::iterator it = symbolRanges_.begin();
+      while (it != symbolRanges_.end())
+      {
+         if (position <= it->first.begin())
+         {
+            pState->symbolRanges.insert(*it);
+            symbolRanges_.erase(it++);
+         }
+         else
+         {
+            ++it;
+         }
+      }
+   }
+   
+   // Re-attach previously detached state: the children from 'childIndex'
+   // on, and the symbols (and symbol ranges) from 'position' on, moved to
+   // where they are after an edit.
+   void reattach(const DetachedState& state,
+                 std::size_t childIndex,
+                 const Position& position,
+                 const PositionShift& shift)
+   {
+      for (std::size_t i = childIndex; i < state.children.size(); ++i)
+      {
+         ParseNode* pChild = state.children[i];
+         pChild->shiftPositions(shift);
+         children_.push_back(pChild);
+      }
+      
+      reattachSymbols(state.definedSymbols, position, shift, &definedSymbols_);
+      reattachSymbols(state.referencedSymbols, position, shift, &referencedSymbols_);
+      reattachSymbols(state.nseReferencedSymbols, position, shift, &nseReferencedSymbols_);
+      
+      for (SymbolRanges::const_iterator it = state.symbolRanges.begin();
+           it != state.symbolRanges.end();
+           ++it)
+      {
+         if (position <= it->first.begin())
+         {
+            Range range(shift(it->first.begin()), shift(it->first.end()));
+            symbolRanges_[range].insert(it->second.begin(), it->second.end());
+         }
+      }
+   }
+   
+   // Move all positions within this sub-tree to where they are after an edit
+   void shiftPositions(const PositionShift& shift)
+   {
+      position_ = shift(position_);
+      shiftSymbols(&definedSymbols_, shift);
+      shiftSymbols(&referencedSymbols_, shift);
+      shiftSymbols(&nseReferencedSymbols_, shift);
+      
+      BOOST_FOREACH(ParseNode* pChild, children_)
+      {
+         pChild->shiftPositions(shift);
+      }
+   }
+   
+private:
+   
+   static const Positions* findPositions(const SymbolPositions& symbols,
+                                         const std::string& name)
+   {
+      SymbolPositions::const_iterator it = symbols.find(name);
+      return it == symbols.end() ? NULL : &it->second;
+   }
+   
+   static void detachSymbols(SymbolPositions* pSymbols,
+                             const Position& position,
+                             DetachedSymbols* pDetached)
+   {
+      SymbolPositions::iterator it = pSymbols->begin();
+      while (it != pSymbols->end())
+      {
+         Positions& positions = it->second;
+         Positions::iterator detached = std::stable_partition(
+                  positions.begin(),
+                  positions.end(),
+                  boost::bind(std::less<Position>(), _1, position));
+         
+         if (detached != positions.end())
+         {
+            std::vector<Position>& target = (*pDetached)[it->first];
+            target.insert(target.end(), detached, positions.end());
+            positions.erase(detached, positions.end());
+         }
+         
+         if (positions.empty())
+            pSymbols->erase(it++);
+         else
+            ++it;
+      }
+   }
+   
+   static void reattachSymbols(const DetachedSymbols& detached,
+                               const Position& position,
+                               const PositionShift& shift,
+                               SymbolPositions* pSymbols)
+   {
+      for (DetachedSymbols::const_iterator it = detached.begin();
+           it != detached.end();
+           ++it)
+      {
+         BOOST_FOREACH(const Position& detachedPosition, it->second)
+         {
+            if (position <= detachedPosition)
+               (*pSymbols)[it->first].push_back(shift(detachedPosition));
+         }
+      }
+   }
+   
+   static void shiftSymbols(SymbolPositions* pSymbols,
+                            const PositionShift& shift)
+   {
+      for (SymbolPositions::iterator it = pSymbols->begin();
+           it != pSymbols->end();
+           ++it)
+      {
+         BOOST_FOREACH(Position& position, it->second)
+         {
+            position = shift(position);
+         }
+      }
+   }
+   
 private:
    
    // tree reference -- children and parent
@@ -1010,12 +1494,39 @@ private:
    PackageSymbols internalSymbols_; // <pkg>::<foo>
    PackageSymbols exportedSymbols_; // <pgk>:::<bar>
    
-   typedef std::map<Range, std::set<std::string> > SymbolRanges;
-   static SymbolRanges& symbolRanges()
+   // symbols made available within ranges of the document (root node only)
+   SymbolRanges symbolRanges_;
+};
+
+inline ParseArena::~ParseArena()
+{
+   for (std::vector<ParseNode*>::reverse_iterator it = nodes_.rbegin();
+        it != nodes_.rend();
+        ++it)
+   {
+      (*it)->~ParseNode();
+   }
+   
+   BOOST_FOREACH(char* pBlock, blocks_)
    {
-      static SymbolRanges instance;
-      return instance;
+      delete[] pBlock;
    }
+}
+
+// The start of a top-level statement, at which the parser holds no state
+// other than the parse tree and the lint collected so far. These are
+// recorded so that an edited document can be re-parsed from the statement
+// preceding the edit, rather than from the start of the document.
+struct SyncPoint
+{
+   SyncPoint(std::size_t token, std::size_t lintCount, std::size_t childCount)
+      : token(token), lintCount(lintCount), childCount(childCount)
+   {
+   }
+   
+   std::size_t token;      // offset of the statement's first token
+   std::size_t lintCount;  // number of lint items preceding the statement
+   std::size_t childCount; // number of children of the root node preceding it
 };
 
 class ParseStatus
@@ -1024,11 +1535,39 @@ class ParseStatus
 public:
    
    explicit ParseStatus(const FilePath& filePath, const ParseOptions& parseOptions)
-      : pRoot_(ParseNode::createRootNode()),
-        pNode_(pRoot_.get()),
+      : pArena_(new ParseArena()),
+        pRoot_(ParseNode::createRootNode(pArena_.get())),
+        pNode_(pRoot_),
         lint_(parseOptions),
         parseOptions_(parseOptions),
-        filePath_(filePath)
+        filePath_(filePath),
+        resuming_(false),
+        pStopTokens_(NULL),
+        stopIndex_(0),
+        stopped_(false)
+   {
+      parseStateStack_.push(ParseStateTopLevel);
+      functionNames_.push(std::wstring(L""));
+   }
+   
+   // resume parsing at a sync point, given the parse tree and the lint
+   // collected before it
+   ParseStatus(const FilePath& filePath,
+               const ParseOptions& parseOptions,
+               boost::shared_ptr<ParseArena> pArena,
+               ParseNode* pRoot,
+               const LintItems& lint,
+               bool resuming)
+      : pArena_(pArena),
+        pRoot_(pRoot),
+        pNode_(pRoot_),
+        lint_(lint),
+        parseOptions_(parseOptions),
+        filePath_(filePath),
+        resuming_(resuming),
+        pStopTokens_(NULL),
+        stopIndex_(0),
+        stopped_(false)
    {
       parseStateStack_.push(ParseStateTopLevel);
       functionNames_.push(std::wstring(L""));
@@ -1036,13 +1575,14 @@ public:
    
    ParseNode* node() { return pNode_; }
    LintItems& lint() { return lint_; }
-   boost::shared_ptr<ParseNode> root() { return pRoot_; }
+   ParseNode* root() { return pRoot_; }
+   boost::shared_ptr<ParseArena> arena() { return pArena_; }
    
-   void addChildAndSetAsCurrentNode(boost::shared_ptr<ParseNode> pChild,
+   void addChildAndSetAsCurrentNode(ParseNode* pChild,
                                     const Position& position)
    {
       node()->addChild(pChild, position);
-      pNode_ = pChild.get();
+      pNode_ = pChild;
    }
    
    void setParentAsCurrent()
@@ -1121,7 +1661,7 @@ public:
                            const Position& position)
    {
       addChildAndSetAsCurrentNode(
-               ParseNode::createNode(name),
+               ParseNode::createNode(pArena_.get(), name),
                position);
       
       DEBUG("Entering function scope: '" << name << "' at " << position);
@@ -1401,9 +1941,74 @@ public:
    {
       return filePath_;
    }
+   
+   // Sync points ----
+   
+   bool isResuming() const
+   {
+      return resuming_;
+   }
+   
+   // is the parser at top level, with no pending state?
+   bool isAtTopLevelWithoutPendingState() const
+   {
+      return parseStateStack_.size() == 1 &&
+             functionNames_.size() == 1 &&
+             nseCallStack_.empty() &&
+             bracketStack_.empty() &&
+             pNode_ == pRoot_;
+   }
+   
+   // sync points (by token offset, in ascending order) at which to stop
+   // parsing; used when re-parsing an edited region of a document
+   void setStopTokens(const std::vector<std::size_t>* pStopTokens)
+   {
+      pStopTokens_ = pStopTokens;
+      stopIndex_ = 0;
+   }
+   
+   // record a sync point; returns true if parsing should stop there
+   bool addSyncPoint(std::size_t token)
+   {
+      if (!syncPoints_.empty() && syncPoints_.back().token == token)
+         return false;
+      
+      if (pStopTokens_)
+      {
+         while (stopIndex_ < pStopTokens_->size() &&
+                (*pStopTokens_)[stopIndex_] < token)
+         {
+            ++stopIndex_;
+         }
+         
+         if (stopIndex_ < pStopTokens_->size() &&
+             (*pStopTokens_)[stopIndex_] == token)
+         {
+            stopped_ = true;
+            return true;
+         }
+      }
+      
+      syncPoints_.push_back(SyncPoint(token,
+                                      lint_.size(),
+                                      pRoot_->getChildren().size()));
+      return false;
+   }
+   
+   const std::vector<SyncPoint>& syncPoints() const
+   {
+      return syncPoints_;
+   }
+   
+   // did parsing stop at one of the stop tokens?
+   bool stopped() const
+   {
+      return stopped_;
+   }
 
 private:
-   boost::shared_ptr<ParseNode> pRoot_;
+   boost::shared_ptr<ParseArena> pArena_;
+   ParseNode* pRoot_;
    ParseNode* pNode_;
    LintItems lint_;
    ParseOptions parseOptions_;
@@ -1420,14 +2025,13 @@ private:
    // this.
    Stack<RToken> bracketStack_;
    
-   // NOTE: This is kind of a hack based on the fact that only
-   // function scopes are parsed as explicit scopes; this is an
-   // alternative mechanism to make symbols available within
-   // given ranges.
-   typedef std::map< Range, std::set<std::string> > SymbolRanges;
-   SymbolRanges symbolRanges_;
-   
    FilePath filePath_;
+   
+   bool resuming_;
+   std::vector<SyncPoint> syncPoints_;
+   const std::vector<std::size_t>* pStopTokens_;
+   std::size_t stopIndex_;
+   bool stopped_;
 };
 
 class ParseResults {
@@ -1435,27 +2039,56 @@ class ParseResults {
 public:
    
    ParseResults()
-      : parseTree_(ParseNode::createRootNode())
+      : pArena_(new ParseArena()),
+        parseTree_(ParseNode::createRootNode(pArena_.get())),
+        fullParseArenaSize_(0)
    {}
    
-   ParseResults(boost::shared_ptr<ParseNode> parseTree,
+   // the parse tree is owned by (and lives as long as) the arena
+   ParseResults(boost::shared_ptr<ParseArena> pArena,
+                ParseNode* parseTree,
                 const LintItems& lint)
-      : parseTree_(parseTree),
-        lint_(lint)
+      : pArena_(pArena),
+        parseTree_(parseTree),
+        lint_(lint),
+        fullParseArenaSize_(0)
    {}
-   ParseResults(boost::shared_ptr<ParseNode> parseTree,
+   ParseResults(boost::shared_ptr<ParseArena> pArena,
+                ParseNode* parseTree,
                 const LintItems& lint,
                 const std::set<std::string>& globals)
-      : parseTree_(parseTree),
+      : pArena_(pArena),
+        parseTree_(parseTree),
         lint_(lint),
-        globals_(globals)
+        globals_(globals),
+        fullParseArenaSize_(0)
+   {}
+   
+   // results which retain what's needed to re-parse the code incrementally
+   ParseResults(boost::shared_ptr<ParseArena> pArena,
+                ParseNode* parseTree,
+                const LintItems& lint,
+                const FilePath& filePath,
+                const ParseOptions& parseOptions,
+                boost::shared_ptr<core::r_util::RTokens> pTokens,
+                const std::vector<SyncPoint>& syncPoints,
+                std::size_t fullParseArenaSize)
+      : pArena_(pArena),
+        parseTree_(parseTree),
+        lint_(lint),
+        globals_(parseOptions.globals()),
+        filePath_(filePath),
+        parseOptions_(parseOptions),
+        pTokens_(pTokens),
+        syncPoints_(syncPoints),
+        fullParseArenaSize_(fullParseArenaSize)
    {}
    
    // copy ctor: copyable members
    
    ParseNode* parseTree() const
    {
-      return parseTree_.get();
+      return parseTree_;
    }
    
    const LintItems& lint() const { return lint_; }
@@ -1464,11 +2097,32 @@ public:
    const std::set<std::string>& globals() const { return globals_; }
    std::set<std::string>& globals() { return globals_; }
    
+   // Incremental re-parsing ----
+   
+   boost::shared_ptr<ParseArena> arena() const { return pArena_; }
+   const FilePath& filePath() const { return filePath_; }
+   const ParseOptions& parseOptions() const { return parseOptions_; }
+   
+   // the tokens parsed (null if the results can't be re-parsed)
+   boost::shared_ptr<core::r_util::RTokens> tokens() const { return pTokens_; }
+   const std::vector<SyncPoint>& syncPoints() const { return syncPoints_; }
+   
+   // size of the arena after the last full parse (re-parses leave behind
+   // the nodes they replace, so we periodically start afresh)
+   std::size_t fullParseArenaSize() const { return fullParseArenaSize_; }
+   
 private:
    
-   boost::shared_ptr<ParseNode> parseTree_;
+   boost::shared_ptr<ParseArena> pArena_;
+   ParseNode* parseTree_;
    LintItems lint_;
    std::set<std::string> globals_;
+   
+   FilePath filePath_;
+   ParseOptions parseOptions_;
+   boost::shared_ptr<core::r_util::RTokens> pTokens_;
+   std::vector<SyncPoint> syncPoints_;
+   std::size_t fullParseArenaSize_;
 };
 
 // Primary method ----
@@ -1476,6 +2130,19 @@ ParseResults parse(const core::FilePath& filePath,
                    const std::wstring& rCode,
                    const ParseOptions& parseOptions = ParseOptions());
 
+// Re-parse code after an edit, given the results of parsing it before the
+// edit. Only the top-level statements around the edit are re-tokenized and
+// re-parsed; the tokens, parse tree and lint of the others are re-used. The
+// parse tree of the previous results is updated in place, and the previous
+// results replaced by the returned ones. Falls back to a full parse when the
+// previous results can't be re-used, or when the edit may have changed how
+// later statements are parsed (e.g. by changing the formals of a function
+// they call).
+ParseResults parse(const core::FilePath& filePath,
+                   const std::wstring& rCode,
+                   const ParseOptions& parseOptions,
+                   ParseResults* pPrevious);
+
 // Useful aliases ----
 ParseResults parse(const core::FilePath& filePath,
                    const ParseOptions& parseOptions = ParseOptions());
@@ -0,0 +1,494 @@
+/*
+ * DefinitionCache.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DefinitionCache.hpp"
+
+#include <cstring>
+#include <map>
+
+#include <boost/foreach.hpp>
+
+#include <core/BinarySerializer.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/system/System.hpp>
+
+using namespace rstudio::core;
+using namespace rstudio::core::binary;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+namespace {
+
+// on disk format:
+//
+//    header:       magic, version, file count, record count, string count
+//    files:        path, first record, record count, (reserved), last write
+//    records:      USR, kind, parent name, name, file, line, column
+//    string table: offsets (string count + 1), then the strings
+//
+// files and strings are sorted so that they can be binary searched; all
+// strings (including paths) are referenced by index into the string table
+const boost::uint32_t kCacheMagic = 0x52534344; // 'RSCD'
+const boost::uint32_t kCacheVersion = 1;
+
+const std::size_t kHeaderSize = 5 * sizeof(boost::uint32_t);
+const std::size_t kFileRecordSize = 4 * sizeof(boost::uint32_t) + sizeof(boost::int64_t);
+const std::size_t kDefinitionFieldCount = 7;
+const std::size_t kDefinitionRecordSize = kDefinitionFieldCount * sizeof(boost::uint32_t);
+
+enum DefinitionField
+{
+   kUSRField = 0,
+   kKindField = 1,
+   kParentNameField = 2,
+   kNameField = 3,
+   kFileField = 4,
+   kLineField = 5,
+   kColumnField = 6
+};
+
+int compare(const char* begin, const char* end, const std::string& value)
+{
+   std::size_t size = end - begin;
+   int result = std::memcmp(begin, value.data(), std::min(size, value.size()));
+   if (result != 0)
+      return result;
+   else if (size == value.size())
+      return 0;
+   else
+      return size < value.size() ? -1 : 1;
+}
+
+} // anonymous namespace
+
+struct DefinitionCache::FileRecord
+{
+   boost::uint32_t path;
+   boost::uint32_t firstRecord;
+   boost::uint32_t recordCount;
+   std::time_t lastWrite;
+};
+
+DefinitionCache::DefinitionCache()
+{
+   close();
+}
+
+Error DefinitionCache::open(const FilePath& cacheFile)
+{
+   close();
+   if (!cacheFile.exists() || cacheFile.size() < kHeaderSize)
+      return Success();
+
+   try
+   {
+      file_.open(cacheFile.absolutePathNative());
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", cacheFile);
+      return error;
+   }
+
+   // validate the header and the size of each table (the contents of the
+   // tables are validated as they're used)
+   const char* pData = file_.data();
+   boost::uint64_t size = file_.size();
+   boost::uint32_t magic = valueAt<boost::uint32_t>(pData);
+   boost::uint32_t version = valueAt<boost::uint32_t>(pData + 4);
+   boost::uint64_t fileCount = valueAt<boost::uint32_t>(pData + 8);
+   boost::uint64_t recordCount = valueAt<boost::uint32_t>(pData + 12);
+   boost::uint64_t stringCount = valueAt<boost::uint32_t>(pData + 16);
+
+   boost::uint64_t stringsOffset = kHeaderSize +
+                                   fileCount * kFileRecordSize +
+                                   recordCount * kDefinitionRecordSize +
+                                   (stringCount + 1) * sizeof(boost::uint32_t);
+   if (magic != kCacheMagic || version != kCacheVersion || size < stringsOffset)
+   {
+      close();
+      return Success();
+   }
+
+   const char* pStringOffsets = pData + stringsOffset -
+                                (stringCount + 1) * sizeof(boost::uint32_t);
+   boost::uint32_t stringsSize = valueAt<boost::uint32_t>(
+            pStringOffsets + stringCount * sizeof(boost::uint32_t));
+   if (size - stringsOffset != stringsSize)
+   {
+      close();
+      return Success();
+   }
+
+   fileCount_ = static_cast<boost::uint32_t>(fileCount);
+   recordCount_ = static_cast<boost::uint32_t>(recordCount);
+   stringCount_ = static_cast<boost::uint32_t>(stringCount);
+   pFiles_ = pData + kHeaderSize;
+   pRecords_ = pFiles_ + fileCount * kFileRecordSize;
+   pStringOffsets_ = pStringOffsets;
+   pStrings_ = pData + stringsOffset;
+   stringsSize_ = stringsSize;
+   return Success();
+}
+
+void DefinitionCache::close()
+{
+   if (file_.is_open())
+      file_.close();
+
+   fileCount_ = 0;
+   recordCount_ = 0;
+   stringCount_ = 0;
+   pFiles_ = NULL;
+   pRecords_ = NULL;
+   pStringOffsets_ = NULL;
+   pStrings_ = NULL;
+   stringsSize_ = 0;
+}
+
+std::string DefinitionCache::file(std::size_t index) const
+{
+   return string(fileRecord(index).path);
+}
+
+bool DefinitionCache::hasFile(const std::string& file,
+                              std::time_t* pFileLastWrite) const
+{
+   int index = findFile(file);
+   if (index < 0)
+      return false;
+
+   if (pFileLastWrite)
+      *pFileLastWrite = fileRecord(index).lastWrite;
+   return true;
+}
+
+bool DefinitionCache::readDefinitions(const std::string& file,
+                                      CppDefinitions* pDefinitions) const
+{
+   int index = findFile(file);
+   if (index < 0)
+      return false;
+
+   FileRecord record = fileRecord(index);
+   pDefinitions->file = file;
+   pDefinitions->fileLastWrite = record.lastWrite;
+   pDefinitions->definitions.clear();
+   for (std::size_t i = 0; i < record.recordCount; i++)
+   {
+      CppDefinition definition;
+      if (this->definition(record.firstRecord + i, &definition))
+         pDefinitions->definitions.push_back(definition);
+   }
+   return true;
+}
+
+bool DefinitionCache::findUSR(const std::string& USR,
+                              const Predicate& includeFile,
+                              CppDefinition* pDefinition) const
+{
+   // (an unknown USR can't be referenced by any of the records)
+   int id = findString(USR);
+   if (id < 0)
+      return false;
+
+   for (std::size_t i = 0; i < fileCount_; i++)
+   {
+      FileRecord record = fileRecord(i);
+      if (!includeFile(string(record.path)))
+         continue;
+
+      for (std::size_t j = 0; j < record.recordCount; j++)
+      {
+         std::size_t index = record.firstRecord + j;
+         if (recordField(index, kUSRField) == static_cast<boost::uint32_t>(id))
+            return definition(index, pDefinition);
+      }
+   }
+
+   return false;
+}
+
+void DefinitionCache::search(const Predicate& nameMatches,
+                             const Predicate& includeFile,
+                             std::vector<CppDefinition>* pDefinitions) const
+{
+   // names are shared by many definitions (e.g. overloads), so each is
+   // only matched once: -1 = not yet matched, 0 = no match, 1 = match
+   std::vector<boost::int8_t> matched(stringCount_, -1);
+
+   for (std::size_t i = 0; i < fileCount_; i++)
+   {
+      FileRecord record = fileRecord(i);
+      if (!includeFile(string(record.path)))
+         continue;
+
+      for (std::size_t j = 0; j < record.recordCount; j++)
+      {
+         std::size_t index = record.firstRecord + j;
+         boost::uint32_t name = recordField(index, kNameField);
+         if (name >= stringCount_)
+            continue;
+
+         if (matched[name] == -1)
+            matched[name] = nameMatches(string(name)) ? 1 : 0;
+
+         CppDefinition definition;
+         if (matched[name] == 1 && this->definition(index, &definition))
+            pDefinitions->push_back(definition);
+      }
+   }
+}
+
+Error DefinitionCache::write(
+      const FilePath& cacheFile,
+      const std::vector<boost::shared_ptr<const CppDefinitions> >& files)
+{
+   // sort the files, and assign string ids in sorted order
+   std::map<std::string, boost::shared_ptr<const CppDefinitions> > sortedFiles;
+   std::map<std::string, boost::uint32_t> strings;
+   BOOST_FOREACH(const boost::shared_ptr<const CppDefinitions>& pFile, files)
+   {
+      sortedFiles[pFile->file] = pFile;
+      strings[pFile->file] = 0;
+      BOOST_FOREACH(const CppDefinition& definition, pFile->definitions)
+      {
+         strings[definition.USR] = 0;
+         strings[definition.parentName] = 0;
+         strings[definition.name] = 0;
+         strings[definition.location.filePath.absolutePath()] = 0;
+      }
+   }
+
+   boost::uint32_t id = 0;
+   for (std::map<std::string, boost::uint32_t>::iterator it = strings.begin();
+        it != strings.end();
+        ++it)
+   {
+      it->second = id++;
+   }
+
+   FilePath tempPath = cacheFile.parent().complete(
+            cacheFile.filename() + "." + core::system::generateShortenedUuid());
+   {
+      boost::shared_ptr<std::ostream> pStream;
+      Error error = tempPath.open_w(&pStream);
+      if (error)
+         return error;
+      std::ostream& ostr = *pStream;
+
+      boost::uint32_t recordCount = 0;
+      BOOST_FOREACH(const boost::shared_ptr<const CppDefinitions>& pFile, files)
+      {
+         recordCount += static_cast<boost::uint32_t>(pFile->definitions.size());
+      }
+
+      writeValue(ostr, kCacheMagic);
+      writeValue(ostr, kCacheVersion);
+      writeValue(ostr, static_cast<boost::uint32_t>(sortedFiles.size()));
+      writeValue(ostr, recordCount);
+      writeValue(ostr, static_cast<boost::uint32_t>(strings.size()));
+
+      boost::uint32_t firstRecord = 0;
+      for (std::map<std::string, boost::shared_ptr<const CppDefinitions> >::const_iterator
+              it = sortedFiles.begin(); it != sortedFiles.end(); ++it)
+      {
+         boost::uint32_t count =
+               static_cast<boost::uint32_t>(it->second->definitions.size());
+         writeValue(ostr, strings[it->first]);
+         writeValue(ostr, firstRecord);
+         writeValue(ostr, count);
+         writeValue(ostr, static_cast<boost::uint32_t>(0));
+         writeValue(ostr, static_cast<boost::int64_t>(it->second->fileLastWrite));
+         firstRecord += count;
+      }
+
+      for (std::map<std::string, boost::shared_ptr<const CppDefinitions> >::const_iterator
+              it = sortedFiles.begin(); it != sortedFiles.end(); ++it)
+      {
+         BOOST_FOREACH(const CppDefinition& definition, it->second->definitions)
+         {
+            writeValue(ostr, strings[definition.USR]);
+            writeValue(ostr, static_cast<boost::uint32_t>(definition.kind));
+            writeValue(ostr, strings[definition.parentName]);
+            writeValue(ostr, strings[definition.name]);
+            writeValue(ostr, strings[definition.location.filePath.absolutePath()]);
+            writeValue(ostr, static_cast<boost::uint32_t>(definition.location.line));
+            writeValue(ostr, static_cast<boost::uint32_t>(definition.location.column));
+         }
+      }
+
+      boost::uint32_t offset = 0;
+      for (std::map<std::string, boost::uint32_t>::const_iterator it = strings.begin();
+           it != strings.end();
+           ++it)
+      {
+         writeValue(ostr, offset);
+         offset += static_cast<boost::uint32_t>(it->first.size());
+      }
+      writeValue(ostr, offset);
+
+      for (std::map<std::string, boost::uint32_t>::const_iterator it = strings.begin();
+           it != strings.end();
+           ++it)
+      {
+         ostr.write(it->first.data(), it->first.size());
+      }
+
+      ostr.flush();
+      if (!ostr.good())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", tempPath);
+         tempPath.removeIfExists();
+         return error;
+      }
+   }
+
+   // release any mapping of the previous version before replacing it
+   close();
+
+   Error error = tempPath.move(cacheFile);
+   if (error)
+      tempPath.removeIfExists();
+   return error;
+}
+
+DefinitionCache::FileRecord DefinitionCache::fileRecord(std::size_t index) const
+{
+   const char* pRecord = pFiles_ + index * kFileRecordSize;
+
+   FileRecord record;
+   record.path = valueAt<boost::uint32_t>(pRecord);
+   record.firstRecord = valueAt<boost::uint32_t>(pRecord + 4);
+   record.recordCount = valueAt<boost::uint32_t>(pRecord + 8);
+   record.lastWrite = static_cast<std::time_t>(
+                        valueAt<boost::int64_t>(pRecord + 16));
+
+   // (a corrupt section is treated as empty)
+   if (record.firstRecord > recordCount_ ||
+       record.recordCount > recordCount_ - record.firstRecord)
+   {
+      record.recordCount = 0;
+   }
+
+   return record;
+}
+
+int DefinitionCache::findFile(const std::string& file) const
+{
+   int lower = 0, upper = static_cast<int>(fileCount_) - 1;
+   while (lower <= upper)
+   {
+      int middle = lower + (upper - lower) / 2;
+      const char *begin, *end;
+      if (!string(fileRecord(middle).path, &begin, &end))
+         return -1;
+
+      int result = compare(begin, end, file);
+      if (result == 0)
+         return middle;
+      else if (result < 0)
+         lower = middle + 1;
+      else
+         upper = middle - 1;
+   }
+   return -1;
+}
+
+int DefinitionCache::findString(const std::string& value) const
+{
+   int lower = 0, upper = static_cast<int>(stringCount_) - 1;
+   while (lower <= upper)
+   {
+      int middle = lower + (upper - lower) / 2;
+      const char *begin, *end;
+      if (!string(middle, &begin, &end))
+         return -1;
+
+      int result = compare(begin, end, value);
+      if (result == 0)
+         return middle;
+      else if (result < 0)
+         lower = middle + 1;
+      else
+         upper = middle - 1;
+   }
+   return -1;
+}
+
+bool DefinitionCache::string(boost::uint32_t id,
+                             const char** pBegin,
+                             const char** pEnd) const
+{
+   if (id >= stringCount_)
+      return false;
+
+   const char* pOffset = pStringOffsets_ + id * sizeof(boost::uint32_t);
+   boost::uint32_t begin = valueAt<boost::uint32_t>(pOffset);
+   boost::uint32_t end = valueAt<boost::uint32_t>(pOffset + sizeof(boost::uint32_t));
+   if (begin > end || end > stringsSize_)
+      return false;
+
+   *pBegin = pStrings_ + begin;
+   *pEnd = pStrings_ + end;
+   return true;
+}
+
+std::string DefinitionCache::string(boost::uint32_t id) const
+{
+   const char *begin, *end;
+   if (!string(id, &begin, &end))
+      return std::string();
+   return std::string(begin, end);
+}
+
+boost::uint32_t DefinitionCache::recordField(std::size_t index,
+                                             std::size_t field) const
+{
+   return valueAt<boost::uint32_t>(pRecords_ +
+                                     index * kDefinitionRecordSize +
+                                     field * sizeof(boost::uint32_t));
+}
+
+bool DefinitionCache::definition(std::size_t index,
+                                 CppDefinition* pDefinition) const
+{
+   boost::uint32_t kind = recordField(index, kKindField);
+   if (kind > CppTypedefDefinition)
+      return false;
+
+   *pDefinition = CppDefinition(
+            string(recordField(index, kUSRField)),
+            static_cast<CppDefinitionKind>(kind),
+            string(recordField(index, kParentNameField)),
+            string(recordField(index, kNameField)),
+            core::libclang::FileLocation(
+               FilePath(string(recordField(index, kFileField))),
+               recordField(index, kLineField),
+               recordField(index, kColumnField)));
+   return true;
+}
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
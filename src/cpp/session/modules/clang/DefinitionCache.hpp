@@ -0,0 +1,120 @@
+/*
+ * DefinitionCache.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_MODULES_CLANG_DEFINITION_CACHE_HPP
+#define SESSION_MODULES_CLANG_DEFINITION_CACHE_HPP
+
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "DefinitionIndex.hpp"
+
+namespace rstudio {
+namespace core {
+   class Error;
+   class FilePath;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+// the definitions found in a translation unit
+struct CppDefinitions
+{
+   CppDefinitions() : fileLastWrite(0) {}
+
+   std::string file;
+   std::time_t fileLastWrite;
+   std::deque<CppDefinition> definitions;
+};
+
+// definitions persisted between sessions. the cache file holds a sorted
+// table of strings, a sorted table of files and a section of fixed size
+// definition records for each file; it is memory mapped and searched in
+// place, so opening it takes constant time and only the definitions which
+// are actually used are decoded
+class DefinitionCache : boost::noncopyable
+{
+public:
+   DefinitionCache();
+
+   // a missing, corrupt or out of date cache file opens as an empty cache
+   core::Error open(const core::FilePath& cacheFile);
+   void close();
+
+   std::size_t fileCount() const { return fileCount_; }
+   std::string file(std::size_t index) const;
+
+   // is the file cached (and if so, as of when)?
+   bool hasFile(const std::string& file, std::time_t* pFileLastWrite = NULL) const;
+
+   bool readDefinitions(const std::string& file, CppDefinitions* pDefinitions) const;
+
+   typedef boost::function<bool(const std::string&)> Predicate;
+
+   // find a definition by USR (in the files for which includeFile is true)
+   bool findUSR(const std::string& USR,
+                const Predicate& includeFile,
+                CppDefinition* pDefinition) const;
+
+   // find the definitions with matching names (in the files for which
+   // includeFile is true)
+   void search(const Predicate& nameMatches,
+               const Predicate& includeFile,
+               std::vector<CppDefinition>* pDefinitions) const;
+
+   // replace the cache file (closing this cache, which may be mapping it)
+   core::Error write(
+         const core::FilePath& cacheFile,
+         const std::vector<boost::shared_ptr<const CppDefinitions> >& files);
+
+private:
+   struct FileRecord;
+   FileRecord fileRecord(std::size_t index) const;
+   int findFile(const std::string& file) const;
+   int findString(const std::string& value) const;
+   bool string(boost::uint32_t id, const char** pBegin, const char** pEnd) const;
+   std::string string(boost::uint32_t id) const;
+   bool definition(std::size_t index, CppDefinition* pDefinition) const;
+   boost::uint32_t recordField(std::size_t index, std::size_t field) const;
+
+   boost::iostreams::mapped_file_source file_;
+   boost::uint32_t fileCount_;
+   boost::uint32_t recordCount_;
+   boost::uint32_t stringCount_;
+   const char* pFiles_;
+   const char* pRecords_;
+   const char* pStringOffsets_;
+   const char* pStrings_;
+   std::size_t stringsSize_;
+};
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_MODULES_CLANG_DEFINITION_CACHE_HPP
@@ -0,0 +1,163 @@
+/*
+ * DefinitionCacheTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "DefinitionCache.hpp"
+
+#include <boost/bind.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+using namespace rstudio::core;
+
+namespace {
+
+boost::shared_ptr<const CppDefinitions> definitions(const std::string& file,
+                                                    std::time_t lastWrite,
+                                                    const char* names[],
+                                                    std::size_t count)
+{
+   boost::shared_ptr<CppDefinitions> pDefinitions(new CppDefinitions());
+   pDefinitions->file = file;
+   pDefinitions->fileLastWrite = lastWrite;
+   for (std::size_t i = 0; i < count; i++)
+   {
+      pDefinitions->definitions.push_back(CppDefinition(
+         "c:@F@" + std::string(names[i]),
+         CppFunctionDefinition,
+         "",
+         names[i],
+         libclang::FileLocation(FilePath(file), i + 1, 1)));
+   }
+   return pDefinitions;
+}
+
+bool anyFile(const std::string&)
+{
+   return true;
+}
+
+bool isFile(const std::string& expected, const std::string& file)
+{
+   return file == expected;
+}
+
+bool startsWith(const std::string& prefix, const std::string& name)
+{
+   return name.compare(0, prefix.size(), prefix) == 0;
+}
+
+} // anonymous namespace
+
+TEST_CASE("DefinitionCache")
+{
+   FilePath cacheFile;
+   REQUIRE_FALSE(FilePath::tempFilePath(&cacheFile));
+
+   const char* fooNames[] = { "foo_init", "foo_run", "shared" };
+   const char* barNames[] = { "bar_run", "shared" };
+   std::vector<boost::shared_ptr<const CppDefinitions> > files;
+   files.push_back(definitions("/pkg/src/foo.cpp", 1000, fooNames, 3));
+   files.push_back(definitions("/pkg/src/bar.cpp", 2000, barNames, 2));
+
+   SECTION("Definitions round trip through the cache")
+   {
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.write(cacheFile, files));
+      REQUIRE_FALSE(cache.open(cacheFile));
+      REQUIRE(cache.fileCount() == 2);
+      CHECK(cache.file(0) == "/pkg/src/bar.cpp");
+      CHECK(cache.file(1) == "/pkg/src/foo.cpp");
+
+      std::time_t lastWrite = 0;
+      REQUIRE(cache.hasFile("/pkg/src/foo.cpp", &lastWrite));
+      CHECK(lastWrite == 1000);
+      CHECK_FALSE(cache.hasFile("/pkg/src/baz.cpp"));
+
+      CppDefinitions result;
+      REQUIRE(cache.readDefinitions("/pkg/src/foo.cpp", &result));
+      CHECK(result.file == "/pkg/src/foo.cpp");
+      CHECK(result.fileLastWrite == 1000);
+      REQUIRE(result.definitions.size() == 3);
+      CHECK(result.definitions[1].USR == "c:@F@foo_run");
+      CHECK(result.definitions[1].kind == CppFunctionDefinition);
+      CHECK(result.definitions[1].name == "foo_run");
+      CHECK(result.definitions[1].location.filePath.absolutePath() == "/pkg/src/foo.cpp");
+      CHECK(result.definitions[1].location.line == 2);
+      CHECK(result.definitions[1].location.column == 1);
+   }
+
+   SECTION("Definitions are found by USR and name in the included files")
+   {
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.write(cacheFile, files));
+      REQUIRE_FALSE(cache.open(cacheFile));
+
+      CppDefinition definition;
+      REQUIRE(cache.findUSR("c:@F@bar_run", anyFile, &definition));
+      CHECK(definition.name == "bar_run");
+      CHECK_FALSE(cache.findUSR("c:@F@bar_run",
+                                boost::bind(isFile, "/pkg/src/foo.cpp", _1),
+                                &definition));
+      CHECK_FALSE(cache.findUSR("c:@F@baz", anyFile, &definition));
+
+      std::vector<CppDefinition> matches;
+      cache.search(boost::bind(startsWith, "sh", _1), anyFile, &matches);
+      CHECK(matches.size() == 2);
+
+      matches.clear();
+      cache.search(boost::bind(startsWith, "", _1),
+                   boost::bind(isFile, "/pkg/src/bar.cpp", _1),
+                   &matches);
+      REQUIRE(matches.size() == 2);
+      CHECK(matches[0].name == "bar_run");
+   }
+
+   SECTION("Missing, corrupt and old format caches open empty")
+   {
+      DefinitionCache cache;
+      REQUIRE_FALSE(cache.open(cacheFile));
+      CHECK(cache.fileCount() == 0);
+
+      REQUIRE_FALSE(writeStringToFile(cacheFile, "[{\"file\": \"/pkg/src/foo.cpp\"}]"));
+      REQUIRE_FALSE(cache.open(cacheFile));
+      CHECK(cache.fileCount() == 0);
+
+      REQUIRE_FALSE(cache.write(cacheFile, files));
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(cacheFile, &contents));
+      REQUIRE_FALSE(writeStringToFile(cacheFile,
+                                      contents.substr(0, contents.size() - 3)));
+      REQUIRE_FALSE(cache.open(cacheFile));
+      CHECK(cache.fileCount() == 0);
+      CHECK_FALSE(cache.hasFile("/pkg/src/foo.cpp"));
+   }
+
+   cacheFile.removeIfExists();
+}
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
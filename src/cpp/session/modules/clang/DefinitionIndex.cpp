@@ -17,10 +17,13 @@
 
 #include <deque>
 
+#include <boost/thread/thread.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/DateTime.hpp>
 #include <core/PerformanceTimer.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
 #include <core/libclang/LibClang.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <session/IncrementalFileChangeHandler.hpp>
@@ -28,6 +31,8 @@
 #include <session/SessionModuleContext.hpp>
 #include <session/projects/SessionProjects.hpp>
 
+#include "DefinitionCache.hpp"
+#include "DefinitionIndexQueue.hpp"
 #include "RSourceIndex.hpp"
 #include "RCompilationDatabase.hpp"
 
@@ -44,17 +49,43 @@ namespace {
 // flag indicating whether we are initialized
 bool s_initialized = false;
 
-struct CppDefinitions
-{
-   std::string file;
-   std::time_t fileLastWrite;
-   std::deque<CppDefinition> definitions;
-};
+// definitions saved by previous sessions (searched in place)
+DefinitionCache s_definitionCache;
 
-// store definitions by file
-typedef std::map<std::string,CppDefinitions> DefinitionsByFile;
+// store definitions indexed during this session by file; these take
+// precedence over the cache (a null entry indicates that the file's
+// definitions were removed)
 DefinitionsByFile s_definitionsByFile;
 
+bool isOverridden(const std::string& file)
+{
+   return s_definitionsByFile.find(file) != s_definitionsByFile.end();
+}
+
+// translation units are parsed on a dedicated pool of worker threads, each
+// parse with its own CXIndex. the pool is kept small since parses of
+// Rcpp-heavy sources take a good deal of memory
+core::thread::ThreadPool& indexThreadPool()
+{
+   static core::thread::ThreadPool* s_pPool = NULL;
+   if (s_pPool == NULL)
+   {
+      std::size_t threads = boost::thread::hardware_concurrency() / 2;
+      s_pPool = new core::thread::ThreadPool(std::max<std::size_t>(threads, 1));
+   }
+   return *s_pPool;
+}
+
+// indexing requests shared with the workers (heap allocated and never
+// freed so that it outlives any parses still running at exit)
+DefinitionIndexQueue& indexQueue()
+{
+   static DefinitionIndexQueue* s_pQueue = new DefinitionIndexQueue();
+   return *s_pQueue;
+}
+
+bool s_collecting = false;
+
 // visitor used to populate deque
 bool insertDefinition(const CppDefinition& definition,
                       CppDefinitions* pDefinitions)
@@ -171,6 +202,63 @@ CXChildVisitResult cursorVisitor(CXCursor cxCursor,
    }
 }
 
+// (runs on a worker thread)
+void indexTranslationUnit(const std::string& file,
+                          std::time_t fileLastWrite,
+                          const std::vector<std::string>& compileArgs,
+                          int verbose,
+                          boost::uint64_t generation)
+{
+   // skip if the file has changed again since this request was made
+   if (!indexQueue().isCurrent(file, generation))
+      return;
+
+   // create index
+   CXIndex index = libclang::clang().createIndex(
+             1 /* Exclude PCH */,
+             (verbose > 0) ? 1 : 0);
+
+   // get args in form clang expects
+   core::system::ProcessArgs argsArray(compileArgs);
+
+   // parse the translation unit
+   CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
+                         index,
+                         file.c_str(),
+                         argsArray.args(),
+                         argsArray.argCount(),
+                         NULL, 0, // no unsaved files
+                         CXTranslationUnit_None |
+                         CXTranslationUnit_Incomplete);
+
+   // create definitions and wire visitor to it
+   boost::shared_ptr<CppDefinitions> pDefinitions(new CppDefinitions());
+   pDefinitions->file = file;
+   pDefinitions->fileLastWrite = fileLastWrite;
+   DefinitionVisitor visitor =
+      boost::bind(insertDefinition, _1, pDefinitions.get());
+
+   // visit the cursors
+   libclang::clang().visitChildren(
+        libclang::clang().getTranslationUnitCursor(tu),
+        cursorVisitor,
+        (CXClientData)&visitor);
+
+   // dispose translation unit and index
+   libclang::clang().disposeTranslationUnit(tu);
+   libclang::clang().disposeIndex(index);
+
+   indexQueue().indexed(file, generation, pDefinitions);
+}
+
+// swap in the definitions indexed by the workers (on the main thread, so
+// searches always see either a file's previous or its new definitions)
+bool collectIndexedFiles()
+{
+   s_collecting = indexQueue().collect(&s_definitionsByFile);
+   return s_collecting;
+}
+
 void fileChangeHandler(const core::system::FileChangeEvent& event)
 {
    // alias the filename
@@ -182,67 +270,61 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
    // enough index of the file
    if (event.type() == core::system::FileChangeEvent::FileAdded)
    {
-      // if we have a definition
+      // if we have a definition (indexed this session or cached)
+      bool haveDefinitions = false;
+      std::time_t fileLastWrite = 0;
       DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
       if (it != s_definitionsByFile.end())
       {
-         // if the definition is fresh enough then bail
-         if (it->second.fileLastWrite >= event.fileInfo().lastWriteTime())
-            return;
+         haveDefinitions = bool(it->second);
+         if (haveDefinitions)
+            fileLastWrite = it->second->fileLastWrite;
+      }
+      else
+      {
+         haveDefinitions = s_definitionCache.hasFile(file, &fileLastWrite);
       }
-   }
 
-   // always remove existing definitions
-   s_definitionsByFile.erase(file);
+      // if the definition is fresh enough then bail
+      if (haveDefinitions && fileLastWrite >= event.fileInfo().lastWriteTime())
+         return;
+   }
 
-   // if this is an add or an update then re-index
+   // if this is an add or an update then re-index (the existing
+   // definitions remain until the new ones are swapped in)
+   std::vector<std::string> compileArgs;
    if (event.type() == core::system::FileChangeEvent::FileAdded ||
        event.type() == core::system::FileChangeEvent::FileModified)
-   {    
-      // get the compilation arguments for this file and use them to
-      // create a translation unit
-      std::vector<std::string> compileArgs =
+   {
+      // get the compilation arguments for this file
+      compileArgs =
          rCompilationDatabase().compileArgsForTranslationUnit(file, true);
+   }
 
-      if (!compileArgs.empty())
-      {
-         // create index
-         CXIndex index = libclang::clang().createIndex(
-                   1 /* Exclude PCH */,
-                   (rSourceIndex().verbose() > 0) ? 1 : 0);
-
-         // get args in form clang expects
-         core::system::ProcessArgs argsArray(compileArgs);
-
-         // parse the translation unit
-         CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
-                               index,
-                               file.c_str(),
-                               argsArray.args(),
-                               argsArray.argCount(),
-                               NULL, 0, // no unsaved files
-                               CXTranslationUnit_None |
-                               CXTranslationUnit_Incomplete);
-
-
-         // create definitions and wire visitor to it
-         CppDefinitions definitions;
-         definitions.file = file;
-         definitions.fileLastWrite = event.fileInfo().lastWriteTime();
-         s_definitionsByFile[file] = definitions;
-         DefinitionVisitor visitor =
-            boost::bind(insertDefinition, _1, &s_definitionsByFile[file]);
+   // otherwise remove existing definitions (and cancel any indexing)
+   if (compileArgs.empty())
+   {
+      indexQueue().cancel(file);
+      if (isOverridden(file) || s_definitionCache.hasFile(file))
+         s_definitionsByFile[file] = boost::shared_ptr<const CppDefinitions>();
+      return;
+   }
 
-         // visit the cursors
-         libclang::clang().visitChildren(
-              libclang::clang().getTranslationUnitCursor(tu),
-              cursorVisitor,
-              (CXClientData)&visitor);
+   boost::uint64_t generation = indexQueue().request(file);
+   indexThreadPool().enque(boost::bind(indexTranslationUnit,
+                                       file,
+                                       event.fileInfo().lastWriteTime(),
+                                       compileArgs,
+                                       rSourceIndex().verbose(),
+                                       generation));
 
-         // dispose translation unit and index
-         libclang::clang().disposeTranslationUnit(tu);
-         libclang::clang().disposeIndex(index);
-      }
+   if (!s_collecting)
+   {
+      s_collecting = true;
+      module_context::schedulePeriodicWork(
+               boost::posix_time::milliseconds(250),
+               collectIndexedFiles,
+               false);
    }
 }
 
@@ -361,12 +443,20 @@ FileLocation findDefinitionLocation(const FileLocation& location)
       BOOST_FOREACH(const DefinitionsByFile::value_type& defs,
                     s_definitionsByFile)
       {
-         BOOST_FOREACH(const CppDefinition& def, defs.second.definitions)
+         if (!defs.second)
+            continue;
+
+         BOOST_FOREACH(const CppDefinition& def, defs.second->definitions)
          {
             if (def.USR == USR)
                return def.location;
          }
       }
+
+      // and finally in the definitions cached by previous sessions
+      CppDefinition def;
+      if (s_definitionCache.findUSR(USR, !boost::bind(isOverridden, _1), &def))
+         return def.location;
    }
 
    // see if we can resolve the cursor to a definition (if we can't
@@ -388,14 +478,21 @@ FileLocation findDefinitionLocation(const FileLocation& location)
 
 namespace {
 
+bool nameMatches(const std::string& term,
+                 const boost::regex& pattern,
+                 const std::string& name)
+{
+   if (!pattern.empty())
+      return regex_utils::textMatches(name, pattern, false, false);
+   else
+      return string_utils::isSubsequence(name, term, true);
+}
+
 bool matches(const std::string& term,
              const boost::regex& pattern,
              const CppDefinition& definition)
 {
-   if (!pattern.empty())
-      return regex_utils::textMatches(definition.name, pattern, false, false);
-   else
-      return string_utils::isSubsequence(definition.name, term, true);
+   return nameMatches(term, pattern, definition.name);
 }
 
 bool insertMatching(const std::string& term,
@@ -409,151 +506,45 @@ bool insertMatching(const std::string& term,
 }
 
 
-json::Object cppDefinitionToJson(const CppDefinition& definition)
-{
-   using namespace safe_convert;
-   json::Object definitionJson;
-   definitionJson["usr"] = definition.USR;
-   definitionJson["kind"] = numberTo<int>(definition.kind, 0);
-   definitionJson["parent_name"] = definition.parentName;
-   definitionJson["name"] = definition.name;
-   definitionJson["file"] = definition.location.filePath.absolutePath();
-   definitionJson["line"] = numberTo<int>(definition.location.line, 1);
-   definitionJson["column"] = numberTo<int>(definition.location.column, 1);
-   return definitionJson;
-}
-
-CppDefinition cppDefinitionFromJson(const json::Object& object)
-{
-   // read json
-   int kind;
-   int line, column;
-   std::string file;
-   CppDefinition definition;
-   Error error = json::readObject(object,
-                                  "usr", &definition.USR,
-                                  "kind", &kind,
-                                  "parent_name", &definition.parentName,
-                                  "name", &definition.name,
-                                  "file", &file,
-                                  "line", &line,
-                                  "column", &column);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return CppDefinition();
-   }
-
-   // required data transforms
-   using namespace safe_convert;
-   definition.kind = static_cast<CppDefinitionKind>(kind);
-   definition.location.filePath = FilePath(file);
-   definition.location.line = numberTo<unsigned>(line, 1);
-   definition.location.column = numberTo<unsigned>(column, 1);
-
-   // return definition
-   return definition;
-}
-
 FilePath definitionIndexFilePath()
 {
    return module_context::scopedScratchPath().childPath("cpp-definition-cache");
 }
 
-void loadDefinitionIndex()
+void saveDefinitionIndex()
 {
-   using namespace safe_convert;
-
-   FilePath indexFilePath = definitionIndexFilePath();
-   if (!indexFilePath.exists())
-      return;
-
-   std::string contents;
-   Error error = readStringFromFile(indexFilePath, &contents);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return;
-   }
-
-   json::Value indexValueJson;
-   if (!json::parse(contents, &indexValueJson) ||
-       !json::isType<json::Array>(indexValueJson))
+   // merge the definitions indexed during this session with those cached
+   // for files which weren't touched (and which still exist)
+   std::vector<boost::shared_ptr<const CppDefinitions> > files;
+   bool stale = false;
+   for (std::size_t i = 0; i < s_definitionCache.fileCount(); i++)
    {
-      LOG_ERROR_MESSAGE("Error parsing definition index: " + contents);
-      return;
-   }
-
-   json::Array indexJson = indexValueJson.get_array();
-   BOOST_FOREACH(const json::Value& definitionsJson, indexJson)
-   {
-      if (!json::isType<json::Object>(definitionsJson))
-      {
-         LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
+      std::string file = s_definitionCache.file(i);
+      if (isOverridden(file))
          continue;
-      }
 
-      json::Array defsArrayJson;
-      double fileLastWrite;
-      CppDefinitions definitions;
-      Error error = json::readObject(definitionsJson.get_obj(),
-                                     "file", &definitions.file,
-                                     "file_last_write", &fileLastWrite,
-                                     "definitions", &defsArrayJson);
-      if (error)
+      if (!FilePath::exists(file))
       {
-         LOG_ERROR(error);
+         stale = true;
          continue;
       }
-      definitions.fileLastWrite = numberTo<double, std::time_t>(fileLastWrite, 0);
 
-      // if the file doesn't exist then bail
-      if (!FilePath::exists(definitions.file))
-         continue;
-
-      BOOST_FOREACH(const json::Value& defJson, defsArrayJson)
-      {
-         if (!json::isType<json::Object>(defJson))
-         {
-            LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-            continue;
-         }
-
-         CppDefinition definition = cppDefinitionFromJson(defJson.get_obj());
-         if (!definition.empty())
-            definitions.definitions.push_back(definition);
-      }
-
-      s_definitionsByFile[definitions.file] = definitions;
+      boost::shared_ptr<CppDefinitions> pDefinitions(new CppDefinitions());
+      if (s_definitionCache.readDefinitions(file, pDefinitions.get()))
+         files.push_back(pDefinitions);
    }
-}
-
 
-void saveDefinitionIndex()
-{
-   using namespace safe_convert;
+   // nothing to do if the cache is still current
+   if (s_definitionsByFile.empty() && !stale)
+      return;
 
-   json::Array indexJson;
    BOOST_FOREACH(const DefinitionsByFile::value_type& defs, s_definitionsByFile)
    {
-      const CppDefinitions& definitions = defs.second;
-      json::Object definitionsJson;
-      definitionsJson["file"] = definitions.file;
-      definitionsJson["file_last_write"] = numberTo<std::time_t, double>(
-                                               definitions.fileLastWrite, 0);
-      json::Array defsArrayJson;
-      std::transform(definitions.definitions.begin(),
-                     definitions.definitions.end(),
-                     std::back_inserter(defsArrayJson),
-                     cppDefinitionToJson);
-      definitionsJson["definitions"] = defsArrayJson;
-
-      indexJson.push_back(definitionsJson);
+      if (defs.second)
+         files.push_back(defs.second);
    }
 
-   std::ostringstream ostr;
-   json::writeFormatted(indexJson, ostr);
-   Error error = writeStringToFile(definitionIndexFilePath(), ostr.str());
+   Error error = s_definitionCache.write(definitionIndexFilePath(), files);
    if (error)
       LOG_ERROR(error);
 }
@@ -600,16 +591,24 @@ void searchDefinitions(const std::string& term,
    // of all saved files
    BOOST_FOREACH(const DefinitionsByFile::value_type& defs, s_definitionsByFile)
    {
-      // skip files we've already searched
-      if (units.find(defs.first) != units.end())
+      // skip files we've already searched (or which have been removed)
+      if (!defs.second || units.find(defs.first) != units.end())
          continue;
 
-      BOOST_FOREACH(const CppDefinition& def, defs.second.definitions)
+      BOOST_FOREACH(const CppDefinition& def, defs.second->definitions)
       {
          if (matches(term, pattern, def))
             pDefinitions->push_back(def);
       }
    }
+
+   // and then the definitions cached by previous sessions (for files
+   // which haven't been searched above)
+   s_definitionCache.search(
+         boost::bind(nameMatches, term, pattern, _1),
+         !boost::bind(isOverridden, _1) &&
+            !boost::bind(&TranslationUnits::count, &units, _1),
+         pDefinitions);
 }
 
 Error initializeDefinitionIndex()
@@ -617,8 +616,10 @@ Error initializeDefinitionIndex()
    using namespace projects;
    if (projectContext().config().buildType == r_util::kBuildTypePackage)
    {
-      // read in any index saved on disk
-      loadDefinitionIndex();
+      // open any index saved on disk
+      Error error = s_definitionCache.open(definitionIndexFilePath());
+      if (error)
+         LOG_ERROR(error);
 
       // check for src and inst/include dirs
       FilePath pkgPath = projects::projectContext().buildTargetPath();
@@ -0,0 +1,117 @@
+/*
+ * DefinitionIndexQueue.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DefinitionIndexQueue.hpp"
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+boost::uint64_t DefinitionIndexQueue::request(const std::string& file)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      boost::uint64_t generation = ++nextGeneration_;
+      generations_[file] = generation;
+      return generation;
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+void DefinitionIndexQueue::cancel(const std::string& file)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      generations_.erase(file);
+   }
+   END_LOCK_MUTEX
+}
+
+bool DefinitionIndexQueue::isCurrent(const std::string& file,
+                                     boost::uint64_t generation)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string, boost::uint64_t>::const_iterator it =
+                                                generations_.find(file);
+      return it != generations_.end() && it->second == generation;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void DefinitionIndexQueue::indexed(
+                  const std::string& file,
+                  boost::uint64_t generation,
+                  const boost::shared_ptr<const CppDefinitions>& pDefinitions)
+{
+   IndexedFile indexed;
+   indexed.file = file;
+   indexed.generation = generation;
+   indexed.pDefinitions = pDefinitions;
+   indexed_.enque(indexed);
+}
+
+bool DefinitionIndexQueue::collect(DefinitionsByFile* pDefinitionsByFile)
+{
+   IndexedFile indexed;
+   while (indexed_.deque(&indexed))
+   {
+      if (complete(indexed.file, indexed.generation))
+         (*pDefinitionsByFile)[indexed.file] = indexed.pDefinitions;
+   }
+
+   return pending();
+}
+
+bool DefinitionIndexQueue::pending()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return !generations_.empty();
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+// complete the request (returns false if it's no longer current)
+bool DefinitionIndexQueue::complete(const std::string& file,
+                                    boost::uint64_t generation)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string, boost::uint64_t>::iterator it =
+                                                generations_.find(file);
+      if (it == generations_.end() || it->second != generation)
+         return false;
+      generations_.erase(it);
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+} // namespace clang
+} // namepace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,91 @@
+/*
+ * DefinitionIndexQueue.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_MODULES_CLANG_DEFINITION_INDEX_QUEUE_HPP
+#define SESSION_MODULES_CLANG_DEFINITION_INDEX_QUEUE_HPP
+
+#include <map>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/Thread.hpp>
+
+#include "DefinitionCache.hpp"
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+// definitions by file. definitions are immutable once indexed (a
+// re-indexed file has its definitions replaced wholesale)
+typedef std::map<std::string, boost::shared_ptr<const CppDefinitions> >
+                                                         DefinitionsByFile;
+
+// DefinitionIndexQueue tracks the files being indexed on worker threads.
+// only the latest request for a file is current: earlier requests are
+// skipped if they haven't yet started, and their results discarded if they
+// have. results are swapped in on the main thread by collect()
+class DefinitionIndexQueue : boost::noncopyable
+{
+public:
+   DefinitionIndexQueue() : nextGeneration_(0) {}
+
+   // request indexing of a file, superseding earlier requests for it;
+   // returns the generation of the request
+   boost::uint64_t request(const std::string& file);
+
+   // cancel any request for a file
+   void cancel(const std::string& file);
+
+   // is the request still current? (called by workers before indexing)
+   bool isCurrent(const std::string& file, boost::uint64_t generation);
+
+   // queue the result of a request (called by workers)
+   void indexed(const std::string& file,
+                boost::uint64_t generation,
+                const boost::shared_ptr<const CppDefinitions>& pDefinitions);
+
+   // swap the results of current requests into the definitions; returns
+   // whether requests are still pending
+   bool collect(DefinitionsByFile* pDefinitionsByFile);
+
+   bool pending();
+
+private:
+   struct IndexedFile
+   {
+      std::string file;
+      boost::uint64_t generation;
+      boost::shared_ptr<const CppDefinitions> pDefinitions;
+   };
+
+   bool complete(const std::string& file, boost::uint64_t generation);
+
+   boost::mutex mutex_;
+   std::map<std::string, boost::uint64_t> generations_;
+   boost::uint64_t nextGeneration_;
+   core::thread::ThreadsafeQueue<IndexedFile> indexed_;
+};
+
+} // namespace clang
+} // namepace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_MODULES_CLANG_DEFINITION_INDEX_QUEUE_HPP
@@ -0,0 +1,207 @@
+/*
+ * DefinitionIndexQueueTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "DefinitionIndexQueue.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+using namespace rstudio::core;
+
+namespace {
+
+const std::size_t kDefinitionsPerFile = 50;
+
+// the definitions an indexing run finds (each identifies its run)
+boost::shared_ptr<const CppDefinitions> definitions(const std::string& file,
+                                                    boost::uint64_t generation)
+{
+   std::string run = safe_convert::numberToString(generation);
+   boost::shared_ptr<CppDefinitions> pDefinitions(new CppDefinitions());
+   pDefinitions->file = file;
+   for (std::size_t i = 0; i < kDefinitionsPerFile; i++)
+   {
+      pDefinitions->definitions.push_back(CppDefinition(
+         run,
+         CppFunctionDefinition,
+         "",
+         "f" + safe_convert::numberToString(i),
+         libclang::FileLocation(FilePath(file), i + 1, 1)));
+   }
+   return pDefinitions;
+}
+
+// the run that found a file's definitions (or an empty string if they
+// aren't all from the same, complete run)
+std::string indexingRun(const boost::shared_ptr<const CppDefinitions>& pDefs)
+{
+   if (!pDefs || pDefs->definitions.size() != kDefinitionsPerFile)
+      return std::string();
+
+   std::string run = pDefs->definitions.front().USR;
+   BOOST_FOREACH(const CppDefinition& definition, pDefs->definitions)
+   {
+      if (definition.USR != run)
+         return std::string();
+   }
+   return run;
+}
+
+// stands in for indexTranslationUnit
+void indexFile(DefinitionIndexQueue* pQueue,
+               const std::string& file,
+               boost::uint64_t generation)
+{
+   if (!pQueue->isCurrent(file, generation))
+      return;
+
+   boost::this_thread::sleep(boost::posix_time::microseconds(100));
+   pQueue->indexed(file, generation, definitions(file, generation));
+}
+
+// queue indexing of each file
+void requestIndexing(DefinitionIndexQueue* pQueue,
+                     core::thread::ThreadPool* pPool,
+                     int files,
+                     std::map<std::string, boost::uint64_t>* pLatest)
+{
+   for (int i = 0; i < files; i++)
+   {
+      std::string file = "file" + safe_convert::numberToString(i) + ".cpp";
+      boost::uint64_t generation = pQueue->request(file);
+      (*pLatest)[file] = generation;
+      pPool->enque(boost::bind(indexFile, pQueue, file, generation));
+   }
+}
+
+// collect definitions until indexing completes
+void waitForIndexing(DefinitionIndexQueue* pQueue,
+                     DefinitionsByFile* pDefinitionsByFile)
+{
+   for (int i = 0; i < 10000 && pQueue->collect(pDefinitionsByFile); i++)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+}
+
+} // anonymous namespace
+
+TEST_CASE("Definition Index Queue")
+{
+   SECTION("Re-queuing a file cancels its stale indexing run")
+   {
+      DefinitionIndexQueue queue;
+      DefinitionsByFile definitionsByFile;
+
+      boost::uint64_t stale = queue.request("a.cpp");
+      boost::uint64_t current = queue.request("a.cpp");
+      CHECK_FALSE(queue.isCurrent("a.cpp", stale));
+      CHECK(queue.isCurrent("a.cpp", current));
+
+      // the stale run finishing last doesn't replace the current one
+      queue.indexed("a.cpp", current, definitions("a.cpp", current));
+      queue.indexed("a.cpp", stale, definitions("a.cpp", stale));
+      CHECK_FALSE(queue.collect(&definitionsByFile));
+      CHECK(indexingRun(definitionsByFile["a.cpp"]) ==
+            safe_convert::numberToString(current));
+
+      // nor does it finishing after the current run was collected
+      queue.indexed("a.cpp", stale, definitions("a.cpp", stale));
+      queue.collect(&definitionsByFile);
+      CHECK(indexingRun(definitionsByFile["a.cpp"]) ==
+            safe_convert::numberToString(current));
+
+      // cancelled runs are discarded too
+      boost::uint64_t cancelled = queue.request("a.cpp");
+      queue.cancel("a.cpp");
+      CHECK_FALSE(queue.isCurrent("a.cpp", cancelled));
+      queue.indexed("a.cpp", cancelled, definitions("a.cpp", cancelled));
+      CHECK_FALSE(queue.collect(&definitionsByFile));
+      CHECK(indexingRun(definitionsByFile["a.cpp"]) ==
+            safe_convert::numberToString(current));
+   }
+
+   SECTION("Readers see one consistent set of definitions per file")
+   {
+      DefinitionIndexQueue queue;
+      DefinitionsByFile definitionsByFile;
+      core::thread::ThreadPool pool(4);
+
+      const int kFiles = 5;
+      const int kRequests = 40;
+      std::map<std::string, boost::uint64_t> latest;
+      bool consistent = true;
+
+      // index every file, then hold on to a set of definitions as a search
+      // in progress would
+      requestIndexing(&queue, &pool, kFiles, &latest);
+      waitForIndexing(&queue, &definitionsByFile);
+      REQUIRE(definitionsByFile.size() == static_cast<std::size_t>(kFiles));
+      boost::shared_ptr<const CppDefinitions> pSnapshot =
+                                          definitionsByFile.begin()->second;
+      std::string snapshotRun = indexingRun(pSnapshot);
+      CHECK_FALSE(snapshotRun.empty());
+
+      for (int i = 0; i < kRequests; i++)
+      {
+         // re-queue every file (as on repeated saves)
+         requestIndexing(&queue, &pool, kFiles, &latest);
+
+         // meanwhile read the definitions swapped in so far
+         queue.collect(&definitionsByFile);
+         BOOST_FOREACH(const DefinitionsByFile::value_type& entry,
+                       definitionsByFile)
+         {
+            if (indexingRun(entry.second).empty())
+               consistent = false;
+         }
+
+         boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+
+      waitForIndexing(&queue, &definitionsByFile);
+      REQUIRE_FALSE(queue.pending());
+      pool.stop();
+
+      CHECK(consistent);
+
+      // each file has the definitions of its latest request
+      CHECK(definitionsByFile.size() == static_cast<std::size_t>(kFiles));
+      typedef std::map<std::string, boost::uint64_t>::value_type Latest;
+      BOOST_FOREACH(const Latest& entry, latest)
+      {
+         CHECK(indexingRun(definitionsByFile[entry.first]) ==
+               safe_convert::numberToString(entry.second));
+      }
+
+      // definitions held across swaps are unchanged
+      CHECK(indexingRun(pSnapshot) == snapshotRun);
+   }
+}
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
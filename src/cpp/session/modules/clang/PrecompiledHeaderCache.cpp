@@ -0,0 +1,372 @@
+/*
+ * PrecompiledHeaderCache.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "PrecompiledHeaderCache.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <map>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/system/Crypto.hpp>
+#include <core/system/System.hpp>
+
+#ifndef _WIN32
+#include <core/system/FileMode.hpp>
+#endif
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+namespace {
+
+const char * const kManifestHeader = "RSPCH 1";
+const char * const kPchExt = ".pch";
+const char * const kManifestExt = ".manifest";
+const char * const kSourceExt = ".cpp";
+const char * const kTempExt = ".tmp";
+
+// builds which haven't been published after this long were abandoned
+const std::time_t kAbandonedBuildSeconds = 60 * 60;
+
+// the manifest records each header as: size, last write time, crc32 of
+// the contents and path. the last write time is only a shortcut (headers
+// which are merely touched are still matched on their contents)
+struct HeaderRecord
+{
+   boost::uintmax_t size;
+   std::time_t lastWrite;
+   std::string hash;
+   std::string path;
+};
+
+Error headerRecord(const FilePath& header, HeaderRecord* pRecord)
+{
+   std::string contents;
+   Error error = readStringFromFile(header, &contents);
+   if (error)
+      return error;
+
+   pRecord->size = contents.size();
+   pRecord->lastWrite = header.lastWriteTime();
+   pRecord->hash = hash::crc32HexHash(contents);
+   pRecord->path = header.absolutePath();
+   return Success();
+}
+
+bool readManifest(const FilePath& manifestPath,
+                  boost::uintmax_t* pPchSize,
+                  std::vector<HeaderRecord>* pHeaders)
+{
+   std::string contents;
+   Error error = readStringFromFile(manifestPath, &contents);
+   if (error)
+      return false;
+
+   std::istringstream istr(contents);
+   std::string line;
+   if (!std::getline(istr, line) || line != kManifestHeader)
+      return false;
+   if (!(istr >> *pPchSize) || !std::getline(istr, line))
+      return false;
+
+   while (std::getline(istr, line))
+   {
+      HeaderRecord record;
+      std::istringstream lineStream(line);
+      if (!(lineStream >> record.size >> record.lastWrite >> record.hash))
+         return false;
+      lineStream.get();
+      if (!std::getline(lineStream, record.path) || record.path.empty())
+         return false;
+      pHeaders->push_back(record);
+   }
+
+   return true;
+}
+
+bool isCurrent(const HeaderRecord& record)
+{
+   FilePath header(record.path);
+   if (!header.exists() || header.size() != record.size)
+      return false;
+   if (header.lastWriteTime() == record.lastWrite)
+      return true;
+
+   HeaderRecord current;
+   Error error = headerRecord(header, &current);
+   return !error && current.hash == record.hash;
+}
+
+// mark a file as used. this is expected to fail for files published to a
+// shared cache by other users, so those age from when they were published
+void touch(const FilePath& filePath)
+{
+   try
+   {
+      boost::filesystem::last_write_time(filePath.absolutePathNative(),
+                                         std::time(NULL));
+   }
+   catch(const boost::filesystem::filesystem_error&)
+   {
+   }
+}
+
+// make published files readable by the other users of a shared cache
+void makeReadable(const FilePath& filePath)
+{
+#ifndef _WIN32
+   Error error = core::system::changeFileMode(
+            filePath, core::system::UserReadWriteGroupEveryoneReadMode);
+   if (error)
+      LOG_ERROR(error);
+#endif
+}
+
+struct CacheEntry
+{
+   CacheEntry() : size(0), lastUsed(0) {}
+   std::string key;
+   boost::uintmax_t size;
+   std::time_t lastUsed;
+   std::vector<FilePath> files;
+};
+
+bool leastRecentlyUsed(const CacheEntry& lhs, const CacheEntry& rhs)
+{
+   return lhs.lastUsed < rhs.lastUsed;
+}
+
+} // anonymous namespace
+
+PrecompiledHeaderCache::PrecompiledHeaderCache(const FilePath& cacheDir,
+                                               boost::uintmax_t maxSize)
+   : cacheDir_(cacheDir), maxSize_(maxSize)
+{
+}
+
+std::string PrecompiledHeaderCache::key(const std::vector<std::string>& inputs)
+{
+   std::string message;
+   BOOST_FOREACH(const std::string& input, inputs)
+   {
+      message.append(input);
+      message.push_back('\0');
+   }
+
+   std::string digest;
+   Error error = core::system::crypto::sha256(message, &digest);
+   if (error)
+   {
+      LOG_ERROR(error);
+      digest = hash::crc32Hash(message);
+   }
+
+   const char* const kHexDigits = "0123456789abcdef";
+   std::string key;
+   BOOST_FOREACH(unsigned char c, digest)
+   {
+      key.push_back(kHexDigits[c >> 4]);
+      key.push_back(kHexDigits[c & 0xF]);
+   }
+   return key;
+}
+
+bool PrecompiledHeaderCache::find(const std::string& key,
+                                  FilePath* pPchPath) const
+{
+   FilePath manifest = manifestPath(key);
+   if (!manifest.exists())
+      return false;
+
+   boost::uintmax_t pchSize = 0;
+   std::vector<HeaderRecord> headers;
+   if (!readManifest(manifest, &pchSize, &headers))
+      return false;
+
+   FilePath pch = pchPath(key);
+   if (!pch.exists() || pch.size() != pchSize)
+      return false;
+
+   BOOST_FOREACH(const HeaderRecord& header, headers)
+   {
+      if (!isCurrent(header))
+         return false;
+   }
+
+   touch(manifest);
+   *pPchPath = pch;
+   return true;
+}
+
+FilePath PrecompiledHeaderCache::sourcePath(const std::string& key) const
+{
+   return cacheDir_.complete(key + kSourceExt);
+}
+
+FilePath PrecompiledHeaderCache::buildPath(const std::string& key) const
+{
+   return cacheDir_.complete(key + "." +
+                             core::system::generateShortenedUuid() +
+                             kTempExt);
+}
+
+Error PrecompiledHeaderCache::publish(const std::string& key,
+                                      const FilePath& builtPath,
+                                      const std::vector<FilePath>& headers,
+                                      FilePath* pPchPath)
+{
+   // record the headers as they were built from
+   std::ostringstream ostr;
+   ostr << kManifestHeader << std::endl;
+   ostr << builtPath.size() << std::endl;
+   BOOST_FOREACH(const FilePath& header, headers)
+   {
+      HeaderRecord record;
+      Error error = headerRecord(header, &record);
+      if (error)
+         return error;
+
+      ostr << record.size << " " << record.lastWrite << " "
+           << record.hash << " " << record.path << std::endl;
+   }
+
+   FilePath tempManifest = buildPath(key);
+   Error error = writeStringToFile(tempManifest, ostr.str());
+   if (error)
+      return error;
+   makeReadable(builtPath);
+   makeReadable(tempManifest);
+
+   // remove any previous manifest before replacing the PCH, so that the
+   // previous manifest can't be read alongside the new PCH (the manifest
+   // is published last, completing the entry)
+   FilePath manifest = manifestPath(key);
+   FilePath pch = pchPath(key);
+   error = manifest.removeIfExists();
+   if (!error)
+      error = builtPath.move(pch);
+   if (!error)
+      error = tempManifest.move(manifest);
+   if (error)
+   {
+      Error removeError = tempManifest.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   evict(key);
+
+   *pPchPath = pch;
+   return Success();
+}
+
+void PrecompiledHeaderCache::evict(const std::string& keepKey) const
+{
+   std::vector<FilePath> children;
+   Error error = cacheDir_.children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   // group the files by entry (removing any abandoned builds)
+   std::map<std::string, CacheEntry> entriesByKey;
+   boost::uintmax_t totalSize = 0;
+   std::time_t now = std::time(NULL);
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      std::string ext = child.extensionLowerCase();
+      if (ext == kTempExt)
+      {
+         if (now - child.lastWriteTime() > kAbandonedBuildSeconds)
+            child.removeIfExists();
+         continue;
+      }
+      else if (ext != kPchExt && ext != kManifestExt && ext != kSourceExt)
+      {
+         continue;
+      }
+
+      CacheEntry& entry = entriesByKey[child.stem()];
+      entry.key = child.stem();
+      entry.size += child.size();
+      entry.lastUsed = std::max(entry.lastUsed, child.lastWriteTime());
+      entry.files.push_back(child);
+      totalSize += child.size();
+   }
+
+   if (totalSize <= maxSize_)
+      return;
+
+   std::vector<CacheEntry> entries;
+   for (std::map<std::string, CacheEntry>::const_iterator it =
+           entriesByKey.begin(); it != entriesByKey.end(); ++it)
+   {
+      if (it->first != keepKey)
+         entries.push_back(it->second);
+   }
+   std::sort(entries.begin(), entries.end(), leastRecentlyUsed);
+
+   // (entries in a shared cache which belong to other users can't be
+   // removed, so failures to remove aren't reported)
+   BOOST_FOREACH(const CacheEntry& entry, entries)
+   {
+      if (totalSize <= maxSize_)
+         break;
+
+      bool removed = true;
+      BOOST_FOREACH(const FilePath& file, entry.files)
+      {
+         if (file.extensionLowerCase() == kManifestExt)
+            removed = !file.removeIfExists() && removed;
+      }
+      BOOST_FOREACH(const FilePath& file, entry.files)
+      {
+         if (file.extensionLowerCase() != kManifestExt)
+            removed = !file.removeIfExists() && removed;
+      }
+
+      if (removed)
+         totalSize -= entry.size;
+   }
+}
+
+FilePath PrecompiledHeaderCache::pchPath(const std::string& key) const
+{
+   return cacheDir_.complete(key + kPchExt);
+}
+
+FilePath PrecompiledHeaderCache::manifestPath(const std::string& key) const
+{
+   return cacheDir_.complete(key + kManifestExt);
+}
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
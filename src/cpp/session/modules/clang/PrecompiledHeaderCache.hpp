@@ -0,0 +1,90 @@
+/*
+ * PrecompiledHeaderCache.hpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_MODULES_CLANG_PRECOMPILED_HEADER_CACHE_HPP
+#define SESSION_MODULES_CLANG_PRECOMPILED_HEADER_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+#include <core/FilePath.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+// content addressed store of precompiled headers. entries are keyed by a
+// hash of the inputs to a build (compiler, clang version, compile arguments)
+// and record the headers they were built from, so that an entry is only
+// used while those headers are unchanged. entries are published atomically
+// so that the cache directory can be shared by concurrent sessions (and by
+// several users, when configured to be). the least recently used entries
+// are evicted once the cache grows beyond its size limit
+class PrecompiledHeaderCache : boost::noncopyable
+{
+public:
+   PrecompiledHeaderCache(const core::FilePath& cacheDir,
+                          boost::uintmax_t maxSize);
+
+   const core::FilePath& cacheDir() const { return cacheDir_; }
+
+   // the key for a set of build inputs
+   static std::string key(const std::vector<std::string>& inputs);
+
+   // the PCH for a key, if there is one built from the current headers
+   bool find(const std::string& key, core::FilePath* pPchPath) const;
+
+   // the source file the PCH for a key is built from. this is kept with
+   // the PCH since libclang checks that it's unchanged when loading it
+   core::FilePath sourcePath(const std::string& key) const;
+
+   // a unique path to build the PCH for a key into
+   core::FilePath buildPath(const std::string& key) const;
+
+   // move a PCH built from the given headers into the cache (then evict
+   // entries as necessary to bring the cache within its size limit)
+   core::Error publish(const std::string& key,
+                       const core::FilePath& builtPath,
+                       const std::vector<core::FilePath>& headers,
+                       core::FilePath* pPchPath);
+
+   // remove the least recently used entries (other than the one for the
+   // given key) until the cache is within its size limit
+   void evict(const std::string& keepKey = std::string()) const;
+
+private:
+   core::FilePath pchPath(const std::string& key) const;
+   core::FilePath manifestPath(const std::string& key) const;
+
+   core::FilePath cacheDir_;
+   boost::uintmax_t maxSize_;
+};
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_MODULES_CLANG_PRECOMPILED_HEADER_CACHE_HPP
@@ -0,0 +1,163 @@
+/*
+ * PrecompiledHeaderCacheTests.cpp
+ *
+ * Copyright (C) 2009-18 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "PrecompiledHeaderCache.hpp"
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace clang {
+
+using namespace rstudio::core;
+
+namespace {
+
+std::vector<std::string> inputs(const char* first, const char* second)
+{
+   std::vector<std::string> result;
+   result.push_back(first);
+   result.push_back(second);
+   return result;
+}
+
+FilePath buildPch(const PrecompiledHeaderCache& cache,
+                  const std::string& key,
+                  const std::string& contents)
+{
+   FilePath buildPath = cache.buildPath(key);
+   Error error = writeStringToFile(buildPath, contents);
+   if (error)
+      LOG_ERROR(error);
+   return buildPath;
+}
+
+// make an entry look as if it was last used some time ago
+void age(const FilePath& cacheDir, const std::string& key, int seconds)
+{
+   std::time_t lastUsed = std::time(NULL) - seconds;
+   cacheDir.complete(key + ".pch").setLastWriteTime(lastUsed);
+   cacheDir.complete(key + ".manifest").setLastWriteTime(lastUsed);
+}
+
+} // anonymous namespace
+
+TEST_CASE("PrecompiledHeaderCache")
+{
+   FilePath cacheDir, headerDir;
+   REQUIRE_FALSE(FilePath::tempFilePath(&cacheDir));
+   REQUIRE_FALSE(FilePath::tempFilePath(&headerDir));
+   REQUIRE_FALSE(cacheDir.ensureDirectory());
+   REQUIRE_FALSE(headerDir.ensureDirectory());
+
+   FilePath header = headerDir.complete("Rcpp.h");
+   REQUIRE_FALSE(writeStringToFile(header, "#include <RcppCommon.h>\n"));
+   std::vector<FilePath> headers;
+   headers.push_back(header);
+
+   SECTION("Keys depend on all of the inputs")
+   {
+      std::string key = PrecompiledHeaderCache::key(inputs("5.0.2", "-std=c++11"));
+      CHECK(key.size() == 64);
+      CHECK(key == PrecompiledHeaderCache::key(inputs("5.0.2", "-std=c++11")));
+      CHECK(key != PrecompiledHeaderCache::key(inputs("5.0.2", "-std=c++14")));
+      CHECK(key != PrecompiledHeaderCache::key(inputs("5.0.2-std=c++11", "")));
+   }
+
+   SECTION("Published headers are found while their headers are unchanged")
+   {
+      PrecompiledHeaderCache cache(cacheDir, 1024 * 1024);
+      std::string key = PrecompiledHeaderCache::key(inputs("5.0.2", "-std=c++11"));
+
+      FilePath pchPath;
+      CHECK_FALSE(cache.find(key, &pchPath));
+
+      FilePath buildPath = buildPch(cache, key, "pch");
+      REQUIRE_FALSE(cache.publish(key, buildPath, headers, &pchPath));
+      CHECK_FALSE(buildPath.exists());
+      CHECK(pchPath.exists());
+
+      // (found by another session sharing the directory)
+      PrecompiledHeaderCache other(cacheDir, 1024 * 1024);
+      FilePath foundPath;
+      REQUIRE(other.find(key, &foundPath));
+      CHECK(foundPath == pchPath);
+
+      // touching a header doesn't invalidate the entry, changing it does
+      header.setLastWriteTime(header.lastWriteTime() - 100);
+      CHECK(other.find(key, &foundPath));
+      REQUIRE_FALSE(writeStringToFile(header, "#include <RcppCommon.h> \n"));
+      CHECK_FALSE(other.find(key, &foundPath));
+
+      // a rebuild replaces the entry
+      buildPath = buildPch(cache, key, "rebuilt pch");
+      REQUIRE_FALSE(cache.publish(key, buildPath, headers, &pchPath));
+      REQUIRE(other.find(key, &foundPath));
+      std::string contents;
+      REQUIRE_FALSE(readStringFromFile(foundPath, &contents));
+      CHECK(contents == "rebuilt pch");
+
+      header.removeIfExists();
+      CHECK_FALSE(other.find(key, &foundPath));
+   }
+
+   SECTION("Least recently used entries are evicted beyond the size limit")
+   {
+      // (room for two entries)
+      PrecompiledHeaderCache cache(cacheDir, 1000);
+      std::string pch(300, 'x');
+
+      const char* args[] = { "-std=c++98", "-std=c++11", "-std=c++14" };
+      std::string keys[3];
+      FilePath pchPaths[3];
+      for (int i = 0; i < 3; i++)
+      {
+         keys[i] = PrecompiledHeaderCache::key(inputs("5.0.2", args[i]));
+         REQUIRE_FALSE(cache.publish(keys[i], buildPch(cache, keys[i], pch),
+                                     headers, &pchPaths[i]));
+         age(cacheDir, keys[i], 1000 - i * 100);
+      }
+
+      // the first entry was evicted when the third was published
+      FilePath pchPath;
+      CHECK_FALSE(cache.find(keys[0], &pchPath));
+      CHECK(cache.find(keys[1], &pchPath));
+      CHECK(cache.find(keys[2], &pchPath));
+
+      // using the second entry keeps it over the third
+      age(cacheDir, keys[1], 900);
+      age(cacheDir, keys[2], 800);
+      CHECK(cache.find(keys[1], &pchPath));
+      std::string key = PrecompiledHeaderCache::key(inputs("5.0.2", "-std=c++17"));
+      REQUIRE_FALSE(cache.publish(key, buildPch(cache, key, pch), headers, &pchPath));
+      CHECK(cache.find(keys[1], &pchPath));
+      CHECK_FALSE(cache.find(keys[2], &pchPath));
+      CHECK(cache.find(key, &pchPath));
+   }
+
+   cacheDir.removeIfExists();
+   headerDir.removeIfExists();
+}
+
+} // namespace clang
+} // namespace modules
+} // namespace session
+} // namespace rstudio
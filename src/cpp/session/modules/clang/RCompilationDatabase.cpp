@@ -39,9 +39,11 @@
 
 #include <session/projects/SessionProjects.hpp>
 #include <session/SessionModuleContext.hpp>
+#include <session/SessionOptions.hpp>
 #include <session/SessionUserSettings.hpp>
 
 #include "CodeCompletion.hpp"
+#include "PrecompiledHeaderCache.hpp"
 #include "RSourceIndex.hpp"
 
 using namespace rstudio::core ;
@@ -948,10 +950,39 @@ core::system::Options RCompilationDatabase::compilationEnvironment() const
 
 namespace {
 
-FilePath precompiledHeaderDir(const std::string& pkgName)
+// precompiled headers are shared by all of a user's sessions, or by all
+// users when a shared cache directory is configured
+PrecompiledHeaderCache& precompiledHeaderCache()
 {
-   return module_context::tempDir().childPath("rstudio/libclang/precompiled/"
-                                              + pkgName);
+   static PrecompiledHeaderCache* s_pCache = NULL;
+   if (s_pCache == NULL)
+   {
+      FilePath cacheDir = module_context::userScratchPath().complete(
+                                                   "libclang/precompiled");
+      std::string sharedPath = session::options().libclangPchCachePath();
+      if (!sharedPath.empty())
+         cacheDir = FilePath(sharedPath);
+
+      Error error = cacheDir.ensureDirectory();
+      if (error)
+         LOG_ERROR(error);
+
+      boost::uintmax_t maxSize = std::max(
+                     session::options().libclangPchCacheMaxMb(), 0);
+      s_pCache = new PrecompiledHeaderCache(cacheDir, maxSize * 1024 * 1024);
+   }
+   return *s_pCache;
+}
+
+void addInclusion(CXFile includedFile,
+                  CXSourceLocation*,
+                  unsigned,
+                  CXClientData clientData)
+{
+   std::vector<FilePath>* pHeaders = (std::vector<FilePath>*)clientData;
+   std::string file = toStdString(clang().getFileName(includedFile));
+   if (!file.empty())
+      pHeaders->push_back(FilePath(file));
 }
 
 } // anonymous namespace
@@ -960,14 +991,8 @@ std::vector<std::string> RCompilationDatabase::precompiledHeaderArgs(
                                                   const std::string& pkgName,
                                                   const std::string& stdArg)
 {
-   // args to return
-   std::vector<std::string> args;
-
-   // precompiled header dir
-   FilePath precompiledDir = precompiledHeaderDir(pkgName);
-
-   // further scope to actual path of package (as the locations of the
-   // header files must be stable)
+   // scope to actual path of package (as the locations of the header
+   // files must be stable)
    std::string pkgPath;
    Error error = r::exec::RFunction("find.package", pkgName).call(&pkgPath);
    if (error)
@@ -975,10 +1000,8 @@ std::vector<std::string> RCompilationDatabase::precompiledHeaderArgs(
       LOG_ERROR(error);
       return std::vector<std::string>();
    }
-   pkgPath = core::hash::crc32HexHash(pkgPath);
-   precompiledDir = precompiledDir.childPath(pkgPath);
 
-   // platform/rcpp version specific directory name
+   // platform/rcpp version specific name
    std::string clangVersion = clang().version().asString();
    std::string platformDir;
    error = r::exec::RFunction(".rs.clangPCHPath", pkgName, clangVersion)
@@ -989,114 +1012,146 @@ std::vector<std::string> RCompilationDatabase::precompiledHeaderArgs(
       return std::vector<std::string>();
    }
 
-   // if this path doesn't exist then blow away all precompiled paths
-   // and re-create this one. this enforces only storing precompiled headers
-   // for the current version of R/Rcpp/pkg -- if we didn't do this then the
-   // storage cost could really pile up over time (~25MB per PCH)
-   FilePath platformPath = precompiledDir.childPath(platformDir);
-   if (!platformPath.exists())
+   // use the PCH we've already resolved for this version of the package if
+   // we can, otherwise find (or build) it in the cache
+   std::string pchId = pkgPath + "/" + platformDir + stdArg;
+   PrecompiledHeaders::const_iterator it = precompiledHeaders_.find(pchId);
+   FilePath pchPath;
+   if (it != precompiledHeaders_.end() && it->second.exists())
    {
-      // delete root directory
-      Error error = precompiledDir.removeIfExists();
-      if (error)
-      {
-         LOG_ERROR(error);
+      pchPath = it->second;
+   }
+   else
+   {
+      pchPath = precompiledHeaderPath(pkgName, pkgPath, platformDir, stdArg);
+      if (pchPath.empty())
          return std::vector<std::string>();
-      }
+      precompiledHeaders_[pchId] = pchPath;
+   }
+
+   // return the pch header file args
+   std::vector<std::string> args;
+   args.push_back("-include-pch");
+   args.push_back(pchPath.absolutePath());
+   return args;
+}
+
+FilePath RCompilationDatabase::precompiledHeaderPath(
+                                             const std::string& pkgName,
+                                             const std::string& pkgPath,
+                                             const std::string& platformDir,
+                                             const std::string& stdArg)
+{
+   // start with base args
+   std::vector<std::string> args = baseCompilationArgs(true);
 
-      // create platform directory
-      error = platformPath.ensureDirectory();
+   // -std argument
+   if (!stdArg.empty())
+      args.push_back(stdArg);
+
+   // run R CMD SHLIB
+   core::system::Options env = compilationEnvironment();
+   FilePath tempSrcFile = module_context::tempFile("clang", "cpp");
+   std::vector<std::string> cArgs = argsForRCmdSHLIB(env, tempSrcFile);
+   std::copy(cArgs.begin(), cArgs.end(), std::back_inserter(args));
+
+   // add this package's path to the args
+   std::vector<std::string> pkgArgs = includesForLinkingTo(pkgName);
+   std::copy(pkgArgs.begin(), pkgArgs.end(), std::back_inserter(args));
+
+   // source file for creating precompiled headers
+   boost::format fmt("#include <%1%.h>\n");
+   std::string contents = boost::str(fmt % pkgName);
+
+   // key the cache on everything which goes into the PCH (the cache checks
+   // that the headers it was built from are unchanged)
+   std::vector<std::string> inputs;
+   inputs.push_back(clang().version().asString());
+   inputs.push_back(platformDir);
+   inputs.push_back(pkgPath);
+   inputs.push_back(contents);
+   std::copy(args.begin(), args.end(), std::back_inserter(inputs));
+
+   PrecompiledHeaderCache& cache = precompiledHeaderCache();
+   std::string key = PrecompiledHeaderCache::key(inputs);
+   FilePath pchPath;
+   if (cache.find(key, &pchPath))
+      return pchPath;
+
+   // write the source (once, since its modification time is checked
+   // when the PCH is loaded)
+   FilePath cppPath = cache.sourcePath(key);
+   if (!cppPath.exists())
+   {
+      FilePath tempCppPath = cache.buildPath(key);
+      Error error = core::writeStringToFile(tempCppPath, contents);
+      if (!error)
+         error = tempCppPath.move(cppPath);
       if (error)
       {
          LOG_ERROR(error);
-         return std::vector<std::string>();
+         tempCppPath.removeIfExists();
+         return FilePath();
       }
    }
 
-   // now create the PCH if we need to
-   FilePath pchPath = platformPath.childPath(pkgName + stdArg + ".pch");
-   if (!pchPath.exists())
+   // create args array
+   core::system::ProcessArgs argsArray(args);
+
+   CXIndex index = clang().createIndex(
+                              0,
+                              (rSourceIndex().verbose() > 0) ? 1 : 0);
+
+   CXTranslationUnit tu = clang().parseTranslationUnit(
+                         index,
+                         cppPath.absolutePath().c_str(),
+                         argsArray.args(),
+                         argsArray.argCount(),
+                         0,
+                         0,
+                         CXTranslationUnit_ForSerialization);
+   if (tu == NULL)
+   {
+      LOG_ERROR_MESSAGE("Error parsing translation unit " +
+                        cppPath.absolutePath());
+      clang().disposeIndex(index);
+      return FilePath();
+   }
+
+   // build into a private file, then publish it to the cache along with
+   // the headers it was built from
+   FilePath buildPath = cache.buildPath(key);
+   int ret = clang().saveTranslationUnit(tu,
+                                         buildPath.absolutePath().c_str(),
+                                         clang().defaultSaveOptions(tu));
+   if (ret == CXSaveError_None)
    {
-      // state cpp file for creating precompiled headers
-      FilePath cppPath = platformPath.childPath(pkgName + stdArg + ".cpp");
-      std::string contents;
-      boost::format fmt("#include <%1%.h>\n");
-      contents.append(boost::str(fmt % pkgName));
-      error = core::writeStringToFile(cppPath, contents);
+      std::vector<FilePath> headers;
+      clang().getInclusions(tu, addInclusion, (CXClientData)&headers);
+
+      Error error = cache.publish(key, buildPath, headers, &pchPath);
       if (error)
       {
          LOG_ERROR(error);
-         return std::vector<std::string>();
-      }
-
-      // start with base args
-      std::vector<std::string> args = baseCompilationArgs(true);
-
-      // -std argument
-      if (!stdArg.empty())
-         args.push_back(stdArg);
-
-      // run R CMD SHLIB
-      core::system::Options env = compilationEnvironment();
-      FilePath tempSrcFile = module_context::tempFile("clang", "cpp");
-      std::vector<std::string> cArgs = argsForRCmdSHLIB(env, tempSrcFile);
-      std::copy(cArgs.begin(), cArgs.end(), std::back_inserter(args));
-
-      // add this package's path to the args
-      std::vector<std::string> pkgArgs = includesForLinkingTo(pkgName);
-      std::copy(pkgArgs.begin(), pkgArgs.end(), std::back_inserter(args));
-
-      // create args array
-      core::system::ProcessArgs argsArray(args);
-
-      CXIndex index = clang().createIndex(
-                                 0,
-                                 (rSourceIndex().verbose() > 0) ? 1 : 0);
-
-      CXTranslationUnit tu = clang().parseTranslationUnit(
-                            index,
-                            cppPath.absolutePath().c_str(),
-                            argsArray.args(),
-                            argsArray.argCount(),
-                            0,
-                            0,
-                            CXTranslationUnit_ForSerialization);
-      if (tu == NULL)
-      {
-         LOG_ERROR_MESSAGE("Error parsing translation unit " +
-                           cppPath.absolutePath());
-         clang().disposeIndex(index);
-
-         Error removeError = precompiledDir.removeIfExists();
-         if (removeError)
-            LOG_ERROR(removeError);
-
-         return std::vector<std::string>();
+         pchPath = FilePath();
       }
+   }
+   else
+   {
+      boost::format fmt("Error %1% saving translation unit %2%");
+      std::string msg = boost::str(fmt % ret % buildPath.absolutePath());
+      LOG_ERROR_MESSAGE(msg);
+   }
 
-      int ret = clang().saveTranslationUnit(tu,
-                                            pchPath.absolutePath().c_str(),
-                                            clang().defaultSaveOptions(tu));
-      if (ret != CXSaveError_None)
-      {
-         boost::format fmt("Error %1% saving translation unit %2%");
-         std::string msg = boost::str(fmt % ret % pchPath.absolutePath());
-         LOG_ERROR_MESSAGE(msg);
-
-         Error removeError = precompiledDir.removeIfExists();
-         if (removeError)
-            LOG_ERROR(removeError);
-      }
+   Error removeError = buildPath.removeIfExists();
+   if (removeError)
+      LOG_ERROR(removeError);
 
-      clang().disposeTranslationUnit(tu);
+   clang().disposeTranslationUnit(tu);
 
-      clang().disposeIndex(index);
-   }
+   clang().disposeIndex(index);
 
-   // reutrn the pch header file args
-   args.push_back("-include-pch");
-   args.push_back(pchPath.absolutePath());
-   return args;
+   return pchPath;
 }
 
 core::libclang::CompilationDatabase rCompilationDatabase()
@@ -90,6 +90,10 @@ private:
    core::system::Options compilationEnvironment() const;
    std::vector<std::string> precompiledHeaderArgs(const std::string& pkgName,
                                                   const std::string& stdArg);
+   core::FilePath precompiledHeaderPath(const std::string& pkgName,
+                                        const std::string& pkgPath,
+                                        const std::string& platformDir,
+                                        const std::string& stdArg);
 
    bool shouldIndexConfig(const CompilationConfig& config);
 
@@ -112,6 +116,10 @@ private:
    std::string packageBuildFileHash_;
    CompilationConfig packageCompilationConfig_;
    bool usePrecompiledHeaders_;
+
+   // precompiled headers resolved (by package path, version and -std)
+   typedef std::map<std::string,core::FilePath> PrecompiledHeaders;
+   PrecompiledHeaders precompiledHeaders_;
    bool restoredCompilationConfig_;
 };
 
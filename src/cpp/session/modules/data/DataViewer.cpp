@@ -14,7 +14,13 @@
  */
 
 #include "DataViewer.hpp"
+#include "DataViewerColumnar.hpp"
+#include "DataViewerFormat.hpp"
+#include "DataViewerIndex.hpp"
+#include "DataViewerSummary.hpp"
 
+#include <algorithm>
+#include <list>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -67,6 +73,12 @@
 // default max value for columns to return unless client requests more
 #define MAX_COLUMNS 50
 
+// the number of sort/filter/search states for which row indexes are kept
+#define MAX_INDEXED_STATES 3
+
+// the number of most frequent levels to summarize
+#define MAX_TOP_LEVELS 10
+
 using namespace rstudio::core;
 
 namespace rstudio {
@@ -129,6 +141,15 @@ namespace {
  *    This allows us to efficiently perform operations on very large datasets
  *    once they've been winnowed down to smaller objects using searches and
  *    filters.
+ *
+ * INDEXED:
+ *    Most sorts, filters and searches are instead applied natively, to the
+ *    column vectors of the cached (or original) object. This produces an
+ *    index of the rows to display (in order) rather than a working copy;
+ *    pages are then read through the index. Indexes for a few recent states
+ *    are kept, and are refined from in the same way as working copies.
+ *    Working copies are only made for transforms which must be applied in R
+ *    (e.g. searches for non-ASCII text).
  */    
 
 // indicates whether one filter string is a subset of another; e.g. if a column
@@ -265,6 +286,10 @@ struct CachedFrame
    int ncol;
    std::vector<std::string> colNames;
 
+   // The description of the frame's columns (and their summaries), computed
+   // on first request; null until then
+   json::Value cols;
+
    // The current search string and filter set
    std::string workingSearch;
    std::vector<std::string> workingFilters;
@@ -298,6 +323,22 @@ struct CachedFrame
 // The set of active frames. Used primarily to check each for changes.
 std::map<std::string, CachedFrame> s_cachedFrames;
 
+// Row indexes for the recent transform states of each frame (by cache key)
+struct FrameIndex
+{
+   FrameIndex() : dataSEXP(NULL), nrow(0) {}
+
+   // NB: There's no protection on this SEXP and it may be a stale pointer!
+   // Used only to test for changes.
+   SEXP dataSEXP;
+   int nrow;
+
+   // most recently used first
+   typedef std::pair<GridTransform, boost::shared_ptr<const GridRows> > State;
+   std::list<State> states;
+};
+std::map<std::string, FrameIndex> s_frameIndexes;
+
 std::string viewerCacheDir() 
 {
    return module_context::sessionScratchPath().childPath(kViewerCacheDir)
@@ -442,12 +483,554 @@ void handleGridResReq(const http::Request& request,
    pResponse->setCacheableFile(gridResource, request);
 }
 
-json::Value getCols(SEXP dataSEXP)
+// whether the rows matching one transform are a subset of those matching
+// another (regardless of order)
+bool isRefinementOf(const GridTransform& outer, const GridTransform& inner)
+{
+   if (!outer.search.empty() &&
+       !boost::algorithm::icontains(inner.search, outer.search))
+   {
+      return false;
+   }
+
+   for (std::size_t i = 0; i < outer.filters.size(); i++)
+   {
+      if (outer.filters[i].empty())
+         continue;
+      if (i >= inner.filters.size() ||
+          !isFilterSubset(outer.filters[i], inner.filters[i]))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool hasOrderableClass(SEXP columnSEXP)
+{
+   // classes which order (and compare) on their underlying values
+   SEXP classSEXP = Rf_getAttrib(columnSEXP, R_ClassSymbol);
+   for (int i = 0; i < Rf_length(classSEXP); i++)
+   {
+      std::string className = CHAR(STRING_ELT(classSEXP, i));
+      if (className != "Date" && className != "POSIXct" &&
+          className != "POSIXt" && className != "difftime")
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// extracts a column for native sorting, filtering and searching; this must
+// be done here (on the main thread) since R's accessors are only safe to use
+// from it
+bool extractGridColumn(SEXP columnSEXP,
+                       int needs,
+                       r::sexp::Protect* pProtect,
+                       GridColumn* pColumn)
+{
+   pColumn->length = Rf_length(columnSEXP);
+   bool orderable = !OBJECT(columnSEXP) || hasOrderableClass(columnSEXP);
+   switch (TYPEOF(columnSEXP))
+   {
+   case INTSXP:
+      if (Rf_isFactor(columnSEXP))
+      {
+         pColumn->type = GridColumnFactor;
+         SEXP levelsSEXP = Rf_getAttrib(columnSEXP, R_LevelsSymbol);
+         for (int i = 0; i < Rf_length(levelsSEXP); i++)
+            pColumn->levels.push_back(CHAR(STRING_ELT(levelsSEXP, i)));
+      }
+      else if (orderable)
+      {
+         pColumn->type = GridColumnInteger;
+      }
+      pColumn->pInts = INTEGER(columnSEXP);
+      break;
+   case LGLSXP:
+      if (orderable)
+         pColumn->type = GridColumnLogical;
+      pColumn->pInts = LOGICAL(columnSEXP);
+      break;
+   case REALSXP:
+      if (orderable)
+         pColumn->type = GridColumnReal;
+      pColumn->pReals = REAL(columnSEXP);
+      break;
+   case STRSXP:
+      pColumn->type = GridColumnString;
+      pColumn->strings.reserve(pColumn->length);
+      for (std::size_t i = 0; i < pColumn->length; i++)
+      {
+         SEXP stringSEXP = STRING_ELT(columnSEXP, i);
+         pColumn->strings.push_back(
+                  stringSEXP == NA_STRING ? NULL : CHAR(stringSEXP));
+      }
+      break;
+   default:
+      break;
+   }
+
+   if (!(needs & GridNeedsValues) && !(needs & GridNeedsText))
+      return true;
+
+   // text can be derived from the values of plain integers and logicals (and
+   // factors); anything else is searched on the text R gives it
+   bool derivedText = pColumn->type == GridColumnString ||
+                      pColumn->type == GridColumnFactor ||
+                      ((pColumn->type == GridColumnInteger ||
+                        pColumn->type == GridColumnLogical) &&
+                       !OBJECT(columnSEXP));
+   if ((needs & GridNeedsText) && !derivedText)
+   {
+      SEXP textSEXP = R_NilValue;
+      Error error = r::exec::RFunction("as.character", columnSEXP)
+            .call(&textSEXP, pProtect);
+      if (error || TYPEOF(textSEXP) != STRSXP ||
+          static_cast<std::size_t>(Rf_length(textSEXP)) != pColumn->length)
+      {
+         return false;
+      }
+
+      pColumn->strings.clear();
+      pColumn->strings.reserve(pColumn->length);
+      for (std::size_t i = 0; i < pColumn->length; i++)
+      {
+         SEXP stringSEXP = STRING_ELT(textSEXP, i);
+         pColumn->strings.push_back(
+                  stringSEXP == NA_STRING ? NULL : CHAR(stringSEXP));
+      }
+   }
+
+   return true;
+}
+
+// sorts, filters and searches the rows of a frame natively, returning an
+// index of the rows to show (or NULL if the transform must be applied in R)
+boost::shared_ptr<const GridRows> indexRows(SEXP dataSEXP,
+                                            const std::string& cacheKey,
+                                            int nrow,
+                                            const GridTransform& transform)
+{
+   if (TYPEOF(dataSEXP) != VECSXP || cacheKey.empty())
+      return boost::shared_ptr<const GridRows>();
+
+   // discard the indexes of a previous version of the frame
+   FrameIndex& frameIndex = s_frameIndexes[cacheKey];
+   if (frameIndex.dataSEXP != dataSEXP || frameIndex.nrow != nrow)
+   {
+      frameIndex.dataSEXP = dataSEXP;
+      frameIndex.nrow = nrow;
+      frameIndex.states.clear();
+   }
+
+   // use an index of the same state as is, or refine one of a superset
+   const GridRows* pBaseRows = NULL;
+   for (std::list<FrameIndex::State>::iterator it = frameIndex.states.begin();
+        it != frameIndex.states.end();
+        ++it)
+   {
+      if (it->first == transform)
+      {
+         frameIndex.states.splice(frameIndex.states.begin(),
+                                  frameIndex.states, it);
+         return frameIndex.states.front().second;
+      }
+      else if (pBaseRows == NULL && isRefinementOf(it->first, transform))
+      {
+         pBaseRows = it->second.get();
+      }
+   }
+
+   // extract the columns we need
+   r::sexp::Protect protect;
+   int ncol = Rf_length(dataSEXP);
+   std::vector<GridColumn> columns(ncol);
+   for (int i = 0; i < ncol; i++)
+   {
+      int needs = gridColumnNeeds(transform, i);
+      if (needs == GridNeedsNothing)
+         continue;
+
+      SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
+      if (!extractGridColumn(columnSEXP, needs, &protect, &columns[i]) ||
+          columns[i].length != static_cast<std::size_t>(nrow))
+      {
+         return boost::shared_ptr<const GridRows>();
+      }
+   }
+
+   if (!canTransformGrid(columns, transform))
+      return boost::shared_ptr<const GridRows>();
+
+   // (R transforms the grid if we fail to, e.g. for want of memory)
+   boost::shared_ptr<const GridRows> pRows;
+   try
+   {
+      pRows = transformGrid(columns, nrow, transform, pBaseRows);
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+   if (!pRows)
+      return boost::shared_ptr<const GridRows>();
+
+   frameIndex.states.push_front(std::make_pair(transform, pRows));
+   if (frameIndex.states.size() > MAX_INDEXED_STATES)
+      frameIndex.states.pop_back();
+
+   return pRows;
+}
+
+int integerOption(const std::string& name, int defaultValue)
+{
+   SEXP valueSEXP = r::options::getOption(name);
+   if (valueSEXP == R_NilValue)
+      return defaultValue;
+   int value = r::sexp::asInteger(valueSEXP);
+   return value == NA_INTEGER ? defaultValue : value;
+}
+
+CellFormatOptions cellFormatOptions()
+{
+   CellFormatOptions options;
+   options.digits = integerOption("digits", options.digits);
+   options.scipen = integerOption("scipen", options.scipen);
+   options.digitsSecs = integerOption("digits.secs", options.digitsSecs);
+   return options;
+}
+
+json::Value stringCell(SEXP stringSEXP)
+{
+   if (stringSEXP == NA_STRING)
+      return SPECIAL_CELL_NA;
+   else if (stringSEXP != NULL && r::sexp::length(stringSEXP) > 0)
+      return Rf_translateCharUTF8(stringSEXP);
+   else
+      return "";
+}
+
+// formats the cells of a data frame's row names at the given rows; returns
+// false if they must be formatted in R
+bool formatRowNameCells(SEXP dataSEXP,
+                        const std::vector<int>& rows,
+                        int start,
+                        std::vector<json::Array>* pRowData)
+{
+   if (!Rf_isFrame(dataSEXP))
+      return false;
+
+   // find the row names as stored (Rf_getAttrib would expand compact names)
+   SEXP rowNamesSEXP = R_NilValue;
+   for (SEXP attribSEXP = ATTRIB(dataSEXP);
+        attribSEXP != R_NilValue;
+        attribSEXP = CDR(attribSEXP))
+   {
+      if (TAG(attribSEXP) == R_RowNamesSymbol)
+      {
+         rowNamesSEXP = CAR(attribSEXP);
+         break;
+      }
+   }
+
+   if (TYPEOF(rowNamesSEXP) == INTSXP)
+   {
+      bool compact = Rf_length(rowNamesSEXP) == 2 &&
+                     INTEGER(rowNamesSEXP)[0] == NA_INTEGER;
+      if (!compact && !rows.empty() &&
+          *std::max_element(rows.begin(), rows.end()) >= Rf_length(rowNamesSEXP))
+      {
+         return false;
+      }
+
+      for (std::size_t i = 0; i < rows.size(); i++)
+      {
+         int name = compact ? rows[i] + 1 : INTEGER(rowNamesSEXP)[rows[i]];
+         if (name == NA_INTEGER)
+            (*pRowData)[i].push_back(static_cast<int>(i) + start);
+         else
+            (*pRowData)[i].push_back(safe_convert::numberToString(name));
+      }
+      return true;
+   }
+   else if (TYPEOF(rowNamesSEXP) == STRSXP)
+   {
+      if (!rows.empty() &&
+          *std::max_element(rows.begin(), rows.end()) >= Rf_length(rowNamesSEXP))
+      {
+         return false;
+      }
+
+      for (std::size_t i = 0; i < rows.size(); i++)
+      {
+         SEXP nameSEXP = STRING_ELT(rowNamesSEXP, rows[i]);
+         if (nameSEXP != NA_STRING && r::sexp::length(nameSEXP) > 0)
+            (*pRowData)[i].push_back(Rf_translateCharUTF8(nameSEXP));
+         else
+            (*pRowData)[i].push_back(static_cast<int>(i) + start);
+      }
+      return true;
+   }
+
+   return false;
+}
+
+// formats the cells of a column at the given rows, as .rs.formatDataColumn
+// would; returns false if the column must be formatted in R
+bool formatColumnCells(SEXP columnSEXP,
+                       const std::vector<int>& rows,
+                       const CellFormatOptions& options,
+                       json::Array* pCells)
+{
+   pCells->clear();
+   int length = Rf_length(columnSEXP);
+   BOOST_FOREACH(int row, rows)
+   {
+      if (row >= length)
+         return false;
+   }
+
+   int type = TYPEOF(columnSEXP);
+   if (!OBJECT(columnSEXP) &&
+       (type == INTSXP || type == REALSXP))
+   {
+      // numbers share a common format; NA doesn't participate in it
+      std::vector<double> values;
+      values.reserve(rows.size());
+      BOOST_FOREACH(int row, rows)
+      {
+         if (type == INTSXP)
+         {
+            int value = INTEGER(columnSEXP)[row];
+            values.push_back(value == NA_INTEGER ? R_NaN : value);
+         }
+         else
+         {
+            double value = REAL(columnSEXP)[row];
+            values.push_back(R_IsNA(value) ? R_NaN : value);
+         }
+      }
+
+      std::vector<std::string> formatted;
+      formatNumbers(values, options, &formatted);
+      for (std::size_t i = 0; i < rows.size(); i++)
+      {
+         bool na = type == INTSXP ?
+                  INTEGER(columnSEXP)[rows[i]] == NA_INTEGER :
+                  R_IsNA(REAL(columnSEXP)[rows[i]]);
+         if (na)
+            pCells->push_back(SPECIAL_CELL_NA);
+         else
+            pCells->push_back(formatted[i]);
+      }
+      return true;
+   }
+   else if (!OBJECT(columnSEXP) && type == LGLSXP)
+   {
+      BOOST_FOREACH(int row, rows)
+      {
+         int value = LOGICAL(columnSEXP)[row];
+         if (value == NA_LOGICAL)
+            pCells->push_back(SPECIAL_CELL_NA);
+         else
+            pCells->push_back(value ? "TRUE" : "FALSE");
+      }
+      return true;
+   }
+   else if (!OBJECT(columnSEXP) && type == STRSXP)
+   {
+      BOOST_FOREACH(int row, rows)
+      {
+         pCells->push_back(stringCell(STRING_ELT(columnSEXP, row)));
+      }
+      return true;
+   }
+   else if (type == INTSXP && Rf_isFactor(columnSEXP))
+   {
+      SEXP levelsSEXP = Rf_getAttrib(columnSEXP, R_LevelsSymbol);
+      if (TYPEOF(levelsSEXP) != STRSXP)
+         return false;
+
+      int levels = Rf_length(levelsSEXP);
+      BOOST_FOREACH(int row, rows)
+      {
+         int code = INTEGER(columnSEXP)[row];
+         if (code == NA_INTEGER || code < 1 || code > levels)
+            pCells->push_back(SPECIAL_CELL_NA);
+         else
+            pCells->push_back(stringCell(STRING_ELT(levelsSEXP, code - 1)));
+      }
+      return true;
+   }
+   else if ((type == INTSXP || type == REALSXP) &&
+            r::sexp::inherits(columnSEXP, "Date"))
+   {
+      std::string cell;
+      BOOST_FOREACH(int row, rows)
+      {
+         double days = type == INTSXP ?
+                  (INTEGER(columnSEXP)[row] == NA_INTEGER ?
+                      R_NaN : INTEGER(columnSEXP)[row]) :
+                  REAL(columnSEXP)[row];
+         if (ISNAN(days))
+            pCells->push_back(SPECIAL_CELL_NA);
+         else if (formatDate(days, &cell))
+            pCells->push_back(cell);
+         else
+            return false;
+      }
+      return true;
+   }
+   else if (type == REALSXP && r::sexp::inherits(columnSEXP, "POSIXct"))
+   {
+      // we can show times in UTC or the local time zone; R shows others
+      std::string timeZone;
+      SEXP timeZoneSEXP = Rf_getAttrib(columnSEXP, Rf_install("tzone"));
+      if (TYPEOF(timeZoneSEXP) == STRSXP && Rf_length(timeZoneSEXP) > 0 &&
+          STRING_ELT(timeZoneSEXP, 0) != NA_STRING)
+      {
+         timeZone = CHAR(STRING_ELT(timeZoneSEXP, 0));
+      }
+      bool utc = timeZone == "UTC" || timeZone == "GMT";
+      if (!utc && !timeZone.empty())
+         return false;
+
+      std::vector<double> seconds;
+      seconds.reserve(rows.size());
+      BOOST_FOREACH(int row, rows)
+      {
+         seconds.push_back(REAL(columnSEXP)[row]);
+      }
+
+      std::vector<std::string> formatted;
+      if (!formatDateTimes(seconds, utc, options, &formatted))
+         return false;
+      for (std::size_t i = 0; i < seconds.size(); i++)
+      {
+         if (ISNAN(seconds[i]))
+            pCells->push_back(SPECIAL_CELL_NA);
+         else
+            pCells->push_back(formatted[i]);
+      }
+      return true;
+   }
+
+   return false;
+}
+
+// summarizes the columns of a frame natively; returns false if they can't be
+bool summarizeFrame(SEXP dataSEXP, std::vector<ColumnSummary>* pSummaries)
+{
+   if (TYPEOF(dataSEXP) != VECSXP)
+      return false;
+
+   r::sexp::Protect protect;
+   int ncol = Rf_length(dataSEXP);
+   std::vector<GridColumn> columns(ncol);
+   for (int i = 0; i < ncol; i++)
+   {
+      if (!extractGridColumn(VECTOR_ELT(dataSEXP, i), GridNeedsValues,
+                             &protect, &columns[i]))
+      {
+         return false;
+      }
+   }
+
+   try
+   {
+      *pSummaries = summarizeColumns(columns, MAX_TOP_LEVELS);
+      return true;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return false;
+}
+
+// adds native summaries to the description of a frame's columns (completing
+// the histograms of numeric columns)
+void addColumnSummaries(const std::vector<ColumnSummary>& summaries,
+                        json::Array* pCols)
+{
+   // (the first column describes the row names)
+   for (std::size_t i = 0; i < summaries.size() && i + 1 < pCols->size(); i++)
+   {
+      if (!json::isType<json::Object>((*pCols)[i + 1]))
+         continue;
+      json::Object& col = (*pCols)[i + 1].get_obj();
+      const ColumnSummary& summary = summaries[i];
+
+      col["col_na_count"] = static_cast<boost::uint64_t>(summary.naCount);
+      col["col_distinct"] = static_cast<boost::uint64_t>(summary.distinct);
+      if (!summary.topLevels.empty())
+      {
+         json::Array topLevels;
+         for (std::size_t j = 0; j < summary.topLevels.size(); j++)
+         {
+            json::Array level;
+            level.push_back(summary.topLevels[j].first);
+            level.push_back(static_cast<boost::uint64_t>(summary.topLevels[j].second));
+            topLevels.push_back(level);
+         }
+         col["col_top_levels"] = topLevels;
+      }
+
+      if (!json::isType<std::string>(col["col_type"]) ||
+          col["col_type"].get_str() != "numeric")
+      {
+         continue;
+      }
+
+      // as .rs.describeCols, numeric columns need more than one finite
+      // value to be filtered on
+      if (summary.breaks.empty())
+      {
+         col["col_type"] = "unknown";
+         col["col_search_type"] = "";
+         continue;
+      }
+
+      col["col_min"] = summary.min;
+      col["col_max"] = summary.max;
+
+      // breaks are sent as R's as.character() gives them
+      CellFormatOptions options;
+      options.digits = 15;
+      json::Array breaks;
+      std::vector<std::string> text;
+      for (std::size_t j = 0; j < summary.breaks.size(); j++)
+      {
+         formatNumbers(std::vector<double>(1, summary.breaks[j]), options, &text);
+         breaks.push_back(text[0]);
+      }
+      json::Array counts;
+      for (std::size_t j = 0; j < summary.counts.size(); j++)
+         counts.push_back(static_cast<boost::uint64_t>(summary.counts[j]));
+      col["col_breaks"] = breaks;
+      col["col_counts"] = counts;
+   }
+}
+
+json::Value getCols(SEXP dataSEXP, const std::string& cacheKey)
 {
+   // the description is kept until the object changes
+   std::map<std::string, CachedFrame>::iterator cachedFrame =
+      s_cachedFrames.find(cacheKey);
+   if (cachedFrame != s_cachedFrames.end() &&
+       !cachedFrame->second.cols.is_null())
+   {
+      return cachedFrame->second.cols;
+   }
+
+   // summarize the columns natively if we can; otherwise R computes the
+   // histograms
+   std::vector<ColumnSummary> summaries;
+   bool summarized = summarizeFrame(dataSEXP, &summaries);
+
    SEXP colsSEXP = R_NilValue;
    r::sexp::Protect protect;
    json::Value result;
-   Error error = r::exec::RFunction(".rs.describeCols", dataSEXP, MAX_FACTORS)
+   Error error = r::exec::RFunction(".rs.describeCols", dataSEXP, MAX_FACTORS,
+                                    !summarized)
       .call(&colsSEXP, &protect);
    if (error || colsSEXP == R_NilValue) 
    {
@@ -461,6 +1044,10 @@ json::Value getCols(SEXP dataSEXP)
    else 
    {
       r::json::jsonValueFromList(colsSEXP, &result);
+      if (summarized && json::isType<json::Array>(result))
+         addColumnSummaries(summaries, &result.get_array());
+      if (cachedFrame != s_cachedFrames.end())
+         cachedFrame->second.cols = result;
    }
    return result;
 }
@@ -521,6 +1108,20 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
    bool needsTransform = ordercol > 0 || hasFilter || !search.empty();
    bool hasTransform = false;
 
+   // sort, filter and search natively if we can
+   boost::shared_ptr<const GridRows> pRows;
+   if (needsTransform)
+   {
+      GridTransform transform;
+      transform.filters = filters;
+      transform.search = search;
+      transform.orderCol = ordercol;
+      transform.descending = orderdir == "desc";
+      pRows = indexRows(dataSEXP, cacheKey, nrow, transform);
+      if (pRows)
+         needsTransform = false;
+   }
+
    // check to see if we have an ordered/filtered view we can build from
    std::map<std::string, CachedFrame>::iterator cachedFrame = 
       s_cachedFrames.find(cacheKey);
@@ -592,9 +1193,12 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
    }
 
    // apply new row count if we've transformed the data (or need to)
-   filteredNRow = needsTransform || hasTransform ?
-      safeDim(dataSEXP, DIM_ROWS) : 
-      nrow;
+   if (pRows)
+      filteredNRow = static_cast<int>(pRows->size());
+   else
+      filteredNRow = needsTransform || hasTransform ?
+         safeDim(dataSEXP, DIM_ROWS) : 
+         nrow;
 
    // return the lesser of the rows available and rows requested
    length = std::min(length, filteredNRow - start);
@@ -602,92 +1206,113 @@ json::Value getData(SEXP dataSEXP, const http::Fields& fields)
    // DataTables uses 0-based indexing, but R uses 1-based indexing
    start++;
 
-   // extract the portion of the column vector requested by the client
-   int numFormattedColumns = ncol - columnOffset < maxColumns ? ncol - columnOffset : maxColumns;
-   SEXP formattedDataSEXP = Rf_allocVector(VECSXP, numFormattedColumns);
-   protect.add(formattedDataSEXP);
+   // the (0-based) rows to show
+   std::vector<int> pageRows;
+   for (int i = 0; i < length; i++)
+      pageRows.push_back(pRows ? (*pRows)[start - 1 + i] : start - 1 + i);
 
-   int initialIndex = 0 + columnOffset;
-   for (int i = initialIndex; i < initialIndex + numFormattedColumns; i++)
+   // the (1-based) rows to show, if we're reading through an index (needed
+   // for columns R formats)
+   SEXP rowsSEXP = R_NilValue;
+   if (pRows)
    {
-      SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-      if (columnSEXP == NULL || TYPEOF(columnSEXP) == NILSXP ||
-          Rf_isNull(columnSEXP))
-      {
-         throw r::exec::RErrorException("No data in column " +
-               boost::lexical_cast<std::string>(i));
-      }
-      SEXP formattedColumnSEXP;
-      r::exec::RFunction formatFx(".rs.formatDataColumn");
-      formatFx.addParam(columnSEXP);
-      formatFx.addParam(static_cast<int>(start));
-      formatFx.addParam(static_cast<int>(length));
-      error = formatFx.call(&formattedColumnSEXP, &protect);
-      if (error)
-         throw r::exec::RErrorException(error.summary());
-      SET_VECTOR_ELT(formattedDataSEXP, i - initialIndex, formattedColumnSEXP);
+      rowsSEXP = Rf_allocVector(INTSXP, pageRows.size());
+      protect.add(rowsSEXP);
+      for (std::size_t i = 0; i < pageRows.size(); i++)
+         INTEGER(rowsSEXP)[i] = pageRows[i] + 1;
    }
 
-   // format the row names
-   SEXP rownamesSEXP;
-   r::exec::RFunction(".rs.formatRowNames", dataSEXP, start, length)
-      .call(&rownamesSEXP, &protect);
-   
-   // create the result grid as JSON
-   json::Array data;
-   for (int row = 0; row < length; row++)
+   // create the result grid as JSON, starting with the row names
+   std::vector<json::Array> rowData(pageRows.size());
+   if (!formatRowNameCells(dataSEXP, pageRows, start, &rowData))
    {
-      json::Array rowData;
-      if (rownamesSEXP != NULL &&
-          TYPEOF(rownamesSEXP) != NILSXP &&
-          !Rf_isNull(rownamesSEXP) )
+      SEXP rownamesSEXP;
+      r::exec::RFunction formatRowNames(".rs.formatRowNames");
+      formatRowNames.addParam(dataSEXP);
+      formatRowNames.addParam(start);
+      formatRowNames.addParam(length);
+      formatRowNames.addParam("rows", rowsSEXP);
+      formatRowNames.call(&rownamesSEXP, &protect);
+
+      for (int row = 0; row < length; row++)
       {
-         SEXP nameSEXP = STRING_ELT(rownamesSEXP, row);
-         if (nameSEXP != NULL &&
-             nameSEXP != NA_STRING &&
-             r::sexp::length(nameSEXP) > 0)
+         if (rownamesSEXP != NULL &&
+             TYPEOF(rownamesSEXP) != NILSXP &&
+             !Rf_isNull(rownamesSEXP) )
          {
-            rowData.push_back(Rf_translateCharUTF8(nameSEXP));
+            SEXP nameSEXP = STRING_ELT(rownamesSEXP, row);
+            if (nameSEXP != NULL &&
+                nameSEXP != NA_STRING &&
+                r::sexp::length(nameSEXP) > 0)
+            {
+               rowData[row].push_back(Rf_translateCharUTF8(nameSEXP));
+            }
+            else
+            {
+               rowData[row].push_back(row + start);
+            }
          }
          else
          {
-            rowData.push_back(row + start);
+            rowData[row].push_back(row + start);
          }
       }
-      else
+   }
+
+   // format the portion of the column vector requested by the client
+   int numFormattedColumns = ncol - columnOffset < maxColumns ? ncol - columnOffset : maxColumns;
+   CellFormatOptions formatOptions = cellFormatOptions();
+   json::Array cells;
+
+   int initialIndex = 0 + columnOffset;
+   for (int i = initialIndex; i < initialIndex + numFormattedColumns; i++)
+   {
+      SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
+      if (columnSEXP == NULL || TYPEOF(columnSEXP) == NILSXP ||
+          Rf_isNull(columnSEXP))
       {
-         rowData.push_back(row + start);
+         throw r::exec::RErrorException("No data in column " +
+               boost::lexical_cast<std::string>(i));
       }
 
-      for (int col = 0; col<Rf_length(formattedDataSEXP); col++)
+      // format natively where we can, and in R otherwise (e.g. for lists
+      // and S4 objects)
+      if (!formatColumnCells(columnSEXP, pageRows, formatOptions, &cells))
       {
-         SEXP columnSEXP = VECTOR_ELT(formattedDataSEXP, col);
-         if (columnSEXP != NULL &&
-             TYPEOF(columnSEXP) != NILSXP &&
-             !Rf_isNull(columnSEXP))
+         SEXP formattedColumnSEXP;
+         r::exec::RFunction formatFx(".rs.formatDataColumn");
+         formatFx.addParam(columnSEXP);
+         formatFx.addParam(static_cast<int>(start));
+         formatFx.addParam(static_cast<int>(length));
+         formatFx.addParam("rows", rowsSEXP);
+         error = formatFx.call(&formattedColumnSEXP, &protect);
+         if (error)
+            throw r::exec::RErrorException(error.summary());
+
+         cells.clear();
+         for (int row = 0; row < length; row++)
          {
-            SEXP stringSEXP = STRING_ELT(columnSEXP, row);
-            if (stringSEXP != NULL &&
-                stringSEXP != NA_STRING &&
-                r::sexp::length(stringSEXP) > 0)
-            {
-               rowData.push_back(Rf_translateCharUTF8(stringSEXP));
-            }
-            else if (stringSEXP == NA_STRING)
+            if (formattedColumnSEXP != NULL &&
+                TYPEOF(formattedColumnSEXP) != NILSXP &&
+                !Rf_isNull(formattedColumnSEXP))
             {
-               rowData.push_back(SPECIAL_CELL_NA);
+               cells.push_back(stringCell(STRING_ELT(formattedColumnSEXP, row)));
             }
             else
             {
-               rowData.push_back("");
+               cells.push_back("");
             }
          }
-         else
-         {
-            rowData.push_back("");
-         }
       }
-      data.push_back(rowData);
+
+      for (std::size_t row = 0; row < rowData.size(); row++)
+         rowData[row].push_back(cells[row]);
+   }
+
+   json::Array data;
+   BOOST_FOREACH(const json::Array& row, rowData)
+   {
+      data.push_back(row);
    }
 
    json::Object result;
@@ -704,6 +1329,9 @@ Error getGridData(const http::Request& request,
    json::Value result;
    http::status::Code status = http::status::Ok;
 
+   // whether the client asked for the page in the columnar encoding
+   bool columnar = false;
+
    try
    {
       // find the data frame we're going to be pulling data from
@@ -763,11 +1391,13 @@ Error getGridData(const http::Request& request,
          }
          if (show == "cols")
          {
-            result = getCols(dataSEXP);
+            result = getCols(dataSEXP, cacheKey);
          }
          else if (show == "data")
          {
             result = getData(dataSEXP, fields);
+            columnar = http::util::fieldValue<std::string>(
+                     fields, kGridFormatField, "") == kGridFormatColumnar;
          }
       }
    }
@@ -782,6 +1412,28 @@ Error getGridData(const http::Request& request,
    }
    CATCH_UNEXPECTED_EXCEPTION
 
+   // encode pages column-major if requested (errors are always JSON)
+   if (columnar && status == http::status::Ok &&
+       json::isType<json::Object>(result))
+   {
+      std::string encoded;
+      Error error = encodeColumnarGrid(result.get_obj(), SPECIAL_CELL_NA,
+                                       &encoded);
+      if (!error)
+      {
+         pResponse->setNoCacheHeaders();
+         pResponse->setStatusCode(status);
+         pResponse->setContentType(kColumnarGridContentType);
+         if (request.acceptsEncoding(http::kGzipEncoding))
+            pResponse->setContentEncoding(http::kGzipEncoding);
+         pResponse->setBody(encoded);
+         return Success();
+      }
+
+      // fall back to JSON
+      LOG_ERROR(error);
+   }
+
    std::ostringstream ostr;
    json::write(result, ostr);
 
@@ -818,6 +1470,9 @@ Error removeCacheKey(const std::string& cacheKey)
       s_cachedFrames.find(cacheKey);
    if (pos != s_cachedFrames.end())
       s_cachedFrames.erase(pos);
+
+   // discard row indexes
+   s_frameIndexes.erase(cacheKey);
    
    // remove cache env object and backing file
    return r::exec::RFunction(".rs.removeCachedData", cacheKey, 
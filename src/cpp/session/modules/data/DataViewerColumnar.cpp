@@ -0,0 +1,193 @@
+/*
+ * DataViewerColumnar.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DataViewerColumnar.hpp"
+
+#include <map>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <core/Error.hpp>
+#include <core/SafeConvert.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+const char * const kGridFormatField = "format";
+const char * const kGridFormatColumnar = "columnar";
+const char * const kColumnarGridContentType = "application/x-rstudio-grid";
+
+namespace {
+
+const char kMagic[] = "RSG1";
+
+void appendInteger(boost::uint32_t value, std::string* pEncoded)
+{
+   for (int i = 0; i < 4; i++)
+      pEncoded->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+void appendVarint(boost::uint32_t value, std::string* pEncoded)
+{
+   while (value >= 0x80)
+   {
+      pEncoded->push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+   }
+   pEncoded->push_back(static_cast<char>(value));
+}
+
+Error readCount(const json::Object& page, const char* name, boost::uint32_t* pCount)
+{
+   json::Object::const_iterator it = page.find(name);
+   if (it == page.end() || !json::isType<int>(it->second) ||
+       it->second.get_int() < 0)
+   {
+      return systemError(boost::system::errc::invalid_argument,
+                         std::string("Invalid grid page count: ") + name,
+                         ERROR_LOCATION);
+   }
+
+   *pCount = static_cast<boost::uint32_t>(it->second.get_int());
+   return Success();
+}
+
+// a column of the page: its distinct text (in order of appearance), and a
+// code per row
+struct Column
+{
+   std::vector<const std::string*> dictionary;
+   std::map<std::string, boost::uint32_t> codes;
+   std::vector<boost::uint32_t> cells;
+
+   void add(const std::string& text)
+   {
+      std::map<std::string, boost::uint32_t>::iterator it = codes.find(text);
+      if (it == codes.end())
+      {
+         dictionary.push_back(NULL);
+         it = codes.insert(std::make_pair(
+                  text, static_cast<boost::uint32_t>(dictionary.size()))).first;
+         dictionary.back() = &it->first;
+      }
+      cells.push_back(it->second);
+   }
+
+   void addNA()
+   {
+      cells.push_back(0);
+   }
+};
+
+} // anonymous namespace
+
+Error encodeColumnarGrid(const json::Object& page,
+                         int naCell,
+                         std::string* pEncoded)
+{
+   boost::uint32_t draw, recordsTotal, recordsFiltered;
+   Error error = readCount(page, "draw", &draw);
+   if (!error)
+      error = readCount(page, "recordsTotal", &recordsTotal);
+   if (!error)
+      error = readCount(page, "recordsFiltered", &recordsFiltered);
+   if (error)
+      return error;
+
+   json::Object::const_iterator dataIt = page.find("data");
+   if (dataIt == page.end() || !json::isType<json::Array>(dataIt->second))
+   {
+      return systemError(boost::system::errc::invalid_argument,
+                         "Grid page has no data",
+                         ERROR_LOCATION);
+   }
+
+   // transpose the rows into columns
+   const json::Array& rows = dataIt->second.get_array();
+   std::vector<Column> columns;
+   for (std::size_t row = 0; row < rows.size(); row++)
+   {
+      if (!json::isType<json::Array>(rows[row]))
+      {
+         return systemError(boost::system::errc::invalid_argument,
+                            "Grid page row is not an array",
+                            ERROR_LOCATION);
+      }
+
+      const json::Array& cells = rows[row].get_array();
+      if (row == 0)
+         columns.resize(cells.size());
+      else if (cells.size() != columns.size())
+      {
+         return systemError(boost::system::errc::invalid_argument,
+                            "Grid page rows differ in length",
+                            ERROR_LOCATION);
+      }
+
+      for (std::size_t col = 0; col < cells.size(); col++)
+      {
+         const json::Value& cell = cells[col];
+         if (json::isType<std::string>(cell))
+            columns[col].add(cell.get_str());
+         else if (json::isType<int>(cell) && cell.get_int() == naCell)
+            columns[col].addNA();
+         else if (json::isType<int>(cell))
+            columns[col].add(safe_convert::numberToString(cell.get_int()));
+         else if (cell.type() == json::RealType)
+            columns[col].add(safe_convert::numberToString(cell.get_real()));
+         else
+            columns[col].addNA();
+      }
+   }
+
+   pEncoded->clear();
+   pEncoded->append(kMagic, 4);
+   appendInteger(draw, pEncoded);
+   appendInteger(recordsTotal, pEncoded);
+   appendInteger(recordsFiltered, pEncoded);
+   appendInteger(static_cast<boost::uint32_t>(rows.size()), pEncoded);
+   appendInteger(static_cast<boost::uint32_t>(columns.size()), pEncoded);
+
+   for (std::vector<Column>::const_iterator it = columns.begin();
+        it != columns.end();
+        ++it)
+   {
+      appendVarint(static_cast<boost::uint32_t>(it->dictionary.size()),
+                   pEncoded);
+      for (std::size_t i = 0; i < it->dictionary.size(); i++)
+      {
+         const std::string& text = *it->dictionary[i];
+         appendVarint(static_cast<boost::uint32_t>(text.size()), pEncoded);
+         pEncoded->append(text);
+      }
+
+      for (std::size_t i = 0; i < it->cells.size(); i++)
+         appendVarint(it->cells[i], pEncoded);
+   }
+
+   return Success();
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,67 @@
+/*
+ * DataViewerColumnar.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_DATA_VIEWER_COLUMNAR_HPP
+#define SESSION_DATA_VIEWER_COLUMNAR_HPP
+
+#include <string>
+
+#include <core/json/Json.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+// the grid_data request field with which a client asks for pages in the
+// columnar encoding (rather than JSON), and the content type of such pages
+extern const char * const kGridFormatField;
+extern const char * const kGridFormatColumnar;
+extern const char * const kColumnarGridContentType;
+
+// encode a page of grid data, as produced for DataTables (an object with
+// draw, recordsTotal and recordsFiltered counts, and the page's rows as
+// arrays of cells), column-major. the page begins with a header of unsigned
+// 32-bit little endian integers:
+//
+//    "RSG1" draw recordsTotal recordsFiltered rows columns
+//
+// followed by each column (the row names first), in which all numbers are
+// unsigned LEB128 varints:
+//
+//    dictionarySize (length bytes)...    the column's distinct cell text
+//    code...                             a code per row
+//
+// code 0 marks an NA cell, and other codes the (1-based) dictionary entry
+// holding the cell's text. integer cells other than naCell are encoded as
+// their decimal text
+core::Error encodeColumnarGrid(const core::json::Object& page,
+                               int naCell,
+                               std::string* pEncoded);
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_DATA_VIEWER_COLUMNAR_HPP
@@ -0,0 +1,214 @@
+/*
+ * DataViewerColumnarTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "DataViewerColumnar.hpp"
+
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/Error.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+using namespace core;
+
+namespace {
+
+const int kNaCell = 0;
+const char* const kNA = "<NA>";
+
+// reads an encoded page back (as the client does), with NA cells as kNA
+class Reader
+{
+public:
+   explicit Reader(const std::string& encoded)
+      : encoded_(encoded), pos_(4)
+   {
+      draw = read();
+      recordsTotal = read();
+      recordsFiltered = read();
+      boost::uint32_t rows = read();
+      boost::uint32_t columns = read();
+
+      cells.resize(columns);
+      for (boost::uint32_t col = 0; col < columns; col++)
+      {
+         std::vector<std::string> dictionary(readVarint());
+         for (std::size_t i = 0; i < dictionary.size(); i++)
+         {
+            boost::uint32_t length = readVarint();
+            dictionary[i] = encoded_.substr(pos_, length);
+            pos_ += length;
+         }
+
+         for (boost::uint32_t row = 0; row < rows; row++)
+         {
+            boost::uint32_t code = readVarint();
+            cells[col].push_back(code == 0 ? kNA : dictionary.at(code - 1));
+         }
+      }
+      complete = pos_ == encoded_.size();
+   }
+
+   boost::uint32_t draw, recordsTotal, recordsFiltered;
+   std::vector<std::vector<std::string> > cells;
+   bool complete;
+
+private:
+   unsigned char byte()
+   {
+      return static_cast<unsigned char>(encoded_.at(pos_++));
+   }
+
+   boost::uint32_t read()
+   {
+      boost::uint32_t value = 0;
+      for (int i = 0; i < 4; i++)
+         value |= static_cast<boost::uint32_t>(byte()) << (8 * i);
+      return value;
+   }
+
+   boost::uint32_t readVarint()
+   {
+      boost::uint32_t value = 0;
+      for (int shift = 0; ; shift += 7)
+      {
+         unsigned char next = byte();
+         value |= static_cast<boost::uint32_t>(next & 0x7F) << shift;
+         if (!(next & 0x80))
+            return value;
+      }
+   }
+
+   const std::string& encoded_;
+   std::size_t pos_;
+};
+
+json::Object page(const json::Array& data)
+{
+   json::Object result;
+   result["draw"] = 3;
+   result["recordsTotal"] = 100;
+   result["recordsFiltered"] = 40;
+   result["data"] = data;
+   return result;
+}
+
+json::Array row(const json::Value& name,
+                const json::Value& a,
+                const json::Value& b)
+{
+   json::Array result;
+   result.push_back(name);
+   result.push_back(a);
+   result.push_back(b);
+   return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Data Viewer Columnar Encoding")
+{
+   SECTION("Pages are encoded column-major with per-column dictionaries")
+   {
+      json::Array data;
+      data.push_back(row(1, "setosa", "5.1"));
+      data.push_back(row(2, "setosa", kNaCell));
+      data.push_back(row("row \"3\"", "virginica", "5.1"));
+
+      std::string encoded;
+      REQUIRE_FALSE(encodeColumnarGrid(page(data), kNaCell, &encoded));
+      REQUIRE(encoded.substr(0, 4) == "RSG1");
+
+      Reader reader(encoded);
+      CHECK(reader.complete);
+      CHECK(reader.draw == 3);
+      CHECK(reader.recordsTotal == 100);
+      CHECK(reader.recordsFiltered == 40);
+      REQUIRE(reader.cells.size() == 3);
+      CHECK(reader.cells[0][0] == "1");
+      CHECK(reader.cells[0][2] == "row \"3\"");
+      CHECK(reader.cells[1][1] == "setosa");
+      CHECK(reader.cells[1][2] == "virginica");
+      CHECK(reader.cells[2][0] == "5.1");
+      CHECK(reader.cells[2][1] == kNA);
+      CHECK(reader.cells[2][2] == "5.1");
+   }
+
+   SECTION("Repeated text is encoded once")
+   {
+      json::Array data;
+      for (int i = 0; i < 500; i++)
+         data.push_back(row(i + 1, "a repeated factor level", i % 2 ? "odd" : "even"));
+
+      std::string encoded;
+      REQUIRE_FALSE(encodeColumnarGrid(page(data), kNaCell, &encoded));
+
+      std::ostringstream json;
+      json::write(page(data), json);
+      CHECK(encoded.size() * 2 < json.str().size());
+
+      Reader reader(encoded);
+      CHECK(reader.complete);
+      CHECK(reader.cells[2][499] == "odd");
+   }
+
+   SECTION("Columns may have many distinct values")
+   {
+      json::Array data;
+      for (int i = 0; i < 300; i++)
+         data.push_back(row(i + 1, boost::lexical_cast<std::string>(i), kNaCell));
+
+      std::string encoded;
+      REQUIRE_FALSE(encodeColumnarGrid(page(data), kNaCell, &encoded));
+      Reader reader(encoded);
+      CHECK(reader.complete);
+      CHECK(reader.cells[1][299] == "299");
+      CHECK(reader.cells[2][299] == kNA);
+   }
+
+   SECTION("Empty pages and malformed pages")
+   {
+      std::string encoded;
+      REQUIRE_FALSE(encodeColumnarGrid(page(json::Array()), kNaCell, &encoded));
+      Reader reader(encoded);
+      CHECK(reader.complete);
+      CHECK(reader.cells.empty());
+
+      json::Array data;
+      data.push_back(row(1, "a", "b"));
+      data.push_back(json::Array(2, "c"));
+      CHECK(encodeColumnarGrid(page(data), kNaCell, &encoded));
+
+      json::Object error;
+      error["error"] = "The object no longer exists.";
+      CHECK(encodeColumnarGrid(error, kNaCell, &encoded));
+   }
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,374 @@
+/*
+ * DataViewerFormat.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DataViewerFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <limits>
+#include <stdexcept>
+
+#include <boost/date_time/c_time.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+namespace {
+
+// the largest power of ten R's formatting computes directly
+const int kMaxPower = 27;
+
+// the range of times we format: the years 1400 to 9999 (beyond which R's
+// formatting of years differs, and the time functions may not cope)
+const double kMinSeconds = -17987443200.0;
+const double kMaxSeconds = 253402300799.0;
+
+// the smallest power of ten for which a scaling factor can be computed
+// directly
+const int kMinExponent = -308;
+
+struct PowersOfTen
+{
+   PowersOfTen()
+   {
+      long double power = 1;
+      for (int i = 0; i <= kMaxPower; i++, power *= 10)
+         powers[i] = power;
+   }
+
+   long double powers[kMaxPower + 1];
+};
+
+long double tenTo(int power)
+{
+   // exact for the powers used most
+   static const PowersOfTen s_powersOfTen;
+   if (power >= 0 && power <= kMaxPower)
+      return s_powersOfTen.powers[power];
+   return std::pow(10.0L, power);
+}
+
+// the significant digits of a (finite) number, as R's scientific() in
+// format.c: its sign, the power of ten of its leading digit, the number of
+// significant digits (at most `digits`) needed to show it, and whether
+// rounding it to those digits carries it to the next power of ten
+struct Significance
+{
+   bool negative;
+   int power;
+   int digits;
+   bool roundingWidens;
+};
+
+Significance significance(double value, int digits)
+{
+   Significance result;
+   result.negative = false;
+   result.power = 0;
+   result.digits = 1;
+   result.roundingWidens = false;
+   if (value == 0)
+      return result;
+
+   double alpha = value;
+   if (value < 0)
+   {
+      result.negative = true;
+      alpha = -value;
+   }
+
+   // scale to `digits` digits left of the point
+   int kp = static_cast<int>(std::floor(std::log10(alpha))) - digits + 1;
+   long double scaled = alpha;
+   if (kp <= kMinExponent)
+      scaled = (alpha * 1e+303) / tenTo(kp + 303);
+   else if (kp > 0)
+      scaled /= tenTo(kp);
+   else if (kp < 0)
+      scaled *= tenTo(-kp);
+   if (scaled < tenTo(digits - 1))
+   {
+      scaled *= 10;
+      kp--;
+   }
+
+   // drop the trailing zeroes of the rounded digits
+   double rounded = static_cast<double>(std::nearbyint(scaled));
+   result.digits = digits;
+   for (int i = 1; i <= digits; i++)
+   {
+      rounded /= 10;
+      if (rounded == std::floor(rounded))
+         result.digits--;
+      else
+         break;
+   }
+   if (result.digits == 0 && digits > 0)
+   {
+      result.digits = 1;
+      kp++;
+   }
+   result.power = kp + digits - 1;
+
+   int right = std::max(0, std::min(kMaxPower, digits - result.power));
+   long double fuzz = 0.5L / tenTo(right);
+   result.roundingWidens = result.power > 0 &&
+                           result.power <= kMaxPower &&
+                           alpha < tenTo(result.power) - fuzz;
+   return result;
+}
+
+std::string formatNonFinite(double value)
+{
+   if (std::isnan(value))
+      return "NaN";
+   return value > 0 ? "Inf" : "-Inf";
+}
+
+// a broken down time
+struct CivilTime
+{
+   int year, month, day, hour, minute;
+   double second;
+};
+
+// the civil date of a number of days since the epoch
+void civilFromDays(long long days, CivilTime* pTime)
+{
+   days += 719468;
+   long long era = (days >= 0 ? days : days - 146096) / 146097;
+   long long dayOfEra = days - era * 146097;
+   long long yearOfEra =
+         (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+   long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+   long long monthIndex = (5 * dayOfYear + 2) / 153;
+   pTime->day = static_cast<int>(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+   pTime->month = static_cast<int>(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+   pTime->year = static_cast<int>(yearOfEra + era * 400 + (pTime->month <= 2));
+}
+
+bool civilFromSeconds(double seconds, bool utc, CivilTime* pTime)
+{
+   double whole = std::floor(seconds);
+   std::time_t time = static_cast<std::time_t>(whole);
+
+   std::tm tm;
+   try
+   {
+      if (utc)
+         boost::date_time::c_time::gmtime(&time, &tm);
+      else
+         boost::date_time::c_time::localtime(&time, &tm);
+   }
+   catch (const std::runtime_error&)
+   {
+      return false;
+   }
+
+   pTime->year = tm.tm_year + 1900;
+   pTime->month = tm.tm_mon + 1;
+   pTime->day = tm.tm_mday;
+   pTime->hour = tm.tm_hour;
+   pTime->minute = tm.tm_min;
+   pTime->second = tm.tm_sec + (seconds - whole);
+   return true;
+}
+
+std::string formatCivilDate(const CivilTime& time)
+{
+   char buffer[32];
+   std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d",
+                 time.year, time.month, time.day);
+   return buffer;
+}
+
+} // anonymous namespace
+
+void formatNumbers(const std::vector<double>& values,
+                   const CellFormatOptions& options,
+                   std::vector<std::string>* pCells)
+{
+   // R's formatReal(): find the widest fixed notation needed to show the
+   // significant digits of every number, and compare it with scientific
+   // notation showing the most significant digits any number needs
+   int digits = std::max(1, std::min(options.digits, 15));
+   bool negative = false;
+   int maxRight = std::numeric_limits<int>::min();
+   int maxLeft = std::numeric_limits<int>::min();
+   int minLeft = std::numeric_limits<int>::max();
+   int maxSignedLeft = std::numeric_limits<int>::min();
+   int maxDigits = std::numeric_limits<int>::min();
+   for (std::size_t i = 0; i < values.size(); i++)
+   {
+      if (!std::isfinite(values[i]))
+         continue;
+
+      Significance sig = significance(values[i], digits);
+      int left = sig.power + 1;
+      if (sig.roundingWidens)
+         left--;
+      int signedLeft = sig.negative + (left <= 0 ? 1 : left);
+      int right = sig.digits - left;
+      if (sig.negative)
+         negative = true;
+
+      maxRight = std::max(maxRight, right);
+      maxLeft = std::max(maxLeft, left);
+      minLeft = std::min(minLeft, left);
+      maxSignedLeft = std::max(maxSignedLeft, signedLeft);
+      maxDigits = std::max(maxDigits, sig.digits);
+   }
+
+   bool scientific = false;
+   int decimals = 0;
+   if (maxDigits != std::numeric_limits<int>::min())
+   {
+      if (maxLeft < 0)
+         maxSignedLeft = 1 + negative;
+      if (maxRight < 0)
+         maxRight = 0;
+      int fixedWidth = maxSignedLeft + maxRight + (maxRight != 0);
+
+      int exponentDigits = (maxLeft > 100 || minLeft <= -99) ? 2 : 1;
+      decimals = maxDigits - 1;
+      int scientificWidth =
+            negative + (decimals > 0) + decimals + 4 + exponentDigits;
+      if (fixedWidth <= scientificWidth + options.scipen)
+         decimals = maxRight;
+      else
+         scientific = true;
+   }
+
+   pCells->clear();
+   pCells->reserve(values.size());
+   char buffer[512];
+   for (std::size_t i = 0; i < values.size(); i++)
+   {
+      double value = values[i];
+      if (!std::isfinite(value))
+      {
+         pCells->push_back(formatNonFinite(value));
+         continue;
+      }
+
+      std::snprintf(buffer, sizeof(buffer), scientific ? "%.*e" : "%.*f",
+                    decimals, value);
+      pCells->push_back(buffer);
+   }
+}
+
+bool formatDate(double days, std::string* pCell)
+{
+   if (!std::isfinite(days) ||
+       days * 86400 < kMinSeconds || days * 86400 > kMaxSeconds)
+   {
+      return false;
+   }
+
+   CivilTime time;
+   civilFromDays(static_cast<long long>(std::floor(days)), &time);
+   *pCell = formatCivilDate(time);
+   return true;
+}
+
+bool formatDateTimes(const std::vector<double>& seconds,
+                     bool utc,
+                     const CellFormatOptions& options,
+                     std::vector<std::string>* pCells)
+{
+   std::vector<CivilTime> times(seconds.size());
+   bool allMidnight = true;
+   for (std::size_t i = 0; i < seconds.size(); i++)
+   {
+      if (std::isnan(seconds[i]))
+         continue;
+      if (seconds[i] < kMinSeconds || seconds[i] > kMaxSeconds ||
+          !civilFromSeconds(seconds[i], utc, &times[i]))
+      {
+         return false;
+      }
+
+      if (times[i].hour != 0 || times[i].minute != 0 || times[i].second != 0)
+         allMidnight = false;
+   }
+
+   // as format.POSIXlt(), show the fewest decimal places (up to digits.secs)
+   // that represent every time's seconds
+   int secondDigits = std::max(0, std::min(6, options.digitsSecs));
+   for (int places = 0; places < secondDigits; places++)
+   {
+      bool represented = true;
+      for (std::size_t i = 0; i < seconds.size() && represented; i++)
+      {
+         if (std::isnan(seconds[i]))
+            continue;
+         double scale = std::pow(10.0, places);
+         double second = times[i].second;
+         if (std::fabs(second - std::floor(second * scale + 0.5) / scale) >= 1e-6)
+            represented = false;
+      }
+      if (represented)
+      {
+         secondDigits = places;
+         break;
+      }
+   }
+
+   pCells->clear();
+   pCells->reserve(seconds.size());
+   char buffer[64];
+   for (std::size_t i = 0; i < seconds.size(); i++)
+   {
+      if (std::isnan(seconds[i]))
+      {
+         pCells->push_back(std::string());
+         continue;
+      }
+
+      const CivilTime& time = times[i];
+      std::string cell = formatCivilDate(time);
+      if (!allMidnight)
+      {
+         std::snprintf(buffer, sizeof(buffer), " %02d:%02d:%02d",
+                       time.hour, time.minute,
+                       static_cast<int>(std::floor(time.second)));
+         cell.append(buffer);
+
+         // fractional seconds are truncated (as %OSn does)
+         if (secondDigits > 0)
+         {
+            double scale = std::pow(10.0, secondDigits);
+            double fraction = time.second - std::floor(time.second);
+            std::snprintf(buffer, sizeof(buffer), ".%0*d", secondDigits,
+                          static_cast<int>(std::floor(fraction * scale + 1e-6)));
+            cell.append(buffer);
+         }
+      }
+      pCells->push_back(cell);
+   }
+
+   return true;
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,71 @@
+/*
+ * DataViewerFormat.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_DATA_VIEWER_FORMAT_HPP
+#define SESSION_DATA_VIEWER_FORMAT_HPP
+
+#include <string>
+#include <vector>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+// the R options which govern how cells are formatted
+struct CellFormatOptions
+{
+   CellFormatOptions()
+      : digits(7), scipen(0), digitsSecs(0)
+   {
+   }
+
+   int digits;       // getOption("digits")
+   int scipen;       // getOption("scipen")
+   int digitsSecs;   // getOption("digits.secs")
+};
+
+// format the numbers in a page of cells as R's format() does: all of the
+// numbers share the same (fixed or scientific) notation and number of
+// decimal places, chosen so that each shows its significant digits.
+// non-finite numbers are formatted as "NaN", "Inf" and "-Inf"; callers
+// should substitute NA themselves
+void formatNumbers(const std::vector<double>& values,
+                   const CellFormatOptions& options,
+                   std::vector<std::string>* pCells);
+
+// format a Date (days since the epoch) as "%Y-%m-%d". returns false if the
+// date is outside the range we can format
+bool formatDate(double days, std::string* pCell);
+
+// format a page of POSIXct values (seconds since the epoch) as R's format()
+// does: dates alone if every time is midnight, otherwise dates and times
+// (with fractional seconds, up to options.digitsSecs places, if needed).
+// values are shown in UTC or in the local time zone. NaN values are left
+// empty (callers should substitute NA). returns false if any time is
+// outside the range we can format
+bool formatDateTimes(const std::vector<double>& seconds,
+                     bool utc,
+                     const CellFormatOptions& options,
+                     std::vector<std::string>* pCells);
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_DATA_VIEWER_FORMAT_HPP
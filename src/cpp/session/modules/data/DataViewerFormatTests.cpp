@@ -0,0 +1,193 @@
+/*
+ * DataViewerFormatTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "DataViewerFormat.hpp"
+
+#include <cmath>
+
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+namespace {
+
+std::vector<std::string> numbers(const std::vector<double>& values,
+                                 int digits = 7,
+                                 int scipen = 0)
+{
+   CellFormatOptions options;
+   options.digits = digits;
+   options.scipen = scipen;
+   std::vector<std::string> cells;
+   formatNumbers(values, options, &cells);
+   return cells;
+}
+
+std::vector<double> values(double a)
+{
+   return std::vector<double>(1, a);
+}
+
+std::vector<double> values(double a, double b)
+{
+   std::vector<double> result;
+   result.push_back(a);
+   result.push_back(b);
+   return result;
+}
+
+std::vector<double> values(double a, double b, double c)
+{
+   std::vector<double> result = values(a, b);
+   result.push_back(c);
+   return result;
+}
+
+std::vector<std::string> cells(const char* a, const char* b)
+{
+   std::vector<std::string> result;
+   result.push_back(a);
+   result.push_back(b);
+   return result;
+}
+
+std::vector<std::string> cells(const char* a, const char* b, const char* c)
+{
+   std::vector<std::string> result = cells(a, b);
+   result.push_back(c);
+   return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Data Viewer Format")
+{
+   SECTION("Numbers share the notation and decimals R's format() gives them")
+   {
+      CHECK(numbers(values(1, 2, 3)) == cells("1", "2", "3"));
+      CHECK(numbers(values(1, 2.5, 10)) == cells("1.0", "2.5", "10.0"));
+      CHECK(numbers(values(3.14159265)) == std::vector<std::string>(1, "3.141593"));
+      CHECK(numbers(values(0.1 + 0.2)) == std::vector<std::string>(1, "0.3"));
+      CHECK(numbers(values(123456789)) == std::vector<std::string>(1, "123456789"));
+      CHECK(numbers(values(1234567.1)) == std::vector<std::string>(1, "1234567"));
+      CHECK(numbers(values(0.0001234)) == std::vector<std::string>(1, "0.0001234"));
+      CHECK(numbers(values(-0.5, 0.25)) == cells("-0.50", "0.25"));
+      CHECK(numbers(values(9.9999999)) == std::vector<std::string>(1, "10"));
+   }
+
+   SECTION("Numbers switch to scientific notation when it's narrower")
+   {
+      CHECK(numbers(values(100000)) == std::vector<std::string>(1, "1e+05"));
+      CHECK(numbers(values(123456)) == std::vector<std::string>(1, "123456"));
+      CHECK(numbers(values(1e-20)) == std::vector<std::string>(1, "1e-20"));
+      CHECK(numbers(values(1e10, 1)) == cells("1e+10", "1e+00"));
+      CHECK(numbers(values(1.5e10, 1)) == cells("1.5e+10", "1.0e+00"));
+
+      // ... unless penalized by scipen
+      CHECK(numbers(values(100000), 7, 100) == std::vector<std::string>(1, "100000"));
+   }
+
+   SECTION("Numbers are shown to the requested significant digits")
+   {
+      CHECK(numbers(values(3.14159265), 3) == std::vector<std::string>(1, "3.14"));
+      CHECK(numbers(values(2.5, 1234.5678), 3) == cells("2.5", "1234.6"));
+   }
+
+   SECTION("Non-finite numbers don't affect the format of the others")
+   {
+      CHECK(numbers(values(-1.5, std::nan(""), INFINITY)) ==
+            cells("-1.5", "NaN", "Inf"));
+      CHECK(numbers(values(-INFINITY, 2)) == cells("-Inf", "2"));
+   }
+
+   SECTION("Dates are shown as %Y-%m-%d")
+   {
+      std::string cell;
+      REQUIRE(formatDate(0, &cell));
+      CHECK(cell == "1970-01-01");
+      REQUIRE(formatDate(18262, &cell));
+      CHECK(cell == "2020-01-01");
+      REQUIRE(formatDate(-1, &cell));
+      CHECK(cell == "1969-12-31");
+      REQUIRE(formatDate(11016.75, &cell));
+      CHECK(cell == "2000-02-29");
+      CHECK_FALSE(formatDate(1e9, &cell));
+      CHECK_FALSE(formatDate(std::nan(""), &cell));
+   }
+
+   SECTION("Date-times show their times unless all are midnight")
+   {
+      CellFormatOptions options;
+      std::vector<std::string> result;
+      REQUIRE(formatDateTimes(values(0, 86400), true, options, &result));
+      CHECK(result == cells("1970-01-01", "1970-01-02"));
+
+      REQUIRE(formatDateTimes(values(0, 3661.5, std::nan("")), true,
+                              options, &result));
+      CHECK(result == cells("1970-01-01 00:00:00", "1970-01-01 01:01:01", ""));
+
+      // fractional seconds are shown to the fewest places (up to digits.secs)
+      // that show every time
+      options.digitsSecs = 3;
+      REQUIRE(formatDateTimes(values(0, 3661.5), true, options, &result));
+      CHECK(result == cells("1970-01-01 00:00:00.0", "1970-01-01 01:01:01.5"));
+      REQUIRE(formatDateTimes(values(0.25, 60), true, options, &result));
+      CHECK(result == cells("1970-01-01 00:00:00.25", "1970-01-01 00:01:00.00"));
+
+      CHECK_FALSE(formatDateTimes(values(1e15), true, options, &result));
+   }
+}
+
+TEST_CASE("Data Viewer Format Benchmark", "[.benchmark]")
+{
+   // a page of a wide frame: 200 columns of 100 rows
+   const int kColumns = 200;
+   const int kRows = 100;
+   std::vector<std::vector<double> > columns(kColumns);
+   for (int column = 0; column < kColumns; column++)
+   {
+      for (int row = 0; row < kRows; row++)
+         columns[column].push_back((row * 2654435761u % 100003) / (column + 7.0));
+   }
+
+   CellFormatOptions options;
+   std::vector<std::string> result;
+   std::size_t formatted = 0;
+   {
+      core::PerformanceTimer timer("format 100 pages of 200 numeric columns");
+      for (int page = 0; page < 100; page++)
+      {
+         for (int column = 0; column < kColumns; column++)
+         {
+            formatNumbers(columns[column], options, &result);
+            formatted += result.size();
+         }
+      }
+   }
+   CHECK(formatted == 100u * kColumns * kRows);
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,804 @@
+/*
+ * DataViewerIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DataViewerIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <core/Error.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules { 
+namespace data {
+namespace viewer {
+
+namespace {
+
+// grids smaller than this are transformed on the calling thread alone
+const std::size_t kParallelRows = 64 * 1024;
+
+enum FilterKind
+{
+   FilterNone,          // no filter (or one which R ignores)
+   FilterUnsupported,   // a filter which must be applied in R
+   FilterFactor,
+   FilterCharacter,
+   FilterNumeric,
+   FilterBoolean
+};
+
+// a column filter, parsed as .rs.applyTransform parses it
+struct ColumnFilter
+{
+   ColumnFilter() : kind(FilterNone), lower(0), upper(0), isRange(false) {}
+
+   FilterKind kind;
+   std::string text;    // (lower case for character filters)
+   double lower;
+   double upper;
+   bool isRange;
+};
+
+bool isAscii(const std::string& text)
+{
+   for (std::size_t i = 0; i < text.size(); i++)
+   {
+      if (static_cast<unsigned char>(text[i]) > 127)
+         return false;
+   }
+   return true;
+}
+
+std::string toLowerAscii(const std::string& text)
+{
+   std::string lower(text);
+   for (std::size_t i = 0; i < lower.size(); i++)
+   {
+      if (lower[i] >= 'A' && lower[i] <= 'Z')
+         lower[i] = lower[i] - 'A' + 'a';
+   }
+   return lower;
+}
+
+char toLowerAscii(char c)
+{
+   return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// case insensitive (for ASCII characters) search for a lower case needle; as
+// non-ASCII needles are searched for in R, this matches what R does for
+// UTF-8 text (and for text in any other ASCII-compatible encoding)
+bool containsIgnoreCase(const char* haystack, const std::string& needle)
+{
+   if (haystack == NULL)
+      return false;
+   if (needle.empty())
+      return true;
+
+   for (const char* pStart = haystack; *pStart; pStart++)
+   {
+      std::size_t i = 0;
+      while (i < needle.size() && pStart[i] &&
+             toLowerAscii(pStart[i]) == needle[i])
+      {
+         i++;
+      }
+      if (i == needle.size())
+         return true;
+   }
+   return false;
+}
+
+bool parseNumber(const std::string& text, double* pValue)
+{
+   if (text.empty())
+      return false;
+
+   char* pEnd = NULL;
+   *pValue = std::strtod(text.c_str(), &pEnd);
+   return *pEnd == '\0' && !std::isnan(*pValue);
+}
+
+ColumnFilter parseFilter(const std::string& filter)
+{
+   ColumnFilter result;
+
+   // (filters without a type are skipped)
+   std::size_t pipe = filter.find('|');
+   if (filter.empty() || pipe == std::string::npos)
+      return result;
+
+   std::string type = filter.substr(0, pipe);
+   std::string value = filter.substr(pipe + 1);
+   value = value.substr(0, value.find('|'));
+   if (!isAscii(value))
+   {
+      result.kind = FilterUnsupported;
+      return result;
+   }
+
+   if (type == "factor")
+   {
+      result.kind = parseNumber(value, &result.lower) ?
+                       FilterFactor : FilterUnsupported;
+   }
+   else if (type == "character")
+   {
+      result.kind = FilterCharacter;
+      result.text = toLowerAscii(value);
+   }
+   else if (type == "numeric")
+   {
+      // either a range ("2_32") or a single value
+      std::size_t separator = value.find('_');
+      result.isRange = separator != std::string::npos;
+      bool parsed = result.isRange ?
+         parseNumber(value.substr(0, separator), &result.lower) &&
+         parseNumber(value.substr(separator + 1).substr(
+                        0, value.find('_', separator + 1) - separator - 1),
+                     &result.upper) :
+         parseNumber(value, &result.lower);
+      result.kind = parsed ? FilterNumeric : FilterUnsupported;
+   }
+   else if (type == "boolean")
+   {
+      result.kind = FilterBoolean;
+      result.text = value == "TRUE" ? "TRUE" : "FALSE";
+   }
+   return result;
+}
+
+bool hasText(const GridColumn& column)
+{
+   switch (column.type)
+   {
+   case GridColumnString:
+   case GridColumnFactor:
+   case GridColumnInteger:
+   case GridColumnLogical:
+      return true;
+   default:
+      return !column.strings.empty();
+   }
+}
+
+bool canFilter(const GridColumn& column, const ColumnFilter& filter)
+{
+   switch (filter.kind)
+   {
+   case FilterNone:
+      return true;
+   case FilterFactor:
+   case FilterNumeric:
+      return column.type == GridColumnInteger ||
+             column.type == GridColumnLogical ||
+             column.type == GridColumnReal ||
+             (filter.kind == FilterFactor && column.type == GridColumnFactor);
+   case FilterBoolean:
+      return column.type != GridColumnOther;
+   case FilterCharacter:
+      return hasText(column);
+   default:
+      return false;
+   }
+}
+
+bool isNA(const GridColumn& column, int row)
+{
+   switch (column.type)
+   {
+   case GridColumnInteger:
+   case GridColumnLogical:
+   case GridColumnFactor:
+      return column.pInts[row] == kGridNaInteger;
+   case GridColumnReal:
+      return std::isnan(column.pReals[row]);
+   case GridColumnString:
+      return column.strings[row] == NULL;
+   default:
+      return true;
+   }
+}
+
+double numericValue(const GridColumn& column, int row)
+{
+   return column.type == GridColumnReal ?
+            column.pReals[row] :
+            static_cast<double>(column.pInts[row]);
+}
+
+// matches a column's text (its values, as R would convert them to text)
+class TextMatcher
+{
+public:
+   TextMatcher(const GridColumn& column, const std::string& needle)
+      : column_(column), needle_(needle)
+   {
+      // each factor level is matched only once
+      if (column.type == GridColumnFactor && column.strings.empty())
+      {
+         for (std::size_t i = 0; i < column.levels.size(); i++)
+            levelMatches_.push_back(containsIgnoreCase(column.levels[i], needle));
+      }
+   }
+
+   bool operator()(int row) const
+   {
+      if (!column_.strings.empty())
+         return containsIgnoreCase(column_.strings[row], needle_);
+
+      switch (column_.type)
+      {
+      case GridColumnFactor:
+      {
+         int code = column_.pInts[row];
+         return code != kGridNaInteger && code >= 1 &&
+                code <= static_cast<int>(levelMatches_.size()) &&
+                levelMatches_[code - 1];
+      }
+      case GridColumnInteger:
+      {
+         if (column_.pInts[row] == kGridNaInteger)
+            return false;
+         char buffer[16];
+         std::snprintf(buffer, sizeof(buffer), "%d", column_.pInts[row]);
+         return containsIgnoreCase(buffer, needle_);
+      }
+      case GridColumnLogical:
+      {
+         int value = column_.pInts[row];
+         if (value == kGridNaInteger)
+            return false;
+         return containsIgnoreCase(value ? "TRUE" : "FALSE", needle_);
+      }
+      default:
+         return false;
+      }
+   }
+
+private:
+   const GridColumn& column_;
+   std::string needle_;
+   std::vector<bool> levelMatches_;
+};
+
+// matches a column filter (as .rs.applyTransform would)
+class FilterMatcher
+{
+public:
+   FilterMatcher(const GridColumn& column, const ColumnFilter& filter)
+      : column_(column), filter_(filter), text_(column, filter.text)
+   {
+   }
+
+   bool operator()(int row) const
+   {
+      switch (filter_.kind)
+      {
+      case FilterFactor:
+         return !isNA(column_, row) &&
+                numericValue(column_, row) == filter_.lower;
+
+      case FilterNumeric:
+      {
+         if (isNA(column_, row))
+            return false;
+         double value = numericValue(column_, row);
+         if (std::isinf(value))
+            return false;
+         return filter_.isRange ?
+                  value >= filter_.lower && value <= filter_.upper :
+                  value == filter_.lower;
+      }
+
+      case FilterBoolean:
+      {
+         // (compared as R compares a logical with each type)
+         if (isNA(column_, row))
+            return false;
+         else if (column_.type == GridColumnString)
+            return filter_.text == column_.strings[row];
+         else if (column_.type == GridColumnFactor)
+            return column_.pInts[row] >= 1 &&
+                   column_.pInts[row] <= static_cast<int>(column_.levels.size()) &&
+                   filter_.text == column_.levels[column_.pInts[row] - 1];
+         else
+            return numericValue(column_, row) == (filter_.text == "TRUE" ? 1 : 0);
+      }
+
+      case FilterCharacter:
+         return text_(row);
+
+      default:
+         return true;
+      }
+   }
+
+private:
+   const GridColumn& column_;
+   ColumnFilter filter_;
+   TextMatcher text_;
+};
+
+// matches rows which match all column filters
+class AllFilters
+{
+public:
+   explicit AllFilters(const std::vector<FilterMatcher>& filters)
+      : filters_(filters)
+   {
+   }
+
+   bool operator()(int row) const
+   {
+      for (std::size_t i = 0; i < filters_.size(); i++)
+      {
+         if (!filters_[i](row))
+            return false;
+      }
+      return true;
+   }
+
+private:
+   const std::vector<FilterMatcher>& filters_;
+};
+
+// matches rows with text in any column which matches a search
+class AnyText
+{
+public:
+   explicit AnyText(const std::vector<TextMatcher>& matchers)
+      : matchers_(matchers)
+   {
+   }
+
+   bool operator()(int row) const
+   {
+      for (std::size_t i = 0; i < matchers_.size(); i++)
+      {
+         if (matchers_[i](row))
+            return true;
+      }
+      return false;
+   }
+
+private:
+   const std::vector<TextMatcher>& matchers_;
+};
+
+template <typename Predicate>
+void filterChunk(const GridRows& rows,
+                 const Predicate& predicate,
+                 std::vector<GridRows>* pChunkRows,
+                 std::size_t chunk,
+                 std::size_t begin,
+                 std::size_t end)
+{
+   GridRows& chunkRows = (*pChunkRows)[chunk];
+   for (std::size_t i = begin; i < end; i++)
+   {
+      if (predicate(rows[i]))
+         chunkRows.push_back(rows[i]);
+   }
+}
+
+template <typename Predicate>
+void filterRows(const Predicate& predicate, GridRows* pRows)
+{
+   std::size_t chunks = gridChunkCount(pRows->size());
+   std::vector<GridRows> chunkRows(std::max<std::size_t>(chunks, 1));
+   forEachGridChunk(pRows->size(), chunks,
+                boost::bind(filterChunk<Predicate>, boost::cref(*pRows),
+                            boost::cref(predicate), &chunkRows, _1, _2, _3));
+
+   pRows->clear();
+   for (std::size_t i = 0; i < chunkRows.size(); i++)
+      pRows->insert(pRows->end(), chunkRows[i].begin(), chunkRows[i].end());
+}
+
+// orders rows on the values of a column (with ties in their original
+// order, as R's order() has them in both directions)
+template <typename T>
+class KeyOrder
+{
+public:
+   explicit KeyOrder(bool descending) : descending_(descending) {}
+
+   bool operator()(const std::pair<T, int>& lhs,
+                   const std::pair<T, int>& rhs) const
+   {
+      if (lhs.first < rhs.first)
+         return !descending_;
+      else if (rhs.first < lhs.first)
+         return descending_;
+      else
+         return lhs.second < rhs.second;
+   }
+
+private:
+   bool descending_;
+};
+
+// orders rows on the values of a character column
+class StringOrder
+{
+public:
+   StringOrder(const GridColumn& column, bool descending)
+      : column_(column), descending_(descending)
+   {
+   }
+
+   bool operator()(int lhs, int rhs) const
+   {
+      int result = std::strcoll(column_.strings[lhs], column_.strings[rhs]);
+      if (result == 0)
+         return lhs < rhs;
+      return descending_ ? result > 0 : result < 0;
+   }
+
+private:
+   const GridColumn& column_;
+   bool descending_;
+};
+
+template <typename T, typename Order>
+void sortChunk(std::vector<T>* pItems,
+               const Order& order,
+               std::size_t,
+               std::size_t begin,
+               std::size_t end)
+{
+   std::sort(pItems->begin() + begin, pItems->begin() + end, order);
+}
+
+template <typename T, typename Order>
+void mergeChunks(std::vector<T>* pItems,
+                 const Order& order,
+                 std::size_t width,
+                 std::size_t,
+                 std::size_t begin,
+                 std::size_t end)
+{
+   // merge each pair of adjacent (sorted) runs of the given width
+   for (std::size_t i = begin; i < end; i++)
+   {
+      std::size_t first = i * 2 * width;
+      std::size_t middle = std::min(pItems->size(), first + width);
+      std::size_t last = std::min(pItems->size(), first + 2 * width);
+      std::inplace_merge(pItems->begin() + first,
+                         pItems->begin() + middle,
+                         pItems->begin() + last,
+                         order);
+   }
+}
+
+// sort in parallel: sort chunks, then merge pairs of them until done (the
+// orders are total, so the result doesn't depend on the chunking)
+template <typename T, typename Order>
+void parallelSort(const Order& order, std::vector<T>* pItems)
+{
+   std::size_t chunks = gridChunkCount(pItems->size());
+   forEachGridChunk(pItems->size(), chunks,
+                boost::bind(sortChunk<T, Order>, pItems, boost::cref(order),
+                            _1, _2, _3));
+   if (chunks <= 1)
+      return;
+
+   std::size_t width = (pItems->size() + chunks - 1) / chunks;
+   while (width < pItems->size())
+   {
+      std::size_t pairs = (pItems->size() + 2 * width - 1) / (2 * width);
+      forEachGridChunk(pairs, std::min(pairs, chunks),
+                   boost::bind(mergeChunks<T, Order>, pItems,
+                               boost::cref(order), width, _1, _2, _3));
+      width *= 2;
+   }
+}
+
+// sort rows on the values of a numeric column. the values are copied
+// alongside the rows, so the sort doesn't chase them through memory
+template <typename T>
+void sortOnValues(const T* pValues, bool descending, GridRows* pRows)
+{
+   std::vector<std::pair<T, int> > keyed(pRows->size());
+   for (std::size_t i = 0; i < pRows->size(); i++)
+      keyed[i] = std::make_pair(pValues[(*pRows)[i]], (*pRows)[i]);
+
+   parallelSort(KeyOrder<T>(descending), &keyed);
+
+   for (std::size_t i = 0; i < keyed.size(); i++)
+      (*pRows)[i] = keyed[i].second;
+}
+
+// sort rows as R's order() does, with NAs last (in their original order)
+void sortRows(const GridColumn* pColumn, bool descending, GridRows* pRows)
+{
+   if (pColumn == NULL)
+   {
+      parallelSort(std::less<int>(), pRows);
+      return;
+   }
+
+   GridRows::iterator naBegin = std::stable_partition(
+            pRows->begin(), pRows->end(),
+            !boost::bind(isNA, boost::cref(*pColumn), _1));
+   GridRows naRows(naBegin, pRows->end());
+   pRows->erase(naBegin, pRows->end());
+
+   switch (pColumn->type)
+   {
+   case GridColumnReal:
+      sortOnValues(pColumn->pReals, descending, pRows);
+      break;
+   case GridColumnString:
+      parallelSort(StringOrder(*pColumn, descending), pRows);
+      break;
+   default:
+      sortOnValues(pColumn->pInts, descending, pRows);
+      break;
+   }
+
+   std::sort(naRows.begin(), naRows.end());
+   pRows->insert(pRows->end(), naRows.begin(), naRows.end());
+}
+
+} // anonymous namespace
+
+std::size_t gridChunkCount(std::size_t rows)
+{
+   if (rows < kParallelRows)
+      return 1;
+   std::size_t threads = std::max(1u, boost::thread::hardware_concurrency());
+   return std::min(threads, rows / (kParallelRows / 2));
+}
+
+namespace {
+
+// the chunks of a forEachGridChunk call. chunks are claimed in turn by the
+// calling thread and by worker threads, so they all run even if no worker
+// is free (or the work was never queued)
+class GridChunks : boost::noncopyable
+{
+public:
+   GridChunks(
+      std::size_t count,
+      std::size_t chunks,
+      const boost::function<void(std::size_t, std::size_t, std::size_t)>& fn)
+      : count_(count),
+        chunks_(chunks),
+        chunkSize_((count + chunks - 1) / chunks),
+        fn_(fn),
+        next_(0),
+        completed_(0)
+   {
+   }
+
+   // run chunks until none remain to be claimed
+   void run()
+   {
+      for (;;)
+      {
+         std::size_t chunk;
+         {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (next_ == chunks_)
+               return;
+            chunk = next_++;
+         }
+
+         std::size_t begin = std::min(count_, chunk * chunkSize_);
+         std::size_t end = std::min(count_, begin + chunkSize_);
+         std::exception_ptr pException;
+         try
+         {
+            fn_(chunk, begin, end);
+         }
+         catch(...)
+         {
+            pException = std::current_exception();
+         }
+
+         {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (pException && !pException_)
+               pException_ = pException;
+            completed_++;
+         }
+         completedChanged_.notify_all();
+      }
+   }
+
+   // wait for the chunks claimed by workers to complete, then rethrow the
+   // first exception any chunk threw
+   void wait()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (completed_ < chunks_)
+         completedChanged_.wait(lock);
+
+      if (pException_)
+         std::rethrow_exception(pException_);
+   }
+
+private:
+   const std::size_t count_;
+   const std::size_t chunks_;
+   const std::size_t chunkSize_;
+   boost::function<void(std::size_t, std::size_t, std::size_t)> fn_;
+
+   boost::mutex mutex_;
+   boost::condition_variable completedChanged_;
+   std::size_t next_;
+   std::size_t completed_;
+   std::exception_ptr pException_;
+};
+
+} // anonymous namespace
+
+void forEachGridChunk(
+      std::size_t count,
+      std::size_t chunks,
+      const boost::function<void(std::size_t, std::size_t, std::size_t)>& fn)
+{
+   if (chunks <= 1)
+   {
+      fn(0, 0, count);
+      return;
+   }
+
+   // workers run chunks alongside this thread (if they can't be given
+   // any, this thread runs the chunks itself)
+   boost::shared_ptr<GridChunks> pChunks(new GridChunks(count, chunks, fn));
+   try
+   {
+      for (std::size_t i = 1; i < chunks; i++)
+      {
+         module_context::workerThreadPool().enque(
+                                 boost::bind(&GridChunks::run, pChunks));
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   pChunks->run();
+   pChunks->wait();
+}
+
+int gridColumnNeeds(const GridTransform& transform, std::size_t column)
+{
+   int needs = GridNeedsNothing;
+   if (!transform.search.empty())
+      needs |= GridNeedsText;
+   if (transform.orderCol > 0 &&
+       static_cast<std::size_t>(transform.orderCol) == column + 1)
+   {
+      needs |= GridNeedsValues;
+   }
+   if (column < transform.filters.size())
+   {
+      ColumnFilter filter = parseFilter(transform.filters[column]);
+      if (filter.kind == FilterCharacter)
+         needs |= GridNeedsText;
+      else if (filter.kind != FilterNone)
+         needs |= GridNeedsValues;
+   }
+   return needs;
+}
+
+bool canTransformGrid(const std::vector<GridColumn>& columns,
+                      const GridTransform& transform)
+{
+   // searches of non-ASCII text are left to R (which knows how to fold its
+   // case)
+   if (!transform.search.empty())
+   {
+      if (!isAscii(transform.search))
+         return false;
+      for (std::size_t i = 0; i < columns.size(); i++)
+      {
+         if (!hasText(columns[i]))
+            return false;
+      }
+   }
+
+   for (std::size_t i = 0; i < transform.filters.size(); i++)
+   {
+      ColumnFilter filter = parseFilter(transform.filters[i]);
+      if (filter.kind == FilterNone)
+         continue;
+      if (i >= columns.size() || !canFilter(columns[i], filter))
+         return false;
+   }
+
+   if (transform.orderCol > 0)
+   {
+      std::size_t col = transform.orderCol - 1;
+      if (col >= columns.size() || columns[col].type == GridColumnOther)
+         return false;
+   }
+
+   return true;
+}
+
+boost::shared_ptr<GridRows> transformGrid(
+      const std::vector<GridColumn>& columns,
+      std::size_t nrow,
+      const GridTransform& transform,
+      const GridRows* pBaseRows)
+{
+   boost::shared_ptr<GridRows> pRows(new GridRows());
+   GridRows& rows = *pRows;
+   if (pBaseRows != NULL)
+   {
+      rows = *pBaseRows;
+   }
+   else
+   {
+      rows.resize(nrow);
+      for (std::size_t i = 0; i < nrow; i++)
+         rows[i] = static_cast<int>(i);
+   }
+
+   // apply column filters (to non-empty columns)
+   std::vector<FilterMatcher> filters;
+   for (std::size_t i = 0; i < transform.filters.size() && i < columns.size(); i++)
+   {
+      ColumnFilter filter = parseFilter(transform.filters[i]);
+      if (filter.kind != FilterNone && columns[i].length > 0)
+         filters.push_back(FilterMatcher(columns[i], filter));
+   }
+   if (!filters.empty())
+      filterRows(AllFilters(filters), &rows);
+
+   // apply global search (across all columns)
+   if (!transform.search.empty())
+   {
+      std::string needle = toLowerAscii(transform.search);
+      std::vector<TextMatcher> matchers;
+      for (std::size_t i = 0; i < columns.size(); i++)
+         matchers.push_back(TextMatcher(columns[i], needle));
+      filterRows(AnyText(matchers), &rows);
+   }
+
+   // apply sort (rows refined from another transform's are restored to
+   // their original order if there's no sort)
+   const GridColumn* pOrderColumn = NULL;
+   if (transform.orderCol > 0 &&
+       columns[transform.orderCol - 1].length > 0)
+   {
+      pOrderColumn = &columns[transform.orderCol - 1];
+   }
+   if (pOrderColumn != NULL || pBaseRows != NULL)
+      sortRows(pOrderColumn, transform.descending, &rows);
+
+   return pRows;
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,136 @@
+/*
+ * DataViewerIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_DATA_VIEWER_INDEX_HPP
+#define SESSION_DATA_VIEWER_INDEX_HPP
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules { 
+namespace data {
+namespace viewer {
+
+// R's integer (and logical) NA
+const int kGridNaInteger = std::numeric_limits<int>::min();
+
+enum GridColumnType
+{
+   GridColumnOther,     // can only be searched (via its text)
+   GridColumnInteger,
+   GridColumnLogical,
+   GridColumnReal,
+   GridColumnString,
+   GridColumnFactor
+};
+
+// read-only view of a column's data. columns are extracted from R on the
+// main thread, after which they can be sorted and filtered on any thread
+struct GridColumn
+{
+   GridColumn()
+      : type(GridColumnOther), length(0), pInts(NULL), pReals(NULL)
+   {
+   }
+
+   GridColumnType type;
+   std::size_t length;
+
+   // integer, logical and factor values (the latter 1-based level codes)
+   const int* pInts;
+
+   // real values
+   const double* pReals;
+
+   // factor levels
+   std::vector<const char*> levels;
+
+   // character values, or the text of other types of column when they're
+   // searched (NULL for NA). unused for columns whose text can be derived
+   // from their values (factors, integers and logicals)
+   std::vector<const char*> strings;
+};
+
+// the sort, column filters and global search applied to a grid. filters
+// are of the form "type|value", as sent by the client
+struct GridTransform
+{
+   GridTransform() : orderCol(0), descending(false) {}
+
+   bool operator==(const GridTransform& other) const
+   {
+      return filters == other.filters && search == other.search &&
+             orderCol == other.orderCol && descending == other.descending;
+   }
+
+   std::vector<std::string> filters;
+   std::string search;
+   int orderCol;        // 1-based (0 for no sort)
+   bool descending;
+};
+
+// what of a column a transform needs
+enum GridColumnNeeds
+{
+   GridNeedsNothing = 0,
+   GridNeedsValues  = 1,
+   GridNeedsText    = 2
+};
+
+int gridColumnNeeds(const GridTransform& transform, std::size_t column);
+
+// whether a transform can be applied natively to the (extracted) columns;
+// when it can't the transform must be applied in R
+bool canTransformGrid(const std::vector<GridColumn>& columns,
+                      const GridTransform& transform);
+
+// (0-based) indexes of the rows of a grid, in display order
+typedef std::vector<int> GridRows;
+
+// filter, search and then sort the rows of a grid. the rows may start from
+// those of a transform which this one refines (a transform whose results
+// are a superset of this one's), or all of the grid's rows (pBaseRows NULL)
+boost::shared_ptr<GridRows> transformGrid(
+      const std::vector<GridColumn>& columns,
+      std::size_t nrow,
+      const GridTransform& transform,
+      const GridRows* pBaseRows = NULL);
+
+// the number of chunks into which to divide work on the given number of rows
+// (1 when it isn't worth doing in parallel)
+std::size_t gridChunkCount(std::size_t rows);
+
+// run fn(chunk, begin, end) over the chunks of [0, count), in parallel on
+// the session's worker threads. an exception thrown by fn is rethrown on
+// the calling thread once all of the chunks have run
+void forEachGridChunk(
+      std::size_t count,
+      std::size_t chunks,
+      const boost::function<void(std::size_t, std::size_t, std::size_t)>& fn);
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_DATA_VIEWER_INDEX_HPP
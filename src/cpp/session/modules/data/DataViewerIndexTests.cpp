@@ -0,0 +1,282 @@
+/*
+ * DataViewerIndexTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "DataViewerIndex.hpp"
+
+#include <cmath>
+#include <new>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+namespace {
+
+const double kNaReal = std::nan("");
+
+// a frame with the columns: id (integer), price (real), name (character),
+// kind (factor) and flag (logical)
+class TestFrame
+{
+public:
+   TestFrame()
+   {
+      const char* names[] = { "eggs", "Bacon", NULL, "Egg noodles", "apples" };
+      int ids[] = { 3, 1, 4, kGridNaInteger, 2 };
+      double prices[] = { 2.5, kNaReal, 10, 2.5, INFINITY };
+      int kinds[] = { 1, 2, 1, kGridNaInteger, 3 };
+      int flags[] = { 1, 0, kGridNaInteger, 1, 0 };
+
+      ids_.assign(ids, ids + 5);
+      prices_.assign(prices, prices + 5);
+      kinds_.assign(kinds, kinds + 5);
+      flags_.assign(flags, flags + 5);
+
+      columns.resize(5);
+      columns[0].type = GridColumnInteger;
+      columns[0].pInts = &ids_[0];
+      columns[1].type = GridColumnReal;
+      columns[1].pReals = &prices_[0];
+      columns[2].type = GridColumnString;
+      columns[2].strings.assign(names, names + 5);
+      columns[3].type = GridColumnFactor;
+      columns[3].pInts = &kinds_[0];
+      columns[3].levels.push_back("Dairy");
+      columns[3].levels.push_back("Meat");
+      columns[3].levels.push_back("Fruit");
+      columns[4].type = GridColumnLogical;
+      columns[4].pInts = &flags_[0];
+      for (std::size_t i = 0; i < columns.size(); i++)
+         columns[i].length = 5;
+   }
+
+   std::vector<GridColumn> columns;
+
+private:
+   std::vector<int> ids_;
+   std::vector<double> prices_;
+   std::vector<int> kinds_;
+   std::vector<int> flags_;
+};
+
+GridTransform transform(int orderCol = 0, bool descending = false)
+{
+   GridTransform result;
+   result.filters.resize(5);
+   result.orderCol = orderCol;
+   result.descending = descending;
+   return result;
+}
+
+GridRows rows(int a, int b = -1, int c = -1, int d = -1, int e = -1)
+{
+   int values[] = { a, b, c, d, e };
+   GridRows result;
+   for (int i = 0; i < 5 && values[i] >= 0; i++)
+      result.push_back(values[i]);
+   return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Data Viewer Index")
+{
+   TestFrame frame;
+
+   SECTION("Rows are sorted as R orders them")
+   {
+      // NAs last in both directions, ties in their original order
+      CHECK(*transformGrid(frame.columns, 5, transform(1)) == rows(1, 4, 0, 2, 3));
+      CHECK(*transformGrid(frame.columns, 5, transform(1, true)) == rows(2, 0, 4, 1, 3));
+      CHECK(*transformGrid(frame.columns, 5, transform(2)) == rows(0, 3, 2, 4, 1));
+      CHECK(*transformGrid(frame.columns, 5, transform(2, true)) == rows(4, 2, 0, 3, 1));
+      CHECK(*transformGrid(frame.columns, 5, transform(4)) == rows(0, 2, 1, 4, 3));
+      CHECK(*transformGrid(frame.columns, 5, transform(5)) == rows(1, 4, 0, 3, 2));
+   }
+
+   SECTION("Column filters match those applied in R")
+   {
+      GridTransform filtered = transform();
+      filtered.filters[2] = "character|EGG";
+      CHECK(*transformGrid(frame.columns, 5, filtered) == rows(0, 3));
+
+      filtered = transform();
+      filtered.filters[1] = "numeric|2_10";
+      CHECK(*transformGrid(frame.columns, 5, filtered) == rows(0, 2, 3));
+
+      filtered.filters[1] = "numeric|2.5";
+      CHECK(*transformGrid(frame.columns, 5, filtered) == rows(0, 3));
+
+      filtered = transform();
+      filtered.filters[3] = "factor|1";
+      CHECK(*transformGrid(frame.columns, 5, filtered) == rows(0, 2));
+
+      filtered = transform();
+      filtered.filters[4] = "boolean|FALSE";
+      CHECK(*transformGrid(frame.columns, 5, filtered) == rows(1, 4));
+
+      // filters without a type are ignored
+      filtered = transform();
+      filtered.filters[0] = "3";
+      CHECK(canTransformGrid(frame.columns, filtered));
+      CHECK(transformGrid(frame.columns, 5, filtered)->size() == 5);
+   }
+
+   SECTION("Global searches match the text of every column")
+   {
+      GridTransform searched = transform(1);
+      searched.search = "e";
+      CHECK(*transformGrid(frame.columns, 5, searched) == rows(1, 4, 0, 3));
+
+      searched.search = "meat";
+      CHECK(*transformGrid(frame.columns, 5, searched) == rows(1));
+
+      searched.search = "true";
+      CHECK(*transformGrid(frame.columns, 5, searched) == rows(0, 3));
+
+      searched.search = "4";
+      CHECK(*transformGrid(frame.columns, 5, searched) == rows(2));
+
+      // (real columns are searched on the text R gives them)
+      searched.search = "2.5";
+      CHECK_FALSE(canTransformGrid(frame.columns, searched));
+   }
+
+   SECTION("Transforms are refined from a superset's rows")
+   {
+      GridTransform outer = transform(2, true);
+      outer.filters[2] = "character|e";
+      boost::shared_ptr<GridRows> pOuter = transformGrid(frame.columns, 5, outer);
+      CHECK(*pOuter == rows(4, 0, 3));
+
+      GridTransform inner = transform();
+      inner.filters[2] = "character|eg";
+      CHECK(*transformGrid(frame.columns, 5, inner, pOuter.get()) == rows(0, 3));
+   }
+
+   SECTION("Unsupported transforms are left to R")
+   {
+      GridTransform unsupported = transform();
+      unsupported.filters[2] = "numeric|1_2";
+      CHECK_FALSE(canTransformGrid(frame.columns, unsupported));
+
+      unsupported = transform();
+      unsupported.filters[2] = "character|\xc3\xa9";
+      CHECK_FALSE(canTransformGrid(frame.columns, unsupported));
+
+      unsupported = transform();
+      unsupported.search = "\xc3\xa9";
+      CHECK_FALSE(canTransformGrid(frame.columns, unsupported));
+   }
+}
+
+namespace {
+
+void countChunk(std::vector<std::size_t>* pCounts,
+                std::size_t chunk,
+                std::size_t begin,
+                std::size_t end)
+{
+   (*pCounts)[chunk] = end - begin;
+}
+
+void failChunk(std::size_t chunk, std::size_t begin, std::size_t end)
+{
+   if (chunk == 2)
+      throw std::bad_alloc();
+}
+
+} // anonymous namespace
+
+TEST_CASE("Data Viewer Grid Chunks")
+{
+   SECTION("Every chunk runs once")
+   {
+      std::vector<std::size_t> counts(8);
+      forEachGridChunk(1000, 8, boost::bind(countChunk, &counts, _1, _2, _3));
+
+      std::size_t total = 0;
+      for (std::size_t i = 0; i < counts.size(); i++)
+         total += counts[i];
+      CHECK(total == 1000);
+      CHECK(counts[0] == 125);
+   }
+
+   SECTION("Exceptions thrown by chunks are rethrown on the calling thread")
+   {
+      CHECK_THROWS_AS(forEachGridChunk(1000, 4, failChunk), std::bad_alloc);
+
+      // and the workers are left free for the next call
+      std::vector<std::size_t> counts(4);
+      forEachGridChunk(1000, 4, boost::bind(countChunk, &counts, _1, _2, _3));
+      CHECK(counts[3] == 250);
+   }
+}
+
+TEST_CASE("Data Viewer Index Benchmark", "[.benchmark]")
+{
+   const std::size_t kRows = 20 * 1000 * 1000;
+   std::vector<double> values(kRows);
+   std::vector<int> codes(kRows);
+   for (std::size_t i = 0; i < kRows; i++)
+   {
+      values[i] = static_cast<double>((i * 2654435761u) % 1000003) / 7;
+      codes[i] = static_cast<int>(i % 50) + 1;
+   }
+
+   std::vector<GridColumn> columns(2);
+   columns[0].type = GridColumnReal;
+   columns[0].length = kRows;
+   columns[0].pReals = &values[0];
+   columns[1].type = GridColumnFactor;
+   columns[1].length = kRows;
+   columns[1].pInts = &codes[0];
+   for (int i = 1; i <= 50; i++)
+      columns[1].levels.push_back(i % 2 ? "odd" : "even");
+
+   GridTransform sorted;
+   sorted.filters.resize(2);
+   sorted.orderCol = 1;
+   boost::shared_ptr<GridRows> pRows;
+   {
+      core::PerformanceTimer timer("sort 20M reals");
+      pRows = transformGrid(columns, kRows, sorted);
+   }
+   CHECK(pRows->size() == kRows);
+
+   GridTransform filtered = sorted;
+   filtered.filters[1] = "factor|7";
+   {
+      core::PerformanceTimer timer("filter sorted rows by factor");
+      pRows = transformGrid(columns, kRows, filtered, pRows.get());
+   }
+   CHECK(pRows->size() == kRows / 50);
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,572 @@
+/*
+ * DataViewerSummary.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DataViewerSummary.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+namespace {
+
+// distinct values are estimated with a HyperLogLog sketch of 2^12 registers
+// (a standard error of about 1.6%)
+const int kSketchBits = 12;
+const std::size_t kSketchSize = 1 << kSketchBits;
+
+boost::uint64_t mix(boost::uint64_t value)
+{
+   // splitmix64's finalizer
+   value += 0x9E3779B97F4A7C15ULL;
+   value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+   return value ^ (value >> 31);
+}
+
+boost::uint64_t hashReal(double value)
+{
+   // -0 and 0 are the same value
+   if (value == 0)
+      value = 0;
+   boost::uint64_t bits;
+   std::memcpy(&bits, &value, sizeof(bits));
+   return mix(bits);
+}
+
+boost::uint64_t hashString(const char* value)
+{
+   // FNV-1a
+   boost::uint64_t hash = 0xCBF29CE484222325ULL;
+   for (const unsigned char* p = reinterpret_cast<const unsigned char*>(value);
+        *p;
+        p++)
+   {
+      hash = (hash ^ *p) * 0x100000001B3ULL;
+   }
+   return mix(hash);
+}
+
+// statistics for a chunk of a column, which can be merged with those of the
+// column's other chunks
+struct ChunkStats
+{
+   ChunkStats()
+      : count(0), naCount(0), finiteCount(0),
+        min(std::numeric_limits<double>::infinity()),
+        max(-std::numeric_limits<double>::infinity())
+   {
+   }
+
+   void addHash(boost::uint64_t hash)
+   {
+      if (sketch.empty())
+         sketch.resize(kSketchSize);
+      std::size_t index = static_cast<std::size_t>(hash >> (64 - kSketchBits));
+      boost::uint64_t rest = (hash << kSketchBits) | (1ULL << (kSketchBits - 1));
+      unsigned char rank = 1;
+      while (!(rest & 0x8000000000000000ULL))
+      {
+         rest <<= 1;
+         rank++;
+      }
+      sketch[index] = std::max(sketch[index], rank);
+   }
+
+   void addFinite(double value)
+   {
+      finiteCount++;
+      min = std::min(min, value);
+      max = std::max(max, value);
+   }
+
+   void merge(const ChunkStats& other)
+   {
+      count += other.count;
+      naCount += other.naCount;
+      finiteCount += other.finiteCount;
+      min = std::min(min, other.min);
+      max = std::max(max, other.max);
+
+      if (sketch.empty())
+         sketch = other.sketch;
+      else if (!other.sketch.empty())
+      {
+         for (std::size_t i = 0; i < kSketchSize; i++)
+            sketch[i] = std::max(sketch[i], other.sketch[i]);
+      }
+
+      if (levelCounts.size() < other.levelCounts.size())
+         levelCounts.resize(other.levelCounts.size());
+      for (std::size_t i = 0; i < other.levelCounts.size(); i++)
+         levelCounts[i] += other.levelCounts[i];
+   }
+
+   std::size_t estimateDistinct() const
+   {
+      if (sketch.empty())
+         return 0;
+
+      double sum = 0;
+      std::size_t zeroes = 0;
+      for (std::size_t i = 0; i < kSketchSize; i++)
+      {
+         sum += std::ldexp(1.0, -sketch[i]);
+         if (sketch[i] == 0)
+            zeroes++;
+      }
+
+      double m = static_cast<double>(kSketchSize);
+      double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+      if (estimate <= 2.5 * m && zeroes > 0)
+      {
+         // linear counting is more accurate for small cardinalities
+         estimate = m * std::log(m / zeroes);
+      }
+
+      std::size_t distinct = static_cast<std::size_t>(estimate + 0.5);
+      return std::max<std::size_t>(1, std::min(distinct, count - naCount));
+   }
+
+   std::size_t count;
+   std::size_t naCount;
+   std::size_t finiteCount;
+   double min;
+   double max;
+   std::vector<unsigned char> sketch;
+   std::vector<std::size_t> levelCounts;
+};
+
+void summarizeChunk(const GridColumn& column,
+                    std::vector<ChunkStats>* pStats,
+                    std::size_t chunk,
+                    std::size_t begin,
+                    std::size_t end)
+{
+   ChunkStats& stats = (*pStats)[chunk];
+   stats.count = end - begin;
+   switch (column.type)
+   {
+   case GridColumnInteger:
+      for (std::size_t i = begin; i < end; i++)
+      {
+         int value = column.pInts[i];
+         if (value == kGridNaInteger)
+         {
+            stats.naCount++;
+            continue;
+         }
+         stats.addFinite(value);
+         stats.addHash(mix(static_cast<boost::uint64_t>(value)));
+      }
+      break;
+
+   case GridColumnReal:
+      for (std::size_t i = begin; i < end; i++)
+      {
+         double value = column.pReals[i];
+         if (std::isnan(value))
+         {
+            stats.naCount++;
+            continue;
+         }
+         if (std::isfinite(value))
+            stats.addFinite(value);
+         stats.addHash(hashReal(value));
+      }
+      break;
+
+   case GridColumnString:
+      for (std::size_t i = begin; i < end; i++)
+      {
+         const char* value = column.strings[i];
+         if (value == NULL)
+         {
+            stats.naCount++;
+            continue;
+         }
+         stats.addHash(hashString(value));
+      }
+      break;
+
+   case GridColumnFactor:
+   case GridColumnLogical:
+   {
+      // logicals are counted as the levels FALSE and TRUE
+      int levels = column.type == GridColumnFactor ?
+               static_cast<int>(column.levels.size()) : 2;
+      stats.levelCounts.resize(levels);
+      for (std::size_t i = begin; i < end; i++)
+      {
+         int value = column.pInts[i];
+         int level = column.type == GridColumnFactor ? value - 1 : value;
+         if (value == kGridNaInteger || level < 0 || level >= levels)
+            stats.naCount++;
+         else
+            stats.levelCounts[level]++;
+      }
+      break;
+   }
+
+   default:
+      break;
+   }
+}
+
+// R's C_BinCount (with right = TRUE, include.lowest = TRUE)
+void countChunk(const GridColumn& column,
+                const std::vector<double>& breaks,
+                std::vector<std::vector<std::size_t> >* pCounts,
+                std::size_t chunk,
+                std::size_t begin,
+                std::size_t end)
+{
+   std::vector<std::size_t>& counts = (*pCounts)[chunk];
+   counts.assign(breaks.size() - 1, 0);
+   std::size_t last = breaks.size() - 1;
+   for (std::size_t i = begin; i < end; i++)
+   {
+      double value;
+      if (column.type == GridColumnInteger)
+      {
+         if (column.pInts[i] == kGridNaInteger)
+            continue;
+         value = column.pInts[i];
+      }
+      else
+      {
+         value = column.pReals[i];
+         if (!std::isfinite(value))
+            continue;
+      }
+
+      if (breaks[0] <= value && value <= breaks[last])
+      {
+         std::size_t lo = 0;
+         std::size_t hi = last;
+         while (hi - lo >= 2)
+         {
+            std::size_t mid = (hi + lo) / 2;
+            if (value > breaks[mid])
+               lo = mid;
+            else
+               hi = mid;
+         }
+         counts[lo]++;
+      }
+   }
+}
+
+void histogram(const GridColumn& column, ColumnSummary* pSummary)
+{
+   // as hist(): Sturges' number of classes over pretty breaks
+   int classes = static_cast<int>(std::ceil(
+            std::log(static_cast<double>(pSummary->finiteCount)) / std::log(2.0) + 1));
+   pSummary->breaks = prettyBreaks(pSummary->min, pSummary->max, classes);
+   std::size_t nBreaks = pSummary->breaks.size();
+   if (nBreaks < 2)
+   {
+      pSummary->breaks.clear();
+      return;
+   }
+
+   // breaks are fuzzed so values on them fall into the lower class
+   std::vector<double> diffs;
+   for (std::size_t i = 1; i < nBreaks; i++)
+      diffs.push_back(pSummary->breaks[i] - pSummary->breaks[i - 1]);
+   double diddle;
+   if (nBreaks > 5)
+   {
+      std::vector<double> sorted = diffs;
+      std::sort(sorted.begin(), sorted.end());
+      std::size_t n = sorted.size();
+      diddle = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+   }
+   else if (nBreaks <= 3)
+   {
+      diddle = pSummary->max - pSummary->min;
+   }
+   else
+   {
+      diddle = std::numeric_limits<double>::infinity();
+      for (std::size_t i = 0; i < diffs.size(); i++)
+      {
+         if (diffs[i] > 0)
+            diddle = std::min(diddle, diffs[i]);
+      }
+   }
+   diddle *= 1e-7;
+
+   std::vector<double> fuzzyBreaks = pSummary->breaks;
+   fuzzyBreaks[0] -= diddle;
+   for (std::size_t i = 1; i < nBreaks; i++)
+      fuzzyBreaks[i] += diddle;
+
+   std::size_t chunks = gridChunkCount(column.length);
+   std::vector<std::vector<std::size_t> > chunkCounts(chunks);
+   forEachGridChunk(column.length, chunks,
+                    boost::bind(countChunk, boost::cref(column),
+                                boost::cref(fuzzyBreaks), &chunkCounts,
+                                _1, _2, _3));
+
+   pSummary->counts.assign(nBreaks - 1, 0);
+   for (std::size_t chunk = 0; chunk < chunks; chunk++)
+   {
+      for (std::size_t i = 0; i < nBreaks - 1; i++)
+         pSummary->counts[i] += chunkCounts[chunk][i];
+   }
+}
+
+bool moreFrequent(const std::pair<std::string, std::size_t>& a,
+                  const std::pair<std::string, std::size_t>& b)
+{
+   return a.second > b.second;
+}
+
+void summarizeColumn(const GridColumn& column,
+                     std::size_t maxTopLevels,
+                     ColumnSummary* pSummary)
+{
+   std::size_t chunks = gridChunkCount(column.length);
+   std::vector<ChunkStats> chunkStats(chunks);
+   forEachGridChunk(column.length, chunks,
+                    boost::bind(summarizeChunk, boost::cref(column),
+                                &chunkStats, _1, _2, _3));
+
+   ChunkStats stats;
+   for (std::size_t chunk = 0; chunk < chunks; chunk++)
+      stats.merge(chunkStats[chunk]);
+
+   pSummary->count = column.length;
+   pSummary->naCount = stats.naCount;
+   if (column.type == GridColumnFactor || column.type == GridColumnLogical)
+   {
+      // levels are counted exactly
+      std::vector<std::pair<std::string, std::size_t> > levels;
+      for (std::size_t i = 0; i < stats.levelCounts.size(); i++)
+      {
+         if (stats.levelCounts[i] == 0)
+            continue;
+         std::string level = column.type == GridColumnFactor ?
+                  std::string(column.levels[i] ? column.levels[i] : "") :
+                  std::string(i ? "TRUE" : "FALSE");
+         levels.push_back(std::make_pair(level, stats.levelCounts[i]));
+      }
+      pSummary->distinct = levels.size();
+      std::stable_sort(levels.begin(), levels.end(), moreFrequent);
+      if (levels.size() > maxTopLevels)
+         levels.resize(maxTopLevels);
+      pSummary->topLevels = levels;
+   }
+   else
+   {
+      pSummary->distinct = stats.estimateDistinct();
+   }
+
+   if (column.type == GridColumnInteger || column.type == GridColumnReal)
+   {
+      pSummary->finiteCount = stats.finiteCount;
+      if (stats.finiteCount > 0)
+      {
+         pSummary->min = stats.min;
+         pSummary->max = stats.max;
+      }
+      if (stats.finiteCount > 1)
+         histogram(column, pSummary);
+   }
+}
+
+void summarizeColumnRange(const std::vector<GridColumn>& columns,
+                          std::size_t maxTopLevels,
+                          std::vector<ColumnSummary>* pSummaries,
+                          std::size_t,
+                          std::size_t begin,
+                          std::size_t end)
+{
+   for (std::size_t i = begin; i < end; i++)
+      summarizeColumn(columns[i], maxTopLevels, &(*pSummaries)[i]);
+}
+
+} // anonymous namespace
+
+ColumnSummary::ColumnSummary()
+   : count(0), naCount(0), finiteCount(0),
+     min(std::numeric_limits<double>::quiet_NaN()),
+     max(std::numeric_limits<double>::quiet_NaN()),
+     distinct(0)
+{
+}
+
+std::vector<ColumnSummary> summarizeColumns(
+      const std::vector<GridColumn>& columns,
+      std::size_t maxTopLevels)
+{
+   std::vector<ColumnSummary> summaries(columns.size());
+
+   // large columns are summarized in parallel chunks, and the rest in
+   // parallel with each other
+   std::vector<GridColumn> smallColumns;
+   std::vector<std::size_t> smallIndexes;
+   std::size_t smallRows = 0;
+   for (std::size_t i = 0; i < columns.size(); i++)
+   {
+      if (gridChunkCount(columns[i].length) > 1)
+      {
+         summarizeColumn(columns[i], maxTopLevels, &summaries[i]);
+      }
+      else
+      {
+         smallColumns.push_back(columns[i]);
+         smallIndexes.push_back(i);
+         smallRows += columns[i].length;
+      }
+   }
+
+   std::vector<ColumnSummary> smallSummaries(smallColumns.size());
+   forEachGridChunk(smallColumns.size(),
+                    std::min(smallColumns.size(), gridChunkCount(smallRows)),
+                    boost::bind(summarizeColumnRange, boost::cref(smallColumns),
+                                maxTopLevels, &smallSummaries, _1, _2, _3));
+   for (std::size_t i = 0; i < smallIndexes.size(); i++)
+      summaries[smallIndexes[i]] = smallSummaries[i];
+
+   return summaries;
+}
+
+std::vector<double> prettyBreaks(double min, double max, int n)
+{
+   // R_pretty() (src/appl/pretty.c) with pretty.default()'s arguments:
+   // min.n = 1, shrink.sml = 0.75, high.u.bias = 1.5, u5.bias = 2.75
+   const double roundingEps = 1e-10;
+   const double h = 1.5;
+   const double h5 = 0.5 + 1.5 * h;
+   const int minN = 1;
+   const double shrink = 0.75;
+
+   std::vector<double> breaks;
+   if (!std::isfinite(min) || !std::isfinite(max) || max < min)
+      return breaks;
+
+   double dx = max - min;
+   double cell;
+   bool small;
+   if (dx == 0 && max == 0)
+   {
+      cell = 1;
+      small = true;
+   }
+   else
+   {
+      cell = std::max(std::fabs(min), std::fabs(max));
+      double u = 1 + ((h5 >= 1.5 * h + 0.5) ? 1 / (1 + h) : 1.5 / (1 + h5));
+      u *= std::max(1, n) * DBL_EPSILON;
+      small = dx < cell * u * 3;
+   }
+
+   if (small)
+   {
+      if (cell > 10)
+         cell = 9 + cell / 10;
+      cell *= shrink;
+      if (minN > 1)
+         cell /= minN;
+   }
+   else
+   {
+      cell = dx;
+      if (n > 1)
+         cell /= n;
+   }
+
+   if (cell < 20 * DBL_MIN)
+      cell = 20 * DBL_MIN;
+   else if (cell * 10 > DBL_MAX)
+      cell = 0.1 * DBL_MAX;
+
+   double base = std::pow(10.0, std::floor(std::log10(cell)));
+   double unit = base;
+   double ns;
+   if ((ns = 2 * base) - cell < h * (cell - unit))
+   {
+      unit = ns;
+      if ((ns = 5 * base) - cell < h5 * (cell - unit))
+      {
+         unit = ns;
+         if ((ns = 10 * base) - cell < h * (cell - unit))
+            unit = ns;
+      }
+   }
+
+   ns = std::floor(min / unit + roundingEps);
+   double nu = std::ceil(max / unit - roundingEps);
+   while (ns * unit > min + roundingEps * unit)
+      ns--;
+   while (nu * unit < max - roundingEps * unit)
+      nu++;
+
+   int k = static_cast<int>(0.5 + nu - ns);
+   if (k < minN)
+   {
+      k = minN - k;
+      if (ns >= 0)
+      {
+         nu += k / 2;
+         ns -= k / 2 + k % 2;
+      }
+      else
+      {
+         ns -= k / 2;
+         nu += k / 2 + k % 2;
+      }
+      k = minN;
+   }
+
+   double lo = std::min(min, ns * unit);
+   double hi = std::max(max, nu * unit);
+
+   // seq.int(lo, hi, length.out = k + 1)
+   int length = k + 1;
+   breaks.resize(length);
+   breaks[0] = lo;
+   breaks[length - 1] = hi;
+   double by = (hi - lo) / k;
+   for (int i = 1; i < length - 1; i++)
+      breaks[i] = i < length / 2 ? lo + i * by : hi - (length - 1 - i) * by;
+
+   // zap values which are zero but for rounding
+   for (int i = 0; i < length; i++)
+   {
+      if (std::fabs(breaks[i]) < 1e-14 * by)
+         breaks[i] = 0;
+   }
+
+   return breaks;
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
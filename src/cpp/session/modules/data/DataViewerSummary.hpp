@@ -0,0 +1,77 @@
+/*
+ * DataViewerSummary.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_DATA_VIEWER_SUMMARY_HPP
+#define SESSION_DATA_VIEWER_SUMMARY_HPP
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DataViewerIndex.hpp"
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+// summary statistics of a column, as shown in the data viewer's column
+// headers and filter UIs
+struct ColumnSummary
+{
+   ColumnSummary();
+
+   // the number of values, and of those which are NA (or NaN)
+   std::size_t count;
+   std::size_t naCount;
+
+   // the number of finite values, and their range (NaN if there are none);
+   // for numeric columns only
+   std::size_t finiteCount;
+   double min;
+   double max;
+
+   // the number of distinct (non-NA) values; exact for factors and
+   // logicals, estimated otherwise
+   std::size_t distinct;
+
+   // the most frequent levels (or TRUE/FALSE) with their counts, most
+   // frequent first; for factors and logicals only
+   std::vector<std::pair<std::string, std::size_t> > topLevels;
+
+   // a histogram of the finite values (as hist() computes it); for numeric
+   // columns with more than one finite value
+   std::vector<double> breaks;
+   std::vector<std::size_t> counts;
+};
+
+// summarize columns (on worker threads, for large columns)
+std::vector<ColumnSummary> summarizeColumns(
+      const std::vector<GridColumn>& columns,
+      std::size_t maxTopLevels);
+
+// R's pretty(c(min, max), n, min.n = 1): about n + 1 equally spaced round
+// values which cover the range
+std::vector<double> prettyBreaks(double min, double max, int n);
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_DATA_VIEWER_SUMMARY_HPP
@@ -0,0 +1,190 @@
+/*
+ * DataViewerSummaryTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "DataViewerSummary.hpp"
+
+#include <cmath>
+
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace data {
+namespace viewer {
+
+namespace {
+
+std::vector<double> sequence(double from, double by, int count)
+{
+   std::vector<double> result;
+   for (int i = 0; i < count; i++)
+      result.push_back(from + i * by);
+   return result;
+}
+
+GridColumn realColumn(const std::vector<double>& values)
+{
+   GridColumn column;
+   column.type = GridColumnReal;
+   column.length = values.size();
+   column.pReals = &values[0];
+   return column;
+}
+
+ColumnSummary summarize(const GridColumn& column)
+{
+   return summarizeColumns(std::vector<GridColumn>(1, column), 3)[0];
+}
+
+} // anonymous namespace
+
+TEST_CASE("Data Viewer Summary")
+{
+   SECTION("Breaks are as pretty() chooses them")
+   {
+      CHECK(prettyBreaks(1, 10, 5) == sequence(0, 2, 6));
+      CHECK(prettyBreaks(1, 100, 5) == sequence(0, 20, 6));
+      CHECK(prettyBreaks(-35, 42, 7) == sequence(-40, 10, 10));
+
+      std::vector<double> tenths = prettyBreaks(0, 1, 5);
+      REQUIRE(tenths.size() == 6);
+      CHECK(tenths[0] == 0);
+      CHECK(std::fabs(tenths[3] - 0.6) < 1e-12);
+      CHECK(tenths[5] == 1);
+   }
+
+   SECTION("Numeric columns have ranges and histograms as hist() computes")
+   {
+      std::vector<double> values = sequence(1, 1, 10);
+      values.push_back(std::nan(""));
+      values.push_back(INFINITY);
+
+      ColumnSummary summary = summarize(realColumn(values));
+      CHECK(summary.count == 12);
+      CHECK(summary.naCount == 1);
+      CHECK(summary.finiteCount == 10);
+      CHECK(summary.min == 1);
+      CHECK(summary.max == 10);
+      CHECK(summary.distinct == 11);
+      CHECK(summary.breaks == sequence(0, 2, 6));
+      CHECK(summary.counts == std::vector<std::size_t>(5, 2));
+      CHECK(summary.topLevels.empty());
+   }
+
+   SECTION("Numeric columns without finite values have no range")
+   {
+      std::vector<double> values(3, std::nan(""));
+      ColumnSummary summary = summarize(realColumn(values));
+      CHECK(summary.naCount == 3);
+      CHECK(summary.distinct == 0);
+      CHECK(std::isnan(summary.min));
+      CHECK(summary.breaks.empty());
+   }
+
+   SECTION("Factors and logicals count their levels exactly")
+   {
+      int codes[] = { 2, 1, 2, kGridNaInteger, 3, 2, 1 };
+      GridColumn factor;
+      factor.type = GridColumnFactor;
+      factor.length = 7;
+      factor.pInts = codes;
+      factor.levels.push_back("a");
+      factor.levels.push_back("b");
+      factor.levels.push_back("c");
+      factor.levels.push_back("unused");
+
+      int flags[] = { 1, 1, kGridNaInteger, 0 };
+      GridColumn logical;
+      logical.type = GridColumnLogical;
+      logical.length = 4;
+      logical.pInts = flags;
+
+      std::vector<GridColumn> columns;
+      columns.push_back(factor);
+      columns.push_back(logical);
+      std::vector<ColumnSummary> summaries = summarizeColumns(columns, 2);
+
+      CHECK(summaries[0].naCount == 1);
+      CHECK(summaries[0].distinct == 3);
+      REQUIRE(summaries[0].topLevels.size() == 2);
+      CHECK(summaries[0].topLevels[0] == std::make_pair(std::string("b"), std::size_t(3)));
+      CHECK(summaries[0].topLevels[1] == std::make_pair(std::string("a"), std::size_t(2)));
+
+      CHECK(summaries[1].naCount == 1);
+      CHECK(summaries[1].distinct == 2);
+      REQUIRE(summaries[1].topLevels.size() == 2);
+      CHECK(summaries[1].topLevels[0].first == "TRUE");
+      CHECK(summaries[1].topLevels[1].first == "FALSE");
+   }
+
+   SECTION("Distinct values of large columns are estimated")
+   {
+      const int kRows = 1000 * 1000;
+      std::vector<double> values(kRows);
+      for (int i = 0; i < kRows; i++)
+         values[i] = (i % 200000) / 7.0;
+
+      ColumnSummary summary = summarize(realColumn(values));
+      CHECK(summary.count == static_cast<std::size_t>(kRows));
+      CHECK(std::fabs(summary.distinct - 200000.0) < 200000 * 0.05);
+      CHECK(summary.max == 199999 / 7.0);
+
+      std::size_t counted = 0;
+      for (std::size_t i = 0; i < summary.counts.size(); i++)
+         counted += summary.counts[i];
+      CHECK(counted == static_cast<std::size_t>(kRows));
+
+      const char* strings[] = { "apple", "banana", NULL, "apple" };
+      GridColumn column;
+      column.type = GridColumnString;
+      column.length = 4;
+      column.strings.assign(strings, strings + 4);
+      summary = summarize(column);
+      CHECK(summary.naCount == 1);
+      CHECK(summary.distinct == 2);
+   }
+}
+
+TEST_CASE("Data Viewer Summary Benchmark", "[.benchmark]")
+{
+   // about 1 GB of doubles
+   const std::size_t kRows = 25 * 1000 * 1000;
+   const std::size_t kColumns = 5;
+   std::vector<std::vector<double> > values(kColumns, std::vector<double>(kRows));
+   std::vector<GridColumn> columns;
+   for (std::size_t col = 0; col < kColumns; col++)
+   {
+      for (std::size_t i = 0; i < kRows; i++)
+         values[col][i] = static_cast<double>((i * 2654435761u) % 1000003) / (col + 1);
+      columns.push_back(realColumn(values[col]));
+   }
+
+   std::vector<ColumnSummary> summaries;
+   {
+      core::PerformanceTimer timer("summarize 5 columns of 25M reals");
+      summaries = summarizeColumns(columns, 10);
+   }
+   CHECK(summaries.size() == kColumns);
+}
+
+} // namespace viewer
+} // namespace data
+} // namespace modules
+} // namespace session
+} // namespace rstudio
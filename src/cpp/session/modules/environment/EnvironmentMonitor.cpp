@@ -13,8 +13,17 @@
  *
  */
 
+#define R_INTERNAL_FUNCTIONS
+
 #include "EnvironmentMonitor.hpp"
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
+
+#include <r/RInternal.hpp>
 #include <r/RSexp.hpp>
 #include <r/RInterface.hpp>
 #include <session/SessionModuleContext.hpp>
@@ -30,6 +39,9 @@ namespace modules {
 namespace environment {
 namespace {
 
+// the time spent describing deferred objects per period of idle time
+const int kDeferredDescriptionBudgetMs = 20;
+
 bool compareVarName(const r::sexp::Variable& var1,
                     const r::sexp::Variable& var2)
 {
@@ -42,29 +54,39 @@ void enqueRefreshEvent()
    module_context::enqueClientEvent(refreshEvent);
 }
 
-// if the given variable is an unevaluated promise, add it to the given
-// list of variables
-void addUnevaledPromise(std::vector<r::sexp::Variable>* pEnv,
-                        const r::sexp::Variable& var)
+std::string symbolName(SEXP symbol)
+{
+   return std::string(CHAR(PRINTNAME(symbol)));
+}
+
+bool isHiddenSymbol(SEXP symbol)
+{
+   return CHAR(PRINTNAME(symbol))[0] == '.';
+}
+
+// fingerprint a chain of binding cells
+std::size_t chainFingerprint(SEXP chain)
 {
-   if (isUnevaluatedPromise(var.second))
+   std::size_t fingerprint = 0;
+   for (SEXP cell = chain; cell != R_NilValue; cell = CDR(cell))
    {
-      pEnv->push_back(var);
+      SEXP value = CAR(cell);
+      EnvironmentSnapshot::addToFingerprint(TAG(cell), value, NAMED(value),
+                                            &fingerprint);
    }
+   return fingerprint;
 }
 
-// If the given variable exists in the given list, remove it. Compares on name
-// only.
-void removeVarFromList(std::vector<r::sexp::Variable>* pEnv,
-                       const r::sexp::Variable& var)
+// list the visible bindings in a chain of binding cells
+void listChainBindings(SEXP chain, std::vector<EnvironmentBinding>* pBindings)
 {
-   for (std::vector<r::sexp::Variable>::iterator iter = pEnv->begin();
-        iter != pEnv->end(); iter++)
+   for (SEXP cell = chain; cell != R_NilValue; cell = CDR(cell))
    {
-      if (iter->first == var.first)
+      SEXP value = CAR(cell);
+      if (value != R_UnboundValue && !isHiddenSymbol(TAG(cell)))
       {
-         pEnv->erase(iter);
-         break;
+         pBindings->push_back(EnvironmentBinding(TAG(cell), value,
+                                                 NAMED(value)));
       }
    }
 }
@@ -72,6 +94,9 @@ void removeVarFromList(std::vector<r::sexp::Variable>* pEnv,
 } // anonymous namespace
 
 EnvironmentMonitor::EnvironmentMonitor() :
+   hashTable_(NULL),
+   lastDotValue_(NULL),
+   deferredScheduled_(false),
    initialized_(false),
    refreshOnInit_(false)
 {}
@@ -85,7 +110,7 @@ void EnvironmentMonitor::enqueRemovedEvent(const r::sexp::Variable& variable)
 void EnvironmentMonitor::enqueAssignedEvent(const r::sexp::Variable& variable)
 {
    // get object info
-   json::Value objInfo = varToJson(getMonitoredEnvironment(), variable);
+   json::Value objInfo = describeVariable(variable);
 
    // enque event
    ClientEvent assignedEvent(client_events::kEnvironmentAssigned, objInfo);
@@ -101,6 +126,14 @@ void EnvironmentMonitor::setMonitoredEnvironment(SEXP pEnvironment,
 
    environment_.set(pEnvironment);
 
+   // forget the previous environment's bindings
+   snapshot_ = EnvironmentSnapshot();
+   hashTable_ = NULL;
+   lastDotValue_ = NULL;
+   unevaledPromises_.clear();
+   deferredNames_.clear();
+   deferredValues_.clear();
+
    // init the environment by doing an initial check for changes
    initialized_ = false;
    refreshOnInit_ = refresh;
@@ -117,38 +150,201 @@ bool EnvironmentMonitor::hasEnvironment()
    return getMonitoredEnvironment() != NULL;
 }
 
-void EnvironmentMonitor::listEnv(std::vector<r::sexp::Variable>* pEnv)
+json::Value EnvironmentMonitor::describeVariable(
+                                       const r::sexp::Variable& variable)
+{
+   SEXP env = getMonitoredEnvironment();
+   if (!isExpensiveToDescribe(variable.second) ||
+       hasSpecialDescription(env, variable))
+   {
+      return varToJson(env, variable);
+   }
+
+   // queue the full description (once per variable)
+   if (deferredValues_.find(variable.first) == deferredValues_.end())
+      deferredNames_.push_back(variable.first);
+   deferredValues_[variable.first] = variable.second;
+
+   if (!deferredScheduled_)
+   {
+      module_context::scheduleIncrementalWork(
+         boost::posix_time::milliseconds(kDeferredDescriptionBudgetMs),
+         boost::bind(&EnvironmentMonitor::describeDeferred, this));
+      deferredScheduled_ = true;
+   }
+
+   return varToBriefJson(env, variable);
+}
+
+// describe the next deferred variable; called repeatedly during idle time
+// until the budget for the period is spent
+bool EnvironmentMonitor::describeDeferred()
 {
-   r::sexp::Protect rProtect;
-   r::sexp::listEnvironment(getMonitoredEnvironment(),
-                            false,
-                            userSettings().showLastDotValue(),
-                            &rProtect,
-                            pEnv);
+   if (!deferredNames_.empty())
+   {
+      std::string name = deferredNames_.front();
+      deferredNames_.pop_front();
+      SEXP value = deferredValues_[name];
+      deferredValues_.erase(name);
+
+      // describe the variable only if it still has the value which was
+      // briefly described (otherwise it's been reassigned or removed, and
+      // the client's been told so)
+      SEXP env = name == ".Last.value" ? R_BaseEnv : getMonitoredEnvironment();
+      if (hasEnvironment() && !r::sexp::isActiveBinding(name, env) &&
+          Rf_findVarInFrame(env, Rf_install(name.c_str())) == value)
+      {
+         json::Value objInfo = varToJson(getMonitoredEnvironment(),
+                                         std::make_pair(name, value));
+         ClientEvent assignedEvent(client_events::kEnvironmentAssigned,
+                                   objInfo);
+         module_context::enqueClientEvent(assignedEvent);
+      }
+   }
+
+   deferredScheduled_ = !deferredNames_.empty();
+   return deferredScheduled_;
+}
+
+// Compare the environment's frame with the snapshot, visiting only the hash
+// buckets whose fingerprint has changed. Each binding cell is still read to
+// fingerprint its bucket, but only changed buckets are listed and diffed.
+void EnvironmentMonitor::updateSnapshot(
+                              std::vector<EnvironmentBinding>* pAssigned,
+                              std::vector<SEXP>* pRemoved)
+{
+   SEXP env = getMonitoredEnvironment();
+
+   if (env == R_BaseEnv || env == R_BaseNamespace)
+   {
+      // the base environment keeps its bindings in the symbol table rather
+      // than in a frame, so list it as a single bucket
+      r::sexp::Protect rProtect;
+      std::vector<r::sexp::Variable> vars;
+      r::sexp::listEnvironment(env, false, false, &rProtect, &vars);
+
+      std::size_t fingerprint = 0;
+      std::vector<EnvironmentBinding> bindings;
+      BOOST_FOREACH(const r::sexp::Variable& var, vars)
+      {
+         SEXP symbol = Rf_install(var.first.c_str());
+         EnvironmentSnapshot::addToFingerprint(symbol, var.second,
+                                               NAMED(var.second),
+                                               &fingerprint);
+         bindings.push_back(EnvironmentBinding(symbol, var.second,
+                                               NAMED(var.second)));
+      }
+
+      if (snapshot_.buckets() != 1)
+         snapshot_.reset(1);
+      if (snapshot_.isChanged(0, fingerprint))
+         snapshot_.updateBucket(0, fingerprint, bindings, pAssigned, pRemoved);
+      return;
+   }
+
+   // unhashed environments (e.g. most function environments) keep their
+   // bindings in a single chain
+   SEXP table = HASHTAB(env);
+   std::size_t buckets = table == R_NilValue ? 1 : Rf_length(table);
+
+   // R replaces the table when it grows; the bindings are then in new
+   // buckets, so rescan all of them
+   bool rescan = table != hashTable_ || buckets != snapshot_.buckets();
+   if (rescan)
+   {
+      snapshot_.reset(buckets);
+      hashTable_ = table;
+   }
+
+   std::vector<EnvironmentBinding> bindings;
+   for (std::size_t bucket = 0; bucket < buckets; bucket++)
+   {
+      SEXP chain = table == R_NilValue ? FRAME(env) :
+                                         VECTOR_ELT(table, bucket);
+
+      std::size_t fingerprint = chainFingerprint(chain);
+      if (!snapshot_.isChanged(bucket, fingerprint))
+         continue;
+
+      bindings.clear();
+      listChainBindings(chain, &bindings);
+      snapshot_.updateBucket(bucket, fingerprint, bindings,
+                             pAssigned, pRemoved);
+   }
+
+   if (rescan)
+      snapshot_.sweep(pRemoved);
 }
 
 void EnvironmentMonitor::checkForChanges()
 {
-   // information about the current environment
-   std::vector<r::sexp::Variable> currentEnv ;
-   std::vector<r::sexp::Variable> currentPromises;
+   // an empty environment (before the check) means startup or a reset
+   // workspace
+   bool wasEmpty = snapshot_.empty() && lastDotValue_ == NULL;
 
    // list of assigns/removes (includes both value changes and promise
    // evaluations)
-   std::vector<r::sexp::Variable> addedVars;
-   std::vector<r::sexp::Variable> removedVars;
+   std::vector<EnvironmentBinding> assigned;
+   std::vector<SEXP> removed;
+   updateSnapshot(&assigned, &removed);
+
+   // .Last.value is found in the base environment; check it by identity
+   SEXP lastDotSymbol = Rf_install(".Last.value");
+   SEXP lastDotValue = NULL;
+   if (userSettings().showLastDotValue())
+   {
+      SEXP value = Rf_findVar(lastDotSymbol, getMonitoredEnvironment());
+      if (value != R_UnboundValue)
+         lastDotValue = value;
+   }
+   if (lastDotValue != lastDotValue_)
+   {
+      if (lastDotValue != NULL)
+         assigned.push_back(EnvironmentBinding(lastDotSymbol, lastDotValue,
+                                               NAMED(lastDotValue)));
+      else
+         removed.push_back(lastDotSymbol);
+      lastDotValue_ = lastDotValue;
+   }
+   bool isEmpty = snapshot_.empty() && lastDotValue_ == NULL;
 
-   // get the set of variables and promises in the current environment
-   listEnv(&currentEnv);
+   // removed symbols are no longer monitored for promise evaluation, and
+   // neither are those assigned a new value (otherwise, we double-assign in
+   // the case where a promise SEXP is simultaneously forced/evaluated and
+   // assigned a new value)
+   BOOST_FOREACH(SEXP symbol, removed)
+   {
+      unevaledPromises_.erase(symbol);
+   }
+   BOOST_FOREACH(const EnvironmentBinding& binding, assigned)
+   {
+      unevaledPromises_.erase(binding.symbol);
+   }
 
-   // R returns an environment list sorted in dictionary order. Since the
-   // set difference algorithms below use simple string comparisons to
-   // establish order, we need to re-sort the list into canonical order
-   // to avoid the algorithms detecting superfluous insertions.
-   std::sort(currentEnv.begin(), currentEnv.end(), compareVarName);
+   // for each promise we are monitoring which has since been evaluated (and
+   // is still bound), process the evaluation as an assign
+   std::vector<EnvironmentBinding> evaluated;
+   for (boost::unordered_map<SEXP, SEXP>::iterator it = unevaledPromises_.begin();
+        it != unevaledPromises_.end(); )
+   {
+      if (isUnevaluatedPromise(it->second))
+      {
+         ++it;
+         continue;
+      }
 
-   std::for_each(currentEnv.begin(), currentEnv.end(),
-                 boost::bind(addUnevaledPromise, &currentPromises, _1));
+      const EnvironmentBinding* pBinding = snapshot_.find(it->first);
+      if (pBinding != NULL && pBinding->value == it->second)
+         evaluated.push_back(*pBinding);
+      it = unevaledPromises_.erase(it);
+   }
+
+   // start monitoring newly assigned promises
+   BOOST_FOREACH(const EnvironmentBinding& binding, assigned)
+   {
+      if (isUnevaluatedPromise(binding.value))
+         unevaledPromises_[binding.symbol] = binding.value;
+   }
 
    bool refreshEnqueued = false;
    if (!initialized_)
@@ -164,14 +360,14 @@ void EnvironmentMonitor::checkForChanges()
    }
    else
    {
-      if (currentEnv != lastEnv_)
+      if (!assigned.empty() || !removed.empty())
       {
-         // optimize for empty currentEnv (user reset workspace) or empty
-         // lastEnv_ (startup) by just sending a single refresh event
-         // only do this for the global environment--while debugging local
-         // environments, the environment object list is sent down as part of
-         // the context depth event.
-         if ((currentEnv.empty() || lastEnv_.empty())
+         // optimize for empty current environment (user reset workspace) or
+         // empty previous environment (startup) by just sending a single
+         // refresh event only do this for the global environment--while
+         // debugging local environments, the environment object list is sent
+         // down as part of the context depth event.
+         if ((isEmpty || wasEmpty)
              && getMonitoredEnvironment() == R_GlobalEnv)
          {
             enqueRefreshEvent();
@@ -179,51 +375,38 @@ void EnvironmentMonitor::checkForChanges()
          }
          else
          {
-            std::set_difference(lastEnv_.begin(), lastEnv_.end(),
-                                currentEnv.begin(), currentEnv.end(),
-                                std::back_inserter(removedVars),
-                                compareVarName);
-
             // fire removed event for deletes
+            std::vector<r::sexp::Variable> removedVars;
+            BOOST_FOREACH(SEXP symbol, removed)
+            {
+               removedVars.push_back(
+                        std::make_pair(symbolName(symbol), R_NilValue));
+            }
+            std::sort(removedVars.begin(), removedVars.end(), compareVarName);
             std::for_each(removedVars.begin(),
                           removedVars.end(),
                           boost::bind(&EnvironmentMonitor::enqueRemovedEvent,
                                       this, _1));
-
-            // remove deleted objects from the list of uneval'ed promises
-            // so we'll stop monitoring them for evaluation
-            std::for_each(removedVars.begin(),
-                          removedVars.end(),
-                          boost::bind(removeVarFromList, &unevaledPromises_, _1));
-
-            // find adds & assigns (all variable name/value combinations in the
-            // current environment but NOT in the previous environment)
-            std::set_difference(currentEnv.begin(), currentEnv.end(),
-                                lastEnv_.begin(), lastEnv_.end(),
-                                std::back_inserter(addedVars));
-
-            // remove assigned objects from the list of uneval'ed promises
-            // (otherwise, we double-assign in the case where a promise SEXP
-            // is simultaneously forced/evaluated and assigned a new value)
-            std::for_each(addedVars.begin(),
-                          addedVars.end(),
-                          boost::bind(removeVarFromList, &unevaledPromises_, _1));
-
          }
       }
+
       // if a refresh is scheduled there's no need to emit add events one by one
       if (!refreshEnqueued)
       {
-         // have any promises been evaluated since we last checked?
-         if (currentPromises != unevaledPromises_)
+         assigned.insert(assigned.end(), evaluated.begin(), evaluated.end());
+
+         // active bindings are described without their values (merely
+         // looking them up would fire them)
+         std::vector<r::sexp::Variable> addedVars;
+         BOOST_FOREACH(const EnvironmentBinding& binding, assigned)
          {
-            // for each promise that is in the set of promises we are monitoring
-            // for evaluation but not in the set of currently tracked promises,
-            // we assume this to be an eval--process as an assign
-            std::set_difference(unevaledPromises_.begin(), unevaledPromises_.end(),
-                                currentPromises.begin(), currentPromises.end(),
-                                std::back_inserter(addedVars));
+            std::string name = symbolName(binding.symbol);
+            SEXP value = binding.value;
+            if (r::sexp::isActiveBinding(name, getMonitoredEnvironment()))
+               value = R_NilValue;
+            addedVars.push_back(std::make_pair(name, value));
          }
+         std::sort(addedVars.begin(), addedVars.end(), compareVarName);
 
          // fire assigned event for adds, assigns, and promise evaluations
          std::for_each(addedVars.begin(),
@@ -232,9 +415,6 @@ void EnvironmentMonitor::checkForChanges()
                                     this, _1));
       }
    }
-
-   unevaledPromises_ = currentPromises;
-   lastEnv_ = currentEnv;
 }
 
 } // namespace environment
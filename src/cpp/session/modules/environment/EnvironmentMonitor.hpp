@@ -13,9 +13,17 @@
  *
  */
 
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
 #include <r/RSexp.hpp>
 #include <r/RInterface.hpp>
 
+#include "EnvironmentSnapshot.hpp"
+
 namespace rstudio {
 namespace session {
 namespace modules {
@@ -31,13 +39,35 @@ public:
    SEXP getMonitoredEnvironment();
    bool hasEnvironment();
    void checkForChanges();
+
+   // describe a variable of the monitored environment for the client; for
+   // objects which are expensive to describe, only a brief description is
+   // returned and the full one is sent later (during idle time)
+   core::json::Value describeVariable(const r::sexp::Variable& variable);
 private:
-   void listEnv(std::vector<r::sexp::Variable>* pEnvironment);
+   bool describeDeferred();
+   void updateSnapshot(std::vector<EnvironmentBinding>* pAssigned,
+                       std::vector<SEXP>* pRemoved);
    void enqueRemovedEvent(const r::sexp::Variable& variable);
    void enqueAssignedEvent(const r::sexp::Variable& variable);
 
-   std::vector<r::sexp::Variable> lastEnv_;
-   std::vector<r::sexp::Variable> unevaledPromises_;
+   // the bindings seen at the last check, and the hash table they were
+   // bucketed by (if the table is replaced R has resized it, and we rescan)
+   EnvironmentSnapshot snapshot_;
+   SEXP hashTable_;
+
+   // .Last.value, which lives in the base environment but is shown with
+   // the monitored one (NULL when not shown)
+   SEXP lastDotValue_;
+
+   // promises we're monitoring for evaluation, by symbol
+   boost::unordered_map<SEXP, SEXP> unevaledPromises_;
+
+   // variables awaiting full descriptions (in order), with the values which
+   // were briefly described
+   std::deque<std::string> deferredNames_;
+   boost::unordered_map<std::string, SEXP> deferredValues_;
+   bool deferredScheduled_;
    r::sexp::PreservedSEXP environment_;
    bool initialized_;
    bool refreshOnInit_;
@@ -0,0 +1,121 @@
+/*
+ * EnvironmentSnapshot.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "EnvironmentSnapshot.hpp"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace environment {
+
+EnvironmentSnapshot::EnvironmentSnapshot()
+   : generation_(0)
+{
+}
+
+void EnvironmentSnapshot::addToFingerprint(SEXP symbol,
+                                           SEXP value,
+                                           int named,
+                                           std::size_t* pFingerprint)
+{
+   boost::hash_combine(*pFingerprint, symbol);
+   boost::hash_combine(*pFingerprint, value);
+   boost::hash_combine(*pFingerprint, named);
+}
+
+void EnvironmentSnapshot::reset(std::size_t buckets)
+{
+   fingerprints_.assign(buckets, 0);
+   stale_.assign(buckets, true);
+   symbols_.assign(buckets, std::vector<SEXP>());
+   generation_++;
+}
+
+bool EnvironmentSnapshot::isChanged(std::size_t bucket,
+                                    std::size_t fingerprint) const
+{
+   return stale_[bucket] || fingerprints_[bucket] != fingerprint;
+}
+
+void EnvironmentSnapshot::updateBucket(
+                     std::size_t bucket,
+                     std::size_t fingerprint,
+                     const std::vector<EnvironmentBinding>& bindings,
+                     std::vector<EnvironmentBinding>* pAssigned,
+                     std::vector<SEXP>* pRemoved)
+{
+   // record new and changed bindings
+   std::vector<SEXP> symbols;
+   symbols.reserve(bindings.size());
+   BOOST_FOREACH(const EnvironmentBinding& binding, bindings)
+   {
+      symbols.push_back(binding.symbol);
+
+      Entry& entry = bindings_[binding.symbol];
+      if (entry.binding != binding)
+      {
+         entry.binding = binding;
+         pAssigned->push_back(binding);
+      }
+      entry.generation = generation_;
+   }
+
+   // symbols which were in the bucket but aren't anymore have been removed
+   // (a full update has no previous symbols; sweep() finds its removals)
+   BOOST_FOREACH(SEXP symbol, symbols_[bucket])
+   {
+      if (std::find(symbols.begin(), symbols.end(), symbol) == symbols.end())
+      {
+         bindings_.erase(symbol);
+         pRemoved->push_back(symbol);
+      }
+   }
+
+   symbols_[bucket].swap(symbols);
+   fingerprints_[bucket] = fingerprint;
+   stale_[bucket] = false;
+}
+
+void EnvironmentSnapshot::sweep(std::vector<SEXP>* pRemoved)
+{
+   for (Bindings::iterator it = bindings_.begin(); it != bindings_.end(); )
+   {
+      if (it->second.generation != generation_)
+      {
+         pRemoved->push_back(it->first);
+         it = bindings_.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+}
+
+const EnvironmentBinding* EnvironmentSnapshot::find(SEXP symbol) const
+{
+   Bindings::const_iterator it = bindings_.find(symbol);
+   return it == bindings_.end() ? NULL : &it->second.binding;
+}
+
+} // namespace environment
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,122 @@
+/*
+ * EnvironmentSnapshot.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_ENVIRONMENT_SNAPSHOT_HPP
+#define SESSION_ENVIRONMENT_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include <r/RSexp.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace environment {
+
+// a binding in an environment's frame: its symbol, its value, and the
+// value's NAMED state
+struct EnvironmentBinding
+{
+   EnvironmentBinding()
+      : symbol(NULL), value(NULL), named(0)
+   {
+   }
+
+   EnvironmentBinding(SEXP symbol, SEXP value, int named)
+      : symbol(symbol), value(value), named(named)
+   {
+   }
+
+   bool operator==(const EnvironmentBinding& other) const
+   {
+      return symbol == other.symbol &&
+             value == other.value &&
+             named == other.named;
+   }
+
+   bool operator!=(const EnvironmentBinding& other) const
+   {
+      return !(*this == other);
+   }
+
+   SEXP symbol;
+   SEXP value;
+   int named;
+};
+
+// EnvironmentSnapshot remembers the bindings of an environment's frame by
+// hash bucket, along with a fingerprint of each bucket, so that changes can
+// be found by listing only the buckets whose fingerprint has changed
+class EnvironmentSnapshot
+{
+public:
+   EnvironmentSnapshot();
+
+   // fold a binding cell into a bucket's fingerprint
+   static void addToFingerprint(SEXP symbol, SEXP value, int named,
+                                std::size_t* pFingerprint);
+
+   // the number of buckets, and of bindings
+   std::size_t buckets() const { return fingerprints_.size(); }
+   std::size_t size() const { return bindings_.size(); }
+   bool empty() const { return bindings_.empty(); }
+
+   // start a full update with the given number of buckets: every bucket is
+   // seen as changed, and bindings not found in any bucket by the following
+   // sweep() are reported as removed
+   void reset(std::size_t buckets);
+
+   // has the bucket changed since it was last updated?
+   bool isChanged(std::size_t bucket, std::size_t fingerprint) const;
+
+   // replace the bindings of a bucket, reporting new and changed bindings
+   // as assigned and those no longer in the bucket as removed
+   void updateBucket(std::size_t bucket,
+                     std::size_t fingerprint,
+                     const std::vector<EnvironmentBinding>& bindings,
+                     std::vector<EnvironmentBinding>* pAssigned,
+                     std::vector<SEXP>* pRemoved);
+
+   // complete a full update, reporting bindings not seen since reset()
+   void sweep(std::vector<SEXP>* pRemoved);
+
+   // the binding of a symbol (NULL if it's not bound)
+   const EnvironmentBinding* find(SEXP symbol) const;
+
+private:
+   struct Entry
+   {
+      EnvironmentBinding binding;
+      unsigned generation;
+   };
+
+   typedef boost::unordered_map<SEXP, Entry> Bindings;
+
+   std::vector<std::size_t> fingerprints_;
+   std::vector<bool> stale_;
+   std::vector<std::vector<SEXP> > symbols_;
+   Bindings bindings_;
+   unsigned generation_;
+};
+
+} // namespace environment
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_ENVIRONMENT_SNAPSHOT_HPP
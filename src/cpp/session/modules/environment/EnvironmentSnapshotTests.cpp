@@ -0,0 +1,242 @@
+/*
+ * EnvironmentSnapshotTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "EnvironmentSnapshot.hpp"
+
+#include <boost/foreach.hpp>
+
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace environment {
+
+namespace {
+
+// the snapshot only compares pointers, so stand-ins will do for symbols
+// and values
+SEXP fake(std::size_t id)
+{
+   return reinterpret_cast<SEXP>((id + 1) * 16);
+}
+
+typedef std::vector<EnvironmentBinding> Bucket;
+
+// a frame of buckets, as the monitor sees it
+class Frame
+{
+public:
+   explicit Frame(std::size_t buckets)
+      : buckets_(buckets)
+   {
+   }
+
+   std::size_t bucketOf(SEXP symbol) const
+   {
+      return reinterpret_cast<std::size_t>(symbol) / 16 % buckets_.size();
+   }
+
+   void assign(SEXP symbol, SEXP value, int named = 1)
+   {
+      Bucket& bucket = buckets_[bucketOf(symbol)];
+      BOOST_FOREACH(EnvironmentBinding& binding, bucket)
+      {
+         if (binding.symbol == symbol)
+         {
+            binding = EnvironmentBinding(symbol, value, named);
+            return;
+         }
+      }
+      bucket.push_back(EnvironmentBinding(symbol, value, named));
+   }
+
+   void remove(SEXP symbol)
+   {
+      Bucket& bucket = buckets_[bucketOf(symbol)];
+      for (Bucket::iterator it = bucket.begin(); it != bucket.end(); ++it)
+      {
+         if (it->symbol == symbol)
+         {
+            bucket.erase(it);
+            return;
+         }
+      }
+   }
+
+   // diff against the snapshot; returns the number of buckets listed
+   std::size_t update(EnvironmentSnapshot* pSnapshot,
+                      std::vector<EnvironmentBinding>* pAssigned,
+                      std::vector<SEXP>* pRemoved) const
+   {
+      bool rescan = pSnapshot->buckets() != buckets_.size();
+      if (rescan)
+         pSnapshot->reset(buckets_.size());
+
+      std::size_t listed = 0;
+      for (std::size_t i = 0; i < buckets_.size(); i++)
+      {
+         std::size_t fingerprint = 0;
+         BOOST_FOREACH(const EnvironmentBinding& binding, buckets_[i])
+         {
+            EnvironmentSnapshot::addToFingerprint(binding.symbol,
+                                                  binding.value,
+                                                  binding.named,
+                                                  &fingerprint);
+         }
+
+         if (pSnapshot->isChanged(i, fingerprint))
+         {
+            pSnapshot->updateBucket(i, fingerprint, buckets_[i],
+                                    pAssigned, pRemoved);
+            listed++;
+         }
+      }
+
+      if (rescan)
+         pSnapshot->sweep(pRemoved);
+      return listed;
+   }
+
+private:
+   std::vector<Bucket> buckets_;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Environment Snapshot")
+{
+   SECTION("The first update assigns every binding")
+   {
+      Frame frame(8);
+      for (std::size_t i = 0; i < 20; i++)
+         frame.assign(fake(i), fake(100 + i));
+
+      EnvironmentSnapshot snapshot;
+      std::vector<EnvironmentBinding> assigned;
+      std::vector<SEXP> removed;
+      CHECK(frame.update(&snapshot, &assigned, &removed) == 8);
+      CHECK(assigned.size() == 20);
+      CHECK(removed.empty());
+      CHECK(snapshot.size() == 20);
+      REQUIRE(snapshot.find(fake(3)) != NULL);
+      CHECK(snapshot.find(fake(3))->value == fake(103));
+      CHECK(snapshot.find(fake(50)) == NULL);
+   }
+
+   SECTION("Only changed buckets are listed")
+   {
+      Frame frame(64);
+      for (std::size_t i = 0; i < 1000; i++)
+         frame.assign(fake(i), fake(5000 + i));
+
+      EnvironmentSnapshot snapshot;
+      std::vector<EnvironmentBinding> assigned;
+      std::vector<SEXP> removed;
+      frame.update(&snapshot, &assigned, &removed);
+
+      assigned.clear();
+      CHECK(frame.update(&snapshot, &assigned, &removed) == 0);
+      CHECK(assigned.empty());
+
+      frame.assign(fake(7), fake(9999));
+      frame.remove(fake(8));
+      frame.assign(fake(2000), fake(2001));
+      CHECK(frame.update(&snapshot, &assigned, &removed) == 3);
+      REQUIRE(assigned.size() == 2);
+      CHECK(assigned[0].value != assigned[1].value);
+      REQUIRE(removed.size() == 1);
+      CHECK(removed[0] == fake(8));
+      CHECK(snapshot.size() == 1000);
+   }
+
+   SECTION("A change in NAMED state is a change")
+   {
+      Frame frame(4);
+      frame.assign(fake(1), fake(10), 1);
+
+      EnvironmentSnapshot snapshot;
+      std::vector<EnvironmentBinding> assigned;
+      std::vector<SEXP> removed;
+      frame.update(&snapshot, &assigned, &removed);
+
+      assigned.clear();
+      frame.assign(fake(1), fake(10), 2);
+      frame.update(&snapshot, &assigned, &removed);
+      REQUIRE(assigned.size() == 1);
+      CHECK(assigned[0].named == 2);
+   }
+
+   SECTION("Rebucketing reports only real changes")
+   {
+      Frame small(4);
+      for (std::size_t i = 0; i < 10; i++)
+         small.assign(fake(i), fake(100 + i));
+
+      EnvironmentSnapshot snapshot;
+      std::vector<EnvironmentBinding> assigned;
+      std::vector<SEXP> removed;
+      small.update(&snapshot, &assigned, &removed);
+
+      // as when R grows the hash table: the same bindings in more buckets,
+      // less one and with another added
+      Frame large(16);
+      for (std::size_t i = 1; i < 11; i++)
+         large.assign(fake(i), fake(100 + i));
+
+      assigned.clear();
+      CHECK(large.update(&snapshot, &assigned, &removed) == 16);
+      REQUIRE(assigned.size() == 1);
+      CHECK(assigned[0].symbol == fake(10));
+      REQUIRE(removed.size() == 1);
+      CHECK(removed[0] == fake(0));
+      CHECK(snapshot.size() == 10);
+   }
+}
+
+TEST_CASE("Environment Snapshot Benchmark", "[.benchmark]")
+{
+   const std::size_t kBindings = 100 * 1000;
+   Frame frame(kBindings / 2);
+   for (std::size_t i = 0; i < kBindings; i++)
+      frame.assign(fake(i), fake(kBindings + i));
+
+   EnvironmentSnapshot snapshot;
+   std::vector<EnvironmentBinding> assigned;
+   std::vector<SEXP> removed;
+   {
+      core::PerformanceTimer timer("snapshot 100k bindings");
+      frame.update(&snapshot, &assigned, &removed);
+   }
+
+   std::size_t listed = 0;
+   {
+      core::PerformanceTimer timer("check 100k bindings, with 10 changes");
+      for (std::size_t i = 0; i < 10; i++)
+         frame.assign(fake(i * 997), fake(3 * kBindings + i));
+      assigned.clear();
+      listed = frame.update(&snapshot, &assigned, &removed);
+   }
+   CHECK(listed == 10);
+   CHECK(assigned.size() == 10);
+}
+
+} // namespace environment
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -15,6 +15,9 @@
 
 #include "EnvironmentUtils.hpp"
 
+#include <cmath>
+#include <set>
+
 #include <r/RCntxt.hpp>
 #include <r/RCntxtUtils.hpp>
 #include <r/RExec.hpp>
@@ -27,6 +30,8 @@
 
 #define MAX_ALTREP_LEN   65535   // maximum width/length for altrep inspection
 #define MAX_ALTREP_DEPTH 5       // maximum depth for altrep inspection
+#define MAX_SIZE_DEPTH   8       // maximum depth for object size computation
+#define MAX_BRIEF_LENGTH 100000  // maximum length of vectors described at once
 
 using namespace rstudio::core;
 
@@ -59,8 +64,119 @@ json::Value descriptionOfVar(SEXP var)
    }
 }
 
+// R's allocation of a vector with the given number of bytes of data: a
+// header, and the data (small vectors are allocated in size classes)
+double vectorSize(double bytes)
+{
+   const double kHeader = 48;
+   const double kSmallClasses[] = { 8, 16, 32, 48, 64, 128 };
+
+   if (bytes <= 0)
+      return kHeader;
+   for (std::size_t i = 0; i < sizeof(kSmallClasses) / sizeof(double); i++)
+   {
+      if (bytes <= kSmallClasses[i])
+         return kHeader + kSmallClasses[i];
+   }
+   return kHeader + std::ceil(bytes / 8) * 8;
+}
+
 } // anonymous namespace
 
+// an estimate of the memory used by an object, in the manner of object.size
+// (but without materializing ALTREP objects); objects nested deeper than
+// maxDepth aren't counted
+double objectSize(SEXP var, int maxDepth)
+{
+   const double kNode = 56;
+
+   if (var == NULL || var == R_NilValue)
+      return 0;
+   if (maxDepth < 0)
+      return 0;
+
+   double size = 0;
+   switch (TYPEOF(var))
+   {
+   case LISTSXP:
+   case LANGSXP:
+   case DOTSXP:
+      // walk the pairlist iteratively (it may be long)
+      for (SEXP cell = var; cell != R_NilValue; cell = CDR(cell))
+      {
+         int type = TYPEOF(cell);
+         if (type != LISTSXP && type != LANGSXP && type != DOTSXP)
+         {
+            size += objectSize(cell, maxDepth - 1);
+            break;
+         }
+         size += kNode + objectSize(TAG(cell), maxDepth - 1) +
+                         objectSize(CAR(cell), maxDepth - 1) +
+                         objectSize(ATTRIB(cell), maxDepth - 1);
+      }
+      return size;
+   case CLOSXP:
+      size = kNode + objectSize(FORMALS(var), maxDepth - 1) +
+                     objectSize(BODY(var), maxDepth - 1);
+      break;
+   case PROMSXP:
+      size = kNode + objectSize(PRVALUE(var), maxDepth - 1) +
+                     objectSize(PRCODE(var), maxDepth - 1);
+      break;
+   case CHARSXP:
+      // the attributes of a CHARSXP belong to the global string cache
+      return vectorSize(LENGTH(var) + 1);
+   case LGLSXP:
+   case INTSXP:
+      size = vectorSize(4.0 * XLENGTH(var));
+      break;
+   case REALSXP:
+      size = vectorSize(8.0 * XLENGTH(var));
+      break;
+   case CPLXSXP:
+      size = vectorSize(16.0 * XLENGTH(var));
+      break;
+   case RAWSXP:
+      size = vectorSize(static_cast<double>(XLENGTH(var)));
+      break;
+   case STRSXP:
+   {
+      R_xlen_t length = XLENGTH(var);
+      size = vectorSize(8.0 * length);
+
+      // count each distinct string once (accessing the strings of ALTREP
+      // vectors would materialize them)
+      if (maxDepth > 0 && !isAltrep(var))
+      {
+         std::set<SEXP> strings;
+         for (R_xlen_t i = 0; i < length; i++)
+         {
+            SEXP string = STRING_ELT(var, i);
+            if (string != NA_STRING && strings.insert(string).second)
+               size += vectorSize(LENGTH(string) + 1);
+         }
+      }
+      break;
+   }
+   case VECSXP:
+   case EXPRSXP:
+   {
+      R_xlen_t length = XLENGTH(var);
+      size = vectorSize(8.0 * length);
+      for (R_xlen_t i = 0; i < length; i++)
+         size += objectSize(VECTOR_ELT(var, i), maxDepth - 1);
+      break;
+   }
+   case SYMSXP:
+   case ENVSXP:
+   default:
+      size = kNode;
+      break;
+   }
+
+   return size + objectSize(ATTRIB(var), maxDepth - 1);
+}
+
 // a variable is an unevaluated promise if its promise value is still unbound
 bool isUnevaluatedPromise (SEXP var)
 {
@@ -213,11 +329,16 @@ json::Value varToJson(SEXP env, const r::sexp::Variable& var)
    // For all other value types, construct the definition normally.
    else
    {
+      // some objects (e.g. ALTREP) have compact representations that are
+      // forced to materialize if their metrics are computed exactly
+      bool computeSize = !hasAltrep(varSEXP);
+      double size = computeSize ? objectSize(varSEXP, MAX_SIZE_DEPTH) : 0;
+
       SEXP description;
       json::Value val;
       r::sexp::Protect protect;
       Error error = r::exec::RFunction(".rs.describeObject",
-                  env, var.first, !hasAltrep(varSEXP))
+                  env, var.first, computeSize, size)
                   .call(&description, &protect);
       if (error)
          LOG_ERROR(error);
@@ -233,6 +354,64 @@ json::Value varToJson(SEXP env, const r::sexp::Variable& var)
    return varJson;
 }
 
+// objects which are recursive or long take a while to measure and preview
+bool isExpensiveToDescribe(SEXP var)
+{
+   switch (TYPEOF(var))
+   {
+   case VECSXP:
+   case EXPRSXP:
+   case LISTSXP:
+   case S4SXP:
+      return true;
+   case LGLSXP:
+   case INTSXP:
+   case REALSXP:
+   case CPLXSXP:
+   case STRSXP:
+   case RAWSXP:
+      return XLENGTH(var) > MAX_BRIEF_LENGTH;
+   default:
+      return false;
+   }
+}
+
+// values which mustn't be inspected (e.g. active bindings, which run code
+// when read) are described specially by varToJson without inspecting them
+bool hasSpecialDescription(SEXP env, const r::sexp::Variable& var)
+{
+   SEXP varSEXP = var.second;
+   return varSEXP == R_UnboundValue ||
+          varSEXP == R_MissingArg ||
+          isUnevaluatedPromise(varSEXP) ||
+          r::sexp::isActiveBinding(var.first, env) ||
+          r::sexp::hasActiveBinding(var.first, env);
+}
+
+// the parts of an object's description which don't depend on its size or
+// contents: its type, class, and length (variables with a special
+// description are described in full, as that's cheap)
+json::Value varToBriefJson(SEXP env, const r::sexp::Variable& var)
+{
+   if (hasSpecialDescription(env, var))
+      return varToJson(env, var);
+
+   SEXP description;
+   json::Value val;
+   r::sexp::Protect protect;
+   Error error = r::exec::RFunction(".rs.describeObjectBrief",
+               env, var.first)
+               .call(&description, &protect);
+   if (!error)
+      error = r::json::jsonValueFromObject(description, &val);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return varToJson(env, var);
+   }
+   return val;
+}
+
 bool functionDiffersFromSource(
       SEXP srcRef,
       const std::string& functionCode)
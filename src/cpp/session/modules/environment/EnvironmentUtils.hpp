@@ -22,6 +22,9 @@ namespace modules {
 namespace environment {
 
 core::json::Value varToJson(SEXP env, const r::sexp::Variable& var);
+core::json::Value varToBriefJson(SEXP env, const r::sexp::Variable& var);
+bool isExpensiveToDescribe(SEXP var);
+bool hasSpecialDescription(SEXP env, const r::sexp::Variable& var);
 bool isUnevaluatedPromise(SEXP var);
 bool functionDiffersFromSource(SEXP srcRef, const std::string& functionCode);
 void sourceRefToJson(const SEXP srcref, core::json::Object* pObject);
@@ -29,6 +32,11 @@ core::Error sourceFileFromRef(const SEXP srcref, std::string* pFileName);
 bool isAltrep(SEXP var);
 bool hasAltrep(SEXP var);
 
+// an estimate of the memory used by an object, in the manner of object.size
+// (but without materializing ALTREP objects); objects nested deeper than
+// maxDepth aren't counted
+double objectSize(SEXP var, int maxDepth);
+
 } // namespace environment
 } // namespace modules
 } // namespace session
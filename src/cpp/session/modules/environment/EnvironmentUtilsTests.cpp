@@ -0,0 +1,160 @@
+/*
+ * EnvironmentUtilsTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+#include "EnvironmentUtils.hpp"
+
+#include <r/RExec.hpp>
+#include <r/RSexp.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace environment {
+
+namespace {
+
+// deep enough that none of the values below are cut off
+const int kUnlimitedDepth = 1000;
+
+// a value that stays protected for the duration of a test
+class Value
+{
+public:
+   explicit Value(const std::string& code)
+      : valueSEXP_(R_NilValue)
+   {
+      core::Error error = r::exec::evaluateString(code, &valueSEXP_, &protect_);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   double estimatedSize(int maxDepth = kUnlimitedDepth) const
+   {
+      return objectSize(valueSEXP_, maxDepth);
+   }
+
+   double rObjectSize() const
+   {
+      r::sexp::Protect protect;
+      SEXP sizeSEXP = R_NilValue;
+      core::Error error = r::exec::RFunction("utils:::object.size", valueSEXP_)
+            .call(&sizeSEXP, &protect);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return -1;
+      }
+      return r::sexp::asReal(sizeSEXP);
+   }
+
+private:
+   r::sexp::Protect protect_;
+   SEXP valueSEXP_;
+};
+
+} // anonymous namespace
+
+TEST_CASE("Environment Object Size")
+{
+   SECTION("Atomic vectors match object.size")
+   {
+      // values are built with c() and arithmetic so that none are ALTREP
+      const char* codes[] = {
+         "logical(0)",
+         "c(TRUE, FALSE, NA)",
+         "c(1L, 2L, 3L, 4L, 5L)",
+         "c(1.5, 2.5)",
+         "rnorm(1000)",
+         "c(1i, 2i, 3i)",
+         "as.raw(c(1, 2, 3, 4, 5, 6, 7, 8, 9))"
+      };
+
+      for (std::size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++)
+      {
+         Value value(codes[i]);
+         INFO(codes[i]);
+         CHECK(value.estimatedSize() == value.rObjectSize());
+      }
+   }
+
+   SECTION("Shared strings are counted once")
+   {
+      Value shared("rep(c(\"alpha\", \"beta\", NA), 100)");
+      CHECK(shared.estimatedSize() == shared.rObjectSize());
+
+      Value distinct("paste0(\"string\", seq_len(100) + 0)");
+      CHECK(distinct.estimatedSize() == distinct.rObjectSize());
+
+      // one hundred references to the same two strings cost no more than
+      // the pointers to them
+      Value few("c(\"alpha\", \"beta\", NA)");
+      CHECK(shared.estimatedSize() - few.estimatedSize() ==
+            Value("rep(NA_character_, 300)").estimatedSize() -
+            Value("rep(NA_character_, 3)").estimatedSize());
+   }
+
+   SECTION("Nested lists match object.size")
+   {
+      Value nested("list(a = c(1.5, 2.5), b = list(c(\"x\", \"y\"), list(NULL, 1L)))");
+      CHECK(nested.estimatedSize() == nested.rObjectSize());
+
+      Value pairlist("as.pairlist(list(a = 1.5, b = \"x\", c = list(TRUE)))");
+      CHECK(pairlist.estimatedSize() == pairlist.rObjectSize());
+   }
+
+   SECTION("Attributes match object.size")
+   {
+      Value named("structure(c(1.5, 2.5, 3.5), names = c(\"a\", \"b\", \"c\"), "
+                  "class = \"measurement\")");
+      CHECK(named.estimatedSize() == named.rObjectSize());
+
+      Value factor("factor(c(\"low\", \"high\", \"low\", \"medium\"))");
+      CHECK(factor.estimatedSize() == factor.rObjectSize());
+
+      Value frame("data.frame(x = c(1.5, 2.5), y = c(\"a\", \"b\"), "
+                  "stringsAsFactors = FALSE)");
+      CHECK(frame.estimatedSize() == frame.rObjectSize());
+   }
+
+   SECTION("Objects nested past the depth cap aren't counted")
+   {
+      std::string code = "c(1.5, 2.5)";
+      for (int i = 0; i < 20; i++)
+         code = "list(" + code + ")";
+      Value deep(code);
+
+      // uncapped, the estimate agrees with object.size
+      CHECK(deep.estimatedSize() == deep.rObjectSize());
+
+      // each list of one element costs a header and a pointer; the cap
+      // drops everything below it
+      double list = Value("list(NULL)").rObjectSize();
+      CHECK(deep.estimatedSize(0) == list);
+      CHECK(deep.estimatedSize(7) == 8 * list);
+      CHECK(deep.estimatedSize(7) < deep.rObjectSize());
+
+      // NULL and values past the cap are free
+      CHECK(objectSize(R_NilValue, kUnlimitedDepth) == 0);
+      CHECK(Value("c(1.5, 2.5)").estimatedSize(-1) == 0);
+   }
+}
+
+} // namespace environment
+} // namespace modules
+} // namespace session
+} // namespace rstudio
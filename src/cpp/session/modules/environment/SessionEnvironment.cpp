@@ -403,11 +403,13 @@ json::Array environmentListAsJson()
                           &rProtect,
                           &vars);
 
-       // get object details and transform to json
+       // get object details and transform to json (the details of large
+       // objects follow as assigned events)
        std::transform(vars.begin(),
                       vars.end(),
                       std::back_inserter(listJson),
-                      boost::bind(varToJson, env, _1));
+                      boost::bind(&EnvironmentMonitor::describeVariable,
+                                  s_pEnvironmentMonitor, _1));
     }
 
     return listJson;